@@ -53,6 +53,10 @@ const map<string,datadefs::forest_t> datadefs::forestTypeAssign = { {"RF",datade
 
 const bool                      datadefs::SF_DEFAULT_NO_NA_BRANCHING = false;
 const vector<datadefs::num_t>   datadefs::SF_DEFAULT_QUANTILES = {};
+const datadefs::num_t           datadefs::SF_DEFAULT_CONVERGENCE_TOLERANCE = 0.0;
+const size_t                    datadefs::SF_DEFAULT_TREE_BATCH_SIZE = 25;
+const string                    datadefs::SF_DEFAULT_CONVERGENCE_CRITERION = "oob";
+const datadefs::num_t           datadefs::SF_DEFAULT_TIME_BUDGET = 0.0;
 
 // Random Forest default configuration
 const size_t                  datadefs::RF_DEFAULT_N_TREES = 100;
@@ -103,6 +107,7 @@ const bool            datadefs::FILTER_DEFAULT_IS_ADJUSTED_P_VALUE = false;
 const datadefs::num_t datadefs::FILTER_DEFAULT_IMPORTANCE_THRESHOLD = 10;
 const bool            datadefs::FILTER_NORMALIZE_IMPORTANCE_VALUES = false;
 const bool            datadefs::FILTER_DEFAULT_REPORT_NONEXISTENT_FEATURES = false;
+const bool            datadefs::FILTER_DEFAULT_PERMUTATION_IMPORTANCE = false;
 
 // Default general configuration
 const bool            datadefs::GENERAL_DEFAULT_PRINT_HELP = false;
@@ -113,6 +118,12 @@ const int             datadefs::GENERAL_DEFAULT_SEED = -1;
 const size_t          datadefs::GENERAL_DEFAULT_N_THREADS = 1;
 const bool            datadefs::GENERAL_DEFAULT_IS_MAX_THREADS = false;
 const datadefs::num_t datadefs::GENERAL_DEFAULT_FEATURE_WEIGHT = 0;
+const bool            datadefs::GENERAL_DEFAULT_PROFILE = false;
+const size_t          datadefs::GENERAL_DEFAULT_TRACE_NODE_SIZE = 1000;
+const bool            datadefs::GENERAL_DEFAULT_STATS = false;
+const bool            datadefs::GENERAL_DEFAULT_PERF_COUNTERS = false;
+const bool            datadefs::GENERAL_DEFAULT_MEM_REPORT = false;
+const bool            datadefs::GENERAL_DEFAULT_QUANTIZE = false;
 
 ////////////////////////////////////////////////////////////
 // HELPER FUNCTIONS
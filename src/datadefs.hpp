@@ -21,8 +21,16 @@ namespace datadefs {
   // CONSTANTS
   ////////////////////////////////////////////////////////////
   // Numerical data type
-  typedef float num_t; /** Baseline numeric representation used throughout
-                         *   RF-ACE. Currently, double. */
+#ifdef NUM_T_DOUBLE
+  typedef double num_t; /** Baseline numeric representation used throughout
+                          *   RF-ACE. Double if built with -DNUM_T_DOUBLE
+                          *   (make rf-ace-double), float otherwise. */
+#else
+  typedef float num_t;
+#endif
+
+  typedef double acc_t; /** Accumulator of split and node statistics (sums,
+                          *   running means), double whatever num_t is */
 
   typedef string cat_t;
 
@@ -66,6 +74,10 @@ namespace datadefs {
 
   extern const bool          SF_DEFAULT_NO_NA_BRANCHING;
   extern const vector<num_t> SF_DEFAULT_QUANTILES;
+  extern const num_t         SF_DEFAULT_CONVERGENCE_TOLERANCE;
+  extern const size_t        SF_DEFAULT_TREE_BATCH_SIZE;
+  extern const string        SF_DEFAULT_CONVERGENCE_CRITERION;
+  extern const num_t         SF_DEFAULT_TIME_BUDGET;
 
   // Random Forest default configuration
   extern const size_t        RF_DEFAULT_N_TREES;
@@ -117,6 +129,7 @@ namespace datadefs {
   extern const num_t      FILTER_DEFAULT_IMPORTANCE_THRESHOLD;
   extern const bool       FILTER_NORMALIZE_IMPORTANCE_VALUES;
   extern const bool       FILTER_DEFAULT_REPORT_NONEXISTENT_FEATURES;
+  extern const bool       FILTER_DEFAULT_PERMUTATION_IMPORTANCE;
 
   // Default general configuration
   extern const bool       GENERAL_DEFAULT_PRINT_HELP;
@@ -127,6 +140,12 @@ namespace datadefs {
   extern const size_t     GENERAL_DEFAULT_N_THREADS;
   extern const bool       GENERAL_DEFAULT_IS_MAX_THREADS;
   extern const num_t      GENERAL_DEFAULT_FEATURE_WEIGHT;
+  extern const bool       GENERAL_DEFAULT_PROFILE;
+  extern const size_t     GENERAL_DEFAULT_TRACE_NODE_SIZE;
+  extern const bool       GENERAL_DEFAULT_STATS;
+  extern const bool       GENERAL_DEFAULT_PERF_COUNTERS;
+  extern const bool       GENERAL_DEFAULT_MEM_REPORT;
+  extern const bool       GENERAL_DEFAULT_QUANTIZE;
 
   
   ////////////////////////////////////////////////////////////
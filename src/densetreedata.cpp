@@ -10,9 +10,153 @@
 
 #include "math.hpp"
 #include "utils.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "workcounters.hpp"
 
 using namespace std;
 
+namespace {
+
+  // Moves the samples that miss a value to missingIcs; both keep their order
+  struct MissingSeparator {
+
+    vector<size_t>& sampleIcs;
+    vector<size_t>& missingIcs;
+
+    MissingSeparator(vector<size_t>& s, vector<size_t>& m): sampleIcs(s), missingIcs(m) {}
+
+    template<typename Reader> void operator()(const Reader& reader) {
+
+      size_t nReal = 0;
+      size_t nMissing = 0;
+
+      missingIcs.resize(sampleIcs.size());
+
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	size_t sampleIdx = sampleIcs[i];
+	if ( !reader.isMissing(sampleIdx) ) {
+	  sampleIcs[nReal++] = sampleIdx;
+	} else {
+	  missingIcs[nMissing++] = sampleIdx;
+	}
+      }
+
+      sampleIcs.resize(nReal);
+      missingIcs.resize(nMissing);
+
+    }
+
+  };
+
+  // Sends the samples that have hashIdx among their hashes to the left, and accumulates the statistics
+  // of the numerical (any reader) or categorical (CatReader) target on both sides
+  struct TextualSplitter {
+
+    const Feature::TxtReader txtReader;
+    const uint32_t hashIdx;
+    const vector<size_t>& sampleWeights;
+    vector<size_t>& sampleIcs_left;
+    vector<size_t>& sampleIcs_right;
+
+    // Branch sizes are sums of sample multiplicities
+    size_t n_left;
+    size_t n_right;
+    size_t n_tot;
+    datadefs::acc_t DI;
+
+    TextualSplitter(const Feature& feature, const uint32_t h, const vector<size_t>& w, vector<size_t>& l, vector<size_t>& r):
+      txtReader(feature.txtData.data()), hashIdx(h), sampleWeights(w), sampleIcs_left(l), sampleIcs_right(r),
+      n_left(0), n_right(0), n_tot(0), DI(0.0) {}
+
+    template<typename Reader> void operator()(const Reader& target) {
+
+      size_t nSamples = sampleIcs_right.size();
+      size_t nSamples_left = 0;
+      size_t nSamples_right = 0;
+
+      sampleIcs_left.resize(nSamples);
+
+      datadefs::acc_t mu_left = 0.0;
+      datadefs::acc_t mu_right = 0.0;
+      datadefs::acc_t mu_tot = 0.0;
+
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	size_t sampleIdx = sampleIcs_right[i];
+	size_t w = sampleWeights[sampleIdx];
+	const unordered_set<uint32_t>& hs = txtReader[sampleIdx];
+	datadefs::acc_t x = target[sampleIdx];
+	if ( hs.find(hashIdx) != hs.end() ) {
+	  sampleIcs_left[nSamples_left++] = sampleIdx;
+	  n_left += w;
+	  if ( w > 0 ) mu_left += w * ( x - mu_left ) / n_left;
+	} else {
+	  sampleIcs_right[nSamples_right++] = sampleIdx;
+	  n_right += w;
+	  if ( w > 0 ) mu_right += w * ( x - mu_right ) / n_right;
+	}
+	n_tot += w;
+	if ( w > 0 ) mu_tot += w * ( x - mu_tot ) / n_tot;
+      }
+
+      if ( n_tot > 0 ) {
+	DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
+      }
+
+      assert(nSamples == nSamples_left + nSamples_right);
+
+      sampleIcs_left.resize(nSamples_left);
+      sampleIcs_right.resize(nSamples_right);
+
+    }
+
+    void operator()(const Feature::CatReader& target) {
+
+      size_t nSamples = sampleIcs_right.size();
+      size_t nSamples_left = 0;
+      size_t nSamples_right = 0;
+
+      sampleIcs_left.resize(nSamples);
+
+      unordered_map<cat_t,size_t> freq_left,freq_right,freq_tot(nSamples);
+
+      size_t sf_left = 0;
+      size_t sf_right = 0;
+      size_t sf_tot = 0;
+
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	size_t sampleIdx = sampleIcs_right[i];
+	size_t w = sampleWeights[sampleIdx];
+	const unordered_set<uint32_t>& hs = txtReader[sampleIdx];
+	const cat_t& x = target[sampleIdx];
+	if ( hs.find(hashIdx) != hs.end() ) {
+	  sampleIcs_left[nSamples_left++] = sampleIdx;
+	  n_left += w;
+	  math::incrementSquaredFrequency(x,w,freq_left,sf_left);
+	} else {
+	  sampleIcs_right[nSamples_right++] = sampleIdx;
+	  n_right += w;
+	  math::incrementSquaredFrequency(x,w,freq_right,sf_right);
+	}
+	n_tot += w;
+	math::incrementSquaredFrequency(x,w,freq_tot,sf_tot);
+      }
+
+      if ( n_left > 0 && n_right > 0 ) {
+	DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
+      }
+
+      assert(nSamples == nSamples_left + nSamples_right);
+
+      sampleIcs_left.resize(nSamples_left);
+      sampleIcs_right.resize(nSamples_right);
+
+    }
+
+  };
+
+}
+
 DenseTreeData::DenseTreeData(const vector<Feature>& features, const bool useContrasts, const vector<string>& sampleHeaders):
   useContrasts_(useContrasts),
   features_(features),
@@ -26,22 +170,21 @@ DenseTreeData::DenseTreeData(const vector<Feature>& features, const bool useCont
   // 4*nFeatures results in a reasonable max load factor of 0.5
   name2idx_.rehash(4*nFeatures);
 
+  // Without sample headers the number of samples comes from the features
+  if ( sampleHeaders_.size() == 0 ) {
+    sampleHeaders_.resize(features_[0].nSamples(),"NO_SAMPLE_ID");
+  } 
+
   size_t nSamples = this->nSamples();
 
   for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
 
-    //assert( features_[featureIdx].data.size() == nSamples );
+    assert( features_[featureIdx].nSamples() == nSamples );
     name2idx_[ features_[featureIdx].name() ] = featureIdx;
   }
 
   assert( nSamples > 0 );
 
-  if ( sampleHeaders_.size() == 0 ) {
-    sampleHeaders_.resize(nSamples,"NO_SAMPLE_ID");
-  } 
-
-  assert( sampleHeaders_.size() == nSamples );
-
   for ( size_t featureIdx = 0; featureIdx < this->nFeatures(); ++featureIdx ) {
     if ( this->feature(featureIdx)->isTextual() ) {
       features_[featureIdx].removeFrequentHashKeys(0.7);
@@ -63,6 +206,9 @@ DenseTreeData::DenseTreeData(const vector<Feature>& features, const bool useCont
 */
 DenseTreeData::DenseTreeData(string fileName, const char dataDelimiter, const char headerDelimiter, const bool useContrasts):
   useContrasts_(useContrasts) {
+
+  profiler::ScopedTimer scopedTimer("readData");
+  trace::ScopedEvent event("readData");
   
   this->readAFM(fileName,dataDelimiter,headerDelimiter);
   
@@ -78,12 +224,18 @@ DenseTreeData::DenseTreeData(string fileName, const char dataDelimiter, const ch
   
 }
 
+DenseTreeData::DenseTreeData(const bool useContrasts):
+  useContrasts_(useContrasts) {
+}
+
 DenseTreeData::~DenseTreeData() {
   /* Empty destructor */
 }
 
 void DenseTreeData::createContrasts() {
 
+  profiler::ScopedTimer scopedTimer("createContrasts");
+
   // Resize the feature data container to fit the
   // original AND contrast features ( so 2*nFeatures )
   size_t nFeatures = features_.size();
@@ -322,37 +474,77 @@ vector<num_t> DenseTreeData::getFeatureWeights() const {
 void DenseTreeData::permuteContrasts(distributions::Random* random) {
 
   size_t nFeatures = this->nFeatures();
-  size_t nSamples = this->nSamples();
 
   for ( size_t i = nFeatures; i < 2*nFeatures; ++i ) {
-    
-    if ( this->feature(i)->isTextual() ) { continue; }
+    this->permuteContrast(i,random);
+  }
+  
+}
 
-    vector<size_t> sampleIcs = utils::range( nSamples );
-    vector<size_t> missingIcs;
-    
-    this->separateMissingSamples(i,sampleIcs,missingIcs);
+void DenseTreeData::permuteContrast(const size_t featureIdx, distributions::Random* random) {
 
-    if ( this->feature(i)->isNumerical() ) {
+  if ( this->feature(featureIdx)->isTextual() ) { return; }
 
-      vector<num_t> filteredData = this->feature(i)->getNumData(sampleIcs);
-      utils::permute(filteredData,random);
-      for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
-	features_[i].setNumSampleValue(sampleIcs[j],filteredData[j]);
-      }
+  vector<size_t> sampleIcs = utils::range( this->nSamples() );
+  vector<size_t> missingIcs;
+    
+  this->separateMissingSamples(featureIdx,sampleIcs,missingIcs);
 
-    } else {
+  if ( this->feature(featureIdx)->isNumerical() ) {
 
-      vector<cat_t> filteredData = this->feature(i)->getCatData(sampleIcs);
-      utils::permute(filteredData,random);
-      for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
-	features_[i].setCatSampleValue(sampleIcs[j],filteredData[j]);
-      }
+    vector<num_t> filteredData = this->feature(featureIdx)->getNumData(sampleIcs);
+    utils::permute(filteredData,random);
+    for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
+      features_[featureIdx].setNumSampleValue(sampleIcs[j],filteredData[j]);
+    }
+
+  } else {
 
+    vector<cat_t> filteredData = this->feature(featureIdx)->getCatData(sampleIcs);
+    utils::permute(filteredData,random);
+    for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
+      features_[featureIdx].setCatSampleValue(sampleIcs[j],filteredData[j]);
     }
+
+  }
     
+}
+
+void DenseTreeData::quantizeFeatures(const size_t targetIdx) {
+
+  size_t nFeatures = this->nFeatures();
+
+  for ( size_t featureIdx = 0; featureIdx < features_.size(); ++featureIdx ) {
+    Feature& feature = features_[featureIdx];
+    if ( featureIdx % nFeatures != targetIdx && feature.isNumerical() && !feature.isSparse() && !feature.isMapped() ) {
+      feature.quantize();
+    }
+  }
+
+}
+
+const vector<size_t>& DenseTreeData::getRealSampleIcs(const size_t featureIdx) {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(realSampleIcsMutex_);
+#endif
+
+  unordered_map<size_t,vector<size_t> >::const_iterator it( realSampleIcs_.find(featureIdx) );
+
+  if ( it != realSampleIcs_.end() ) {
+    return( it->second );
   }
+
+  vector<size_t>& realIcs = realSampleIcs_[featureIdx];
   
+  for ( size_t i = 0; i < this->nSamples(); ++i ) {
+    if ( !this->feature(featureIdx)->isMissing(i) ) {
+      realIcs.push_back(i);
+    }
+  }
+
+  return( realIcs );
+
 }
 
 void DenseTreeData::bootstrapFromRealSamples(distributions::Random* random,
@@ -360,7 +552,10 @@ void DenseTreeData::bootstrapFromRealSamples(distributions::Random* random,
                                         const num_t sampleSize, 
                                         const size_t featureIdx, 
                                         vector<size_t>& ics, 
+					vector<size_t>& sampleWeights,
                                         vector<size_t>& oobIcs) {
+
+  profiler::ScopedTimer scopedTimer("bootstrap");
     
   //Check that the sampling parameters are appropriate
   assert(sampleSize > 0.0);
@@ -369,79 +564,65 @@ void DenseTreeData::bootstrapFromRealSamples(distributions::Random* random,
     exit(1);
   }
 
-  //First we collect all indices that correspond to real samples
-  vector<size_t> allIcs;
-  for ( size_t i = 0; i < this->nSamples(); ++i) {
-    if ( !this->feature(featureIdx)->isMissing(i) ) {
-      allIcs.push_back(i);
-    }
-  }
+  //All indices that correspond to real samples are collected only once per feature
+  const vector<size_t>& allIcs = this->getRealSampleIcs(featureIdx);
   
   //Extract the number of real samples, and see how many samples do we have to collect
   size_t nRealSamples = allIcs.size();
   size_t nSamples = static_cast<size_t>( floor( sampleSize * nRealSamples ) );
-  ics.resize(nSamples);
+
+  sampleWeights.assign(this->nSamples(),0);
   
   //If sampled with replacement...
   if(withReplacement) {
-    //Draw nSamples random integers from range of allIcs
+    //Draw nSamples random integers from range of allIcs, and count the multiplicities
     for(size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx) {
-      ics[sampleIdx] = allIcs[ random->integer() % nRealSamples ];
+      ++sampleWeights[ allIcs[ random->integer() % nRealSamples ] ];
     }
   } else {  //If sampled without replacement...
-    vector<size_t> foo = utils::range(nRealSamples);
-    utils::permute(foo,random);
+    //Partial Fisher-Yates shuffle; the first nSamples elements will form the sample
+    vector<size_t> foo = allIcs;
     for(size_t i = 0; i < nSamples; ++i) {
-      ics[i] = allIcs[foo[i]];
+      size_t j = i + random->integer() % (nRealSamples - i);
+      swap(foo[i],foo[j]);
+      sampleWeights[foo[i]] = 1;
     }
   }
 
-  sort(ics.begin(),ics.end());
-
-  if(nSamples < nRealSamples) {
-    oobIcs.resize(nRealSamples);
-  } else {
-    oobIcs.resize(nSamples);
+  //Then, as we now have the multiplicities stored in sampleWeights, the real samples 
+  //with non-zero weight form the (sorted) in-box sample and the rest go to oobIcs
+  ics.clear();
+  oobIcs.clear();
+  for(size_t i = 0; i < nRealSamples; ++i) {
+    if(sampleWeights[allIcs[i]] > 0) {
+      ics.push_back(allIcs[i]);
+    } else {
+      oobIcs.push_back(allIcs[i]);
+    }
   }
-
-  //Then, as we now have the sample stored in ics, we'll check which of the samples, from allIcs, are not contained in ics and store them in oobIcs instead
-  vector<size_t>::iterator it = set_difference(allIcs.begin(),allIcs.end(),ics.begin(),ics.end(),oobIcs.begin());
-  size_t nOob = distance(oobIcs.begin(),it);
-  oobIcs.resize(nOob);
-  //cout << "nOob=" << nOob << endl;
+  //cout << "nOob=" << oobIcs.size() << endl;
 }
   
-  void DenseTreeData::separateMissingSamples(const size_t featureIdx,
-					     vector<size_t>& sampleIcs,
-					     vector<size_t>& missingIcs) {
-  
-  size_t nReal = 0;
-  size_t nMissing = 0;
+void DenseTreeData::separateMissingSamples(const size_t featureIdx,
+					   vector<size_t>& sampleIcs,
+					   vector<size_t>& missingIcs) {
 
-  missingIcs.resize(sampleIcs.size());
+  MissingSeparator separator(sampleIcs,missingIcs);
 
-  vector<size_t>::const_iterator it(sampleIcs.begin());
-
-  for ( ; it != sampleIcs.end(); ++it ) {
-    if ( !this->feature(featureIdx)->isMissing(*it) ) {
-      sampleIcs[nReal++] = *it;
-    } else {
-      missingIcs[nMissing++] = *it;
-    }
-  }
-
-  sampleIcs.resize(nReal);
-  missingIcs.resize(nMissing);
+  features_[featureIdx].visitData(separator);
 
 }
 
-num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
+num_t DenseTreeData::numericalFeatureSplit(const Feature* target,
 					   const size_t featureIdx,
 					   const size_t minSamples,
+					   const vector<size_t>& sampleWeights,
 					   vector<size_t>& sampleIcs_left,
 					   vector<size_t>& sampleIcs_right,
 					   num_t& splitValue) {
 
+  profiler::ScopedTimer scopedTimer("numericalSplit");
+
   num_t DI_best = 0.0;
 
   sampleIcs_left.clear();
@@ -449,13 +630,29 @@ num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
   vector<num_t> fv = this->feature(featureIdx)->getNumData(sampleIcs_right);
 
   vector<size_t> sortIcs = utils::range(sampleIcs_right.size());
-  utils::sortDataAndMakeRef(true,fv,sortIcs);
-  utils::sortFromRef(sampleIcs_right,sortIcs);
+  {
+    profiler::ScopedTimer sortTimer("sort");
+    utils::sortDataAndMakeRef(true,fv,sortIcs);
+    utils::sortFromRef(sampleIcs_right,sortIcs);
+  }
+
+  WorkCounters& workCounters = WorkCounters::local();
+  ++workCounters.numCandidates;
+  ++workCounters.sortCalls;
+  workCounters.samplesScanned += fv.size();
 
   size_t n_tot = fv.size();
   size_t n_left = 0;
 
-  if(n_tot < 2 * minSamples) {
+  // Multiplicities of the samples, in the same order as fv
+  vector<size_t> wv(n_tot);
+  size_t w_tot = 0;
+  for ( size_t i = 0; i < n_tot; ++i ) {
+    wv[i] = sampleWeights[ sampleIcs_right[i] ];
+    w_tot += wv[i];
+  }
+
+  if(w_tot < 2 * minSamples) {
     DI_best = 0.0;
     return( DI_best );
   }
@@ -463,19 +660,19 @@ num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
   size_t bestSplitIdx = datadefs::MAX_IDX;
 
   //If the target is numerical, we use the incremental squared error formula
-  if ( this->feature(targetIdx)->isNumerical() ) {
+  if ( target->isNumerical() ) {
 
-    vector<num_t> tv = this->feature(targetIdx)->getNumData(sampleIcs_right);
+    vector<num_t> tv = target->getNumData(sampleIcs_right);
     //utils::sortFromRef(tv,sortIcs);
 
-    DI_best = utils::numericalFeatureSplitsNumericalTarget(tv,fv,minSamples,bestSplitIdx);
+    DI_best = utils::numericalFeatureSplitsNumericalTarget(tv,fv,wv,minSamples,bestSplitIdx);
 
   } else { // Otherwise we use the iterative gini index formula to update impurity scores while we traverse "right"
 
-    vector<cat_t> tv = this->feature(targetIdx)->getCatData(sampleIcs_right);
+    vector<cat_t> tv = target->getCatData(sampleIcs_right);
     //utils::sortFromRef(tv,sortIcs);
 
-    DI_best = utils::numericalFeatureSplitsCategoricalTarget(tv,fv,minSamples,bestSplitIdx);
+    DI_best = utils::numericalFeatureSplitsCategoricalTarget(tv,fv,wv,minSamples,bestSplitIdx);
 
   }
 
@@ -485,7 +682,7 @@ num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
     return( DI_best );
   }
 
-  splitValue = fv[bestSplitIdx];
+  splitValue = this->feature(featureIdx)->splitEdge(fv[bestSplitIdx]);
   n_left = bestSplitIdx + 1;
   sampleIcs_left.resize(n_left);
 
@@ -504,13 +701,16 @@ num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
 }
 
 // !! Inadequate Abstraction: Refactor me.
-num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
+num_t DenseTreeData::categoricalFeatureSplit(const Feature* target,
 					     const size_t featureIdx,
 					     const vector<cat_t>& catOrder,
 					     const size_t minSamples,
+					     const vector<size_t>& sampleWeights,
 					     vector<size_t>& sampleIcs_left,
 					     vector<size_t>& sampleIcs_right,
 					     unordered_set<cat_t>& splitValues_left) {
+
+  profiler::ScopedTimer scopedTimer("categoricalSplit");
   
   num_t DI_best = 0.0;
 
@@ -520,7 +720,19 @@ num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
 
   size_t n_tot = fv.size();
 
-  if(n_tot < 2 * minSamples) {
+  WorkCounters& workCounters = WorkCounters::local();
+  ++workCounters.catCandidates;
+  workCounters.samplesScanned += n_tot;
+
+  // Multiplicities of the samples, in the same order as fv
+  vector<size_t> wv(n_tot);
+  size_t w_tot = 0;
+  for ( size_t i = 0; i < n_tot; ++i ) {
+    wv[i] = sampleWeights[ sampleIcs_right[i] ];
+    w_tot += wv[i];
+  }
+
+  if(w_tot < 2 * minSamples) {
     DI_best = 0.0;
     return( DI_best );
   }
@@ -528,17 +740,17 @@ num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
   unordered_map<cat_t,vector<size_t> > fmap_right(catOrder.size());
   unordered_map<cat_t,vector<size_t> > fmap_left(catOrder.size());
 
-  if ( this->feature(targetIdx)->isNumerical() ) {
+  if ( target->isNumerical() ) {
 
-    vector<num_t> tv = this->feature(targetIdx)->getNumData(sampleIcs_right);
+    vector<num_t> tv = target->getNumData(sampleIcs_right);
 
-    DI_best = utils::categoricalFeatureSplitsNumericalTarget(tv,fv,minSamples,catOrder,fmap_left,fmap_right);
+    DI_best = utils::categoricalFeatureSplitsNumericalTarget(tv,fv,wv,minSamples,catOrder,fmap_left,fmap_right);
 
   } else {
 
-    vector<cat_t> tv = this->feature(targetIdx)->getCatData(sampleIcs_right);
+    vector<cat_t> tv = target->getCatData(sampleIcs_right);
 
-    DI_best = utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,minSamples,catOrder,fmap_left,fmap_right);
+    DI_best = utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,wv,minSamples,catOrder,fmap_left,fmap_right);
 
   }
 
@@ -584,82 +796,81 @@ num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
 
 }
 
-num_t DenseTreeData::textualFeatureSplit(const size_t targetIdx,
+num_t DenseTreeData::textualFeatureSplit(const Feature* target,
 				    const size_t featureIdx,
 				    const uint32_t hashIdx,
 				    const size_t minSamples,
+				    const vector<size_t>& sampleWeights,
 				    vector<size_t>& sampleIcs_left,
 				    vector<size_t>& sampleIcs_right) {
 
+  profiler::ScopedTimer scopedTimer("textualSplit");
 
   assert(features_[featureIdx].isTextual());
 
-  size_t n_left = 0;
-  size_t n_right = 0;
-  size_t n_tot = sampleIcs_right.size();
+  WorkCounters& workCounters = WorkCounters::local();
+  ++workCounters.txtCandidates;
+  workCounters.samplesScanned += sampleIcs_right.size();
 
-  sampleIcs_left.resize(n_tot);
-
-  num_t DI_best = 0.0;
-
-  if ( this->feature(targetIdx)->isNumerical() ) {
-  
-    num_t mu_left = 0.0;
-    num_t mu_right = 0.0;
-    num_t mu_tot = 0.0;
-
-    for ( size_t i = 0; i < n_tot; ++i ) {
-      unordered_set<uint32_t> hs = this->feature(featureIdx)->getTxtData(sampleIcs_right[i]);
-      num_t x = this->feature(targetIdx)->getNumData(sampleIcs_right[i]);
-      if ( hs.find(hashIdx) != hs.end() ) {
-	sampleIcs_left[n_left++] = sampleIcs_right[i];
-	mu_left += ( x - mu_left ) / n_left;
-      } else {
-	sampleIcs_right[n_right++] = sampleIcs_right[i];
-	mu_right += ( x - mu_right ) / n_right;
-      }
-      mu_tot += x / n_tot;
-    }
-    
-    DI_best = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
+  TextualSplitter splitter(features_[featureIdx],hashIdx,sampleWeights,sampleIcs_left,sampleIcs_right);
 
+  if ( target->isNumerical() ) {
+    target->visitNumData(splitter);
   } else {
+    target->visitCatData(splitter);
+  }
 
-    unordered_map<cat_t,size_t> freq_left,freq_right,freq_tot(n_tot);
+  size_t n_left = splitter.n_left;
+  size_t n_right = splitter.n_right;
 
-    size_t sf_left = 0;
-    size_t sf_right = 0;
-    size_t sf_tot = 0;
+  assert(splitter.n_tot == n_left + n_right);
 
-    for ( size_t i = 0; i < sampleIcs_right.size(); ++i ) {
-      unordered_set<uint32_t> hs = this->feature(featureIdx)->getTxtData(sampleIcs_right[i]);
-      cat_t x = this->feature(targetIdx)->getCatData(sampleIcs_right[i]);
-      if ( hs.find(hashIdx) != hs.end() ) {
-        sampleIcs_left[n_left++] = sampleIcs_right[i];
-	math::incrementSquaredFrequency(x,freq_left,sf_left);
-      } else {
-        sampleIcs_right[n_right++] = sampleIcs_right[i];
-	math::incrementSquaredFrequency(x,freq_right,sf_right);
-      }
-      math::incrementSquaredFrequency(x,freq_tot,sf_tot);
-    }
+  if ( n_left < minSamples || n_right < minSamples || n_left == 0 || n_right == 0 ) {
+    return(0.0);
+  }
+  
+  return(splitter.DI);
+  
+}
 
-    DI_best = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
+void DenseTreeData::memoryUsage(memreport::Breakdown& breakdown) const {
 
+  size_t nFeatures = this->nFeatures();
+
+  for ( size_t featureIdx = 0; featureIdx < features_.size(); ++featureIdx ) {
+
+    const Feature& feature = features_[featureIdx];
+
+    if ( featureIdx >= nFeatures ) {
+      memreport::add(breakdown, "contrast features", feature.memoryBytes());
+    } else if ( feature.isMapped() ) {
+      memreport::add(breakdown, "mapped numerical features", feature.memoryBytes());
+    } else if ( feature.isSparse() ) {
+      memreport::add(breakdown, "sparse numerical features", feature.memoryBytes());
+    } else if ( feature.isQuantized() ) {
+      memreport::add(breakdown, "quantized numerical features", feature.memoryBytes());
+    } else if ( feature.isNumerical() ) {
+      memreport::add(breakdown, "numerical features", feature.memoryBytes());
+    } else if ( feature.isCategorical() ) {
+      memreport::add(breakdown, "categorical features", feature.memoryBytes());
+    } else {
+      memreport::add(breakdown, "textual features", feature.memoryBytes());
+    }
   }
 
-  assert(n_tot == n_left + n_right);
+  // Hash maps are charged a bucket pointer per bucket and a node with a next pointer and a cached hash per entry
+  size_t indexBytes = memreport::heapBytes(sampleHeaders_) + 
+    name2idx_.bucket_count() * sizeof(void*) + name2idx_.size() * ( sizeof(pair<string,size_t>) + sizeof(void*) + sizeof(size_t) ) +
+    realSampleIcs_.bucket_count() * sizeof(void*) + realSampleIcs_.size() * ( sizeof(pair<size_t,vector<size_t> >) + sizeof(void*) );
 
-  if ( n_left < minSamples || n_right < minSamples ) {
-    return(0.0);
+  for ( unordered_map<string,size_t>::const_iterator it( name2idx_.begin() ); it != name2idx_.end(); ++it ) {
+    indexBytes += memreport::heapBytes(it->first);
   }
 
-  sampleIcs_left.resize(n_left);
-  sampleIcs_right.resize(n_right);
-  
-  return(DI_best);
-  
-}
-
+  for ( unordered_map<size_t,vector<size_t> >::const_iterator it( realSampleIcs_.begin() ); it != realSampleIcs_.end(); ++it ) {
+    indexBytes += memreport::heapBytes(it->second);
+  }
 
+  memreport::add(breakdown, "sample names and indices", indexBytes);
 
+}
@@ -11,12 +11,17 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#ifndef NOTHREADS
+#include <mutex>
+#endif
+
 #include "datadefs.hpp"
 #include "distributions.hpp"
 #include "options.hpp"
 #include "feature.hpp"
 #include "reader.hpp"
 #include "treedata.hpp"
+#include "memreport.hpp"
 
 using namespace std;
 using datadefs::num_t;
@@ -32,25 +37,28 @@ public:
 
   ~DenseTreeData();
 
+  // The accessors are final, so that code templated over DenseTreeData (see Node) calls them
+  // directly, also for the derived classes
+
   // Reveals the Feature class interface to the user
-  const Feature* feature(const size_t featureIdx) const {
+  const Feature* feature(const size_t featureIdx) const final {
     return( &features_[featureIdx] );
   }
   
   // Returns the number of features
-  size_t nFeatures() const;
+  size_t nFeatures() const final;
   
   // Returns feature index, given the name
-  size_t getFeatureIdx(const string& featureName) const;
+  size_t getFeatureIdx(const string& featureName) const final;
   
   // A value denoting the "one-over-last" feature in matrix
-  size_t end() const { return( datadefs::MAX_IDX ); }
+  size_t end() const final { return( datadefs::MAX_IDX ); }
   
   // Returns sample name, given sample index
   string getSampleName(const size_t sampleIdx);
   
   // Returns the number of samples
-  size_t nSamples() const;
+  size_t nSamples() const final;
   
   vector<num_t> getFeatureWeights() const;
   
@@ -58,25 +66,28 @@ public:
 			      vector<size_t>& sampleIcs,
 			      vector<size_t>& missingIcs);
   
-  num_t numericalFeatureSplit(const size_t targetIdx,
+  num_t numericalFeatureSplit(const Feature* target,
 			      const size_t featureIdx,
 			      const size_t minSamples,
+			      const vector<size_t>& sampleWeights,
 			      vector<size_t>& sampleIcs_left,
 			      vector<size_t>& sampleIcs_right,
 			      num_t& splitValue);
 
-  num_t categoricalFeatureSplit(const size_t targetIdx,
+  num_t categoricalFeatureSplit(const Feature* target,
 				const size_t featureIdx,
 				const vector<cat_t>& catOrder,
 				const size_t minSamples,
+				const vector<size_t>& sampleWeights,
 				vector<size_t>& sampleIcs_left,
 				vector<size_t>& sampleIcs_right,
 				unordered_set<cat_t>& splitValues_left);
 
-  num_t textualFeatureSplit(const size_t targetIdx,
+  num_t textualFeatureSplit(const Feature* target,
 			    const size_t featureIdx,
 			    const uint32_t hashIdx,
 			    const size_t minSamples,
+			    const vector<size_t>& sampleWeights,
 			    vector<size_t>& sampleIcs_left,
 			    vector<size_t>& sampleIcs_right);
     
@@ -84,25 +95,44 @@ public:
   //string getRawFeatureData(const size_t featureIdx, const num_t data);
   //vector<string> getRawFeatureData(const size_t featureIdx);
   
-  // Generates a bootstrap sample from the real samples of featureIdx. Samples not in the bootstrap sample will be stored in oob_ics,
-  // and the number of oob samples is stored in noob.
+  // Generates a bootstrap sample from the real samples of featureIdx. The sample is represented as per-sample
+  // multiplicities in sampleWeights (one entry per sample in the data, 0 if not drawn). The distinct drawn 
+  // samples are stored in ics, and the real samples that were not drawn (weight 0) are stored in oobIcs.
   void bootstrapFromRealSamples(distributions::Random* random,
 				const bool withReplacement, 
                                 const num_t sampleSize, 
                                 const size_t featureIdx, 
                                 vector<size_t>& ics, 
+                                vector<size_t>& sampleWeights,
                                 vector<size_t>& oobIcs);
 
+  // Returns the indices of samples that have a real (non-missing) value for featureIdx. 
+  // The list is computed once per feature and cached.
+  const vector<size_t>& getRealSampleIcs(const size_t featureIdx);
+
   void createContrasts();
   void permuteContrasts(distributions::Random* random);
 
+  // Stores the dense numerical features other than the target, and their contrasts, as 16-bit codes
+  // (see Feature::quantize()). The target keeps its precision, since predictions are made of it
+  void quantizeFeatures(const size_t targetIdx);
+
   void replaceFeatureData(const size_t featureIdx, const vector<num_t>& featureData);
   void replaceFeatureData(const size_t featureIdx, const vector<string>& rawFeatureData);
 
+  // Bytes held by the features by type, by the contrasts, and by the sample names and indices
+  virtual void memoryUsage(memreport::Breakdown& breakdown) const;
+
   
 #ifndef TEST__
-private:
+protected:
 #endif
+
+  // For derived classes that read the data themselves
+  explicit DenseTreeData(const bool useContrasts);
+
+  // Permutes the real samples of one contrast feature
+  void permuteContrast(const size_t featureIdx, distributions::Random* random);
   
   enum FileType {UNKNOWN, AFM, ARFF};
 
@@ -128,6 +158,12 @@ private:
   vector<string> sampleHeaders_;
 
   unordered_map<string,size_t> name2idx_;
+
+  // Real sample indices per feature, see getRealSampleIcs()
+  unordered_map<size_t,vector<size_t> > realSampleIcs_;
+#ifndef NOTHREADS
+  mutex realSampleIcsMutex_;
+#endif
   
 };
 
@@ -7,11 +7,13 @@
 
 #include "errno.hpp"
 
+using namespace std;
+
 class RFACE_EXCEPTION : public exception {
 
 public:
 
-  RFACE_EXCEPTION(const ERRNO& errno, const std::string& note = "") throw():errno_(errno) {
+  RFACE_EXCEPTION(const ERRNO& errorNumber, const std::string& note = "") throw():errno_(errorNumber) {
     stringstream ss;
     ss << "ERRNO (" << errno_ << "): ";
     switch ( errno_ ) {
@@ -24,6 +26,9 @@ public:
     case ERRNO::ILLEGAL_MEMORY_ACCESS:
       ss << "illegal memory access.";
       break;
+    case ERRNO::INVALID_READ:
+      ss << "invalid input file.";
+      break;
     default:
       ss << "unknown exception!";
       break;
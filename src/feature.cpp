@@ -1,17 +1,34 @@
 #include "feature.hpp"
 
 #include <algorithm>
+#include <utility>
 
 #include "utils.hpp"
+#include "memreport.hpp"
 
+const uint16_t Feature::QUANT_NA;
 
 Feature::Feature():
-  type_(Feature::Type::UNKNOWN) {
+  type_(Feature::Type::UNKNOWN),
+  isSparse_(false),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(0) {
 }
 
 Feature::Feature(Feature::Type newType, const string& newName, const size_t nSamples):
   type_(newType),
-  name_(newName) {
+  name_(newName),
+  isSparse_(false),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(0) {
   
   if ( type_ == Feature::Type::NUM ) {
     numData.resize(nSamples);
@@ -30,8 +47,22 @@ Feature::Feature(Feature::Type newType, const string& newName, const size_t nSam
 }
 
 void Feature::setNumSampleValue(const size_t sampleIdx, const num_t val) {
-  assert( type_ == Feature::Type::NUM );
-  numData[sampleIdx] = val;
+  assert( type_ == Feature::Type::NUM && !isSparse_ && !mappedData_ );
+
+  if ( !isQuantized_ ) {
+    numData[sampleIdx] = val;
+    return;
+  }
+
+  // Values read from the feature are on the grid and keep their code
+  if ( datadefs::isNAN(val) ) {
+    quantData[sampleIdx] = QUANT_NA;
+  } else if ( quantStep_ > 0.0 ) {
+    num_t code = floor( ( val - quantMin_ ) / quantStep_ + 0.5 );
+    quantData[sampleIdx] = static_cast<uint16_t>( min<num_t>( max<num_t>( code, 0.0 ), QUANT_NA - 1 ) );
+  } else {
+    quantData[sampleIdx] = 0;
+  }
 }
 
 void Feature::setCatSampleValue(const size_t sampleIdx, const cat_t& val) {
@@ -69,17 +100,63 @@ vector<cat_t> Feature::getCatData(const vector<size_t>& sampleIcs) const {
 
 num_t Feature::getNumData(const size_t sampleIdx) const {
   assert(type_ == Feature::Type::NUM);
-  return(numData[sampleIdx]);
+
+  if ( mappedData_ ) {
+    return( mappedData_[ mappedOrder_ ? mappedOrder_[sampleIdx] : sampleIdx ] );
+  }
+
+  if ( isQuantized_ ) {
+    return( quantData[sampleIdx] == QUANT_NA ? datadefs::NUM_NAN : quantMin_ + quantStep_ * quantData[sampleIdx] );
+  }
+
+  if ( !isSparse_ ) {
+    return(numData[sampleIdx]);
+  }
+
+  size_t pos = this->sparsePos(sampleIdx);
+  if ( pos != datadefs::MAX_IDX ) {
+    return(numData[pos]);
+  }
+
+  return( this->isMissing(sampleIdx) ? datadefs::NUM_NAN : 0.0 );
 }
 
 vector<num_t> Feature::getNumData() const {
   assert(type_ == Feature::Type::NUM);
-  return(numData);
+
+  if ( mappedData_ || isQuantized_ ) {
+    return( this->getNumData( utils::range(nSamples_) ) );
+  }
+
+  if ( !isSparse_ ) {
+    return(numData);
+  }
+
+  vector<num_t> data(nSamples_,0.0);
+  for ( size_t i = 0; i < sparseIcs.size(); ++i ) {
+    data[sparseIcs[i]] = numData[i];
+  }
+  for ( size_t i = 0; i < sparseMissingIcs.size(); ++i ) {
+    data[sparseMissingIcs[i]] = datadefs::NUM_NAN;
+  }
+  return(data);
 }
 
 vector<num_t> Feature::getNumData(const vector<size_t>& sampleIcs) const {
   assert(type_ == Feature::Type::NUM);
   vector<num_t> data(sampleIcs.size());
+  if ( mappedData_ ) {
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      data[i] = mappedData_[ mappedOrder_ ? mappedOrder_[sampleIcs[i]] : sampleIcs[i] ];
+    }
+    return(data);
+  }
+  if ( isSparse_ || isQuantized_ ) {
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      data[i] = this->getNumData(sampleIcs[i]);
+    }
+    return(data);
+  }
   for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
     data[i] = numData[sampleIcs[i]];
   }
@@ -93,19 +170,40 @@ unordered_set<uint32_t> Feature::getTxtData(const size_t sampleIdx) const {
 
 Feature::Feature(const vector<num_t>& newNumData, const string& newName):
   type_(Feature::Type::NUM),
-  name_(newName) {
+  name_(newName),
+  isSparse_(false),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(0) {
   numData = newNumData;
 }
 
 Feature::Feature(const vector<cat_t>& newCatData, const string& newName):
   type_(Feature::Type::CAT),
-  name_(newName) {
+  name_(newName),
+  isSparse_(false),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(0) {
   catData = newCatData;
   }
 
 Feature::Feature(const vector<string>& newTxtData, const string& newName, const bool doHash):
   type_(Feature::Type::TXT),
-  name_(newName) {
+  name_(newName),
+  isSparse_(false),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(0) {
   
   assert(doHash);
 
@@ -123,8 +221,122 @@ Feature::Feature(const vector<string>& newTxtData, const string& newName, const
   
 }
 
+Feature::Feature(const vector<uint32_t>& sampleIcs, const vector<num_t>& values, const size_t nSamples, const string& newName):
+  type_(Feature::Type::NUM),
+  name_(newName),
+  isSparse_(true),
+  mappedData_(NULL),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(nSamples) {
+
+  assert( sampleIcs.size() == values.size() );
+
+  vector<pair<uint32_t,num_t> > entries;
+  entries.reserve(sampleIcs.size());
+
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    assert( sampleIcs[i] < nSamples );
+    if ( datadefs::isNAN(values[i]) ) {
+      sparseMissingIcs.push_back(sampleIcs[i]);
+    } else if ( values[i] != 0.0 ) {
+      entries.push_back( make_pair(sampleIcs[i],values[i]) );
+    }
+  }
+
+  sort(entries.begin(),entries.end());
+  sort(sparseMissingIcs.begin(),sparseMissingIcs.end());
+
+  sparseIcs.resize(entries.size());
+  numData.resize(entries.size());
+  for ( size_t i = 0; i < entries.size(); ++i ) {
+    sparseIcs[i] = entries[i].first;
+    numData[i] = entries[i].second;
+  }
+
+}
+
+Feature::Feature(const num_t* mappedData, const size_t nSamples, const string& newName):
+  type_(Feature::Type::NUM),
+  name_(newName),
+  isSparse_(false),
+  mappedData_(mappedData),
+  mappedOrder_(NULL),
+  isQuantized_(false),
+  quantMin_(0.0),
+  quantStep_(0.0),
+  nSamples_(nSamples) {
+
+  assert( mappedData_ != NULL );
+
+}
+
 Feature::~Feature() { }
 
+void Feature::setMappedOrder(const uint32_t* sampleIcs) {
+  assert( mappedData_ != NULL );
+  mappedOrder_ = sampleIcs;
+}
+
+void Feature::quantize() {
+
+  assert( type_ == Feature::Type::NUM && !isSparse_ && !mappedData_ );
+
+  if ( isQuantized_ ) {
+    return;
+  }
+
+  num_t minValue = datadefs::NUM_INF;
+  num_t maxValue = -datadefs::NUM_INF;
+
+  // Infinite values would leave no finite grid; they are stored at the ends of the grid of the finite values
+  for ( size_t i = 0; i < numData.size(); ++i ) {
+    if ( !datadefs::isNAN(numData[i]) && fabs(numData[i]) < datadefs::NUM_INF ) {
+      minValue = min(minValue,numData[i]);
+      maxValue = max(maxValue,numData[i]);
+    }
+  }
+
+  nSamples_ = numData.size();
+  isQuantized_ = true;
+  quantMin_ = minValue <= maxValue ? minValue : 0.0;
+  quantStep_ = minValue < maxValue ? ( maxValue - minValue ) / ( QUANT_NA - 1 ) : 0.0;
+
+  quantData.resize(nSamples_);
+  for ( size_t i = 0; i < nSamples_; ++i ) {
+    this->setNumSampleValue(i,numData[i]);
+  }
+
+  vector<num_t>().swap(numData);
+
+}
+
+num_t Feature::splitEdge(const num_t value) const {
+
+  if ( !isQuantized_ || quantStep_ <= 0.0 ) {
+    return( value );
+  }
+
+  num_t code = floor( ( value - quantMin_ ) / quantStep_ + 0.5 );
+
+  return( quantMin_ + quantStep_ * ( code + 0.5 ) );
+
+}
+
+size_t Feature::sparsePos(const size_t sampleIdx) const {
+
+  vector<uint32_t>::const_iterator it( lower_bound(sparseIcs.begin(),sparseIcs.end(),sampleIdx) );
+
+  if ( it == sparseIcs.end() || *it != sampleIdx ) {
+    return( datadefs::MAX_IDX );
+  }
+
+  return( it - sparseIcs.begin() );
+
+}
+
 bool Feature::isNumerical() const {
   return( type_ == Feature::Type::NUM ? true : false );
 }
@@ -140,6 +352,13 @@ bool Feature::isTextual() const {
 bool Feature::isMissing(const size_t sampleIdx) const {
   switch (type_) {
   case NUM:
+    if ( isSparse_ ) {
+      return( binary_search(sparseMissingIcs.begin(),sparseMissingIcs.end(),sampleIdx) );
+    } else if ( mappedData_ ) {
+      return( datadefs::isNAN<num_t>( this->getNumData(sampleIdx) ) );
+    } else if ( isQuantized_ ) {
+      return( quantData[sampleIdx] == QUANT_NA );
+    }
     return( datadefs::isNAN<num_t>(numData[sampleIdx]) );
   case CAT:
     return( datadefs::isNAN<cat_t>(catData[sampleIdx]) );
@@ -156,7 +375,7 @@ bool Feature::isMissing(const size_t sampleIdx) const {
 size_t Feature::nSamples() const {
   switch ( type_ ) {
   case NUM:
-    return( numData.size() );
+    return( isSparse_ || mappedData_ || isQuantized_ ? nSamples_ : numData.size() );
   case CAT:
     return( catData.size() );
   case TXT:
@@ -170,6 +389,10 @@ size_t Feature::nSamples() const {
 }
 									      
 size_t Feature::nRealSamples() const {
+
+  if ( isSparse_ ) {
+    return( nSamples_ - sparseMissingIcs.size() );
+  }
   
   size_t n = 0;
 
@@ -297,3 +520,9 @@ void Feature::removeFrequentHashKeys(num_t fThreshold) {
   }
   
 }
+
+size_t Feature::memoryBytes() const {
+  return( sizeof(Feature) + memreport::heapBytes(name_) + memreport::heapBytes(numData) + 
+	  memreport::heapBytes(catData) + memreport::heapBytes(txtData) + 
+	  memreport::heapBytes(sparseIcs) + memreport::heapBytes(sparseMissingIcs) + memreport::heapBytes(quantData) );
+}
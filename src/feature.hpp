@@ -22,11 +22,28 @@ public:
   vector<cat_t> catData;
   vector<unordered_set<uint32_t> > txtData;
 
+  // Sparse numerical data: numData holds the non-zero values of the samples in sparseIcs, in increasing
+  // sample order, and the missing samples are listed in sparseMissingIcs; all other samples are zero
+  vector<uint32_t> sparseIcs;
+  vector<uint32_t> sparseMissingIcs;
+
+  // Quantized numerical data: sample i has the value quantMin + quantStep * quantData[i], or NA if
+  // quantData[i] is QUANT_NA, see quantize()
+  vector<uint16_t> quantData;
+
+  static const uint16_t QUANT_NA = 65535;
+
   Feature();
   Feature(Type newType, const string& newName, const size_t nSamples);
   Feature(const vector<num_t>& newNumData, const string& newName);
   Feature(const vector<cat_t>& newCatData, const string& newName);
   Feature(const vector<string>& newTxtData, const string& newName, const bool doHash);
+
+  // Sparse numerical feature from entries in any order; zeros are dropped and NA values are kept as missing
+  Feature(const vector<uint32_t>& sampleIcs, const vector<num_t>& values, const size_t nSamples, const string& newName);
+
+  // Numerical feature viewing nSamples values owned elsewhere, such as in a memory-mapped file
+  Feature(const num_t* mappedData, const size_t nSamples, const string& newName);
   ~Feature();
 
   void setNumSampleValue(const size_t sampleIdx, const num_t   val);
@@ -46,6 +63,26 @@ public:
   bool isNumerical() const;
   bool isCategorical() const;
   bool isTextual() const;
+  bool isSparse() const { return( isSparse_ ); }
+  bool isMapped() const { return( mappedData_ != NULL ); }
+  bool isQuantized() const { return( isQuantized_ ); }
+
+  // Stores dense numerical data as 16-bit codes on an even grid from the smallest to the largest value,
+  // which halves the memory of float data. Values move to the nearest of the 65535 grid points; their
+  // order, and so the splits available, are kept unless the range is finer than the grid
+  void quantize();
+
+  // Largest value that a split at the given value of the feature should send left. For quantized features
+  // that is the upper edge of the grid cell of the value, so that the original values, as found in test
+  // data, go the way their codes went; otherwise it is the value itself
+  num_t splitEdge(const num_t value) const;
+
+  // Sample i of a mapped feature reads the value of sample sampleIcs[i]. The array is owned
+  // elsewhere, and NULL restores the original order
+  void setMappedOrder(const uint32_t* sampleIcs);
+
+  // Position of sampleIdx in sparseIcs, or datadefs::MAX_IDX if the sample has no stored value
+  size_t sparsePos(const size_t sampleIdx) const;
 
   bool isMissing(const size_t sampleIdx) const;
 
@@ -66,6 +103,94 @@ public:
 
   void removeFrequentHashKeys(const num_t fThreshold);
 
+  // Bytes held by the feature, including its own object and the hash sets of textual data
+  size_t memoryBytes() const;
+
+  // Readers of one storage mode of the data, without the type and storage checks of getNumData() and
+  // getCatData(). Loops over samples are written as templates over the reader and instantiated through
+  // visitData() and friends, so that the type and storage are resolved once per loop instead of per sample
+  struct DenseNumReader {
+    const num_t* data;
+    explicit DenseNumReader(const num_t* d): data(d) {}
+    num_t operator[](const size_t sampleIdx) const { return( data[sampleIdx] ); }
+    bool isMissing(const size_t sampleIdx) const { return( datadefs::isNAN(data[sampleIdx]) ); }
+  };
+
+  // Mapped column read in a shared sample order, see setMappedOrder()
+  struct PermutedNumReader {
+    const num_t* data;
+    const uint32_t* order;
+    PermutedNumReader(const num_t* d, const uint32_t* o): data(d), order(o) {}
+    num_t operator[](const size_t sampleIdx) const { return( data[ order[sampleIdx] ] ); }
+    bool isMissing(const size_t sampleIdx) const { return( datadefs::isNAN(data[ order[sampleIdx] ]) ); }
+  };
+
+  struct SparseNumReader {
+    const Feature* feature;
+    explicit SparseNumReader(const Feature* f): feature(f) {}
+    num_t operator[](const size_t sampleIdx) const { return( feature->getNumData(sampleIdx) ); }
+    bool isMissing(const size_t sampleIdx) const { return( feature->isMissing(sampleIdx) ); }
+  };
+
+  struct QuantizedNumReader {
+    const uint16_t* data;
+    num_t min;
+    num_t step;
+    QuantizedNumReader(const uint16_t* d, const num_t m, const num_t s): data(d), min(m), step(s) {}
+    num_t operator[](const size_t sampleIdx) const { 
+      return( data[sampleIdx] == QUANT_NA ? datadefs::NUM_NAN : min + step * data[sampleIdx] ); 
+    }
+    bool isMissing(const size_t sampleIdx) const { return( data[sampleIdx] == QUANT_NA ); }
+  };
+
+  struct CatReader {
+    const cat_t* data;
+    explicit CatReader(const cat_t* d): data(d) {}
+    const cat_t& operator[](const size_t sampleIdx) const { return( data[sampleIdx] ); }
+    bool isMissing(const size_t sampleIdx) const { return( datadefs::isNAN(data[sampleIdx]) ); }
+  };
+
+  struct TxtReader {
+    const unordered_set<uint32_t>* data;
+    explicit TxtReader(const unordered_set<uint32_t>* d): data(d) {}
+    const unordered_set<uint32_t>& operator[](const size_t sampleIdx) const { return( data[sampleIdx] ); }
+    bool isMissing(const size_t sampleIdx) const { return( data[sampleIdx].size() == 0 ); }
+  };
+
+  // Calls visitor(reader) with the reader of the data, whatever its type
+  template<typename Visitor> void visitData(Visitor& visitor) const {
+    if ( type_ == Feature::Type::NUM ) {
+      this->visitNumData(visitor);
+    } else if ( type_ == Feature::Type::CAT ) {
+      this->visitCatData(visitor);
+    } else {
+      assert( type_ == Feature::Type::TXT );
+      visitor( TxtReader(txtData.data()) );
+    }
+  }
+
+  // Calls visitor(reader) with the reader of the numerical data
+  template<typename Visitor> void visitNumData(Visitor& visitor) const {
+    assert( type_ == Feature::Type::NUM );
+    if ( mappedData_ && mappedOrder_ ) {
+      visitor( PermutedNumReader(mappedData_,mappedOrder_) );
+    } else if ( mappedData_ ) {
+      visitor( DenseNumReader(mappedData_) );
+    } else if ( isSparse_ ) {
+      visitor( SparseNumReader(this) );
+    } else if ( isQuantized_ ) {
+      visitor( QuantizedNumReader(quantData.data(),quantMin_,quantStep_) );
+    } else {
+      visitor( DenseNumReader(numData.data()) );
+    }
+  }
+
+  // Calls visitor(reader) with the reader of the categorical data
+  template<typename Visitor> void visitCatData(Visitor& visitor) const {
+    assert( type_ == Feature::Type::CAT );
+    visitor( CatReader(catData.data()) );
+  }
+
 #ifndef TEST__
 private:
 #endif
@@ -73,6 +198,17 @@ private:
   Type type_;
   string name_;
 
+  bool isSparse_;
+  const num_t* mappedData_;
+  const uint32_t* mappedOrder_;
+
+  bool isQuantized_;
+  num_t quantMin_;
+  num_t quantStep_;
+
+  // Number of samples of sparse, mapped and quantized features
+  size_t nSamples_;
+
 };
 
 
@@ -0,0 +1,342 @@
+#include "mappedtreedata.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPEDTREEDATA_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "utils.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+namespace {
+
+  const char magic[8] = { 'R','F','A','C','E','B','I','N' };
+  const uint32_t version = 1;
+
+  // magic, version, sizeof(num_t), nSamples, nFeatures, offset of the first column, length of the text header
+  const size_t fixedHeaderBytes = 8 + 4 + 4 + 8 + 8 + 8 + 8;
+
+  const size_t pageBytes = 4096;
+
+  template<typename T> void writeRaw(ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value),sizeof(T));
+  }
+
+  template<typename T> T readRaw(const char* bytes, size_t& pos) {
+    T value;
+    memcpy(&value,bytes + pos,sizeof(T));
+    pos += sizeof(T);
+    return( value );
+  }
+
+}
+
+MappedTreeData::MappedTreeData(const string& fileName, const bool useContrasts):
+  DenseTreeData(useContrasts),
+  mapping_(NULL),
+  mappedBytes_(0),
+  dataOffset_(0) {
+
+  profiler::ScopedTimer scopedTimer("readData");
+  trace::ScopedEvent event("readData");
+
+#ifdef MAPPEDTREEDATA_MMAP
+
+  int fd = open(fileName.c_str(),O_RDONLY);
+
+  if ( fd == -1 ) {
+    cerr << "ERROR: failed to open file '" << fileName << "' for reading. Make sure the file exists. Quitting..." << endl;
+    exit(1);
+  }
+
+  struct stat fileStat;
+  if ( fstat(fd,&fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < fixedHeaderBytes ) {
+    cerr << "ERROR: file '" << fileName << "' is not an RF-ACE binary file" << endl;
+    exit(1);
+  }
+
+  mappedBytes_ = fileStat.st_size;
+
+  void* mapping = mmap(NULL,mappedBytes_,PROT_READ,MAP_SHARED,fd,0);
+
+  // The mapping holds its own reference to the file
+  close(fd);
+
+  if ( mapping == MAP_FAILED ) {
+    cerr << "ERROR: failed to map file '" << fileName << "': " << strerror(errno) << endl;
+    exit(1);
+  }
+
+  mapping_ = static_cast<const char*>(mapping);
+
+#else
+
+  cerr << "ERROR: memory-mapped data files are not supported on this platform" << endl;
+  exit(1);
+
+#endif
+
+  size_t pos = 0;
+
+  if ( memcmp(mapping_,magic,sizeof(magic)) != 0 ) {
+    cerr << "ERROR: file '" << fileName << "' is not an RF-ACE binary file" << endl;
+    exit(1);
+  }
+  pos += sizeof(magic);
+
+  uint32_t fileVersion = readRaw<uint32_t>(mapping_,pos);
+  uint32_t numBytes = readRaw<uint32_t>(mapping_,pos);
+  size_t nSamples = readRaw<uint64_t>(mapping_,pos);
+  size_t nFeatures = readRaw<uint64_t>(mapping_,pos);
+  dataOffset_ = readRaw<uint64_t>(mapping_,pos);
+  size_t textBytes = readRaw<uint64_t>(mapping_,pos);
+
+  if ( fileVersion != version ) {
+    cerr << "ERROR: binary file '" << fileName << "' has version " << fileVersion << ", but version " << version << " is supported" << endl;
+    exit(1);
+  }
+
+  if ( numBytes != sizeof(num_t) ) {
+    cerr << "ERROR: binary file '" << fileName << "' stores " << numBytes << "-byte values, but this build uses " << sizeof(num_t) << "-byte values" << endl;
+    exit(1);
+  }
+
+  size_t columnBytes = nSamples * sizeof(num_t);
+
+  if ( nSamples == 0 || nFeatures == 0 || fixedHeaderBytes + textBytes > dataOffset_ || dataOffset_ + nFeatures * columnBytes > mappedBytes_ ) {
+    cerr << "ERROR: binary file '" << fileName << "' is truncated or corrupt" << endl;
+    exit(1);
+  }
+
+  stringstream header( string(mapping_ + fixedHeaderBytes,textBytes) );
+
+  features_.clear();
+  name2idx_.clear();
+  name2idx_.rehash(4*nFeatures);
+
+  for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+
+    string line;
+    getline(header,line);
+
+    vector<string> fields;
+    stringstream ss(line);
+    string field;
+    while ( getline(ss,field,'\t') ) {
+      fields.push_back(field);
+    }
+
+    if ( fields.size() < 2 || ( fields[0] != "N" && fields[0] != "C" ) ) {
+      cerr << "ERROR: binary file '" << fileName << "' has an invalid description of feature " << featureIdx << endl;
+      exit(1);
+    }
+
+    const num_t* column = reinterpret_cast<const num_t*>(mapping_ + dataOffset_ + featureIdx * columnBytes);
+
+    if ( fields[0] == "N" ) {
+      features_.push_back( Feature(column,nSamples,fields[1]) );
+    } else {
+      vector<cat_t> catData(nSamples);
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	if ( datadefs::isNAN(column[i]) ) {
+	  catData[i] = datadefs::STR_NAN;
+	} else {
+	  catData[i] = fields.at( 2 + static_cast<size_t>(column[i]) );
+	}
+      }
+      features_.push_back( Feature(catData,fields[1]) );
+    }
+
+    if ( name2idx_.find(fields[1]) != name2idx_.end() ) {
+      cerr << "ERROR: binary file '" << fileName << "' has a duplicate feature name '" << fields[1] << "'" << endl;
+      exit(1);
+    }
+
+    name2idx_[fields[1]] = featureIdx;
+
+  }
+
+  sampleHeaders_.resize(nSamples);
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    getline(header,sampleHeaders_[i]);
+  }
+
+  if ( useContrasts_ ) {
+    this->createContrasts();
+  }
+
+}
+
+MappedTreeData::~MappedTreeData() {
+  this->unmap();
+}
+
+void MappedTreeData::unmap() {
+
+#ifdef MAPPEDTREEDATA_MMAP
+  if ( mapping_ ) {
+    munmap(const_cast<char*>(mapping_),mappedBytes_);
+    mapping_ = NULL;
+  }
+#endif
+
+}
+
+bool MappedTreeData::isMappedFile(const string& fileName) {
+  return( fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".rfb") == 0 );
+}
+
+void MappedTreeData::writeBinary(TreeData* treeData, const string& fileName) {
+
+  profiler::ScopedTimer scopedTimer("writeBinary");
+  trace::ScopedEvent event("writeBinary");
+
+  size_t nSamples = treeData->nSamples();
+  size_t nFeatures = treeData->nFeatures();
+
+  stringstream header;
+  vector<vector<cat_t> > categories(nFeatures);
+
+  for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+    const Feature* feature = treeData->feature(featureIdx);
+    if ( feature->isNumerical() ) {
+      header << "N\t" << feature->name() << "\n";
+    } else if ( feature->isCategorical() ) {
+      categories[featureIdx] = feature->categories();
+      header << "C\t" << feature->name();
+      for ( size_t i = 0; i < categories[featureIdx].size(); ++i ) {
+	header << "\t" << categories[featureIdx][i];
+      }
+      header << "\n";
+    } else {
+      cerr << "ERROR: textual feature '" << feature->name() << "' cannot be written to a binary file" << endl;
+      exit(1);
+    }
+  }
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    header << treeData->getSampleName(i) << "\n";
+  }
+
+  string text = header.str();
+
+  uint64_t dataOffset = ( ( fixedHeaderBytes + text.size() + pageBytes - 1 ) / pageBytes ) * pageBytes;
+
+  ofstream out(fileName.c_str(),ios::binary);
+
+  if ( !out.good() ) {
+    cerr << "ERROR: failed to open file '" << fileName << "' for writing" << endl;
+    exit(1);
+  }
+
+  out.write(magic,sizeof(magic));
+  writeRaw(out,version);
+  writeRaw(out,static_cast<uint32_t>(sizeof(num_t)));
+  writeRaw(out,static_cast<uint64_t>(nSamples));
+  writeRaw(out,static_cast<uint64_t>(nFeatures));
+  writeRaw(out,dataOffset);
+  writeRaw(out,static_cast<uint64_t>(text.size()));
+  out.write(text.data(),text.size());
+  out.write(string(dataOffset - fixedHeaderBytes - text.size(),'\0').data(),dataOffset - fixedHeaderBytes - text.size());
+
+  for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+
+    const Feature* feature = treeData->feature(featureIdx);
+
+    vector<num_t> column;
+
+    if ( feature->isNumerical() ) {
+      column = feature->getNumData();
+    } else {
+      unordered_map<cat_t,size_t> codes;
+      for ( size_t i = 0; i < categories[featureIdx].size(); ++i ) {
+	codes[ categories[featureIdx][i] ] = i;
+      }
+      column.resize(nSamples);
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	column[i] = feature->isMissing(i) ? datadefs::NUM_NAN : codes[ feature->getCatData(i) ];
+      }
+    }
+
+    out.write(reinterpret_cast<const char*>(&column[0]),nSamples * sizeof(num_t));
+
+  }
+
+  if ( !out.good() ) {
+    cerr << "ERROR: failed to write file '" << fileName << "'" << endl;
+    exit(1);
+  }
+
+}
+
+void MappedTreeData::prefetchFeatures(const vector<size_t>& featureIcs) {
+
+#ifdef MAPPEDTREEDATA_MMAP
+
+  size_t nFeatures = this->nFeatures();
+  size_t columnBytes = this->nSamples() * sizeof(num_t);
+
+  for ( size_t i = 0; i < featureIcs.size(); ++i ) {
+
+    if ( !this->feature(featureIcs[i])->isMapped() ) {
+      continue;
+    }
+
+    // Contrasts read the column of their feature
+    size_t columnIdx = featureIcs[i] % nFeatures;
+
+    size_t begin = dataOffset_ + columnIdx * columnBytes;
+    size_t pageBegin = begin - begin % pageBytes;
+
+    madvise(const_cast<char*>(mapping_ + pageBegin),begin + columnBytes - pageBegin,MADV_WILLNEED);
+
+  }
+
+#endif
+
+}
+
+void MappedTreeData::permuteContrasts(distributions::Random* random) {
+
+  size_t nFeatures = this->nFeatures();
+
+  if ( contrastOrder_.size() != this->nSamples() ) {
+    contrastOrder_.resize(this->nSamples());
+    for ( size_t i = 0; i < contrastOrder_.size(); ++i ) {
+      contrastOrder_[i] = i;
+    }
+  }
+
+  utils::permute(contrastOrder_,random);
+
+  for ( size_t i = nFeatures; i < 2*nFeatures; ++i ) {
+    if ( features_[i].isMapped() ) {
+      features_[i].setMappedOrder(&contrastOrder_[0]);
+    } else {
+      this->permuteContrast(i,random);
+    }
+  }
+
+}
+
+void MappedTreeData::memoryUsage(memreport::Breakdown& breakdown) const {
+
+  DenseTreeData::memoryUsage(breakdown);
+
+  memreport::add(breakdown, "contrast sample order", memreport::heapBytes(contrastOrder_));
+
+}
@@ -0,0 +1,74 @@
+//mappedtreedata.hpp
+//
+//
+
+#ifndef MAPPEDTREEDATA_HPP
+#define MAPPEDTREEDATA_HPP
+
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "datadefs.hpp"
+#include "distributions.hpp"
+#include "feature.hpp"
+#include "densetreedata.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+// Data matrix read out-of-core from a memory-mapped binary file (.rfb). Numerical features are
+// stored feature-major, one contiguous column of num_t per feature, so that a split reads one
+// column sequentially and only the columns sampled for splitting are ever paged in; the pages are
+// file-backed, and the kernel evicts them under memory pressure instead of swapping. Categorical
+// features are decoded into memory. Textual features are not supported.
+//
+// Contrasts of the numerical features share one permutation of the samples instead of being
+// copied, so that missing values move along with the rest
+class MappedTreeData : public DenseTreeData {
+public:
+
+  // Maps the file for reading
+  MappedTreeData(const string& fileName, const bool useContrasts = false);
+
+  ~MappedTreeData();
+
+  // Files with extension .rfb are memory-mappable binary
+  static bool isMappedFile(const string& fileName);
+
+  // Writes the features of the data into a memory-mappable binary file. The file starts with
+  //   magic "RFACEBIN", uint32 version, uint32 sizeof(num_t), uint64 nSamples, uint64 nFeatures,
+  //   uint64 offset of the first column, uint64 length of the text header
+  // followed by the text header, one line per feature ("N<tab>name", or "C<tab>name" and its
+  // categories, tab-separated) and one line per sample name. The columns start at the next page
+  // boundary; categorical values are stored as the index of the category, or NA
+  static void writeBinary(TreeData* treeData, const string& fileName);
+
+  // Starts reading the columns of the features ahead (madvise)
+  void prefetchFeatures(const vector<size_t>& featureIcs);
+
+  void permuteContrasts(distributions::Random* random);
+
+  // Adds the shared contrast order; the mapped columns are file-backed and not counted
+  void memoryUsage(memreport::Breakdown& breakdown) const;
+
+  // Size of the mapped file
+  size_t mappedBytes() const { return( mappedBytes_ ); }
+
+#ifndef TEST__
+private:
+#endif
+
+  void unmap();
+
+  const char* mapping_;
+  size_t mappedBytes_;
+  size_t dataOffset_;
+
+  // Shared sample order of the numerical contrasts
+  vector<uint32_t> contrastOrder_;
+
+};
+
+#endif
@@ -237,6 +237,43 @@ num_t math::pearsonCorrelation(const vector<num_t>& x,
 
 }
 
+vector<num_t> math::ranks(const vector<num_t>& x) {
+
+  size_t n = x.size();
+
+  vector<size_t> refIcs(n);
+  for ( size_t i = 0; i < n; ++i ) {
+    refIcs[i] = i;
+  }
+
+  sort(refIcs.begin(),refIcs.end(),[&x](const size_t a, const size_t b) { return( x[a] < x[b] ); });
+
+  vector<num_t> r(n);
+
+  size_t i = 0;
+  while ( i < n ) {
+    size_t j = i + 1;
+    while ( j < n && x[ refIcs[j] ] == x[ refIcs[i] ] ) {
+      ++j;
+    }
+    num_t avgRank = 0.5 * ( i + j + 1 );
+    for ( size_t k = i; k < j; ++k ) {
+      r[ refIcs[k] ] = avgRank;
+    }
+    i = j;
+  }
+
+  return( r );
+
+}
+
+num_t math::spearmanCorrelation(const vector<num_t>& x,
+				const vector<num_t>& y) {
+
+  return( math::pearsonCorrelation(math::ranks(x),math::ranks(y)) );
+
+}
+
 num_t math::gamma(const vector<num_t>& x, const size_t nCategories) {
   
   size_t n = x.size();
@@ -252,14 +289,39 @@ num_t math::gamma(const vector<num_t>& x, const size_t nCategories) {
     numerator   += x[i];
   }
   
+  return( math::gamma(numerator,denominator,nCategories) );
+  
+}
+
+num_t math::gamma(const vector<num_t>& x, const vector<size_t>& w, const size_t nCategories) {
+  
+  size_t n = x.size();
+  assert( n > 0 );
+  assert( n == w.size() );
+  assert( nCategories > 0 );
+  
+  num_t numerator = 0.0;
+  num_t denominator = 0.0;
+  
+  for (size_t i = 0; i < n; ++i) {
+    num_t abs_data_i = fabs( x[i] );
+    denominator += w[i] * abs_data_i * (1.0 - abs_data_i);
+    numerator   += w[i] * x[i];
+  }
+  
+  return( math::gamma(numerator,denominator,nCategories) );
+  
+}
+
+num_t math::gamma(const num_t numerator, const num_t denominator, const size_t nCategories) {
+
   if ( fabs(denominator) <= datadefs::EPS ) {
     return( datadefs::LOG_OF_MAX_NUM * numerator );
   } else {
     return( (numerator*(nCategories - 1)) / (denominator*nCategories) );
   }
-  
-}
 
+}
 
 num_t math::numericalError(const vector<num_t>& x, const vector<num_t>& y) {
 
@@ -97,13 +97,21 @@ namespace math {
   num_t pearsonCorrelation(const vector<num_t>& x,
 			   const vector<num_t>& y);
 
+  /**
+     Ranks of x starting from 1, ties sharing their average rank
+  */
+  vector<num_t> ranks(const vector<num_t>& x);
+
+  num_t spearmanCorrelation(const vector<num_t>& x,
+			    const vector<num_t>& y);
+
   inline num_t mean(const vector<num_t>& x) {
     
     if ( x.size() == 0 ) {
       return( datadefs::NUM_NAN );
     }
 
-    num_t mu = 0.0;
+    datadefs::acc_t mu = 0.0;
 
     for(size_t i = 0; i < x.size(); ++i) {
 	mu += x[i];
@@ -113,6 +121,36 @@ namespace math {
     
   }
 
+  /**
+     Weighted mean in the precision of the accumulator, where w[i] is the multiplicity of x[i]
+  */
+  inline datadefs::acc_t accMean(const vector<num_t>& x, const vector<size_t>& w) {
+
+    assert( x.size() == w.size() );
+
+    size_t n = 0;
+    datadefs::acc_t mu = 0.0;
+
+    for(size_t i = 0; i < x.size(); ++i) {
+      mu += w[i] * static_cast<datadefs::acc_t>(x[i]);
+      n  += w[i];
+    }
+
+    if ( n == 0 ) {
+      return( datadefs::NUM_NAN );
+    }
+
+    return( mu / n );
+
+  }
+
+  /**
+     Weighted mean, where w[i] is the multiplicity of x[i]
+  */
+  inline num_t mean(const vector<num_t>& x, const vector<size_t>& w) {
+    return( static_cast<num_t>( accMean(x,w) ) );
+  }
+
   template<typename T>
   unordered_map<T,size_t> frequency(const vector<T>& x) {
     unordered_map<T,size_t> freq;
@@ -127,8 +165,19 @@ namespace math {
   }
 
   template<typename T>
-  T mode(const vector<T>& x) {
-    unordered_map<T,size_t> freq = frequency(x);
+  unordered_map<T,size_t> frequency(const vector<T>& x, const vector<size_t>& w) {
+    assert( x.size() == w.size() );
+    unordered_map<T,size_t> freq;
+    for(size_t i = 0; i < x.size(); ++i) {
+      if ( w[i] > 0 ) {
+	freq[ x[i] ] += w[i];
+      }
+    }
+    return( freq );
+  }
+
+  template<typename T>
+  T mode(const unordered_map<T,size_t>& freq) {
     typename unordered_map<T,size_t>::const_iterator maxElement( freq.begin() );
     for ( typename unordered_map<T,size_t>::const_iterator it(freq.begin()); it != freq.end(); ++it ) {
       if ( it->second > maxElement->second ) {
@@ -138,6 +187,19 @@ namespace math {
     return( maxElement->first );
   }
 
+  template<typename T>
+  T mode(const vector<T>& x) {
+    return( mode(frequency(x)) );
+  }
+
+  /**
+     Weighted mode, where w[i] is the multiplicity of x[i]
+  */
+  template<typename T>
+  T mode(const vector<T>& x, const vector<size_t>& w) {
+    return( mode(frequency(x,w)) );
+  }
+
   template<typename T>
   size_t nMismatches(const vector<T>& x, const T& y) {
     size_t count = 0;
@@ -197,6 +259,13 @@ namespace math {
 
 
   num_t gamma(const vector<num_t>& x, const size_t nCategories); 
+
+  num_t gamma(const vector<num_t>& x, const vector<size_t>& w, const size_t nCategories);
+
+  /**
+     Gamma from precomputed sums: numerator = sum(x), denominator = sum(|x|*(1-|x|))
+  */
+  num_t gamma(const num_t numerator, const num_t denominator, const size_t nCategories);
   
   //num_t squaredError(const vector<num_t>& x);
   
@@ -235,6 +304,22 @@ namespace math {
     }
   }
  
+  /**
+     Updates the squared frequency by ADDING w copies of x_n to the set
+  */
+  template<typename T>
+  inline void incrementSquaredFrequency(const T& x_n,
+					const size_t w,
+					unordered_map<T,size_t>& freq,
+					size_t& sqFreq) {
+
+    // (f + w)^2 - f^2 = 2*f*w + w^2
+    size_t& f = freq[x_n];
+    sqFreq += 2*f*w + w*w;
+    f += w;
+
+  }
+
   /**
      Updates the squared frequency by REMOVING x_n
      from the set
@@ -255,14 +340,39 @@ namespace math {
       freq.erase(x_n);
     }
   }
+
+  /**
+     Updates the squared frequency by REMOVING w copies of x_n
+     from the set
+  */
+  template<typename T>
+  inline void decrementSquaredFrequency(const T& x_n,
+					const size_t w,
+                                        unordered_map<T,size_t>& freq,
+                                        size_t& sqFreq) {
+
+    typename unordered_map<T,size_t>::iterator it(freq.find(x_n));
+
+    assert( it != freq.end() );
+    assert( it->second >= w );
+
+    // f^2 - (f - w)^2 = 2*f*w - w^2
+    sqFreq -= 2*it->second*w - w*w;
+    it->second -= w;
+
+    if(it->second == 0) {
+      freq.erase(it);
+    }
+  }
   
-  // Calculates decrease in impurity for a numerical target
-  inline num_t deltaImpurity_regr(const num_t mu_tot,
-				  const size_t n_tot,
-				  const num_t mu_left,
-				  const size_t n_left,
-				  const num_t mu_right,
-				  const size_t n_right) {
+  // Calculates decrease in impurity for a numerical target. The terms nearly cancel, so
+  // the means are taken in the precision of the accumulator
+  inline datadefs::acc_t deltaImpurity_regr(const datadefs::acc_t mu_tot,
+					    const size_t n_tot,
+					    const datadefs::acc_t mu_left,
+					    const size_t n_left,
+					    const datadefs::acc_t mu_right,
+					    const size_t n_right) {
 
     return( - mu_tot   * mu_tot
 	    + mu_left  * mu_left  * n_left  / n_tot
@@ -270,12 +380,12 @@ namespace math {
     
   }
  
-  inline num_t deltaImpurity_class(const size_t sf_tot,
-				   const size_t n_tot,
-				   const size_t sf_left,
-				   const size_t n_left,
-				   const size_t sf_right,
-				   const size_t n_right) {
+  inline datadefs::acc_t deltaImpurity_class(const size_t sf_tot,
+					    const size_t n_tot,
+					    const size_t sf_left,
+					    const size_t n_left,
+					    const size_t sf_right,
+					    const size_t n_right) {
 
     //cout << - 1.0 * sf_tot   / ( 1.0 * n_tot * n_tot   ) << " + " << 1.0 * sf_left  / ( 1.0 * n_tot * n_left  ) << " + " << 1.0 * sf_right / ( 1.0 * n_tot * n_right ) << endl;
 
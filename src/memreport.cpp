@@ -0,0 +1,216 @@
+#include "memreport.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#ifndef NOTHREADS
+#include <mutex>
+#endif
+
+bool memreport::isEnabled = false;
+
+namespace {
+
+  struct Checkpoint {
+    string phase;
+    size_t rss;
+    size_t peakRss;
+  };
+
+  vector<Checkpoint> checkpoints;
+  size_t maxBufferBytes = 0;
+
+  // Whether the peak has been reset at enable() and at every checkpoint, so that each checkpoint
+  // has the peak of its phase alone
+  bool isPeakPerPhase = false;
+
+#ifndef NOTHREADS
+  mutex bufferMutex;
+#endif
+
+  // Value of a "Key:   1234 kB" line of /proc/self/status, in bytes
+  size_t readStatus(const string& key) {
+
+    ifstream status("/proc/self/status");
+
+    string line;
+    while ( getline(status,line) ) {
+      if ( line.compare(0,key.size(),key) == 0 && line.size() > key.size() && line[key.size()] == ':' ) {
+	stringstream ss( line.substr(key.size() + 1) );
+	size_t kiloBytes = 0;
+	ss >> kiloBytes;
+	return( 1024 * kiloBytes );
+      }
+    }
+
+    return( 0 );
+
+  }
+
+  // Resets the peak resident set size of the process to the current one, which Linux allows
+  // since version 4.0; elsewhere the peak keeps counting from the start of the process
+  bool resetPeakRSS() {
+
+    ofstream clearRefs("/proc/self/clear_refs");
+
+    if ( !clearRefs ) {
+      return( false );
+    }
+
+    clearRefs << "5";
+    clearRefs.close();
+
+    return( !clearRefs.fail() );
+
+  }
+
+  // Sizes below a megabyte are shown in kilobytes
+  string toMB(const size_t bytes) {
+    stringstream ss;
+    if ( bytes < 1048576 ) {
+      ss << fixed << setprecision(1) << bytes / 1024.0 << " kB";
+    } else {
+      ss << fixed << setprecision(1) << bytes / 1048576.0 << " MB";
+    }
+    return( ss.str() );
+  }
+
+}
+
+void memreport::enable() {
+  isEnabled = true;
+  isPeakPerPhase = resetPeakRSS();
+}
+
+void memreport::add(Breakdown& breakdown, const string& item, const size_t bytes) {
+
+  for ( size_t i = 0; i < breakdown.size(); ++i ) {
+    if ( breakdown[i].first == item ) {
+      breakdown[i].second += bytes;
+      return;
+    }
+  }
+
+  breakdown.push_back( pair<string,size_t>(item,bytes) );
+
+}
+
+size_t memreport::total(const Breakdown& breakdown) {
+  size_t bytes = 0;
+  for ( size_t i = 0; i < breakdown.size(); ++i ) {
+    bytes += breakdown[i].second;
+  }
+  return( bytes );
+}
+
+void memreport::print(ostream& os, const string& title, const Breakdown& breakdown) {
+
+  os << title << ": " << toMB( total(breakdown) ) << endl;
+  for ( size_t i = 0; i < breakdown.size(); ++i ) {
+    os << "  " << left << setw(36) << breakdown[i].first << right << setw(14) << toMB(breakdown[i].second) << endl;
+  }
+
+}
+
+size_t memreport::currentRSS() {
+  return( readStatus("VmRSS") );
+}
+
+size_t memreport::peakRSS() {
+  return( readStatus("VmHWM") );
+}
+
+void memreport::checkpoint(const string& phase) {
+
+  if ( !isEnabled ) {
+    return;
+  }
+
+  Checkpoint checkpoint = { phase, currentRSS(), peakRSS() };
+  checkpoints.push_back(checkpoint);
+
+  isPeakPerPhase = resetPeakRSS() && isPeakPerPhase;
+
+}
+
+void memreport::printCheckpoints(ostream& os) {
+
+  if ( peakBuffers() > 0 ) {
+    os << "Largest buffers of growing one tree, with the caches of the split threads: " << toMB( peakBuffers() ) << endl;
+  }
+
+  if ( checkpoints.empty() ) {
+    return;
+  }
+
+  if ( !isPeakPerPhase ) {
+
+    // Without resetting the peak, it would be the peak of all phases so far, so only the current size is shown
+    os << "Resident set size after each phase (the peak per phase is not available, as /proc/self/clear_refs cannot be written):" << endl
+       << "  " << left << setw(36) << "phase" << right << setw(14) << "current RSS" << endl;
+
+    for ( size_t i = 0; i < checkpoints.size(); ++i ) {
+      os << "  " << left << setw(36) << checkpoints[i].phase << right << setw(14) << toMB(checkpoints[i].rss) << endl;
+    }
+
+    return;
+  }
+
+  os << "Resident set size after each phase, and its peak during the phase:" << endl
+     << "  " << left << setw(36) << "phase" << right << setw(14) << "RSS" << setw(14) << "peak RSS" << endl;
+
+  for ( size_t i = 0; i < checkpoints.size(); ++i ) {
+    os << "  " << left << setw(36) << checkpoints[i].phase << right
+       << setw(14) << toMB(checkpoints[i].rss) << setw(14) << toMB(checkpoints[i].peakRss) << endl;
+  }
+
+}
+
+void memreport::recordBuffers(const size_t bytes) {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(bufferMutex);
+#endif
+
+  maxBufferBytes = bytes > maxBufferBytes ? bytes : maxBufferBytes;
+
+}
+
+size_t memreport::peakBuffers() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(bufferMutex);
+#endif
+
+  return( maxBufferBytes );
+
+}
+
+void memreport::reset() {
+
+  checkpoints.clear();
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(bufferMutex);
+#endif
+
+  maxBufferBytes = 0;
+
+}
+
+size_t memreport::heapBytes(const vector<string>& vec) {
+  size_t bytes = vec.capacity() * sizeof(string);
+  for ( size_t i = 0; i < vec.size(); ++i ) {
+    bytes += heapBytes(vec[i]);
+  }
+  return( bytes );
+}
+
+size_t memreport::heapBytes(const unordered_set<string>& set) {
+  size_t bytes = set.bucket_count() * sizeof(void*) + set.size() * ( sizeof(string) + sizeof(void*) + sizeof(size_t) );
+  for ( unordered_set<string>::const_iterator it( set.begin() ); it != set.end(); ++it ) {
+    bytes += heapBytes(*it);
+  }
+  return( bytes );
+}
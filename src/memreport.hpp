@@ -0,0 +1,82 @@
+#ifndef MEMREPORT_HPP
+#define MEMREPORT_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "datadefs.hpp"
+
+using namespace std;
+
+// Memory accounting. Data structures report the heap bytes they hold as a Breakdown of named items,
+// estimated from the capacities of their containers, and the resident set size of the process is
+// sampled from /proc/self/status at checkpoints after the major phases. Each checkpoint resets the
+// peak through /proc/self/clear_refs where allowed, so that the peak is that of the phase. While
+// disabled, a checkpoint does nothing
+namespace memreport {
+
+  // Set by enable(), before any threads are spawned
+  extern bool isEnabled;
+
+  void enable();
+
+  typedef vector<pair<string,size_t> > Breakdown;
+
+  // Adds bytes to the named item, appending the item if it is not there yet
+  void add(Breakdown& breakdown, const string& item, const size_t bytes);
+
+  size_t total(const Breakdown& breakdown);
+
+  void print(ostream& os, const string& title, const Breakdown& breakdown);
+
+  // Resident and peak resident set size of the process, or 0 where /proc is not available
+  size_t currentRSS();
+  size_t peakRSS();
+
+  // Records the resident set size after the named phase, and its peak since the previous checkpoint
+  void checkpoint(const string& phase);
+
+  // Also reports the largest transient buffers
+  void printCheckpoints(ostream& os);
+
+  // Transient buffers, such as those of growing a tree, report their size when done; the largest is kept
+  void recordBuffers(const size_t bytes);
+  size_t peakBuffers();
+
+  void reset();
+
+  // Heap bytes held by containers, not counting the container objects themselves. Strings short
+  // enough to be stored inline count as nothing, and hash containers are charged a bucket pointer
+  // per bucket and a node with a next pointer and a cached hash per element
+  inline size_t heapBytes(const string& str) {
+    return( str.capacity() > 15 ? str.capacity() + 1 : 0 );
+  }
+
+  template<typename T> size_t heapBytes(const vector<T>& vec) {
+    return( vec.capacity() * sizeof(T) );
+  }
+
+  size_t heapBytes(const vector<string>& vec);
+
+  template<typename T> size_t heapBytes(const unordered_set<T>& set) {
+    return( set.bucket_count() * sizeof(void*) + set.size() * ( sizeof(T) + sizeof(void*) + sizeof(size_t) ) );
+  }
+
+  size_t heapBytes(const unordered_set<string>& set);
+
+  template<typename T> size_t heapBytes(const vector<unordered_set<T> >& vec) {
+    size_t bytes = vec.capacity() * sizeof(unordered_set<T>);
+    for ( size_t i = 0; i < vec.size(); ++i ) {
+      bytes += heapBytes(vec[i]);
+    }
+    return( bytes );
+  }
+
+}
+
+#endif
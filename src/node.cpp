@@ -1,14 +1,51 @@
 #include<iostream>
 #include<cassert>
 #include<iomanip>
+#include<limits>
+#include<algorithm>
+#ifndef NOTHREADS
+#include<functional>
+#endif
 
 #include "node.hpp"
+#include "densetreedata.hpp"
 #include "datadefs.hpp"
 #include "math.hpp"
 
 using namespace std;
 using datadefs::num_t;
 
+// Below this many (sample,candidate) pairs the split search of a node is not worth spreading over threads
+static const size_t MIN_PARALLEL_SPLIT_WORK = 10000;
+
+// Sum of multiplicities of the samples in sampleIcs
+static size_t weightedSize(const vector<size_t>& sampleIcs, const vector<size_t>& sampleWeights) {
+  size_t n = 0;
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    n += sampleWeights[ sampleIcs[i] ];
+  }
+  return( n );
+}
+
+// Multiplicities of the samples in sampleIcs, in the same order
+static vector<size_t> weightsOf(const vector<size_t>& sampleIcs, const vector<size_t>& sampleWeights) {
+  vector<size_t> w(sampleIcs.size());
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    w[i] = sampleWeights[ sampleIcs[i] ];
+  }
+  return( w );
+}
+
+// Repeats each element of x as many times as its multiplicity says
+template<typename T>
+static vector<T> expand(const vector<T>& x, const vector<size_t>& w) {
+  vector<T> y;
+  for ( size_t i = 0; i < x.size(); ++i ) {
+    y.insert(y.end(),w[i],x[i]);
+  }
+  return( y );
+}
+
 Node::Node():
   leftChild_(NULL),
   rightChild_(NULL),
@@ -95,65 +132,91 @@ void Node::setMissingChild(Node& missingChild) {
   missingChild_ = &missingChild;
 }
 
-Node* Node::percolate(TreeData* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx) {
+// The data class is resolved on every call, and the tree is descended with direct calls if it is DenseTreeData
+Node* Node::percolate(TreeData* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx, const size_t scrambleSampleIdx) {
+
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(testData);
+
+  if ( denseData ) {
+    return( this->percolateData(denseData,sampleIdx,scrambleFeatureIdx,scrambleSampleIdx,NULL) );
+  }
+
+  return( this->percolateData(testData,sampleIdx,scrambleFeatureIdx,scrambleSampleIdx,NULL) );
+  
+}
+
+Node* Node::percolate(TreeData* testData, const size_t sampleIdx, vector<size_t>& pathFeatureIcs) {
+
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(testData);
+
+  if ( denseData ) {
+    return( this->percolateData(denseData,sampleIdx,datadefs::MAX_IDX,datadefs::MAX_IDX,&pathFeatureIcs) );
+  }
+
+  return( this->percolateData(testData,sampleIdx,datadefs::MAX_IDX,datadefs::MAX_IDX,&pathFeatureIcs) );
+
+}
+
+template<typename DataT>
+Node* Node::percolateData(DataT* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx, const size_t scrambleSampleIdx, vector<size_t>* pathFeatureIcs) {
+
+  if ( pathFeatureIcs ) { pathFeatureIcs->clear(); }
+
+  Node* node = this;
+  Node* child;
+  size_t featureIdx;
+
+  while ( ( child = node->descend(testData,sampleIdx,scrambleFeatureIdx,scrambleSampleIdx,&featureIdx) ) ) {
+    if ( pathFeatureIcs ) { pathFeatureIcs->push_back(featureIdx); }
+    node = child;
+  }
+
+  return( node );
+
+}
+
+// Takes one step down the tree; returns NULL if the sample stops at this node.
+// If a donor sample is given, data for scrambleFeatureIdx is read from the donor instead
+template<typename DataT>
+Node* Node::descend(DataT* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx, const size_t scrambleSampleIdx, size_t* splitFeatureIdx) {
   
-  if ( !this->hasChildren() ) { return( this ); }
+  if ( !this->hasChildren() ) { return( NULL ); }
   
   size_t featureIdx = testData->getFeatureIdx(splitter_.name);
   
-  if ( featureIdx == testData->end() ) { return( this ); }
+  if ( featureIdx == testData->end() ) { return( NULL ); }
+
+  if ( splitFeatureIdx ) { *splitFeatureIdx = featureIdx; }
+
+  const size_t dataIdx = ( featureIdx == scrambleFeatureIdx && scrambleSampleIdx != datadefs::MAX_IDX ) ? scrambleSampleIdx : sampleIdx;
   
   if ( splitter_.type == Feature::Type::NUM ) {
-    num_t data;
-    if ( scrambleFeatureIdx != featureIdx ) {
-      data = testData->feature(featureIdx)->getNumData(sampleIdx);
-    } else {
-      cerr << "Randomized prediction is not available!" << endl;
-      exit(1);
-      // data = testData->getFeatureData(featureIdx, random_->integer() % testData->nSamples() );
-    }
+    num_t data = testData->feature(featureIdx)->getNumData(dataIdx);
     if ( datadefs::isNAN(data) ) { 
-      if ( this->missingChild() ) {
-	return( this->missingChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
-      } else {
-	return( this ); 
-      }
+      return( this->missingChild() );
     } else {
-      return( data <= splitter_.leftLeqValue ? 
-	      this->leftChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) : 
-	      this->rightChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
+      return( data <= splitter_.leftLeqValue ? this->leftChild() : this->rightChild() );
     }
   } else if ( splitter_.type == Feature::Type::CAT ){
-    cat_t data;
-    if ( scrambleFeatureIdx != featureIdx ) {
-      data = testData->feature(featureIdx)->getCatData(sampleIdx);
-    } else {
-      cerr << "randomized prediction is not available!" << endl;
-      exit(1);
-      // data = testData->getRawFeatureData(featureIdx, random_->integer() % testData->nSamples() );
-    }
+    cat_t data = testData->feature(featureIdx)->getCatData(dataIdx);
     if ( datadefs::isNAN(data) ) { 
-      if ( this->missingChild() ) {
-	return( this->missingChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
-      } else {
-	return( this );
-      }
+      return( this->missingChild() );
     } else { 
       
       // Return left child if splits left
       if ( splitter_.leftValues.find(data) != splitter_.leftValues.end() ) {
-	return( this->leftChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
+	return( this->leftChild() );
       } else {
-	return( this->rightChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
+	return( this->rightChild() );
       }
     }
     
   } else {
     
-    if ( testData->feature(featureIdx)->hasHash(sampleIdx,splitter_.hashValue) ) {
-      return( this->leftChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
+    if ( testData->feature(featureIdx)->hasHash(dataIdx,splitter_.hashValue) ) {
+      return( this->leftChild() );
     } else {
-      return( this->rightChild()->percolate(testData,sampleIdx,scrambleFeatureIdx) );
+      return( this->rightChild() );
     }
   }
   
@@ -298,39 +361,42 @@ const Node::Splitter& Node::getSplitter() {
   return( splitter_ );
 }
 
-void Node::recursiveNodeSplit(TreeData* treeData,
+template<typename DataT>
+void Node::recursiveNodeSplit(DataT* treeData,
+			      const Feature* target,
 			      const size_t targetIdx,
 			      const ForestOptions* forestOptions,
 			      distributions::Random* random,
 			      const PredictionFunctionType& predictionFunctionType,
 			      const distributions::PMF* pmf,
 			      const vector<size_t>& sampleIcs,
+			      const vector<size_t>& sampleWeights,
+			      const NodeStats& stats,
 			      size_t* nLeaves,
-			      size_t& childIdx,
-			      vector<Node>& children,
+			      const size_t nodeIdx,
+			      TreeArena& arena,
 			      SplitCache& splitCache) {
 
-  if ( false ) {
-    cout << "REC " << this << endl;
-    cout << " " << treeData << endl;
-    cout << " " << forestOptions << endl;
-    cout << " " << nLeaves << endl;
-  }
+  // Only the nodes big enough to matter on the timeline are traced
+  trace::ScopedEvent event( stats.n >= trace::minNodeSize ? "node" : NULL, "nSamples", stats.n );
+
+  ++WorkCounters::local().nodesCreated;
 
-  splitCache.nSamples = sampleIcs.size();
+  // Node size is the sum of the bootstrap multiplicities of the samples
+  splitCache.nSamples = stats.n;
 
+  // The prediction comes straight from the statistics handed down by the parent
   if ( predictionFunctionType == MEAN ) {
-    num_t numTrainPrediction = math::mean(treeData->feature(targetIdx)->getNumData(sampleIcs));
-    this->setNumTrainPrediction( numTrainPrediction);
-    assert(!datadefs::isNAN(prediction_.numTrainPrediction));
+    arena.nodes[nodeIdx].numTrainPrediction = stats.sum / stats.n;
+    assert(!datadefs::isNAN(arena.nodes[nodeIdx].numTrainPrediction));
   } else if ( predictionFunctionType == MODE ) {
-    cat_t catTrainPrediction = math::mode(treeData->feature(targetIdx)->getCatData(sampleIcs));
-    this->setCatTrainPrediction( catTrainPrediction );
-    assert(!datadefs::isNAN(prediction_.catTrainPrediction));
+    arena.nodes[nodeIdx].catTrainPredictionIdx = arena.catPredictions.size();
+    arena.catPredictions.push_back( math::mode(stats.catFreq) );
+    assert(!datadefs::isNAN(arena.catPredictions.back()));
   } else if ( predictionFunctionType == GAMMA ) {
-    num_t numTrainPrediction = math::gamma(treeData->feature(targetIdx)->getNumData(sampleIcs), treeData->feature(targetIdx)->categories().size() );
-    this->setNumTrainPrediction( numTrainPrediction );
-    assert(!datadefs::isNAN(prediction_.numTrainPrediction));
+    // The target is then the residual, while the number of categories comes from the original target
+    arena.nodes[nodeIdx].numTrainPrediction = math::gamma(stats.sum, stats.gammaDenominator, treeData->feature(targetIdx)->categories().size() );
+    assert(!datadefs::isNAN(arena.nodes[nodeIdx].numTrainPrediction));
   } else {
     cerr << "Node::recursiveNodeSplit() -- unknown prediction function!" << endl;
     exit(1);
@@ -338,134 +404,261 @@ void Node::recursiveNodeSplit(TreeData* treeData,
 
   assert( *nLeaves <= forestOptions->nMaxLeaves );
 
-  if ( splitCache.nSamples < 2 * forestOptions->nodeSize || *nLeaves == forestOptions->nMaxLeaves || childIdx + 1 >= children.size() ) {
-    if ( forestOptions->forestType == forest_t::QRF ) {
-      if ( treeData->feature(targetIdx)->isNumerical() ) {
-	this->setNumTrainData( treeData->feature(targetIdx)->getNumData(sampleIcs) );
-      } else {
-	this->setCatTrainData( treeData->feature(targetIdx)->getCatData(sampleIcs) );
-      }
-    }
-    return;
-  }
-
-  splitCache.featureSampleIcs.clear();
-
-  if ( forestOptions->isRandomSplit ) {
+  bool foundSplit = false;
 
-    splitCache.featureSampleIcs.resize(forestOptions->mTry);
+  if ( !stats.isPure() && splitCache.nSamples >= 2 * forestOptions->nodeSize && *nLeaves < forestOptions->nMaxLeaves ) {
 
-    for ( size_t i = 0; i < forestOptions->mTry; ++i ) {
-      splitCache.featureSampleIcs[i] = pmf->sample(random); //icdf( random->uniform() );
-    }
-
-    if ( forestOptions->useContrasts ) {
+    splitCache.featureSampleIcs.clear();
+    
+    if ( forestOptions->isRandomSplit ) {
+      
+      splitCache.featureSampleIcs.resize(forestOptions->mTry);
+      
       for ( size_t i = 0; i < forestOptions->mTry; ++i ) {
-	
-	// If the sampled feature is a contrast... 
-	if ( ! treeData->feature(splitCache.featureSampleIcs[i])->isTextual() && random->uniform() < forestOptions->contrastFraction ) { // p% sampling rate
+	splitCache.featureSampleIcs[i] = pmf->sample(random); //icdf( random->uniform() );
+      }
+      
+      if ( forestOptions->useContrasts ) {
+	for ( size_t i = 0; i < forestOptions->mTry; ++i ) {
 	  
-	  // Contrast features in TreeData are indexed with an offset of the number of features: nFeatures
-	  splitCache.featureSampleIcs[i] += treeData->nFeatures();
+	  // If the sampled feature is a contrast... 
+	  if ( ! treeData->feature(splitCache.featureSampleIcs[i])->isTextual() && random->uniform() < forestOptions->contrastFraction ) { // p% sampling rate
+	    
+	    // Contrast features in TreeData are indexed with an offset of the number of features: nFeatures
+	    splitCache.featureSampleIcs[i] += treeData->nFeatures();
+	  }
 	}
-      }
-    } 
-  } else {
+      } 
 
-    splitCache.featureSampleIcs = utils::range(treeData->nFeatures());
-
-    splitCache.featureSampleIcs.erase(splitCache.featureSampleIcs.begin()+targetIdx);
+      treeData->prefetchFeatures(splitCache.featureSampleIcs);
+    } else {
+      
+      splitCache.featureSampleIcs = utils::range(treeData->nFeatures());
+      
+      splitCache.featureSampleIcs.erase(splitCache.featureSampleIcs.begin()+targetIdx);
+    }
+    
+    splitCache.sampleIcs_left.clear();
+    splitCache.sampleIcs_right.clear();
+    splitCache.sampleIcs_missing.clear();
+    
+    foundSplit = Node::regularSplitterSeek(treeData,
+					   target,
+					   targetIdx,
+					   forestOptions,
+					   random,
+					   sampleIcs,
+					   sampleWeights,
+					   nodeIdx,
+					   arena,
+					   splitCache);
   }
-  
-  splitCache.sampleIcs_left.clear();
-  splitCache.sampleIcs_right.clear();
-  splitCache.sampleIcs_missing.clear();
-
-  bool foundSplit = this->regularSplitterSeek(treeData,
-					      targetIdx,
-					      forestOptions,
-					      random,
-					      sampleIcs,
-					      childIdx,
-					      children,
-					      splitCache);
         
   if ( !foundSplit ) {
     if ( forestOptions->forestType == forest_t::QRF ) {
-      if ( treeData->feature(targetIdx)->isNumerical() ) {
-        this->setNumTrainData( treeData->feature(targetIdx)->getNumData(sampleIcs) );
+      vector<size_t> w = weightsOf(sampleIcs,sampleWeights);
+      if ( target->isNumerical() ) {
+	arena.nodes[nodeIdx].trainDataIdx = arena.numTrainData.size();
+        arena.numTrainData.push_back( expand(target->getNumData(sampleIcs),w) );
       } else {
-        this->setCatTrainData( treeData->feature(targetIdx)->getCatData(sampleIcs) );
+	arena.nodes[nodeIdx].trainDataIdx = arena.catTrainData.size();
+        arena.catTrainData.push_back( expand(target->getCatData(sampleIcs),w) );
       }
     }
+    if ( !arena.sampleLeafIdx.empty() ) {
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	arena.sampleLeafIdx[ sampleIcs[i] ] = nodeIdx;
+      }
+    }
+    ++WorkCounters::local().leaves;
     return;
   }
   
   *nLeaves += 1;
 
+  // The missing branch is counted before the other branches grow. If it would be one leaf too many, it is 
+  // dropped as with noNABranching; the missing child is the last node added to the arena
+  if ( arena.nodes[nodeIdx].missingIdx != datadefs::MAX_IDX ) {
+    if ( *nLeaves < forestOptions->nMaxLeaves ) {
+      *nLeaves += 1;
+      ++WorkCounters::local().missingNodes;
+    } else {
+      assert( arena.nodes[nodeIdx].missingIdx == arena.nodes.size() - 1 );
+      arena.nodes.pop_back();
+      arena.nodes[nodeIdx].missingIdx = datadefs::MAX_IDX;
+    }
+  }
+
   vector<size_t> sampleIcs_left = splitCache.sampleIcs_left;
   vector<size_t> sampleIcs_right = splitCache.sampleIcs_right;
   vector<size_t> sampleIcs_missing = splitCache.sampleIcs_missing;
-  
-  // Left child recursive split
-  this->leftChild()->recursiveNodeSplit(treeData,
-					targetIdx,
-					forestOptions,
-					random,
-					predictionFunctionType,
-					pmf,
-					sampleIcs_left,
-					nLeaves,
-					childIdx,
-					children,
-					splitCache);
 
+  // Copy the child indices, since the arena may be reallocated during recursion
+  const size_t leftIdx    = arena.nodes[nodeIdx].leftIdx;
+  const size_t rightIdx   = arena.nodes[nodeIdx].rightIdx;
+  const size_t missingIdx = arena.nodes[nodeIdx].missingIdx;
 
-  // Right child recursive split
-  this->rightChild()->recursiveNodeSplit(treeData,
-					 targetIdx,
-					 forestOptions,
-					 random,
-					 predictionFunctionType,
-					 pmf,
-					 sampleIcs_right,
-					 nLeaves,
-					 childIdx,
-					 children,
-					 splitCache);
+  // Only the missing and the smaller of the left and right branches are gathered; 
+  // the statistics of the remaining branch follow by subtraction
+  NodeStats stats_left(stats.shift), stats_right(stats.shift), stats_missing(stats.shift);
+
+  stats_missing.add(target,sampleIcs_missing,sampleWeights);
+
+  bool isLeftSmaller = sampleIcs_left.size() <= sampleIcs_right.size();
+  NodeStats& stats_small = isLeftSmaller ? stats_left : stats_right;
+  NodeStats& stats_large = isLeftSmaller ? stats_right : stats_left;
+
+  stats_small.add(target,isLeftSmaller ? sampleIcs_left : sampleIcs_right,sampleWeights);
+  stats_large = stats;
+  stats_large.subtract(stats_missing);
+  stats_large.subtract(stats_small);
   
+  // Left child recursive split
+  Node::recursiveNodeSplit(treeData,
+			   target,
+			   targetIdx,
+			   forestOptions,
+			   random,
+			   predictionFunctionType,
+			   pmf,
+			   sampleIcs_left,
+			   sampleWeights,
+			   stats_left,
+			   nLeaves,
+			   leftIdx,
+			   arena,
+			   splitCache);
 
+  // Right child recursive split
+  Node::recursiveNodeSplit(treeData,
+			   target,
+			   targetIdx,
+			   forestOptions,
+			   random,
+			   predictionFunctionType,
+			   pmf,
+			   sampleIcs_right,
+			   sampleWeights,
+			   stats_right,
+			   nLeaves,
+			   rightIdx,
+			   arena,
+			   splitCache);
   
   // OPTIONAL: Missing child recursive split
-  if ( this->missingChild() ) {
+  if ( missingIdx != datadefs::MAX_IDX ) {
     
     assert( sampleIcs_missing.size() > 0 );
 
-    *nLeaves += 1;
-    
-    this->missingChild()->recursiveNodeSplit(treeData,
-					     targetIdx,
-					     forestOptions,
-					     random,
-					     predictionFunctionType,
-					     pmf,
-					     sampleIcs_missing,
-					     nLeaves,
-					     childIdx,
-					     children,
-					     splitCache); 
+    Node::recursiveNodeSplit(treeData,
+			     target,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     sampleIcs_missing,
+			     sampleWeights,
+			     stats_missing,
+			     nLeaves,
+			     missingIdx,
+			     arena,
+			     splitCache);
   }
   
 }
 
-bool Node::regularSplitterSeek(TreeData* treeData,
-			       const size_t targetIdx,
-			       const ForestOptions* forestOptions,
-			       distributions::Random* random,
-			       const vector<size_t>& sampleIcs,
-			       size_t& childIdx,
-			       vector<Node>& children,
-			       SplitCache& splitCache) {
+struct Node::NodeStats::Accumulator {
+
+  NodeStats& stats;
+  const vector<size_t>& sampleIcs;
+  const vector<size_t>& sampleWeights;
+
+  Accumulator(NodeStats& s, const vector<size_t>& ics, const vector<size_t>& w): stats(s), sampleIcs(ics), sampleWeights(w) {}
+
+  template<typename Reader> void operator()(const Reader& target) {
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      size_t w = sampleWeights[ sampleIcs[i] ];
+      datadefs::acc_t x = target[ sampleIcs[i] ];
+      stats.n                += w;
+      stats.sum              += w * x;
+      stats.sumSq            += w * ( x - stats.shift ) * ( x - stats.shift );
+      stats.gammaDenominator += w * fabs(x) * ( 1.0 - fabs(x) );
+    }
+  }
+
+  void operator()(const Feature::CatReader& target) {
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      size_t w = sampleWeights[ sampleIcs[i] ];
+      stats.n += w;
+      stats.catFreq[ target[ sampleIcs[i] ] ] += w;
+    }
+  }
+
+};
+
+void Node::NodeStats::add(const Feature* target, const vector<size_t>& sampleIcs, const vector<size_t>& sampleWeights) {
+
+  Accumulator accumulator(*this,sampleIcs,sampleWeights);
+
+  if ( target->isNumerical() ) {
+    target->visitNumData(accumulator);
+  } else {
+    target->visitCatData(accumulator);
+  }
+
+}
+
+void Node::NodeStats::subtract(const NodeStats& other) {
+
+  assert( other.n <= n );
+  assert( other.shift == shift );
+
+  n                -= other.n;
+  sum              -= other.sum;
+  sumSq            -= other.sumSq;
+  gammaDenominator -= other.gammaDenominator;
+
+  for ( unordered_map<cat_t,size_t>::const_iterator it(other.catFreq.begin()); it != other.catFreq.end(); ++it ) {
+    unordered_map<cat_t,size_t>::iterator jt( catFreq.find(it->first) );
+    assert( jt != catFreq.end() && jt->second >= it->second );
+    jt->second -= it->second;
+    if ( jt->second == 0 ) {
+      catFreq.erase(jt);
+    }
+  }
+
+}
+
+bool Node::NodeStats::isPure() const {
+
+  if ( catFreq.size() > 0 ) {
+    return( catFreq.size() == 1 );
+  }
+
+  // Squared error below the resolution of num_t at the mean of the node, allowing for the rounding of
+  // the sums of squares around the shift, which may lie far from the node
+  datadefs::acc_t sumShifted = sum - n * shift;
+  datadefs::acc_t resolution = numeric_limits<num_t>::epsilon() * fabs(sum / n);
+  return( sumSq - sumShifted * sumShifted / n <= n * resolution * resolution + numeric_limits<datadefs::acc_t>::epsilon() * sumSq );
+
+}
+
+// Tests the candidate features in splitCache.featureSampleIcs and keeps the best split in splitCache
+template<typename DataT>
+void Node::findBestSplit(DataT* treeData,
+			 const Feature* target,
+			 const size_t targetIdx,
+			 const ForestOptions* forestOptions,
+			 distributions::Random* random,
+			 const vector<size_t>& sampleIcs,
+			 const vector<size_t>& sampleWeights,
+			 SplitCache& splitCache,
+			 const profiler::Path& profilePath) {
+
+  profiler::ScopedAttach attach(profilePath);
+
+  WorkCounters workCountersBefore = WorkCounters::local();
   
   // This many features will be tested for splitting the data
   size_t nFeaturesForSplit = splitCache.featureSampleIcs.size();
@@ -496,9 +689,10 @@ bool Node::regularSplitterSeek(TreeData* treeData,
 
     if ( newSplitFeature->isNumerical() ) {
 
-      splitCache.newSplitFitness = treeData->numericalFeatureSplit(targetIdx,
+      splitCache.newSplitFitness = treeData->numericalFeatureSplit(target,
 								   splitCache.newSplitFeatureIdx,
 								   forestOptions->nodeSize,
+								   sampleWeights,
 								   splitCache.newSampleIcs_left,
 								   splitCache.newSampleIcs_right,
 								   splitCache.newSplitValue);
@@ -506,9 +700,11 @@ bool Node::regularSplitterSeek(TreeData* treeData,
     } else if ( newSplitFeature->isCategorical() ) {
       
       unordered_set<cat_t> uniqueCats(sampleIcs.size());
+
+      const vector<cat_t>& catData = newSplitFeature->catData;
       
       for ( size_t i = 0; i < splitCache.newSampleIcs_right.size(); ++i ) {
-	uniqueCats.insert(treeData->feature(splitCache.newSplitFeatureIdx)->getCatData(splitCache.newSampleIcs_right[i]));
+	uniqueCats.insert(catData[ splitCache.newSampleIcs_right[i] ]);
       }
       
       vector<cat_t> catOrder(uniqueCats.size());
@@ -520,10 +716,11 @@ bool Node::regularSplitterSeek(TreeData* treeData,
       
       utils::permute(catOrder,random);
       
-      splitCache.newSplitFitness = treeData->categoricalFeatureSplit(targetIdx,
+      splitCache.newSplitFitness = treeData->categoricalFeatureSplit(target,
 								     splitCache.newSplitFeatureIdx,
 								     catOrder,
 								     forestOptions->nodeSize,
+								     sampleWeights,
 								     splitCache.newSampleIcs_left,
 								     splitCache.newSampleIcs_right,
 								     splitCache.newSplitValues_left);
@@ -536,18 +733,19 @@ bool Node::regularSplitterSeek(TreeData* treeData,
       // Choose random hash from the randomly selected sample
       splitCache.newHashIdx = newSplitFeature->getHash(sampleIdx,random->integer());
 
-      splitCache.newSplitFitness = treeData->textualFeatureSplit(targetIdx,
+      splitCache.newSplitFitness = treeData->textualFeatureSplit(target,
 								 splitCache.newSplitFeatureIdx,
 								 splitCache.newHashIdx,
 								 forestOptions->nodeSize,
+								 sampleWeights,
 								 splitCache.newSampleIcs_left,
 								 splitCache.newSampleIcs_right);
 
     }
 
     if( splitCache.newSplitFitness > splitCache.splitFitness &&
-	splitCache.newSampleIcs_left.size() >= forestOptions->nodeSize &&
-	splitCache.newSampleIcs_right.size() >= forestOptions->nodeSize ) {
+	weightedSize(splitCache.newSampleIcs_left,sampleWeights) >= forestOptions->nodeSize &&
+	weightedSize(splitCache.newSampleIcs_right,sampleWeights) >= forestOptions->nodeSize ) {
       
       splitCache.splitFitness      = splitCache.newSplitFitness;
       splitCache.splitFeatureIdx   = splitCache.newSplitFeatureIdx;
@@ -560,37 +758,205 @@ bool Node::regularSplitterSeek(TreeData* treeData,
     }    
 
   }
-  
+
+  splitCache.workCounters = WorkCounters::local() - workCountersBefore;
+
+}
+
+template<typename DataT>
+bool Node::regularSplitterSeek(DataT* treeData,
+			       const Feature* target,
+			       const size_t targetIdx,
+			       const ForestOptions* forestOptions,
+			       distributions::Random* random,
+			       const vector<size_t>& sampleIcs,
+			       const vector<size_t>& sampleWeights,
+			       const size_t nodeIdx,
+			       TreeArena& arena,
+			       SplitCache& splitCache) {
+
+#ifndef NOTHREADS
+  size_t nFeaturesForSplit = splitCache.featureSampleIcs.size();
+  size_t nThreads = splitCache.splitPool ? min(splitCache.splitPool->nWorkers(), nFeaturesForSplit) : 1;
+
+  if ( nThreads > 1 && splitCache.nSamples * nFeaturesForSplit >= MIN_PARALLEL_SPLIT_WORK ) {
+
+    // Candidate features are divided among the threads, each with a scratch cache of its own and 
+    // a random stream seeded from the tree's, so the outcome does not depend on scheduling
+    vector<vector<size_t> > candidateIcs = utils::splitRange(nFeaturesForSplit, nThreads);
+    vector<SplitCache> threadCaches(nThreads);
+    vector<distributions::Random> threadRandoms;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      threadCaches[threadIdx].nSamples = splitCache.nSamples;
+      for ( size_t i = 0; i < candidateIcs[threadIdx].size(); ++i ) {
+	threadCaches[threadIdx].featureSampleIcs.push_back( splitCache.featureSampleIcs[ candidateIcs[threadIdx][i] ] );
+      }
+      threadRandoms.push_back( distributions::Random(random->integer()) );
+    }
+
+    profiler::Path profilePath = profiler::currentPath();
+
+    vector<function<void()> > tasks;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      tasks.push_back(bind(&Node::findBestSplit<DataT>,
+			   treeData,
+			   target,
+			   targetIdx,
+			   forestOptions,
+			   &threadRandoms[threadIdx],
+			   cref(sampleIcs),
+			   cref(sampleWeights),
+			   ref(threadCaches[threadIdx]),
+			   cref(profilePath)));
+    }
+
+    splitCache.splitPool->run(tasks);
+
+    if ( memreport::isEnabled ) {
+      size_t threadCacheBytes = 0;
+      for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+	threadCacheBytes += threadCaches[threadIdx].heapBytes();
+      }
+      splitCache.peakThreadCacheBytes = max(splitCache.peakThreadCacheBytes,threadCacheBytes);
+    }
+
+    // Reduce in thread order; strict comparison keeps the first best candidate, as in the serial scan
+    splitCache.splitFitness = 0.0;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      SplitCache& threadCache = threadCaches[threadIdx];
+      WorkCounters::local() += threadCache.workCounters;
+      if ( threadCache.splitFitness > splitCache.splitFitness ) {
+	splitCache.splitFitness      = threadCache.splitFitness;
+	splitCache.splitFeatureIdx   = threadCache.splitFeatureIdx;
+	splitCache.splitValue        = threadCache.splitValue;
+	splitCache.splitValues_left  = threadCache.splitValues_left;
+	splitCache.hashIdx           = threadCache.hashIdx;
+	splitCache.sampleIcs_left    = threadCache.sampleIcs_left;
+	splitCache.sampleIcs_right   = threadCache.sampleIcs_right;
+	splitCache.sampleIcs_missing = threadCache.sampleIcs_missing;
+      }
+    }
+
+  } else 
+#endif
+  {
+    Node::findBestSplit(treeData,target,targetIdx,forestOptions,random,sampleIcs,sampleWeights,splitCache);
+  }
+
   // If none of the splitter candidates worked as a splitter
   if ( fabs(splitCache.splitFitness) < datadefs::EPS ) {
+    ++WorkCounters::local().rejectedSplits;
     return(false);
   } 
 
   const Feature* splitFeature = treeData->feature(splitCache.splitFeatureIdx);
 
+  // Children are appended to the arena on demand
+  size_t leftIdx = arena.addNode();
+  size_t rightIdx = arena.addNode();
+  size_t missingIdx = datadefs::MAX_IDX;
+
+  if ( ! forestOptions->noNABranching && splitCache.sampleIcs_missing.size() > 0 ) { 
+    missingIdx = arena.addNode();
+  }
+
+  TrainNode& node = arena.nodes[nodeIdx];
+
+  node.fitness = splitCache.splitFitness;
+  node.splitFeatureIdx = splitCache.splitFeatureIdx;
+  node.leftIdx = leftIdx;
+  node.rightIdx = rightIdx;
+  node.missingIdx = missingIdx;
+
   if ( splitFeature->isNumerical() ) {
 
-    this->setSplitter(splitCache.splitFitness,splitFeature->name(),splitCache.splitValue,children[childIdx],children[childIdx+1]);
+    node.splitterType = Feature::Type::NUM;
+    node.leftLeqValue = splitCache.splitValue;
 
   } else if ( splitFeature->isCategorical() ) {
     
-    this->setSplitter(splitCache.splitFitness,splitFeature->name(),splitCache.splitValues_left,children[childIdx],children[childIdx+1]);
+    node.splitterType = Feature::Type::CAT;
+    node.leftValuesIdx = arena.leftValues.size();
+    arena.leftValues.push_back(splitCache.splitValues_left);
 
   } else if ( splitFeature->isTextual() ) {
     
-    this->setSplitter(splitCache.splitFitness,splitFeature->name(),splitCache.hashIdx,children[childIdx],children[childIdx+1]);
+    node.splitterType = Feature::Type::TXT;
+    node.hashValue = splitCache.hashIdx;
 
   }
 
-  childIdx += 2;
+  return(true);
+
+}
+
+void Node::setFromArena(TreeData* treeData, TreeArena& arena, const size_t nodeIdx, vector<Node>& children) {
 
-  if ( ! forestOptions->noNABranching && splitCache.sampleIcs_missing.size() > 0 && childIdx < children.size() ) { 
-    missingChild_ = &children[childIdx++];
+  const TrainNode& node = arena.nodes[nodeIdx];
+
+  // The leaf training data are moved out of the arena, so that the tree never holds them twice
+  if ( node.catTrainPredictionIdx != datadefs::MAX_IDX ) {
+    this->setCatTrainPrediction( arena.catPredictions[node.catTrainPredictionIdx] );
+    if ( node.trainDataIdx != datadefs::MAX_IDX ) {
+      prediction_.catTrainData.swap( arena.catTrainData[node.trainDataIdx] );
+    }
+  } else {
+    this->setNumTrainPrediction( node.numTrainPrediction );
+    if ( node.trainDataIdx != datadefs::MAX_IDX ) {
+      prediction_.numTrainData.swap( arena.numTrainData[node.trainDataIdx] );
+    }
   }
 
-  return(true);
+  if ( node.leftIdx == datadefs::MAX_IDX ) {
+    return;
+  }
+
+  // Arena index 0 is the root node itself, so the children are offset by one
+  Node& leftChild = children[node.leftIdx - 1];
+  Node& rightChild = children[node.rightIdx - 1];
+  const string& splitterName = treeData->feature(node.splitFeatureIdx)->name();
+
+  if ( node.splitterType == Feature::Type::NUM ) {
+    this->setSplitter(node.fitness,splitterName,node.leftLeqValue,leftChild,rightChild);
+  } else if ( node.splitterType == Feature::Type::CAT ) {
+    this->setSplitter(node.fitness,splitterName,arena.leftValues[node.leftValuesIdx],leftChild,rightChild);
+  } else {
+    this->setSplitter(node.fitness,splitterName,node.hashValue,leftChild,rightChild);
+  }
+
+  if ( node.missingIdx != datadefs::MAX_IDX ) {
+    this->setMissingChild(children[node.missingIdx - 1]);
+  }
 
 }
 
+void Node::memoryUsage(memreport::Breakdown& breakdown) const {
 
-  
+  memreport::add(breakdown, "splitter names and category sets", memreport::heapBytes(splitter_.name) + memreport::heapBytes(splitter_.leftValues));
+
+  memreport::add(breakdown, "leaf data", memreport::heapBytes(prediction_.catTrainPrediction) + 
+		 memreport::heapBytes(prediction_.numTrainData) + memreport::heapBytes(prediction_.catTrainData));
+
+}
+
+size_t Node::SplitCache::heapBytes() const {
+  return( memreport::heapBytes(featureSampleIcs) + 
+	  memreport::heapBytes(sampleIcs_left) + memreport::heapBytes(sampleIcs_right) + memreport::heapBytes(sampleIcs_missing) + 
+	  memreport::heapBytes(newSampleIcs_left) + memreport::heapBytes(newSampleIcs_right) + memreport::heapBytes(newSampleIcs_missing) );
+}
+
+// Instances of percolation for callers that resolve the data class themselves
+template Node* Node::percolateData<TreeData>(TreeData*,const size_t,const size_t,const size_t,vector<size_t>*);
+template Node* Node::percolateData<DenseTreeData>(DenseTreeData*,const size_t,const size_t,const size_t,vector<size_t>*);
+
+// Instances of growth for RootNode::growTree()
+template void Node::recursiveNodeSplit<TreeData>(TreeData*,const Feature*,const size_t,const ForestOptions*,distributions::Random*,
+						 const PredictionFunctionType&,const distributions::PMF*,const vector<size_t>&,
+						 const vector<size_t>&,const NodeStats&,size_t*,const size_t,TreeArena&,SplitCache&);
+
+template void Node::recursiveNodeSplit<DenseTreeData>(DenseTreeData*,const Feature*,const size_t,const ForestOptions*,distributions::Random*,
+						      const PredictionFunctionType&,const distributions::PMF*,const vector<size_t>&,
+						      const vector<size_t>&,const NodeStats&,size_t*,const size_t,TreeArena&,SplitCache&);
@@ -10,12 +10,18 @@
 #include <map>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <string>
 #include "datadefs.hpp"
 #include "treedata.hpp"
 #include "options.hpp"
 #include "utils.hpp"
 #include "distributions.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "workcounters.hpp"
+#include "memreport.hpp"
+#include "workerpool.hpp"
 
 using namespace std;
 using datadefs::num_t;
@@ -75,7 +81,23 @@ public:
   void setMissingChild(Node& missingChild);
   
   //Given a value, descends to either one of the child nodes, if existing, otherwise returns a pointer to the current node
-  Node* percolate(TreeData* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx = datadefs::MAX_IDX);
+  //If scrambleSampleIdx is given, the value of feature scrambleFeatureIdx is taken from that sample instead
+  Node* percolate(TreeData* testData, 
+		  const size_t sampleIdx, 
+		  const size_t scrambleFeatureIdx = datadefs::MAX_IDX, 
+		  const size_t scrambleSampleIdx = datadefs::MAX_IDX);
+
+  //Same as above, but also collects the indices of the features split on along the path
+  Node* percolate(TreeData* testData, const size_t sampleIdx, vector<size_t>& pathFeatureIcs);
+
+  // Percolation is templated over the data class as growth is. percolate() resolves the class on every
+  // call; callers that percolate many samples resolve it once and call this for TreeData or DenseTreeData
+  template<typename DataT>
+  Node* percolateData(DataT* testData,
+		      const size_t sampleIdx,
+		      const size_t scrambleFeatureIdx = datadefs::MAX_IDX,
+		      const size_t scrambleSampleIdx = datadefs::MAX_IDX,
+		      vector<size_t>* pathFeatureIcs = NULL);
   
   void setNumTrainPrediction(const num_t& numTrainPrediction);
   void setCatTrainPrediction(const cat_t& catTrainPrediction);
@@ -98,8 +120,70 @@ public:
 
   void recursiveWriteTree(string& traversal, ofstream& toFile);
 
+  // Heap bytes held by the splitter names and category sets, and by the leaf data of the node
+  void memoryUsage(memreport::Breakdown& breakdown) const;
+
   enum PredictionFunctionType { MEAN, MODE, GAMMA };
 
+  // Compact training-time record of a node. Trees are grown into a TreeArena of these, and
+  // the full Node objects are allocated only once the final size of the tree is known
+  struct TrainNode {
+
+    size_t leftIdx;
+    size_t rightIdx;
+    size_t missingIdx;
+
+    size_t splitFeatureIdx;
+    Feature::Type splitterType;
+    num_t fitness;
+    num_t leftLeqValue;
+    uint32_t hashValue;
+    size_t leftValuesIdx;
+
+    num_t numTrainPrediction;
+    size_t catTrainPredictionIdx;
+    size_t trainDataIdx;
+
+  };
+
+  // Per-tree arena of training nodes, grown on demand. Variable-size payloads live in side pools
+  // and are referred to by index from TrainNode; arena index 0 is the root
+  struct TreeArena {
+
+    vector<TrainNode> nodes;
+
+    vector<unordered_set<cat_t> > leftValues;
+    vector<cat_t> catPredictions;
+    vector<vector<num_t> > numTrainData;
+    vector<vector<cat_t> > catTrainData;
+
+    // If sized to the number of samples, records the leaf each in-bag sample ends up in
+    vector<size_t> sampleLeafIdx;
+
+    size_t addNode() {
+      TrainNode node;
+      node.leftIdx = datadefs::MAX_IDX;
+      node.rightIdx = datadefs::MAX_IDX;
+      node.missingIdx = datadefs::MAX_IDX;
+      node.splitFeatureIdx = datadefs::MAX_IDX;
+      node.splitterType = Feature::Type::UNKNOWN;
+      node.fitness = 0.0;
+      node.leftLeqValue = datadefs::NUM_NAN;
+      node.hashValue = 0;
+      node.leftValuesIdx = datadefs::MAX_IDX;
+      node.numTrainPrediction = datadefs::NUM_NAN;
+      node.catTrainPredictionIdx = datadefs::MAX_IDX;
+      node.trainDataIdx = datadefs::MAX_IDX;
+      nodes.push_back(node);
+      return( nodes.size() - 1 );
+    }
+
+  };
+
+  // Copies prediction and splitter of arena node nodeIdx and moves its leaf training data out of the
+  // arena; children[i] corresponds to arena node i+1
+  void setFromArena(TreeData* treeData, TreeArena& arena, const size_t nodeIdx, vector<Node>& children);
+
 #ifndef TEST__
 protected:
 #endif
@@ -127,32 +211,101 @@ protected:
     unordered_set<cat_t> newSplitValues_left;
     num_t newSplitFitness;
 
+    // Work done by findBestSplit, so that a worker thread can hand it over to the node's thread
+    WorkCounters workCounters;
+
+    // Workers of the split search, shared by all nodes of the tree; without a pool the search is serial
+    WorkerPool* splitPool;
+
+    // Largest heap bytes held at once by the scratch caches of the split threads, over the nodes so far.
+    // Only tracked while memreport is enabled
+    size_t peakThreadCacheBytes;
+
+    SplitCache(): splitPool(NULL),peakThreadCacheBytes(0) {}
+
+    // Heap bytes of the sample index buffers
+    size_t heapBytes() const;
+
   };
 
-  void recursiveNodeSplit(TreeData* treeData,
-                          const size_t targetIdx,
-			  const ForestOptions* forestOptions,
-			  distributions::Random* random,
-			  const PredictionFunctionType& predictionFunctionType,
-			  const distributions::PMF* pmf,
-			  const vector<size_t>& sampleIcs,
-                          size_t* nLeaves,
-			  size_t& childIdx,
-			  vector<Node>& children,
-			  SplitCache& splitCache);
-
-  bool regularSplitterSeek(TreeData* treeData,
-			   const size_t targetIdx,
-			   const ForestOptions* forestOptions,
-			   distributions::Random* random,
-			   const vector<size_t>& sampleIcs,
-			   size_t& childIdx,
-			   vector<Node>& children,
-			   SplitCache& splitCache);
+  // Target statistics of a node, weighted by the bootstrap multiplicities. The statistics 
+  // are additive, so a child's statistics are the parent's minus those of its siblings
+  struct NodeStats {
+
+    size_t n;
+    datadefs::acc_t sum;
+    datadefs::acc_t gammaDenominator;
+    unordered_map<cat_t,size_t> catFreq;
+
+    // Squares are summed around shift, a value of the target shared by all nodes of a tree, so that
+    // the spread of a node does not cancel against the offset of the target
+    datadefs::acc_t shift;
+    datadefs::acc_t sumSq;
 
+    explicit NodeStats(const datadefs::acc_t s = 0.0): n(0),sum(0.0),gammaDenominator(0.0),shift(s),sumSq(0.0) {}
+
+    // Visitor of the target data that does the adding, see Feature::visitNumData()
+    struct Accumulator;
+
+    void add(const Feature* target, const vector<size_t>& sampleIcs, const vector<size_t>& sampleWeights);
+    void subtract(const NodeStats& other);
+
+    // A pure node cannot be split with positive fitness
+    bool isPure() const;
+
+  };
+
+  // The growth functions are templates over the data class, so that the accessors of DenseTreeData, which
+  // are final, are called directly. They are compiled for DenseTreeData and, through the virtual interface,
+  // for TreeData; RootNode::growTree() picks one per tree
+  template<typename DataT>
+  static void recursiveNodeSplit(DataT* treeData,
+				 const Feature* target,
+				 const size_t targetIdx,
+				 const ForestOptions* forestOptions,
+				 distributions::Random* random,
+				 const PredictionFunctionType& predictionFunctionType,
+				 const distributions::PMF* pmf,
+				 const vector<size_t>& sampleIcs,
+				 const vector<size_t>& sampleWeights,
+				 const NodeStats& stats,
+				 size_t* nLeaves,
+				 const size_t nodeIdx,
+				 TreeArena& arena,
+				 SplitCache& splitCache);
+
+  template<typename DataT>
+  static bool regularSplitterSeek(DataT* treeData,
+				  const Feature* target,
+				  const size_t targetIdx,
+				  const ForestOptions* forestOptions,
+				  distributions::Random* random,
+				  const vector<size_t>& sampleIcs,
+				  const vector<size_t>& sampleWeights,
+				  const size_t nodeIdx,
+				  TreeArena& arena,
+				  SplitCache& splitCache);
+
+  template<typename DataT>
+  static void findBestSplit(DataT* treeData,
+			    const Feature* target,
+			    const size_t targetIdx,
+			    const ForestOptions* forestOptions,
+			    distributions::Random* random,
+			    const vector<size_t>& sampleIcs,
+			    const vector<size_t>& sampleWeights,
+			    SplitCache& splitCache,
+			    const profiler::Path& profilePath = profiler::Path());
 
   void recursiveGetSubTreeLeaves(vector<Node*>& leaves);
 
+  template<typename DataT>
+  Node* descend(DataT* testData, 
+		const size_t sampleIdx, 
+		const size_t scrambleFeatureIdx, 
+		const size_t scrambleSampleIdx, 
+		size_t* splitFeatureIdx);
+
 #ifndef TEST__
 private:
 #endif
@@ -73,11 +73,19 @@ public:
   vector<num_t> quantiles; const string quantiles_s; const string quantiles_l;
   size_t nSamplesForQuantiles; const string nSamplesForQuantiles_s; const string nSamplesForQuantiles_l;
   bool distributions; const string distributions_s; const string distributions_l; 
+  bool warmStart; const string warmStart_s; const string warmStart_l;
+  num_t convergenceTolerance; const string convergenceTolerance_s; const string convergenceTolerance_l;
+  size_t treeBatchSize; const string treeBatchSize_s; const string treeBatchSize_l;
+  string convergenceCriterion; const string convergenceCriterion_s; const string convergenceCriterion_l;
+  num_t timeBudget; const string timeBudget_s; const string timeBudget_l;
 
   num_t inBoxFraction;
   bool sampleWithReplacement;
   bool isRandomSplit;
   bool useContrasts;
+
+  // Number of threads a single node may use to search for its splitter (not a command line option)
+  size_t nSplitThreads;
   
   ForestOptions(const forest_t ft):
     forestType(ft), forestType_s("f"), forestType_l("forestType"),
@@ -90,7 +98,13 @@ public:
     noNABranching(false),noNABranching_s("N"), noNABranching_l("noNABranching"),
     quantiles_s("q"), quantiles_l("quantiles"),
     nSamplesForQuantiles_s("r"), nSamplesForQuantiles_l("qSamples"),
-    distributions(false), distributions_s("d"), distributions_l("distributions") {
+    distributions(false), distributions_s("d"), distributions_l("distributions"),
+    warmStart(false), warmStart_s("K"), warmStart_l("warmStart"),
+    convergenceTolerance(datadefs::SF_DEFAULT_CONVERGENCE_TOLERANCE), convergenceTolerance_s("E"), convergenceTolerance_l("convergenceTol"),
+    treeBatchSize(datadefs::SF_DEFAULT_TREE_BATCH_SIZE), treeBatchSize_s("b"), treeBatchSize_l("treeBatch"),
+    convergenceCriterion(datadefs::SF_DEFAULT_CONVERGENCE_CRITERION), convergenceCriterion_s("C"), convergenceCriterion_l("convergeOn"),
+    timeBudget(datadefs::SF_DEFAULT_TIME_BUDGET), timeBudget_s("u"), timeBudget_l("timeBudget"),
+    nSplitThreads(1) {
     
     forestType = forest_t::QRF;
 
@@ -117,7 +131,12 @@ public:
     if ( isSet ) {
       string forestTypeAsStr = "";
       parser.getArgument<string>(forestType_s, forestType_l, forestTypeAsStr);
-      //forestType = datadefs::forestTypeAssign.at(forestTypeAsStr);
+      map<string,forest_t>::const_iterator it( datadefs::forestTypeAssign.find(forestTypeAsStr) );
+      if ( it == datadefs::forestTypeAssign.end() ) {
+	cerr << "GeneralOptions::load() -- unknown forest type: " << forestTypeAsStr << endl;
+	exit(1);
+      }
+      forestType = it->second;
       if ( forestType == forest_t::RF ) {
 	this->setRFDefaults();
       } else if ( forestType == forest_t::QRF ) {
@@ -138,6 +157,11 @@ public:
     parser.getArgument<num_t>(  contrastFraction_s, contrastFraction_l, contrastFraction );
     parser.getFlag(             noNABranching_s,    noNABranching_l,    noNABranching );
     parser.getFlag(             distributions_s,    distributions_l,    distributions);
+    parser.getFlag(             warmStart_s,        warmStart_l,        warmStart );
+    parser.getArgument<num_t>(  convergenceTolerance_s, convergenceTolerance_l, convergenceTolerance );
+    parser.getArgument<size_t>( treeBatchSize_s,    treeBatchSize_l,    treeBatchSize );
+    parser.getArgument<string>( convergenceCriterion_s, convergenceCriterion_l, convergenceCriterion );
+    parser.getArgument<num_t>(  timeBudget_s,       timeBudget_l,       timeBudget );
 
     string quantilesAsStr;
     parser.getArgument<string>( quantiles_s,        quantiles_l,        quantilesAsStr );
@@ -237,6 +261,36 @@ public:
       exit(1);
     }
 
+    if ( convergenceTolerance < 0.0 ) {
+      cerr << "ERROR: convergenceTol must be non-negative!" << endl;
+      exit(1);
+    }
+
+    if ( convergenceTolerance > 0.0 && treeBatchSize == 0 ) {
+      cerr << "ERROR: treeBatch must be set for convergence mode!" << endl;
+      exit(1);
+    }
+
+    if ( timeBudget < 0.0 ) {
+      cerr << "ERROR: timeBudget must be non-negative!" << endl;
+      exit(1);
+    }
+
+    if ( forestType == forest_t::GBT && timeBudget > 0.0 ) {
+      cerr << "ERROR: time budget is not available for GBT" << endl;
+      exit(1);
+    }
+
+    if ( convergenceCriterion != "oob" && convergenceCriterion != "mdi" ) {
+      cerr << "ERROR: convergeOn must be either 'oob' or 'mdi'" << endl;
+      exit(1);
+    }
+
+    if ( forestType == forest_t::GBT && ( warmStart || convergenceTolerance > 0.0 ) ) {
+      cerr << "ERROR: warm start and convergence mode are not available for GBT" << endl;
+      exit(1);
+    }
+
     if ( forestType == forest_t::QRF ) {
       for ( size_t i = 0; i < quantiles.size(); ++i ) {
 	if ( 0.0 >= quantiles[i] || quantiles[i] > 1.0 ) {
@@ -265,6 +319,11 @@ public:
     this->printHelpLine(quantiles_s,quantiles_l,"[QRF] comma-separated list of quantiles to build a Quantile Random Forest from");
     this->printHelpLine(nSamplesForQuantiles_s,nSamplesForQuantiles_l,"[QRF] specify the number of samples per tree for calculating the quantiles");
     this->printHelpLine(distributions_s,distributions_l,"[QRF] If set, distributions will be output in the prediction file");
+    this->printHelpLine(warmStart_s,warmStart_l,"[RF+QRF] If set, new trees are added to the loaded forest instead of replacing it");
+    this->printHelpLine(convergenceTolerance_s,convergenceTolerance_l,"[RF+QRF] If > 0, trees are grown in batches until the convergence criterion changes less than this; nTrees is then the maximum");
+    this->printHelpLine(treeBatchSize_s,treeBatchSize_l,"[RF+QRF] Number of trees grown per batch in convergence mode");
+    this->printHelpLine(convergenceCriterion_s,convergenceCriterion_l,"[RF+QRF] Convergence criterion: 'oob' (relative change in OOB error) or 'mdi' (1 - rank correlation of MDI)");
+    this->printHelpLine(timeBudget_s,timeBudget_l,"[RF+QRF] Wall-clock budget in seconds for training or filtering; growth stops when it is nearly spent (0 = no limit)");
   }
 
   void print() {
@@ -295,6 +354,15 @@ public:
       exit(1);
     }
     this->printOption(noNABranching_s,noNABranching_l,noNABranching);
+    if ( forestType != forest_t::GBT ) {
+      this->printOption(warmStart_s,warmStart_l,warmStart);
+      this->printOption(convergenceTolerance_s,convergenceTolerance_l,convergenceTolerance);
+      if ( convergenceTolerance > 0.0 ) {
+	this->printOption(treeBatchSize_s,treeBatchSize_l,treeBatchSize);
+	this->printOption(convergenceCriterion_s,convergenceCriterion_l,convergenceCriterion);
+      }
+      this->printOption(timeBudget_s,timeBudget_l,timeBudget);
+    }
     cout << endl;
   }
    
@@ -306,6 +374,7 @@ public:
   // Statistical test related parameters
   size_t nPerms; const string nPerms_s; const string nPerms_l;
   num_t pValueThreshold; const string pValueThreshold_s; const string pValueThreshold_l;
+  bool permutationImportance; const string permutationImportance_s; const string permutationImportance_l;
   //bool isAdjustedPValue; const string isAdjustedPValue_s; const string isAdjustedPValue_l;
   //bool normalizeImportanceValues; const string normalizeImportanceValues_s; const string normalizeImportanceValues_l;
   //num_t importanceThreshold; const string importanceThreshold_s; const string importanceThreshold_l;
@@ -313,7 +382,8 @@ public:
 
   FilterOptions():
     nPerms(datadefs::FILTER_DEFAULT_N_PERMS),nPerms_s("p"),nPerms_l("nPerms"),
-    pValueThreshold(datadefs::FILTER_DEFAULT_P_VALUE_THRESHOLD),pValueThreshold_s("t"),pValueThreshold_l("pValueTh") {}
+    pValueThreshold(datadefs::FILTER_DEFAULT_P_VALUE_THRESHOLD),pValueThreshold_s("t"),pValueThreshold_l("pValueTh"),
+    permutationImportance(datadefs::FILTER_DEFAULT_PERMUTATION_IMPORTANCE),permutationImportance_s("O"),permutationImportance_l("permImportance") {}
     //isAdjustedPValue(datadefs::FILTER_DEFAULT_IS_ADJUSTED_P_VALUE),isAdjustedPValue_s("d"),isAdjustedPValue_l("adjustP"),
     //normalizeImportanceValues(datadefs::FILTER_NORMALIZE_IMPORTANCE_VALUES),normalizeImportanceValues_s("r"),normalizeImportanceValues_l("normImportance"),
     //importanceThreshold(datadefs::FILTER_DEFAULT_IMPORTANCE_THRESHOLD),importanceThreshold_s("o"),importanceThreshold_l("importanceTh") {}
@@ -325,6 +395,7 @@ public:
     ArgParse parser(argc,argv);
     parser.getArgument<size_t>(nPerms_s,nPerms_l,nPerms);
     parser.getArgument<num_t>(pValueThreshold_s,pValueThreshold_l,pValueThreshold);
+    parser.getFlag(permutationImportance_s,permutationImportance_l,permutationImportance);
     //parser.getArgument<bool>(isAdjustedPValue_s,isAdjustedPValue_l,isAdjustedPValue);
     //parser.getArgument<num_t>(importanceThreshold_s,importanceThreshold_l,importanceThreshold);
     //parser.getArgument<bool>(normalizeImportanceValues_s,normalizeImportanceValues_l,normalizeImportanceValues);
@@ -340,6 +411,7 @@ public:
     cout << "Filter Options:" << endl;
     this->printHelpLine(nPerms_s,nPerms_l,"Number of permutations in statistical test");
     this->printHelpLine(pValueThreshold_s,pValueThreshold_l,"P-value threshold in statistical test");
+    this->printHelpLine(permutationImportance_s,permutationImportance_l,"If set, features are scored by OOB permutation importance instead of mean decrease in impurity");
     //this->printHelpLine(isAdjustedPValue_s,isAdjustedPValue_l,"Flag to turn ON Benjamini-Hochberg multiple testing correction");
     //this->printHelpLine(importanceThreshold_s,importanceThreshold_l,"Importance threshold");
     //this->printHelpLine(normalizeImportanceValues_s,normalizeImportanceValues_l,"Flag to turn ON normalization of importance scores");
@@ -350,6 +422,7 @@ public:
     cout << "Filter options:" << endl;
     this->printOption(nPerms_s,nPerms_l,nPerms);
     this->printOption(pValueThreshold_s,pValueThreshold_l,pValueThreshold);
+    this->printOption(permutationImportance_s,permutationImportance_l,permutationImportance);
     cout << endl;
     //cout << "isAdjustedPValue = " << isAdjustedPValue << endl;
     //cout << "normalizeImportanceValues = " << normalizeImportanceValues << endl;
@@ -371,9 +444,12 @@ public:
   string predictionsFile; const string predictionsFile_s; const string predictionsFile_l;
   string pairInteractionsFile; const string pairInteractionsFile_s; const string pairInteractionsFile_l;
   string logFile; const string logFile_s; const string logFile_l;
+  string profileFile; const string profileFile_s; const string profileFile_l;
+  string traceFile; const string traceFile_s; const string traceFile_l;
   string featureWeightsFile; const string featureWeightsFile_s; const string featureWeightsFile_l;
   string whiteListFile; const string whiteListFile_s; const string whiteListFile_l;
   string blackListFile; const string blackListFile_s; const string blackListFile_l;
+  string saveBinaryFile; const string saveBinaryFile_s; const string saveBinaryFile_l;
 
   bool trainStream; const string trainStream_s; const string trainStream_l;
   
@@ -387,9 +463,12 @@ public:
     predictionsFile_s("P"), predictionsFile_l("predictions"),
     pairInteractionsFile_s("R"), pairInteractionsFile_l("pairInteractions"),
     logFile_s("G"), logFile_l("log"),
+    profileFile_s("J"), profileFile_l("profileJSON"),
+    traceFile_s("Z"), traceFile_l("trace"),
     featureWeightsFile_s("w"), featureWeightsFile_l("featureWeights"),
     whiteListFile_s("W"), whiteListFile_l("whiteList"),
     blackListFile_s("B"), blackListFile_l("blackList"),
+    saveBinaryFile_s("x"), saveBinaryFile_l("saveBinary"),
     trainStream(false), trainStream_s("S"), trainStream_l("trainStream") {}
 
   ~IO() {}
@@ -405,28 +484,34 @@ public:
     parser.getArgument<string>(predictionsFile_s,predictionsFile_l,predictionsFile);
     parser.getArgument<string>(pairInteractionsFile_s,pairInteractionsFile_l,pairInteractionsFile);
     parser.getArgument<string>(logFile_s,logFile_l,logFile);
+    parser.getArgument<string>(profileFile_s,profileFile_l,profileFile);
+    parser.getArgument<string>(traceFile_s,traceFile_l,traceFile);
     parser.getArgument<string>(featureWeightsFile_s,featureWeightsFile_l,featureWeightsFile);
     parser.getArgument<string>(whiteListFile_s,whiteListFile_l,whiteListFile);
     parser.getArgument<string>(blackListFile_s,blackListFile_l,blackListFile);
+    parser.getArgument<string>(saveBinaryFile_s,saveBinaryFile_l,saveBinaryFile);
 
     parser.getFlag(trainStream_s,trainStream_l,trainStream);
   }
 
   void help() {
     cout << "File Options:" << endl;
-    this->printHelpLine(filterDataFile_s,filterDataFile_l,"Load data file (.afm or .arff) for feature selection");
-    this->printHelpLine(trainDataFile_s,trainDataFile_l,"Load data file (.afm or .arff) for training a model");
+    this->printHelpLine(filterDataFile_s,filterDataFile_l,"Load data file (.afm, .arff, sparse .libsvm, or memory-mapped .rfb) for feature selection");
+    this->printHelpLine(trainDataFile_s,trainDataFile_l,"Load data file (.afm, .arff, sparse .libsvm, or memory-mapped .rfb) for training a model");
     this->printHelpLine(trainStream_s,trainStream_l,"Read data in a serial format from stream");
     this->printHelpLine(featureWeightsFile_s,featureWeightsFile_l,"Load feature weights from file");
     this->printHelpLine(whiteListFile_s,whiteListFile_l,"Load white list from file");
     this->printHelpLine(blackListFile_s,blackListFile_l,"Load black list from file");
-    this->printHelpLine(testDataFile_s,testDataFile_l,"Load data file (.afm or .arff) for testing a model");
+    this->printHelpLine(testDataFile_s,testDataFile_l,"Load data file (.afm, .arff, sparse .libsvm, or memory-mapped .rfb) for testing a model");
+    this->printHelpLine(saveBinaryFile_s,saveBinaryFile_l,"Save the train or filter data to file (.rfb), to be read back memory-mapped; without a target the data is only converted");
     this->printHelpLine(loadForestFile_s,loadForestFile_l,"Load model from file (.sf)");
     this->printHelpLine(saveForestFile_s,saveForestFile_l,"Save model to file (.sf)");
     this->printHelpLine(associationsFile_s,associationsFile_l,"Save associations to file");
     this->printHelpLine(predictionsFile_s,predictionsFile_l,"Save predictions to file");
     this->printHelpLine(pairInteractionsFile_s,pairInteractionsFile_l,"Save pair interactions to file");
-    this->printHelpLine(logFile_s,logFile_l,"Save log to file");
+    this->printHelpLine(logFile_s,logFile_l,"Save statistics of every tree grown to file; JSON if the name ends with .json, TSV otherwise");
+    this->printHelpLine(profileFile_s,profileFile_l,"Save the time spent in each phase to file as JSON; implies --profile");
+    this->printHelpLine(traceFile_s,traceFile_l,"Save a per-thread timeline of trees, large nodes, permutations and I/O to file (Chrome trace-event JSON)");
   }
 
   void print() {
@@ -439,9 +524,12 @@ public:
     cout << "predictionsFile = " << predictionsFile << endl;
     cout << "pairInteractionsFile = " << pairInteractionsFile << endl;
     cout << "logFile = " << logFile << endl;
+    cout << "profileFile = " << profileFile << endl;
+    cout << "traceFile = " << traceFile << endl;
     cout << "featureWeightsFile = " << featureWeightsFile << endl;
     cout << "whiteListFile = " << whiteListFile << endl;
     cout << "blackListFile = " << blackListFile << endl;
+    cout << "saveBinaryFile = " << saveBinaryFile << endl;
   }
   
   void validate() {
@@ -473,6 +561,12 @@ public:
   size_t nThreads; const string nThreads_s; const string nThreads_l;
   bool isMaxThreads; const string isMaxThreads_s; const string isMaxThreads_l;
   num_t defaultFeatureWeight; const string defaultFeatureWeight_s; const string defaultFeatureWeight_l;  
+  bool profile; const string profile_s; const string profile_l;
+  size_t traceNodeSize; const string traceNodeSize_s; const string traceNodeSize_l;
+  bool stats; const string stats_s; const string stats_l;
+  bool perfCounters; const string perfCounters_s; const string perfCounters_l;
+  bool memReport; const string memReport_s; const string memReport_l;
+  bool quantize; const string quantize_s; const string quantize_l;
 
   GeneralOptions():
     printHelp(datadefs::GENERAL_DEFAULT_PRINT_HELP),printHelp_s("h"),printHelp_l("help"),
@@ -483,7 +577,13 @@ public:
     seed(datadefs::GENERAL_DEFAULT_SEED),seed_s("S"),seed_l("seed"),
     nThreads(datadefs::GENERAL_DEFAULT_N_THREADS),nThreads_s("e"),nThreads_l("nThreads"),
     isMaxThreads(datadefs::GENERAL_DEFAULT_IS_MAX_THREADS),isMaxThreads_s("R"),isMaxThreads_l("maxThreads"),
-    defaultFeatureWeight(datadefs::GENERAL_DEFAULT_FEATURE_WEIGHT),defaultFeatureWeight_s("d"),defaultFeatureWeight_l("defaultWeight") {}
+    defaultFeatureWeight(datadefs::GENERAL_DEFAULT_FEATURE_WEIGHT),defaultFeatureWeight_s("d"),defaultFeatureWeight_l("defaultWeight"),
+    profile(datadefs::GENERAL_DEFAULT_PROFILE),profile_s("Y"),profile_l("profile"),
+    traceNodeSize(datadefs::GENERAL_DEFAULT_TRACE_NODE_SIZE),traceNodeSize_s("z"),traceNodeSize_l("traceNodeSize"),
+    stats(datadefs::GENERAL_DEFAULT_STATS),stats_s("Q"),stats_l("stats"),
+    perfCounters(datadefs::GENERAL_DEFAULT_PERF_COUNTERS),perfCounters_s("U"),perfCounters_l("perfCounters"),
+    memReport(datadefs::GENERAL_DEFAULT_MEM_REPORT),memReport_s("M"),memReport_l("memReport"),
+    quantize(datadefs::GENERAL_DEFAULT_QUANTIZE),quantize_s("y"),quantize_l("quantize") {}
   ~GeneralOptions() {}
 
   void load(const int argc, char* const argv[]) {
@@ -507,6 +607,12 @@ public:
     parser.getArgument<int>(seed_s, seed_l, seed);
     parser.getArgument<size_t>(nThreads_s, nThreads_l, nThreads);
     parser.getFlag(isMaxThreads_s, isMaxThreads_l, isMaxThreads);
+    parser.getFlag(profile_s, profile_l, profile);
+    parser.getArgument<size_t>(traceNodeSize_s, traceNodeSize_l, traceNodeSize);
+    parser.getFlag(stats_s, stats_l, stats);
+    parser.getFlag(perfCounters_s, perfCounters_l, perfCounters);
+    parser.getFlag(memReport_s, memReport_l, memReport);
+    parser.getFlag(quantize_s, quantize_l, quantize);
   }
 
   void validate() {
@@ -528,6 +634,12 @@ public:
     this->printHelpLine(nThreads_s,nThreads_l,"Number of threads if using multithreading");
     this->printHelpLine(isMaxThreads_s,isMaxThreads_l,"Flag to make use of all available threads");
     this->printHelpLine(defaultFeatureWeight_s,defaultFeatureWeight_l,"Default feature weight, if using feature weighting");
+    this->printHelpLine(profile_s,profile_l,"If set, a breakdown of the time spent in each phase is printed at exit");
+    this->printHelpLine(traceNodeSize_s,traceNodeSize_l,"Smallest tree node, in samples, that is recorded when tracing");
+    this->printHelpLine(stats_s,stats_l,"If set, counts of the split candidates, samples and nodes processed in growing are printed");
+    this->printHelpLine(perfCounters_s,perfCounters_l,"[Linux only] Add hardware counters (cycles, IPC, cache and branch misses) to the profile; implies --profile");
+    this->printHelpLine(memReport_s,memReport_l,"If set, the memory held by the data and the forest, and the resident set size after each phase, are printed; implied by --stats");
+    this->printHelpLine(quantize_s,quantize_l,"If set, numerical features of the train or filter data, other than the target, are stored in 16 bits on an even grid over their range");
   }
 
   void print() {
@@ -540,6 +652,12 @@ public:
     cout << "nThreads = " << nThreads << endl;
     cout << "isMaxThreads = " << isMaxThreads << endl;
     cout << "defaultFeatureWeight = " << defaultFeatureWeight << endl;
+    cout << "profile = " << profile << endl;
+    cout << "traceNodeSize = " << traceNodeSize << endl;
+    cout << "stats = " << stats << endl;
+    cout << "perfCounters = " << perfCounters << endl;
+    cout << "memReport = " << memReport << endl;
+    cout << "quantize = " << quantize << endl;
   }
 
 };
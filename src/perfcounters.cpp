@@ -0,0 +1,177 @@
+#include "perfcounters.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char* const perfcounters::eventNames[perfcounters::N_EVENTS] = { "cycles", "instructions", "LLCMisses", "branchMisses" };
+
+bool perfcounters::isEnabled = false;
+
+namespace {
+
+  bool isEventCounted[perfcounters::N_EVENTS] = { false, false, false, false };
+
+#ifdef __linux__
+
+  const uint64_t eventConfigs[perfcounters::N_EVENTS] = { PERF_COUNT_HW_CPU_CYCLES,
+							   PERF_COUNT_HW_INSTRUCTIONS,
+							   PERF_COUNT_HW_CACHE_MISSES,
+							   PERF_COUNT_HW_BRANCH_MISSES };
+
+  int openEvent(const perfcounters::Event event, const int groupFd) {
+
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = eventConfigs[event];
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // pid 0 and cpu -1 count the calling thread on whichever CPU it runs
+    return( syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0) );
+
+  }
+
+  // Counter group of one thread; the cycles counter leads, and the other events are members
+  // in the order they could be opened. The descriptors are closed as the thread exits
+  class ThreadGroup {
+  public:
+
+    ThreadGroup(): leaderFd_(-1),nMembers_(0) {
+
+      leaderFd_ = openEvent(perfcounters::CYCLES,-1);
+      if ( leaderFd_ == -1 ) {
+	return;
+      }
+
+      memberEvents_[nMembers_] = perfcounters::CYCLES;
+      memberFds_[nMembers_++] = leaderFd_;
+
+      for ( size_t i = 1; i < perfcounters::N_EVENTS; ++i ) {
+	perfcounters::Event event = static_cast<perfcounters::Event>(i);
+	int fd = openEvent(event,leaderFd_);
+	if ( fd != -1 ) {
+	  memberEvents_[nMembers_] = event;
+	  memberFds_[nMembers_++] = fd;
+	}
+      }
+
+      ioctl(leaderFd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leaderFd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    }
+
+    ~ThreadGroup() {
+      for ( size_t i = 0; i < nMembers_; ++i ) {
+	close(memberFds_[i]);
+      }
+    }
+
+    bool isOpen() const { return( leaderFd_ != -1 ); }
+
+    bool isCounted(const perfcounters::Event event) const {
+      for ( size_t i = 0; i < nMembers_; ++i ) {
+	if ( memberEvents_[i] == event ) {
+	  return( true );
+	}
+      }
+      return( false );
+    }
+
+    void read(perfcounters::Counts& counts) const {
+
+      if ( leaderFd_ == -1 ) {
+	return;
+      }
+
+      // nr, time enabled, time running, and one value per member
+      uint64_t buffer[3 + perfcounters::N_EVENTS];
+      ssize_t nBytes = ::read(leaderFd_, buffer, sizeof(buffer));
+      if ( nBytes < static_cast<ssize_t>( 3 * sizeof(uint64_t) ) || buffer[0] != nMembers_ ) {
+	return;
+      }
+
+      double scale = buffer[2] > 0 ? 1.0 * buffer[1] / buffer[2] : 1.0;
+
+      for ( size_t i = 0; i < nMembers_; ++i ) {
+	counts.values[ memberEvents_[i] ] = static_cast<uint64_t>( scale * buffer[3 + i] );
+      }
+
+    }
+
+  private:
+
+    int leaderFd_;
+    size_t nMembers_;
+    int memberFds_[perfcounters::N_EVENTS];
+    perfcounters::Event memberEvents_[perfcounters::N_EVENTS];
+
+  };
+
+  ThreadGroup& threadGroup() {
+    static thread_local ThreadGroup group;
+    return( group );
+  }
+
+#endif
+
+}
+
+bool perfcounters::enable(string& errorMessage) {
+
+#ifdef __linux__
+
+  errno = 0;
+
+  const ThreadGroup& group = threadGroup();
+
+  if ( !group.isOpen() ) {
+    if ( errno == EACCES || errno == EPERM ) {
+      errorMessage = "not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+    } else if ( errno == ENOENT || errno == EOPNOTSUPP || errno == ENOSYS ) {
+      errorMessage = "no hardware counters are exposed, as is typical of containers and virtual machines";
+    } else {
+      errorMessage = string("perf_event_open failed: ") + strerror(errno);
+    }
+    return( false );
+  }
+
+  for ( size_t i = 0; i < N_EVENTS; ++i ) {
+    isEventCounted[i] = group.isCounted( static_cast<Event>(i) );
+  }
+
+  isEnabled = true;
+  return( true );
+
+#else
+
+  errorMessage = "hardware counters are only supported on Linux";
+  return( false );
+
+#endif
+
+}
+
+bool perfcounters::isCounted(const Event event) {
+  return( isEventCounted[event] );
+}
+
+void perfcounters::read(Counts& counts) {
+
+#ifdef __linux__
+  if ( isEnabled ) {
+    threadGroup().read(counts);
+  }
+#endif
+
+}
@@ -0,0 +1,40 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+using namespace std;
+
+// Hardware performance counters of the calling thread, read through perf_event_open on Linux.
+// Every thread opens its own counter group the first time it reads, and only user-space events
+// are counted. Where the counters cannot be opened, as in most containers, or on other platforms,
+// enable() returns false and reads leave the counts at zero
+namespace perfcounters {
+
+  enum Event { CYCLES = 0, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, N_EVENTS };
+
+  extern const char* const eventNames[N_EVENTS];
+
+  struct Counts {
+    uint64_t values[N_EVENTS];
+    Counts() { for ( size_t i = 0; i < N_EVENTS; ++i ) values[i] = 0; }
+  };
+
+  // Set by enable(), before any threads are spawned
+  extern bool isEnabled;
+
+  // Probes the counters in the calling thread; on failure explains why in errorMessage
+  bool enable(string& errorMessage);
+
+  // Whether the event could be opened, for telling an unsupported event from a zero count
+  bool isCounted(const Event event);
+
+  // Running totals of the calling thread, scaled up if the kernel had to multiplex the counters
+  void read(Counts& counts);
+
+}
+
+#endif
@@ -1,31 +1,99 @@
 #include "progress.hpp"
 
+#include <sstream>
+
+bool Progress::isEnabled = false;
+
+atomic<size_t> Progress::nOpen_(0);
+
+namespace {
+
+  const int64_t drawIntervalNs = 1000000000;
+
+  string formatSeconds(const num_t seconds) {
+
+    size_t s = static_cast<size_t>(seconds + 0.5);
+
+    stringstream ss;
+    if ( s >= 3600 ) {
+      ss << s / 3600 << "h" << setw(2) << setfill('0') << ( s % 3600 ) / 60 << "m";
+    } else if ( s >= 60 ) {
+      ss << s / 60 << "m" << setw(2) << setfill('0') << s % 60 << "s";
+    } else {
+      ss << s << "s";
+    }
+
+    return( ss.str() );
+
+  }
 
-Progress::Progress(): 
-  width_(3) { 
-  cout << setw(width_) << "0" << "%" << flush; 
 }
 
-Progress::~Progress() { 
-  reset(); 
+Progress::Progress(const string& label, const string& unitName, const size_t nTotal):
+  isActive_(false),
+  label_(label),
+  unitName_(unitName),
+  nTotal_(nTotal),
+  startTime_(chrono::steady_clock::now()),
+  nDone_(0),
+  nextDrawNs_(drawIntervalNs),
+  hasDrawn_(false) {
+
+  // Only the outermost progress is reported
+  isActive_ = nOpen_.fetch_add(1) == 0 && isEnabled;
+
 }
 
-void Progress::update(const num_t fraction) { 
-  
-  reset(); 
-  
-  cout << setw(width_) << static_cast<size_t>(fraction*100) << "%" << flush; 
+Progress::~Progress() {
+
+  if ( hasDrawn_ ) {
+    this->draw(nDone_,true);
+    cout << endl;
+  }
+
+  nOpen_.fetch_sub(1);
 
 }
 
-void Progress::reset() { 
+void Progress::record(const size_t nUnits) {
+
+  size_t nDone = nDone_.fetch_add(nUnits,memory_order_relaxed) + nUnits;
 
-  for(size_t i = 0; i <= width_; ++i) { 
-    cout << "\b"; 
-  } 
+  int64_t elapsedNs = chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - startTime_ ).count();
+  int64_t nextDrawNs = nextDrawNs_.load(memory_order_relaxed);
+
+  // Of the threads that find the line out of date, only the one that moves the next draw time forward draws
+  if ( elapsedNs >= nextDrawNs && nextDrawNs_.compare_exchange_strong(nextDrawNs, elapsedNs + drawIntervalNs) ) {
+    this->draw(nDone,false);
+  }
 
 }
 
+void Progress::draw(const size_t nDone, const bool isFinal) {
+
+  chrono::duration<num_t> elapsed = chrono::steady_clock::now() - startTime_;
+  num_t rate = elapsed.count() > 0.0 ? nDone / elapsed.count() : 0.0;
 
+  stringstream ss;
+  ss << fixed << setprecision(1) << label_ << " " << nDone;
 
+  if ( nTotal_ > 0 ) {
+    ss << " / " << nTotal_ << " " << unitName_ << " (" << 100.0 * nDone / nTotal_ << "%)";
+  } else {
+    ss << " " << unitName_;
+  }
 
+  ss << ", " << rate << " " << unitName_ << "/s";
+
+  if ( isFinal ) {
+    ss << ", took " << formatSeconds( elapsed.count() );
+  } else if ( nTotal_ > 0 && rate > 0.0 && nDone < nTotal_ ) {
+    ss << ", ETA " << formatSeconds( ( nTotal_ - nDone ) / rate );
+  }
+
+  // Padding clears what is left of a longer previous line
+  cout << "\r" << left << setw(79) << ss.str() << right << flush;
+
+  hasDrawn_ = true;
+
+}
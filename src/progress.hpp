@@ -1,25 +1,57 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 
 #include "datadefs.hpp"
 
 using namespace std;
 using datadefs::num_t;
 
+// Progress of a long run, reported on one line as the units done, their rate and the time left.
+// Any thread may add units; counting is a single atomic add, and of the threads that find the
+// line out of date only one redraws it, at most once a second. Progress nested in another, such
+// as the trees of the forests of a filter run, is not reported
 class Progress {
 public:
-  Progress();
+
+  // Set before any threads are spawned; while disabled, nothing is reported
+  static bool isEnabled;
+
+  // A total of 0 means that the total is not known, and then no percentage or time left is reported
+  Progress(const string& label, const string& unitName, const size_t nTotal);
   ~Progress();
 
-  void update(const num_t fraction);
+  void add(const size_t nUnits = 1) { if ( isActive_ ) this->record(nUnits); }
+
+  size_t nDone() const { return( nDone_ ); }
 
 private:
 
-  void reset();
+  void record(const size_t nUnits);
 
-  size_t width_;
+  void draw(const size_t nDone, const bool isFinal);
 
-};
+  static atomic<size_t> nOpen_;
 
+  bool isActive_;
+
+  string label_;
+  string unitName_;
+  size_t nTotal_;
+
+  chrono::steady_clock::time_point startTime_;
+
+  atomic<size_t> nDone_;
+  atomic<int64_t> nextDrawNs_;
+  atomic<bool> hasDrawn_;
+
+};
 
+#endif
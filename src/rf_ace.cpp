@@ -10,7 +10,11 @@
 #include "datadefs.hpp"
 #include "options.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include "memreport.hpp"
 #include "densetreedata.hpp"
+#include "sparsetreedata.hpp"
+#include "mappedtreedata.hpp"
 
 using namespace std;
 using datadefs::num_t;
@@ -25,14 +29,24 @@ void printHeader(ostream& out) {
       << endl;
 }
 
+DenseTreeData* readData(const string& fileName, const string& targetName, const Options& options, const bool useContrasts = false);
+
 size_t getTargetIdx(TreeData* treeData, const string& targetAsStr);
 
 vector<num_t> readFeatureWeights(const TreeData* treeData, const size_t targetIdx, const Options& options);
 
 void printDataStatistics(TreeData* treeData, const size_t targetIdx);
 
+void printDataMemory(const DenseTreeData* treeData);
+
+bool saveBinaryData(TreeData* treeData, const Options& options);
+
+void writeStatisticsToFile(statistics::RF_statistics& statistics, const string& fileName);
+
 void writeFilterOutputToFile(RFACE::FilterOutput& filterOutput, const string& fileName);
 
+void printPredictionsToFile(RFACE::TestOutput& testOutput, const string& fileName);
+
 void printQRFPredictionsToFile(RFACE::QRFPredictionOutput& qPredOut, const bool printDistributions, const string& fileName);
 
 int main(const int argc, char* const argv[]) {
@@ -52,6 +66,27 @@ int main(const int argc, char* const argv[]) {
 
   options.io.validate();
 
+  if ( options.generalOptions.profile || options.generalOptions.perfCounters || options.io.profileFile != "" ) {
+    profiler::enable();
+  }
+
+  if ( options.generalOptions.perfCounters ) {
+    string errorMessage;
+    if ( !perfcounters::enable(errorMessage) ) {
+      cout << " WARNING: hardware counters are unavailable: " << errorMessage << "; profiling times only" << endl;
+    }
+  }
+
+  if ( options.io.traceFile != "" ) {
+    trace::enable(options.generalOptions.traceNodeSize);
+  }
+
+  if ( options.generalOptions.memReport || options.generalOptions.stats ) {
+    memreport::enable();
+  }
+
+  Progress::isEnabled = true;
+
   // With no input arguments the help is printed
   if ( argc == 1 || options.generalOptions.printHelp ) {
     options.help();
@@ -62,6 +97,7 @@ int main(const int argc, char* const argv[]) {
 
   RFACE::FilterOutput filterOutput;
   RFACE::QRFPredictionOutput qPredOut;
+  RFACE::TestOutput testOutput;
 
   timer.tic("Total time elapsed");
 
@@ -73,27 +109,59 @@ int main(const int argc, char* const argv[]) {
 
     bool useContrasts = true;
     cout << "-Reading file '" << options.io.filterDataFile << "' for filtering" << endl;
-    DenseTreeData filterData(options.io.filterDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter,useContrasts);
+    DenseTreeData* filterData = readData(options.io.filterDataFile,options.generalOptions.targetStr,options,useContrasts);
 
-    size_t targetIdx = getTargetIdx(&filterData,options.generalOptions.targetStr);
+    if ( saveBinaryData(filterData,options) ) {
+      delete filterData;
+      return(EXIT_SUCCESS);
+    }
+
+    size_t targetIdx = getTargetIdx(filterData,options.generalOptions.targetStr);
 
-    assert( targetIdx != filterData.end() );
+    assert( targetIdx != filterData->end() );
 
-    printDataStatistics(&filterData,targetIdx);
+    if ( options.generalOptions.quantize ) {
+      filterData->quantizeFeatures(targetIdx);
+    }
 
-    vector<num_t> featureWeights = readFeatureWeights(&filterData,targetIdx,options);
+    memreport::checkpoint("readData");
+    printDataMemory(filterData);
+
+    printDataStatistics(filterData,targetIdx);
+
+    vector<num_t> featureWeights = readFeatureWeights(filterData,targetIdx,options);
     
     if ( options.generalOptions.seed < 0 ) {
       options.generalOptions.seed = distributions::generateSeed();
     }
 
-    filterOutput = rface.filter(&filterData,targetIdx,featureWeights,&options.forestOptions,&options.filterOptions,options.io.saveForestFile);
+    chrono::steady_clock::time_point filterStart = chrono::steady_clock::now();
+    filterOutput = rface.filter(filterData,targetIdx,featureWeights,&options.forestOptions,&options.filterOptions,options.io.saveForestFile);
+    chrono::duration<double> filterTime = chrono::steady_clock::now() - filterStart;
+
+    memreport::checkpoint("filter");
+
+    if ( options.io.logFile != "" ) {
+      writeStatisticsToFile(rface.getStatistics(),options.io.logFile);
+    }
+
+    if ( options.generalOptions.stats ) {
+      filterOutput.workCounters.print(cout,filterTime.count());
+    }
+
+    if ( filterOutput.nPerms < options.filterOptions.nPerms ) {
+      cout << "-Time budget reached: " << filterOutput.nPerms << " / " << options.filterOptions.nPerms << " permutations done" << endl;
+    }
 
     options.io.saveForestFile = "";
 
+    delete filterData;
+
   } 
 
   if ( options.io.associationsFile != "" ) {
+    profiler::ScopedTimer scopedTimer("writeOutput");
+    trace::ScopedEvent event("writeOutput");
     cout << "-Writing associations to file '" << options.io.associationsFile << "'" << endl;
     writeFilterOutputToFile(filterOutput,options.io.associationsFile);
   } 
@@ -104,15 +172,28 @@ int main(const int argc, char* const argv[]) {
        options.io.predictionsFile != "" ) {
 
     cout << "-Loading model '" << options.io.loadForestFile << "', making on-the-fly predictions and saving to file '" << options.io.predictionsFile << "'" << endl;
-    DenseTreeData testData(options.io.testDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter);
-    qPredOut = rface.loadForestAndPredictQRF(options.io.loadForestFile,&testData,options.forestOptions);
+    DenseTreeData* testData = readData(options.io.testDataFile,options.generalOptions.targetStr,options);
+    try {
+      qPredOut = rface.loadForestAndPredictQRF(options.io.loadForestFile,testData,options.forestOptions);
+    } catch ( exception& e ) {
+      cerr << "ERROR: could not load model '" << options.io.loadForestFile << "': " << e.what() << endl;
+      delete testData;
+      return(EXIT_FAILURE);
+    }
     printQRFPredictionsToFile(qPredOut,options.forestOptions.distributions,options.io.predictionsFile);
+    delete testData;
     return(EXIT_SUCCESS);
   } 
 
   if ( options.io.loadForestFile != "" ) {
     cout << "-Loading model '" << options.io.loadForestFile << "'" << endl;
-    rface.load(options.io.loadForestFile);
+    try {
+      rface.load(options.io.loadForestFile);
+    } catch ( exception& e ) {
+      cerr << "ERROR: could not load model '" << options.io.loadForestFile << "': " << e.what() << endl;
+      return(EXIT_FAILURE);
+    }
+    memreport::checkpoint("loadForest");
   }
 
   if ( options.io.trainDataFile != "" ) {
@@ -121,31 +202,96 @@ int main(const int argc, char* const argv[]) {
     
     // Read train data into TreeData object
     cout << "-Reading train file '" << options.io.trainDataFile << "'" << endl;
-    DenseTreeData trainData(options.io.trainDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter);
+    DenseTreeData* trainData = readData(options.io.trainDataFile,options.generalOptions.targetStr,options);
+
+    if ( saveBinaryData(trainData,options) ) {
+      delete trainData;
+      return(EXIT_SUCCESS);
+    }
     
-    size_t targetIdx = getTargetIdx(&trainData,options.generalOptions.targetStr);
+    size_t targetIdx = getTargetIdx(trainData,options.generalOptions.targetStr);
     
-    assert( targetIdx != trainData.end() );
+    assert( targetIdx != trainData->end() );
+
+    if ( options.generalOptions.quantize ) {
+      trainData->quantizeFeatures(targetIdx);
+    }
+
+    memreport::checkpoint("readData");
+    printDataMemory(trainData);
 
-    printDataStatistics(&trainData,targetIdx);
+    printDataStatistics(trainData,targetIdx);
     
-    vector<num_t> featureWeights = readFeatureWeights(&trainData,targetIdx,options);
+    vector<num_t> featureWeights = readFeatureWeights(trainData,targetIdx,options);
     
-    cout << "-Training the model" << endl;
-    rface.train(&trainData,targetIdx,featureWeights,&options.forestOptions);
+    size_t nOldTrees = options.forestOptions.warmStart && rface.forestRef() ? rface.forestRef()->nTrees() : 0;
+
+    if ( options.forestOptions.warmStart && options.io.loadForestFile != "" ) {
+      cout << "-Adding trees to the loaded model" << endl;
+    } else {
+      cout << "-Training the model" << endl;
+    }
+    chrono::steady_clock::time_point trainStart = chrono::steady_clock::now();
+    rface.train(trainData,targetIdx,featureWeights,&options.forestOptions);
+    chrono::duration<double> trainTime = chrono::steady_clock::now() - trainStart;
+
+    StochasticForest* forest = rface.forestRef();
+
+    memreport::checkpoint("train");
+
+    if ( options.io.logFile != "" ) {
+      writeStatisticsToFile(rface.getStatistics(),options.io.logFile);
+    }
+
+    if ( options.generalOptions.stats ) {
+      forest->getWorkCounters().print(cout,trainTime.count());
+    }
+
+    if ( memreport::isEnabled ) {
+      memreport::Breakdown breakdown;
+      forest->memoryUsage(breakdown);
+      memreport::print(cout,"Memory held by the forest",breakdown);
+      cout << endl;
+    }
+
+    cout << "-Forest has " << forest->nTrees() << " trees" << endl;
+    if ( options.forestOptions.timeBudget > 0.0 ) {
+      cout << "-Grew " << forest->nTrees() - nOldTrees << " / " << options.forestOptions.nTrees 
+	   << " trees within the time budget of " << options.forestOptions.timeBudget << " seconds" << endl;
+    }
+    if ( forest->nOobSamples() > 0 ) {
+      cout << "-OOB error " << forest->getOobError(trainData) << ( trainData->feature(targetIdx)->isNumerical() ? " (RMSE)" : " (misclassification rate)" )
+	   << " over " << forest->nOobSamples() << " / " << trainData->feature(targetIdx)->nRealSamples() << " samples" << endl;
+    }
+
+    delete trainData;
     
   }
   
   if ( options.io.testDataFile != "" ) {  
     cout << "-Reading test file '" << options.io.testDataFile << "'" << endl;
-    DenseTreeData testData(options.io.testDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter);
+    StochasticForest* forest = rface.forestRef();
+    string targetName = forest && forest->nTrees() > 0 ? forest->getTargetName() : options.generalOptions.targetStr;
+    DenseTreeData* testData = readData(options.io.testDataFile,targetName,options);
     cout << "-Making predictions" << endl;
-    qPredOut = rface.predictQRF(&testData,options.forestOptions);
+    if ( options.forestOptions.forestType == forest_t::QRF ) {
+      qPredOut = rface.predictQRF(testData,options.forestOptions);
+    } else {
+      testOutput = rface.test(testData);
+    }
+    memreport::checkpoint("predict");
+    delete testData;
   }
 
   if ( options.io.predictionsFile != "" ) {
+    profiler::ScopedTimer scopedTimer("writeOutput");
+    trace::ScopedEvent event("writeOutput");
     cout << "-Writing predictions to file '" << options.io.predictionsFile << "'" << endl; 
-    printQRFPredictionsToFile(qPredOut,options.forestOptions.distributions,options.io.predictionsFile);
+    if ( options.forestOptions.forestType == forest_t::QRF ) {
+      printQRFPredictionsToFile(qPredOut,options.forestOptions.distributions,options.io.predictionsFile);
+    } else {
+      printPredictionsToFile(testOutput,options.io.predictionsFile);
+    }
   }
     
   if ( options.io.saveForestFile != "" ) {
@@ -155,6 +301,32 @@ int main(const int argc, char* const argv[]) {
 
   timer.toc("Total time elapsed");
   timer.print();
+
+  if ( profiler::isEnabled ) {
+    profiler::print(cout);
+  }
+
+  if ( memreport::isEnabled ) {
+    memreport::printCheckpoints(cout);
+    cout << endl;
+  }
+
+  if ( options.io.profileFile != "" ) {
+    cout << "-Writing profile to file '" << options.io.profileFile << "'" << endl;
+    ofstream toFile(options.io.profileFile.c_str());
+    profiler::writeJSON(toFile);
+    toFile.close();
+  }
+
+  if ( options.io.traceFile != "" ) {
+    cout << "-Writing " << trace::nEvents() - trace::nDropped() << " trace events to file '" << options.io.traceFile << "'" << endl;
+    if ( trace::nDropped() > 0 ) {
+      cout << " WARNING: " << trace::nDropped() << " oldest events were overwritten; consider raising --traceNodeSize" << endl;
+    }
+    ofstream toFile(options.io.traceFile.c_str());
+    trace::writeJSON(toFile);
+    toFile.close();
+  }
   
   return( EXIT_SUCCESS );
   
@@ -162,6 +334,26 @@ int main(const int argc, char* const argv[]) {
 
 
 
+DenseTreeData* readData(const string& fileName, const string& targetName, const Options& options, const bool useContrasts) {
+
+  // The label of a libsvm file is read as categorical only if the target is named so
+  if ( SparseTreeData::isSparseFile(fileName) ) {
+    char headerDelimiter = options.generalOptions.headerDelimiter;
+    bool isLabelNumerical = !( targetName.size() > 1 && targetName[0] == 'C' && targetName[1] == headerDelimiter );
+    return( new SparseTreeData(fileName,headerDelimiter,isLabelNumerical,useContrasts) );
+  }
+
+  if ( MappedTreeData::isMappedFile(fileName) ) {
+    MappedTreeData* treeData = new MappedTreeData(fileName,useContrasts);
+    cout << "-Mapped " << treeData->nFeatures() << " features of " << treeData->nSamples() << " samples ("
+	 << treeData->mappedBytes() / 1048576 << " MB) out-of-core" << endl;
+    return( treeData );
+  }
+
+  return( new DenseTreeData(fileName,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter,useContrasts) );
+
+}
+
 vector<num_t> readFeatureWeights(const TreeData* treeData, const size_t targetIdx, const Options& options) {
 
   size_t nFeatures = treeData->nFeatures();
@@ -238,6 +430,49 @@ void printDataStatistics(TreeData* treeData, const size_t targetIdx) {
 
 }
 
+void printDataMemory(const DenseTreeData* treeData) {
+
+  if ( !memreport::isEnabled ) {
+    return;
+  }
+
+  memreport::Breakdown breakdown;
+  treeData->memoryUsage(breakdown);
+  memreport::print(cout,"Memory held by the data",breakdown);
+  cout << endl;
+
+}
+
+// Returns true if the data was only to be converted
+bool saveBinaryData(TreeData* treeData, const Options& options) {
+
+  if ( options.io.saveBinaryFile == "" ) {
+    return( false );
+  }
+
+  cout << "-Writing data to binary file '" << options.io.saveBinaryFile << "'" << endl;
+  MappedTreeData::writeBinary(treeData,options.io.saveBinaryFile);
+
+  return( options.generalOptions.targetStr == "" );
+
+}
+
+void writeStatisticsToFile(statistics::RF_statistics& statistics, const string& fileName) {
+
+  cout << "-Writing statistics of " << statistics.treeRecords().size() << " trees to file '" << fileName << "'" << endl;
+
+  ofstream toFile(fileName.c_str());
+
+  if ( fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0 ) {
+    statistics.writeJSON(toFile);
+  } else {
+    statistics.writeTSV(toFile);
+  }
+
+  toFile.close();
+
+}
+
 size_t getTargetIdx(TreeData* treeData, const string& targetAsStr) {
 
   // Check if the target is specified as an index
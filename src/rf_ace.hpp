@@ -15,6 +15,7 @@
 #include <cstdlib>
 #include <string>
 #include <vector>
+#include <chrono>
 
 #include "stochasticforest.hpp"
 #include "treedata.hpp"
@@ -23,7 +24,11 @@
 #include "math.hpp"
 #include "datadefs.hpp"
 #include "progress.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
 #include "distributions.hpp"
+#include "statistics.hpp"
+#include "exceptions.hpp"
 
 using namespace std;
 using datadefs::num_t;
@@ -54,12 +59,14 @@ public:
   struct FilterOutput {
     size_t nAllFeatures;
     size_t nSignificantFeatures;
+    size_t nPerms;
     string targetName;
     vector<string> featureNames;
     vector<num_t> pValues;
     vector<num_t> importances;
     vector<num_t> correlations;
     vector<num_t> sampleCounts;
+    WorkCounters workCounters;
   };
   
   struct TestOutput {
@@ -157,6 +164,8 @@ public:
 	     const size_t targetIdx, 
 	     const vector<num_t>& featureWeights, 
 	     ForestOptions* forestOptions) {
+
+    profiler::ScopedTimer scopedTimer("train");
     
     forestOptions->useContrasts = false;
 
@@ -164,6 +173,18 @@ public:
 
     assert( !forestOptions->useContrasts );
 
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+    statistics_ = statistics::RF_statistics();
+
+    // Warm start keeps the current trees and grows new ones next to them
+    if ( forestOptions->warmStart && trainedModel_ ) {
+      trainedModel_->setDeadline(this->deadline(forestOptions));
+      trainedModel_->growRF(trainData,targetIdx,forestOptions,featureWeights,randoms_);
+      this->addTrainStatistics(startTime);
+      return;
+    }
+
     if ( trainedModel_ ) {
       delete trainedModel_;
       trainedModel_ = NULL;
@@ -171,6 +192,8 @@ public:
     
     trainedModel_ = new StochasticForest();
 
+    trainedModel_->setDeadline(this->deadline(forestOptions));
+
     if ( forestOptions->forestType == forest_t::RF || forestOptions->forestType == forest_t::QRF ) {
       trainedModel_->learnRF(trainData,targetIdx,forestOptions,featureWeights,randoms_);
     } else if ( forestOptions->forestType == forest_t::GBT ) {
@@ -179,6 +202,8 @@ public:
       cerr << "Unknown forest type!" << endl;
       exit(1);
     }
+
+    this->addTrainStatistics(startTime);
   }
 
   FilterOutput filter(TreeData* filterData, 
@@ -188,6 +213,8 @@ public:
 		      FilterOptions* filterOptions,
 		      const string& forestFile = "" ) {
 
+    profiler::ScopedTimer scopedTimer("filter");
+
     forestOptions->useContrasts = true;
 
     forestOptions->validate();
@@ -202,6 +229,10 @@ public:
 
     FilterOutput filterOutput;
 
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+    statistics_ = statistics::RF_statistics();
+
     vector<num_t> contrastImportanceSample;
     set<size_t> featuresInAllForests;
 
@@ -209,6 +240,9 @@ public:
     executeRandomForest(filterData,targetIdx,featureWeights,forestOptions,filterOptions,filterOutput,forestFile);
     cout << "DONE" << endl;
 
+    chrono::duration<num_t> executionTime = chrono::steady_clock::now() - startTime;
+    statistics_.setExecutionTime(executionTime.count());
+
     return( filterOutput );
 
   }
@@ -233,11 +267,17 @@ public:
     filterOutput.correlations.resize(nFeatures);
     filterOutput.featureNames.resize(nFeatures);
 
-    Progress progress;
+    Progress progress("Uncovering associations...","permutations",filterOptions->nPerms);
     vector<num_t> contrastImportanceSample(filterOptions->nPerms);
 
     ftable_t frequency;
 
+    // Permutations are run until the time budget is nearly spent, but the null distribution needs at least 5
+    chrono::steady_clock::time_point deadline = this->deadline(forestOptions);
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    size_t nMinPerms = min(static_cast<size_t>(5),filterOptions->nPerms);
+    size_t nPerms = 0;
+
     ofstream toFile;
     if ( forestFile != "" ) {
       toFile.open(forestFile.c_str());
@@ -246,14 +286,28 @@ public:
 
     for(size_t permIdx = 0; permIdx < filterOptions->nPerms; ++permIdx) {
 
+      if ( permIdx >= nMinPerms ) {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if ( now + ( now - startTime ) / static_cast<chrono::steady_clock::rep>(permIdx) > deadline ) {
+	  break;
+	}
+      }
+
       filterData->permuteContrasts(&randoms_[0]);
 
-      progress.update(1.0*permIdx/filterOptions->nPerms);
+      profiler::ScopedTimer permutationTimer("permutation");
+      trace::ScopedEvent event("permutation", "permIdx", permIdx);
 
       StochasticForest SF;
 
+      if ( permIdx >= nMinPerms ) {
+	SF.setDeadline(deadline);
+      }
+
       SF.learnRF(filterData,targetIdx,forestOptions,featureWeights,randoms_);
 
+      filterOutput.workCounters += SF.getWorkCounters();
+
       if ( forestFile != "" ) {
 	//ofstream toFile;
 	toFile.open(forestFile.c_str(),ios::app);
@@ -261,19 +315,34 @@ public:
 	toFile.close();
       }
 
-      SF.getMDI(filterData,importanceMat[permIdx],contrastImportanceMat[permIdx]);
+      if ( filterOptions->permutationImportance ) {
+	SF.getPermutationImportance(filterData,importanceMat[permIdx],contrastImportanceMat[permIdx],randoms_);
+      } else {
+	SF.getMDI(filterData,importanceMat[permIdx],contrastImportanceMat[permIdx]);
+      }
+
+      statistics_.addForest(&SF,importanceMat[permIdx],contrastImportanceMat[permIdx]);
 
       // Store the new percentile value in the vector contrastImportanceSample
       contrastImportanceSample[permIdx] = math::mean( utils::removeNANs( contrastImportanceMat[permIdx] ) );
 
+      ++nPerms;
+
+      progress.add();
+
     }
 
+    filterOutput.nPerms = nPerms;
+    importanceMat.resize(nPerms);
+    contrastImportanceMat.resize(nPerms);
+    contrastImportanceSample.resize(nPerms);
+
     contrastImportanceSample = utils::removeNANs( contrastImportanceSample );
 
     //assert( !datadefs::containsNAN(contrastImportanceSample) );
 
     // Notify if the sample size of the null distribution is very low
-    if ( filterOptions->nPerms > 1 && contrastImportanceSample.size() < 5 ) {
+    if ( nPerms > 1 && contrastImportanceSample.size() < 5 ) {
       cerr << " WARNING: Too few samples drawn ( " << contrastImportanceSample.size()
 	   << " < 5 ) from the null distribution. Consider adding more permutations. Quitting..."
 	   << endl;
@@ -283,10 +352,10 @@ public:
     // Loop through each feature and calculate p-value for each
     for ( size_t featureIdx = 0; featureIdx < filterData->nFeatures(); ++featureIdx ) {
 
-      vector<num_t> featureImportanceSample(filterOptions->nPerms);
+      vector<num_t> featureImportanceSample(nPerms);
       
       // Extract the sample for the real feature
-      for ( size_t permIdx = 0; permIdx < filterOptions->nPerms; ++permIdx ) {
+      for ( size_t permIdx = 0; permIdx < nPerms; ++permIdx ) {
 	featureImportanceSample[permIdx] = importanceMat[permIdx][featureIdx];
       }
       
@@ -300,6 +369,8 @@ public:
 	filterOutput.pValues[featureIdx] = 1.0;
 	
       } else {
+
+	profiler::ScopedTimer tTestTimer("tTest");
 	
 	// Perform WS-approximated t-test against the contrast sample
 	bool WS = true;
@@ -347,6 +418,15 @@ public:
 
   }
 
+  // Deadline for growing trees or permutations, if a time budget is set
+  chrono::steady_clock::time_point deadline(const ForestOptions* forestOptions) {
+    if ( forestOptions->timeBudget > 0.0 ) {
+      return( chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(forestOptions->timeBudget)) );
+    } else {
+      return( chrono::steady_clock::time_point::max() );
+    }
+  }
+
   void sortFilterOutput(FilterOutput* filterOutput) {
 
     vector<size_t> sortIcs = utils::range(filterOutput->pValues.size());
@@ -363,6 +443,9 @@ public:
 
   TestOutput test(TreeData* testData) {
 
+    profiler::ScopedTimer scopedTimer("predict");
+    trace::ScopedEvent event("predict", "nSamples", testData->nSamples());
+
     assert(trainedModel_);
 
     TestOutput testOutput;
@@ -405,6 +488,9 @@ public:
 
   
   QRFPredictionOutput predictQRF(TreeData* testData, ForestOptions& forestOptions) {
+
+    profiler::ScopedTimer scopedTimer("predictQRF");
+    trace::ScopedEvent event("predictQRF", "nSamples", testData->nSamples());
     
     assert(trainedModel_);
     
@@ -445,23 +531,38 @@ public:
     
   }
   
+  // A forest file that cannot be loaded throws RFACE_EXCEPTION, and leaves the current model as it was
   void load(const string& fileName) {
+
+    profiler::ScopedTimer scopedTimer("loadForest");
+    trace::ScopedEvent event("loadForest");
     
+    StochasticForest* forest = new StochasticForest();
+
+    try {
+      forest->loadForest(fileName);
+    } catch ( ... ) {
+      delete forest;
+      throw;
+    }
+
     if ( trainedModel_ ) {
       delete trainedModel_;
-      trainedModel_ = NULL;
     }
     
-    trainedModel_ = new StochasticForest();
-    trainedModel_->loadForest(fileName);
+    trainedModel_ = forest;
   }
 
+  // Streams the trees of the forest file one at a time; a malformed file throws RFACE_EXCEPTION
   QRFPredictionOutput loadForestAndPredictQRF(const string& forestFile, TreeData* testData, const ForestOptions& forestOptions) {
     
     QRFPredictionOutput qPredOut;
 
     ifstream forestStream(forestFile.c_str());
-    assert(forestStream.good());
+
+    if ( !forestStream.good() || forestStream.peek() == EOF ) {
+      throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "failed to read forest file '" + forestFile + "'");
+    }
     
     size_t nSamples = testData->nSamples();
 
@@ -470,6 +571,8 @@ public:
     qPredOut.numDistributions = vector<vector<num_t> >(nSamples);
     qPredOut.catDistributions = vector<vector<cat_t> >(nSamples);
 
+    Progress progress("-Loading trees and predicting:","trees",0);
+
     size_t treeIdx = 0;
     while ( forestStream.good() ) {
 
@@ -478,7 +581,6 @@ public:
       qPredOut.targetName = rootNode.getTargetName();
       qPredOut.isTargetNumerical = rootNode.isTargetNumerical();
 
-      cout << "Tree " << treeIdx << " loaded" << endl;
       treeIdx++;
 
       if ( qPredOut.isTargetNumerical ) {
@@ -512,6 +614,8 @@ public:
         }
 
       }
+
+      progress.add();
     }
 
     // This can be done once the distributions and quantile points are loaded into qPredOut
@@ -546,6 +650,9 @@ public:
 
   void save(const string& fileName) {
 
+    profiler::ScopedTimer scopedTimer("writeForest");
+    trace::ScopedEvent event("writeForest");
+
     assert(trainedModel_);
     
     ofstream toFile(fileName);
@@ -555,6 +662,9 @@ public:
   }
 
   StochasticForest* forestRef() { return( trainedModel_ ); }
+
+  // Statistics of the trees of the latest train() or filter()
+  statistics::RF_statistics& getStatistics() { return( statistics_ ); }
   
   void resetRandomNumberGenerators(const size_t nThreads, int seed) {
 
@@ -579,9 +689,17 @@ public:
 
 private:
 
+  void addTrainStatistics(const chrono::steady_clock::time_point& startTime) {
+    chrono::duration<num_t> executionTime = chrono::steady_clock::now() - startTime;
+    statistics_.addForest(trainedModel_,vector<num_t>(),vector<num_t>());
+    statistics_.setExecutionTime(executionTime.count());
+  }
+
   vector<distributions::Random> randoms_;
 
   StochasticForest* trainedModel_;
+
+  statistics::RF_statistics statistics_;
   
 
 };
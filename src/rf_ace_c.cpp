@@ -0,0 +1,487 @@
+#include "rf_ace_c.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <exception>
+
+#include "rf_ace.hpp"
+#include "densetreedata.hpp"
+#include "feature.hpp"
+#include "options.hpp"
+#include "datadefs.hpp"
+
+using namespace std;
+using datadefs::num_t;
+using datadefs::cat_t;
+using datadefs::forest_t;
+
+struct rface_data {
+
+  size_t nSamples;
+
+  vector<Feature> features;
+
+  // Built from the features on first use, and again after columns are added
+  DenseTreeData* treeData;
+
+  // Copies of columns that cannot be read in place
+  vector<vector<num_t> > ownedColumns;
+
+};
+
+struct rface_model {
+
+  RFACE rface;
+
+  rface_model(const size_t nThreads, const int seed): rface(nThreads,seed) {}
+
+};
+
+namespace {
+
+  thread_local string lastError;
+
+  int fail(const string& message) {
+    lastError = message;
+    return( -1 );
+  }
+
+  DenseTreeData* treeDataOf(rface_data* data) {
+    if ( !data->treeData ) {
+      bool useContrasts = false;
+      data->treeData = new DenseTreeData(data->features,useContrasts);
+    }
+    return( data->treeData );
+  }
+
+  int addFeature(rface_data* data, const Feature& feature) {
+
+    for ( size_t i = 0; i < data->features.size(); ++i ) {
+      if ( data->features[i].name() == feature.name() ) {
+	return( fail("data set already has a column named '" + feature.name() + "'") );
+      }
+    }
+
+    data->features.push_back(feature);
+
+    if ( data->treeData ) {
+      delete data->treeData;
+      data->treeData = NULL;
+    }
+
+    return( 0 );
+
+  }
+
+  forest_t toForestType(const rface_forest_type forestType) {
+    if ( forestType == RFACE_RF ) {
+      return( forest_t::RF );
+    } else if ( forestType == RFACE_GBT ) {
+      return( forest_t::GBT );
+    } else {
+      return( forest_t::QRF );
+    }
+  }
+
+  int checkThreads(const size_t nThreads) {
+#ifdef NOTHREADS
+    bool isThreaded = false;
+#else
+    bool isThreaded = true;
+#endif
+    if ( !isThreaded && nThreads > 1 ) {
+      return( fail("this build of RF-ACE runs on one thread only") );
+    }
+    return( 0 );
+  }
+
+  void setDefaults(ForestOptions& forestOptions, const forest_t forestType) {
+    if ( forestType == forest_t::RF ) {
+      forestOptions.setRFDefaults();
+    } else if ( forestType == forest_t::GBT ) {
+      forestOptions.setGBTDefaults();
+    } else {
+      forestOptions.setQRFDefaults();
+    }
+  }
+
+  // Rejects the options that ForestOptions::validate() would end the process on. The C interface
+  // leaves the time budget, warm start and convergence at their defaults
+  int checkOptions(const ForestOptions& forestOptions) {
+
+    if ( forestOptions.nTrees == 0 || forestOptions.nodeSize == 0 ) {
+      return( fail("the number of trees and the node size must be positive") );
+    }
+
+    if ( forestOptions.isRandomSplit && forestOptions.mTry == 0 ) {
+      return( fail("the number of features drawn per split must be positive") );
+    }
+
+    if ( forestOptions.nMaxLeaves == 0 ) {
+      return( fail("the maximum number of leaves must be positive") );
+    }
+
+    if ( forestOptions.forestType == forest_t::GBT && !( forestOptions.shrinkage > 0.0 && forestOptions.shrinkage <= 1.0 ) ) {
+      return( fail("shrinkage must be in (0,1]") );
+    }
+
+    if ( forestOptions.timeBudget < 0.0 || ( forestOptions.forestType == forest_t::GBT && forestOptions.timeBudget > 0.0 ) ) {
+      return( fail("time budget must be non-negative, and is not available for GBT") );
+    }
+
+    return( 0 );
+
+  }
+
+  // Every forest type learns numerical and categorical targets alike, but the trees cannot be
+  // grown on a target without values
+  int checkTarget(const Feature* target) {
+
+    for ( size_t i = 0; i < target->nSamples(); ++i ) {
+      if ( !target->isMissing(i) ) {
+	return( 0 );
+      }
+    }
+
+    return( fail("target '" + target->name() + "' has no values") );
+
+  }
+
+  // Runs the predictions of the model for the data, checking the type of its target
+  int test(rface_model* model, rface_data* data, const bool isTargetNumerical, RFACE::TestOutput& testOutput) {
+
+    if ( !model || !data || !model->rface.forestRef() || model->rface.forestRef()->nTrees() == 0 ) {
+      return( fail("model and data must be set, and the model trained or loaded") );
+    }
+
+    if ( model->rface.forestRef()->isTargetNumerical() != isTargetNumerical ) {
+      return( fail(string("the target of the model is ") + ( isTargetNumerical ? "categorical" : "numerical" )) );
+    }
+
+    if ( data->features.size() == 0 ) {
+      return( fail("data set has no columns") );
+    }
+
+    testOutput = model->rface.test(treeDataOf(data));
+
+    return( 0 );
+
+  }
+
+}
+
+int rface_abi_version(void) {
+  return( RFACE_ABI_VERSION );
+}
+
+const char* rface_last_error(void) {
+  return( lastError.c_str() );
+}
+
+void rface_train_options_init(rface_train_options* options, rface_forest_type forest_type) {
+
+  ForestOptions forestOptions(forest_t::QRF);
+  setDefaults(forestOptions,toForestType(forest_type));
+
+  options->forest_type     = forest_type;
+  options->n_trees         = forestOptions.nTrees;
+  options->m_try           = forestOptions.mTry;
+  options->node_size       = forestOptions.nodeSize;
+  options->n_max_leaves    = forestOptions.nMaxLeaves == datadefs::MAX_IDX ? 0 : forestOptions.nMaxLeaves;
+  options->shrinkage       = forestOptions.shrinkage;
+  options->no_na_branching = 0;
+  options->n_threads       = 1;
+  options->seed            = -1;
+
+}
+
+rface_data* rface_data_create(size_t n_samples) {
+
+  if ( n_samples == 0 ) {
+    fail("data set must have samples");
+    return( NULL );
+  }
+
+  rface_data* data = new rface_data;
+  data->nSamples = n_samples;
+  data->treeData = NULL;
+
+  return( data );
+
+}
+
+int rface_data_add_numerical(rface_data* data, const char* name, const float* values, const uint8_t* na_mask) {
+
+  if ( !data || !name || !values ) {
+    return( fail("data, name and values must be set") );
+  }
+
+  try {
+
+#ifdef NUM_T_DOUBLE
+    bool isReadInPlace = false;
+#else
+    bool isReadInPlace = na_mask == NULL;
+#endif
+
+    if ( isReadInPlace ) {
+      return( addFeature(data,Feature(reinterpret_cast<const num_t*>(values),data->nSamples,name)) );
+    }
+
+    data->ownedColumns.push_back( vector<num_t>(values,values + data->nSamples) );
+    vector<num_t>& column = data->ownedColumns.back();
+
+    if ( na_mask ) {
+      for ( size_t i = 0; i < data->nSamples; ++i ) {
+	if ( na_mask[i] ) {
+	  column[i] = datadefs::NUM_NAN;
+	}
+      }
+    }
+
+    return( addFeature(data,Feature(&column[0],data->nSamples,name)) );
+
+  } catch ( exception& e ) {
+    return( fail(e.what()) );
+  }
+
+}
+
+int rface_data_add_categorical(rface_data* data, const char* name, const int32_t* codes, const uint8_t* na_mask,
+			       const char* const* category_names, size_t n_categories) {
+
+  if ( !data || !name || !codes || ( n_categories > 0 && !category_names ) ) {
+    return( fail("data, name, codes and category names must be set") );
+  }
+
+  try {
+
+    vector<cat_t> catData(data->nSamples,datadefs::STR_NAN);
+
+    for ( size_t i = 0; i < data->nSamples; ++i ) {
+      if ( codes[i] < 0 || ( na_mask && na_mask[i] ) ) {
+	continue;
+      }
+      if ( static_cast<size_t>(codes[i]) >= n_categories ) {
+	stringstream ss;
+	ss << "code " << codes[i] << " of sample " << i << " in column '" << name << "' is not one of the " << n_categories << " categories";
+	return( fail(ss.str()) );
+      }
+      catData[i] = category_names[ codes[i] ];
+    }
+
+    return( addFeature(data,Feature(catData,name)) );
+
+  } catch ( exception& e ) {
+    return( fail(e.what()) );
+  }
+
+}
+
+size_t rface_data_n_samples(const rface_data* data) {
+  return( data ? data->nSamples : 0 );
+}
+
+void rface_data_free(rface_data* data) {
+  if ( data ) {
+    delete data->treeData;
+    delete data;
+  }
+}
+
+rface_model* rface_train(rface_data* data, const char* target, const rface_train_options* options) {
+
+  if ( !data || !target || !options ) {
+    fail("data, target and options must be set");
+    return( NULL );
+  }
+
+  if ( options->forest_type != RFACE_RF && options->forest_type != RFACE_QRF && options->forest_type != RFACE_GBT ) {
+    fail("unknown forest type");
+    return( NULL );
+  }
+
+  if ( checkThreads(options->n_threads) != 0 ) {
+    return( NULL );
+  }
+
+  rface_model* model = NULL;
+
+  try {
+
+    if ( data->features.size() < 2 ) {
+      fail("data set must have a target and at least one other column");
+      return( NULL );
+    }
+
+    DenseTreeData* treeData = treeDataOf(data);
+
+    size_t targetIdx = treeData->getFeatureIdx(target);
+
+    if ( targetIdx == treeData->end() ) {
+      fail(string("data set has no column named '") + target + "'");
+      return( NULL );
+    }
+
+    forest_t forestType = toForestType(options->forest_type);
+
+    ForestOptions forestOptions(forestType);
+    setDefaults(forestOptions,forestType);
+
+    forestOptions.nTrees        = options->n_trees;
+    forestOptions.mTry          = options->m_try > 0 ? options->m_try : max(static_cast<size_t>(1),( treeData->nFeatures() - 1 ) / 3);
+    forestOptions.nodeSize      = options->node_size;
+    forestOptions.nMaxLeaves    = options->n_max_leaves > 0 ? options->n_max_leaves : datadefs::MAX_IDX;
+    forestOptions.shrinkage     = options->shrinkage;
+    forestOptions.noNABranching = options->no_na_branching != 0;
+
+    if ( checkOptions(forestOptions) != 0 || checkTarget(treeData->feature(targetIdx)) != 0 ) {
+      return( NULL );
+    }
+
+    vector<num_t> featureWeights = treeData->getFeatureWeights();
+    featureWeights[targetIdx] = 0.0;
+
+    model = new rface_model(max(static_cast<size_t>(1),options->n_threads),options->seed);
+
+    model->rface.train(treeData,targetIdx,featureWeights,&forestOptions);
+
+    return( model );
+
+  } catch ( exception& e ) {
+    delete model;
+    fail(e.what());
+    return( NULL );
+  }
+
+}
+
+int rface_predict_numerical(rface_model* model, rface_data* data, float* predictions, float* confidence) {
+
+  if ( !predictions ) {
+    return( fail("predictions must be set") );
+  }
+
+  try {
+
+    RFACE::TestOutput testOutput;
+
+    if ( test(model,data,true,testOutput) != 0 ) {
+      return( -1 );
+    }
+
+    for ( size_t i = 0; i < data->nSamples; ++i ) {
+      predictions[i] = testOutput.numPredictions[i];
+      if ( confidence ) {
+	confidence[i] = testOutput.confidence[i];
+      }
+    }
+
+    return( 0 );
+
+  } catch ( exception& e ) {
+    return( fail(e.what()) );
+  }
+
+}
+
+int rface_predict_categorical(rface_model* model, rface_data* data, const char* const* category_names, size_t n_categories,
+			      int32_t* predictions, float* confidence) {
+
+  if ( !predictions || ( n_categories > 0 && !category_names ) ) {
+    return( fail("predictions and category names must be set") );
+  }
+
+  try {
+
+    RFACE::TestOutput testOutput;
+
+    if ( test(model,data,false,testOutput) != 0 ) {
+      return( -1 );
+    }
+
+    unordered_map<cat_t,int32_t> codes;
+    for ( size_t c = 0; c < n_categories; ++c ) {
+      codes[ category_names[c] ] = static_cast<int32_t>(c);
+    }
+
+    for ( size_t i = 0; i < data->nSamples; ++i ) {
+      unordered_map<cat_t,int32_t>::const_iterator it( codes.find(testOutput.catPredictions[i]) );
+      predictions[i] = it != codes.end() ? it->second : -1;
+      if ( confidence ) {
+	confidence[i] = testOutput.confidence[i];
+      }
+    }
+
+    return( 0 );
+
+  } catch ( exception& e ) {
+    return( fail(e.what()) );
+  }
+
+}
+
+int rface_model_is_numerical(rface_model* model) {
+  return( model && model->rface.forestRef() && model->rface.forestRef()->nTrees() > 0 && model->rface.forestRef()->isTargetNumerical() ? 1 : 0 );
+}
+
+int rface_model_save(rface_model* model, const char* file_name) {
+
+  if ( !model || !file_name || !model->rface.forestRef() ) {
+    return( fail("trained model and file name must be set") );
+  }
+
+  try {
+
+    model->rface.save(file_name);
+
+    if ( !ifstream(file_name).good() ) {
+      return( fail(string("failed to write file '") + file_name + "'") );
+    }
+
+    return( 0 );
+
+  } catch ( exception& e ) {
+    return( fail(e.what()) );
+  }
+
+}
+
+rface_model* rface_model_load(const char* file_name, size_t n_threads) {
+
+  if ( !file_name ) {
+    fail("file name must be set");
+    return( NULL );
+  }
+
+  rface_model* model = NULL;
+
+  try {
+
+    if ( checkThreads(n_threads) != 0 ) {
+      return( NULL );
+    }
+
+    model = new rface_model(max(static_cast<size_t>(1),n_threads),-1);
+
+    model->rface.load(file_name);
+
+    return( model );
+
+  } catch ( exception& e ) {
+    delete model;
+    fail(e.what());
+    return( NULL );
+  }
+
+}
+
+void rface_model_free(rface_model* model) {
+  delete model;
+}
@@ -0,0 +1,102 @@
+/* rf_ace_c.h
+ *
+ * C interface of RF-ACE, built as bin/librface.so with "make librface".
+ *
+ * Data sets are assembled column by column from buffers owned by the caller. Unmasked float
+ * columns are read in place, without copying, and must stay valid and unchanged until the data set
+ * is freed; builds with NUM_T_DOUBLE copy them instead. NaN marks a missing value. Models are
+ * trained on one data set and predict on others, matching features by name.
+ *
+ * Functions returning int return 0 on success and -1 on failure, and functions returning a pointer
+ * return NULL on failure; rface_last_error() then describes the failure, such as invalid
+ * arguments or training options, a target without values, or a malformed forest file.
+ */
+
+#ifndef RF_ACE_C_H
+#define RF_ACE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  define RFACE_API __declspec(dllexport)
+#else
+#  define RFACE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RFACE_ABI_VERSION 1
+
+typedef struct rface_data rface_data;
+typedef struct rface_model rface_model;
+
+typedef enum { RFACE_RF = 0, RFACE_QRF = 1, RFACE_GBT = 2 } rface_forest_type;
+
+typedef struct {
+  rface_forest_type forest_type;
+  size_t n_trees;
+  size_t m_try;          /* features drawn per split; 0 draws a third of the features */
+  size_t node_size;
+  size_t n_max_leaves;   /* 0 places no limit */
+  double shrinkage;      /* GBT only, in (0,1] */
+  int no_na_branching;
+  size_t n_threads;      /* at most 1 in builds with NOTHREADS */
+  int seed;              /* negative draws a seed */
+} rface_train_options;
+
+/* Version of this interface, RFACE_ABI_VERSION of the library */
+RFACE_API int rface_abi_version(void);
+
+/* Description of the latest failure in the calling thread */
+RFACE_API const char* rface_last_error(void);
+
+/* Fills the options with the defaults of the forest type */
+RFACE_API void rface_train_options_init(rface_train_options* options, rface_forest_type forest_type);
+
+RFACE_API rface_data* rface_data_create(size_t n_samples);
+
+/* Adds a numerical column of n_samples values. Without a mask the values are read in place,
+ * except in builds with NUM_T_DOUBLE, which copy them. A non-zero entry of na_mask marks the
+ * sample missing; the column is then copied, with the masked samples set missing */
+RFACE_API int rface_data_add_numerical(rface_data* data, const char* name, const float* values, const uint8_t* na_mask);
+
+/* Adds a categorical column of n_samples codes into the n_categories names of category_names. A
+ * negative code, or a non-zero entry of na_mask, marks the sample missing. The codes are decoded
+ * into the data set, so the buffers may be released after the call */
+RFACE_API int rface_data_add_categorical(rface_data* data, const char* name, const int32_t* codes, const uint8_t* na_mask,
+					 const char* const* category_names, size_t n_categories);
+
+RFACE_API size_t rface_data_n_samples(const rface_data* data);
+
+RFACE_API void rface_data_free(rface_data* data);
+
+/* Trains a model to predict the column named target from the other columns */
+RFACE_API rface_model* rface_train(rface_data* data, const char* target, const rface_train_options* options);
+
+/* Writes one prediction per sample of the data into predictions, and their confidence into
+ * confidence unless it is NULL. The target of the model must be numerical */
+RFACE_API int rface_predict_numerical(rface_model* model, rface_data* data, float* predictions, float* confidence);
+
+/* Writes the predicted category of each sample as its index in category_names, or -1 if the
+ * category is not listed, and the confidence unless it is NULL. The target must be categorical */
+RFACE_API int rface_predict_categorical(rface_model* model, rface_data* data, const char* const* category_names, size_t n_categories,
+					int32_t* predictions, float* confidence);
+
+/* 1 if the target of the model is numerical, 0 if categorical */
+RFACE_API int rface_model_is_numerical(rface_model* model);
+
+/* Writes the trees of a trained or loaded model into a file */
+RFACE_API int rface_model_save(rface_model* model, const char* file_name);
+
+RFACE_API rface_model* rface_model_load(const char* file_name, size_t n_threads);
+
+RFACE_API void rface_model_free(rface_model* model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
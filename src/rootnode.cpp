@@ -1,14 +1,19 @@
 #include <string>
 #include <cmath>
 #include <stack>
+#include <chrono>
 #include <unordered_set>
 #include "math.hpp"
 #include "rootnode.hpp"
+#include "densetreedata.hpp"
 #include "datadefs.hpp"
+#include "exceptions.hpp"
 
 using datadefs::forest_t;
 
-RootNode::RootNode() {}
+RootNode::RootNode():
+  nLeaves_(0),
+  growTime_(0.0) {}
 
 RootNode::RootNode(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random):
   forestType_(forestOptions->forestType),
@@ -16,15 +21,17 @@ RootNode::RootNode(TreeData* trainData, const size_t targetIdx, const distributi
   isTargetNumerical_(trainData->feature(targetIdx)->isNumerical()),
   children_(0),
   nLeaves_(0),
-  bootstrapIcs_(0),
   oobIcs_(0),
-  minDistToRoot_(0) {
+  minDistToRoot_(0),
+  growTime_(0.0) {
 
   this->growTree(trainData,targetIdx,pmf,forestOptions,random);
 
 }
 
-RootNode::RootNode(ifstream& treeStream) {
+RootNode::RootNode(ifstream& treeStream):
+  nLeaves_(0),
+  growTime_(0.0) {
 
   this->loadTree(treeStream);
 
@@ -32,27 +39,30 @@ RootNode::RootNode(ifstream& treeStream) {
 
 RootNode::~RootNode() { /* EMPTY DESTRUCTOR */ }
 
-size_t RootNode::getTreeSizeEstimate(const size_t nSamples, const size_t nMaxLeaves, const size_t nodeSize) const {
-
-  // Upper bound for the number of nodes as dictated by nMaxLeaves, 
-  // assuming ternary splits (left,right,missing)
-  size_t S1 = static_cast<size_t>(ceil(1.0 + 3.0 * ( nMaxLeaves - 1 ) / 2.0)); 
+void RootNode::reset(const size_t nNodes) {
 
-  // Upper bound for the number of nodes as dictated by sample size,
-  // assuming ternary splits (left,right,missing)
-  size_t S2 = static_cast<size_t>(ceil(1.0 + 3.0 * ( ceil(nSamples/nodeSize) - 1 ) / 2.0 ));
+  assert(nNodes > 0);
 
-  // Return the smaller of the two upper bounds, S1 and S2
-  return( S1 < S2 ? S1 : S2 );
+  children_.clear();
+  children_.resize(nNodes-1);
 
 }
 
-void RootNode::reset(const size_t nNodes) {
+namespace {
 
-  assert(nNodes > 1);
+  // Value of a field of a tree file, or an exception naming the field if it is malformed
+  template<typename T>
+  T readField(const string& str, const string& fieldName, const string& nodeName) {
 
-  children_.clear();
-  children_.resize(nNodes-1);
+    T value;
+
+    if ( !utils::convert(str,value) ) {
+      throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "node '" + nodeName + "' has a malformed " + fieldName + " '" + str + "'");
+    }
+
+    return( value );
+
+  }
 
 }
 
@@ -70,37 +80,65 @@ void RootNode::loadTree(ifstream& treeStream) {
   // remove trailing end-of-line characters
   newLine = utils::chomp(newLine);
 
-  assert(newLine.compare(0, 5, "TREE=") == 0);
+  if ( newLine.compare(0, 5, "TREE=") != 0 ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "a tree does not start with 'TREE='");
+  }
+
   map<string,string> treeSetup = utils::parse(newLine, ',', '=', '"');
-  assert( treeSetup.find("NNODES") != treeSetup.end() );
-  nNodes = utils::str2<size_t>(treeSetup["NNODES"]);
+
+  if ( datadefs::isNAN_STR(treeSetup["NNODES"]) || !utils::convert(treeSetup["NNODES"],nNodes) || nNodes == 0 ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "a tree must declare at least one node in NNODES");
+  }
+
+  if ( datadefs::forestTypeAssign.find(treeSetup["FOREST"]) == datadefs::forestTypeAssign.end() ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "unknown forest type '" + treeSetup["FOREST"] + "'");
+  }
+
+  if ( treeSetup["ISTARGETNUMERICAL"] != "0" && treeSetup["ISTARGETNUMERICAL"] != "1" ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "ISTARGETNUMERICAL must be 0 or 1");
+  }
 
   forestType_ = datadefs::forestTypeAssign.at(treeSetup["FOREST"]);
   targetName_ = treeSetup["TARGET"];
-  isTargetNumerical_ = utils::str2<bool>(treeSetup["ISTARGETNUMERICAL"]);
+  isTargetNumerical_ = treeSetup["ISTARGETNUMERICAL"] == "1";
 
   this->reset(nNodes);
   treeMap["*"] = this;
 
+  // Every node without a splitter is a leaf
+  nLeaves_ = 0;
+
   for ( size_t nodeIdx = 0; nodeIdx < nNodes; ++nodeIdx ) {
 
-    assert( getline(treeStream,newLine) );
+    if ( !getline(treeStream,newLine) ) {
+      throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "a tree has fewer nodes than declared");
+    }
     
     // remove trailing end-of-line characters
     newLine = utils::chomp(newLine);
 
     map<string,string> nodeMap = utils::parse(newLine, ',', '=', '"');
+
+    string nodeName = nodeMap["NODE"];
     
-    Node* nodep = treeMap[nodeMap["NODE"]];
+    unordered_map<string,Node*>::const_iterator it( treeMap.find(nodeName) );
+
+    if ( it == treeMap.end() ) {
+      throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "node '" + nodeName + "' is not a child of an earlier node");
+    }
+
+    Node* nodep = it->second;
     
     string rawTrainPrediction = nodeMap["PRED"];
     vector<string> rawTrainData = utils::split(nodeMap["DATA"],',');
 
     // Set the prediction and data for the node
     if ( isTargetNumerical_ || (!isTargetNumerical_ && forestType_ == forest_t::GBT) ) {
-      nodep->setNumTrainPrediction( utils::str2<num_t>(rawTrainPrediction) );
+      nodep->setNumTrainPrediction( readField<num_t>(rawTrainPrediction,"PRED",nodeName) );
       vector<num_t> numTrainData(rawTrainData.size());
-      transform(rawTrainData.begin(),rawTrainData.end(),numTrainData.begin(),utils::str2<num_t>);
+      for ( size_t i = 0; i < rawTrainData.size(); ++i ) {
+	numTrainData[i] = readField<num_t>(rawTrainData[i],"DATA",nodeName);
+      }
       nodep->setNumTrainData(numTrainData);
     } else { 
       nodep->setCatTrainPrediction( rawTrainPrediction );
@@ -109,25 +147,30 @@ void RootNode::loadTree(ifstream& treeStream) {
       nodep->setCatTrainData(catTrainData);
     }
     
+    if ( nodeMap.find("SPLITTER") == nodeMap.end() ) {
+      ++nLeaves_;
+    }
+
     // If the node has a splitter... 
     if ( nodeMap.find("SPLITTER") != nodeMap.end() ) {
+
+      bool hasMissingChild = nodeMap.find("M") != nodeMap.end();
+
+      if ( nNodesAllocated + ( hasMissingChild ? 3 : 2 ) + 1 > nNodes ) {
+	throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "a tree has more nodes than declared");
+      }
       
       size_t leftChildIdx = nNodesAllocated++;
       size_t rightChildIdx = nNodesAllocated++;
       
-      if ( nNodesAllocated + 1 > nNodes ) {
-	cerr << "RootNode::loadForest() -- the tree contains more nodes than declared!" << endl;
-	exit(1);
-      }
-      
       Node& lChild = this->childRef(leftChildIdx);
       Node& rChild = this->childRef(rightChildIdx);
 
-      num_t splitFitness = utils::str2<num_t>(nodeMap["DI"]);
+      num_t splitFitness = readField<num_t>(nodeMap["DI"],"DI",nodeName);
       
       if ( nodeMap["SPLITTERTYPE"] == "NUMERICAL" ) {
 
-        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], utils::str2<num_t>(nodeMap["LVALUES"]), lChild, rChild);
+        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], readField<num_t>(nodeMap["LVALUES"],"LVALUES",nodeName), lChild, rChild);
 
       } else if ( nodeMap["SPLITTERTYPE"] == "CATEGORICAL" ){
 
@@ -136,32 +179,33 @@ void RootNode::loadTree(ifstream& treeStream) {
         nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], splitLeftValues, lChild, rChild);
 
       } else if ( nodeMap["SPLITTERTYPE"] == "TEXTUAL" ) {
-        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], utils::str2<uint32_t>(nodeMap["LVALUES"]), lChild, rChild);
+        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], readField<uint32_t>(nodeMap["LVALUES"],"LVALUES",nodeName), lChild, rChild);
       } else {
-        cerr << "ERROR: incompatible splitter type '" << nodeMap["SPLITTERTYPE"] << endl;
-        exit(1);
+	throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "node '" + nodeName + "' has an incompatible splitter type '" + nodeMap["SPLITTERTYPE"] + "'");
       }
 
       assert( &lChild == nodep->leftChild() );
       assert( &rChild == nodep->rightChild() );
 
-      treeMap[nodeMap["NODE"] + "L"] = nodep->leftChild();
-      treeMap[nodeMap["NODE"] + "R"] = nodep->rightChild();
+      treeMap[nodeName + "L"] = nodep->leftChild();
+      treeMap[nodeName + "R"] = nodep->rightChild();
 
       // In case there is a branch for case when the splitter has missing value
-      if ( nodeMap.find("M") != nodeMap.end() ) {
+      if ( hasMissingChild ) {
         size_t missingChildIdx = nNodesAllocated++;
         Node& mChild = this->childRef(missingChildIdx);
         nodep->setMissingChild(mChild);
         assert( &mChild == nodep->missingChild() );
-        treeMap[nodeMap["NODE"] + "M"] = nodep->missingChild();
+        treeMap[nodeName + "M"] = nodep->missingChild();
       }
 
     }
 
   }
 
-  assert( nNodesAllocated + 1 == nNodes );
+  if ( nNodesAllocated + 1 != nNodes ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "the nodes of a tree do not add up to the declared number");
+  }
 
   treeStream.peek();
 
@@ -190,21 +234,36 @@ void RootNode::writeTree(ofstream& toFile) {
 }
 
 
-void RootNode::growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random) {
+void RootNode::growTree(TreeData* trainData, 
+			const size_t targetIdx, 
+			const distributions::PMF* pmf, 
+			const ForestOptions* forestOptions, 
+			distributions::Random* random,
+			const Feature* target,
+			vector<num_t>* trainPredictions,
+			WorkerPool* splitPool) {
+
+  profiler::ScopedTimer scopedTimer("growTree");
+  trace::ScopedEvent event("growTree", "nSamples", trainData->nSamples());
+
+  chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+  if ( !target ) {
+    target = trainData->feature(targetIdx);
+  }
 
   forestType_ = forestOptions->forestType;
   targetName_ = trainData->feature(targetIdx)->name();
   isTargetNumerical_ = trainData->feature(targetIdx)->isNumerical();
 
-  size_t nMaxNodes = this->getTreeSizeEstimate(trainData->feature(targetIdx)->nRealSamples(),forestOptions->nMaxLeaves,forestOptions->nodeSize);
-
-  this->reset(nMaxNodes);
-
   //Generate the vector for bootstrap indices
   vector<size_t> bootstrapIcs;
+
+  //Multiplicities of the samples in the bootstrap; repeated draws are not stored as duplicate indices
+  vector<size_t> sampleWeights;
   
   //Generate bootstrap indices and oob-indices
-  trainData->bootstrapFromRealSamples(random, forestOptions->sampleWithReplacement, forestOptions->inBoxFraction, targetIdx, bootstrapIcs_, oobIcs_);
+  trainData->bootstrapFromRealSamples(random, forestOptions->sampleWithReplacement, forestOptions->inBoxFraction, targetIdx, bootstrapIcs, sampleWeights, oobIcs_);
 
   //featuresInTree_.clear();
 
@@ -220,22 +279,99 @@ void RootNode::growTree(TreeData* trainData, const size_t targetIdx, const distr
 
   nLeaves_ = 1;
 
-  size_t nChildren = 0;
-
-  //Start the recursive node splitting from the root node. This will generate the tree.
-  this->recursiveNodeSplit(trainData,
-			   targetIdx,
-			   forestOptions,
-			   random,
-			   predictionFunctionType,
-			   pmf,
-			   bootstrapIcs_,
-			   &nLeaves_,
-			   nChildren,
-			   children_,
-			   splitCache_);
-  
-  children_.resize(nChildren);
+  //The tree is grown into a compact arena, which is only as large as the tree becomes
+  TreeArena arena;
+  SplitCache splitCache;
+
+  //The split search of all nodes shares one set of workers
+  WorkerPool* treePool = NULL;
+  if ( !splitPool && forestOptions->nSplitThreads > 1 ) {
+    treePool = new WorkerPool(forestOptions->nSplitThreads);
+    splitPool = treePool;
+  }
+  splitCache.splitPool = splitPool;
+
+  if ( trainPredictions ) {
+    arena.sampleLeafIdx.resize(trainData->nSamples(),datadefs::MAX_IDX);
+  }
+
+  size_t rootIdx = arena.addNode();
+
+  //Target statistics of the root; the nodes below derive theirs from the parent. Squares are summed
+  //around a sample of the target, which is close to the data whatever its offset
+  num_t shift = target->isNumerical() && bootstrapIcs.size() > 0 ? target->getNumData(bootstrapIcs[0]) : 0.0;
+  NodeStats rootStats( datadefs::isNAN(shift) ? 0.0 : shift );
+  rootStats.add(target,bootstrapIcs,sampleWeights);
+
+  //Start the recursive node splitting from the root node. This will generate the tree. The data class
+  //is resolved here once, and growth calls the accessors of DenseTreeData directly
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(trainData);
+
+  if ( denseData ) {
+    Node::recursiveNodeSplit(denseData,
+			     target,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     bootstrapIcs,
+			     sampleWeights,
+			     rootStats,
+			     &nLeaves_,
+			     rootIdx,
+			     arena,
+			     splitCache);
+  } else {
+    Node::recursiveNodeSplit(trainData,
+			     target,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     bootstrapIcs,
+			     sampleWeights,
+			     rootStats,
+			     &nLeaves_,
+			     rootIdx,
+			     arena,
+			     splitCache);
+  }
+
+  //The growing buffers are at their largest now
+  if ( memreport::isEnabled ) {
+    memreport::recordBuffers( memreport::heapBytes(bootstrapIcs) + memreport::heapBytes(sampleWeights) +
+			      memreport::heapBytes(arena.nodes) + memreport::heapBytes(arena.leftValues) + 
+			      memreport::heapBytes(arena.catPredictions) + memreport::heapBytes(arena.sampleLeafIdx) +
+			      splitCache.heapBytes() + splitCache.peakThreadCacheBytes );
+  }
+
+  delete treePool;
+
+  //Now that the size of the tree is known, allocate exactly that many nodes and link them
+  vector<Node>(arena.nodes.size() - 1).swap(children_);
+
+  this->setFromArena(trainData,arena,rootIdx,children_);
+  for ( size_t nodeIdx = 1; nodeIdx < arena.nodes.size(); ++nodeIdx ) {
+    children_[nodeIdx - 1].setFromArena(trainData,arena,nodeIdx,children_);
+  }
+
+  //In-bag samples take the prediction of the leaf they ended up in during growing; only the rest need to be percolated
+  if ( trainPredictions ) {
+    size_t nSamples = trainData->nSamples();
+    trainPredictions->resize(nSamples);
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      if ( arena.sampleLeafIdx[i] != datadefs::MAX_IDX ) {
+	(*trainPredictions)[i] = arena.nodes[ arena.sampleLeafIdx[i] ].numTrainPrediction;
+      } else {
+	(*trainPredictions)[i] = this->getPrediction(trainData,i).numTrainPrediction;
+      }
+    }
+  }
+
+  chrono::duration<num_t> growTime = chrono::steady_clock::now() - startTime;
+  growTime_ = growTime.count();
   
 }
 
@@ -309,6 +445,41 @@ void RootNode::verifyIntegrity() const {
   
 }
 
+RootNode::TreeStats RootNode::getTreeStats() const {
+
+  TreeStats treeStats = { 0, 0, 0, 0, oobIcs_.size(), growTime_ };
+
+  // The root is at depth 0
+  stack<pair<const Node*,size_t> > nodesToVisit;
+  nodesToVisit.push( pair<const Node*,size_t>(this,0) );
+
+  while ( ! nodesToVisit.empty() ) {
+
+    const Node* node = nodesToVisit.top().first;
+    size_t depth = nodesToVisit.top().second;
+    nodesToVisit.pop();
+
+    ++treeStats.nNodes;
+    treeStats.depth = max(treeStats.depth,depth);
+
+    if ( node->hasChildren() ) {
+      nodesToVisit.push( pair<const Node*,size_t>(node->leftChild(),depth + 1) );
+      nodesToVisit.push( pair<const Node*,size_t>(node->rightChild(),depth + 1) );
+    } else {
+      ++treeStats.nLeaves;
+    }
+
+    if ( node->missingChild() ) {
+      ++treeStats.nMissingNodes;
+      nodesToVisit.push( pair<const Node*,size_t>(node->missingChild(),depth + 1) );
+    }
+
+  }
+
+  return( treeStats );
+
+}
+
 // This is a bad function, it exposes the private data to public!!
 Node& RootNode::childRef(const size_t childIdx) {
 
@@ -325,7 +496,7 @@ size_t RootNode::nNodes() const {
 size_t RootNode::nLeaves() const {
 
   if ( nLeaves_ == 0 ) {
-    cerr << "ERROR: RootNode::nLeaves() -- trying to save a forest that has been read from file? Don't!" << endl;
+    cerr << "ERROR: RootNode::nLeaves() -- the tree has been neither grown nor loaded" << endl;
     exit(1);
   }
 
@@ -379,4 +550,17 @@ vector<cat_t> RootNode::getChildLeafCatTrainData(TreeData* treeData, const size_
 
 }
 
+void RootNode::memoryUsage(memreport::Breakdown& breakdown) const {
+
+  memreport::add(breakdown, "nodes", sizeof(RootNode) + memreport::heapBytes(children_));
 
+  this->Node::memoryUsage(breakdown);
+  for ( size_t nodeIdx = 0; nodeIdx < children_.size(); ++nodeIdx ) {
+    children_[nodeIdx].memoryUsage(breakdown);
+  }
+
+  // A set node holds its value, three pointers and a color
+  memreport::add(breakdown, "OOB samples and other bookkeeping", memreport::heapBytes(targetName_) + memreport::heapBytes(oobIcs_) +
+		 featuresInTree_.size() * ( sizeof(size_t) + 4 * sizeof(void*) ) + memreport::heapBytes(minDistToRoot_));
+
+}
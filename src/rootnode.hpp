@@ -19,13 +19,23 @@ using datadefs::cat_t;
 class RootNode : public Node {
 public:
 
+  // Shape of a tree, and the seconds it took to grow; trees loaded from file have no growth time
+  struct TreeStats {
+    size_t depth;
+    size_t nNodes;
+    size_t nLeaves;
+    size_t nMissingNodes;
+    size_t nOobSamples;
+    num_t growTime;
+  };
+
   // Empty tree
   RootNode();
   
   // Learn Tree from data
   RootNode(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random);
 
-  // Load tree from file
+  // Load tree from file; a malformed tree throws RFACE_EXCEPTION with ERRNO::INVALID_READ
   RootNode(ifstream& treeStream);
 
   ~RootNode();
@@ -36,7 +46,17 @@ public:
   
   void writeTree(ofstream& toFile);
   
-  void growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random);
+  // The tree is fit against target, which defaults to feature targetIdx of trainData. If trainPredictions
+  // is given, it receives the prediction of the grown tree for every sample of trainData. The split search
+  // runs on splitPool if given, and otherwise on a pool of forestOptions->nSplitThreads workers of the tree
+  void growTree(TreeData* trainData, 
+		const size_t targetIdx, 
+		const distributions::PMF* pmf, 
+		const ForestOptions* forestOptions, 
+		distributions::Random* random,
+		const Feature* target = NULL,
+		vector<num_t>* trainPredictions = NULL,
+		WorkerPool* splitPool = NULL);
   
   Node& childRef(const size_t childIdx);
   
@@ -55,6 +75,7 @@ public:
 
   set<size_t> getFeaturesInTree() { return( featuresInTree_ ); }
 
+  forest_t getForestType() const { return( forestType_ ); }
   string getTargetName() const { return( targetName_ ); }
   bool isTargetNumerical() const { return( isTargetNumerical_ ); }
 
@@ -62,12 +83,15 @@ public:
 
   void verifyIntegrity() const;
 
+  TreeStats getTreeStats() const;
+
+  // Bytes held by the nodes, their category sets and leaf data, and the bookkeeping of the tree
+  void memoryUsage(memreport::Breakdown& breakdown) const;
+
 #ifndef TEST__
 private:
 #endif
 
-  size_t getTreeSizeEstimate(const size_t nSamples, const size_t nMaxLeaves, const size_t nodeSize) const;
-
   forest_t forestType_;
   string targetName_;
   bool isTargetNumerical_;
@@ -77,14 +101,13 @@ private:
 
   size_t nLeaves_;
 
-  vector<size_t> bootstrapIcs_;
   vector<size_t> oobIcs_;
 
   set<size_t> featuresInTree_;
 
   vector<size_t> minDistToRoot_;
 
-  SplitCache splitCache_;
+  num_t growTime_;
 
 };
 
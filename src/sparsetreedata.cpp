@@ -0,0 +1,460 @@
+#include "sparsetreedata.hpp"
+#include <cstdlib>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "reader.hpp"
+#include "utils.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "workcounters.hpp"
+
+using namespace std;
+
+SparseTreeData::SparseTreeData(const vector<Feature>& features, const bool useContrasts, const vector<string>& sampleHeaders):
+  DenseTreeData(features,useContrasts,sampleHeaders) {
+}
+
+SparseTreeData::SparseTreeData(const string& fileName, const char headerDelimiter, const bool isLabelNumerical, const bool useContrasts):
+  DenseTreeData(useContrasts) {
+
+  profiler::ScopedTimer scopedTimer("readData");
+  trace::ScopedEvent event("readData");
+
+  this->readLibSVM(fileName,headerDelimiter,isLabelNumerical);
+
+  if ( useContrasts_ ) {
+    this->createContrasts();
+  }
+
+}
+
+SparseTreeData::~SparseTreeData() {
+  /* Empty destructor */
+}
+
+bool SparseTreeData::isSparseFile(const string& fileName) {
+
+  size_t dotPos = fileName.find_last_of('.');
+
+  if ( dotPos == string::npos ) {
+    return( false );
+  }
+
+  string extension = fileName.substr(dotPos);
+
+  return( extension == ".libsvm" || extension == ".svm" );
+
+}
+
+void SparseTreeData::readLibSVM(const string& fileName, const char headerDelimiter, const bool isLabelNumerical) {
+
+  Reader reader(fileName,' ');
+
+  vector<string> labels;
+
+  // Entries of each feature, by the index of the feature in the file
+  vector<vector<uint32_t> > featureIcs;
+  vector<vector<num_t> > featureValues;
+
+  sampleHeaders_.clear();
+
+  for ( size_t lineIdx = 1; reader.nextLine(); ++lineIdx ) {
+
+    // Empty lines and comment lines hold no sample
+    if ( reader.endOfLine() ) {
+      continue;
+    }
+
+    string label; reader >> label;
+
+    if ( label.empty() || label[0] == '#' ) {
+      continue;
+    }
+
+    if ( labels.size() == numeric_limits<uint32_t>::max() ) {
+      cerr << "ERROR reading libsvm file '" << fileName << "': too many samples" << endl;
+      exit(1);
+    }
+
+    uint32_t sampleIdx = labels.size();
+    labels.push_back(label);
+
+    stringstream ss;
+    ss << lineIdx;
+    sampleHeaders_.push_back(ss.str());
+
+    while ( !reader.endOfLine() ) {
+
+      string field; reader >> field;
+
+      // Repeated delimiters leave empty fields, and a comment ends the line
+      if ( field.empty() ) {
+	continue;
+      } else if ( field[0] == '#' ) {
+	break;
+      }
+
+      size_t colonPos = field.find(':');
+
+      if ( colonPos == 0 || colonPos == string::npos || colonPos + 1 == field.size() ) {
+	cerr << "ERROR reading libsvm file '" << fileName << "': expected <index>:<value> but found '" << field << "' on line " << lineIdx << endl;
+	exit(1);
+      }
+
+      // Query identifiers of ranking data are not features
+      if ( field.compare(0,colonPos,"qid") == 0 ) {
+	continue;
+      }
+
+      size_t featureIdx = utils::str2<size_t>(field.substr(0,colonPos));
+      num_t value = utils::str2<num_t>(field.substr(colonPos + 1));
+
+      if ( featureIdx >= featureIcs.size() ) {
+	featureIcs.resize(featureIdx + 1);
+	featureValues.resize(featureIdx + 1);
+      }
+
+      featureIcs[featureIdx].push_back(sampleIdx);
+      featureValues[featureIdx].push_back(value);
+
+    }
+
+  }
+
+  size_t nSamples = labels.size();
+
+  if ( nSamples == 0 ) {
+    cerr << "ERROR reading libsvm file '" << fileName << "': no samples found" << endl;
+    exit(1);
+  }
+
+  features_.clear();
+  name2idx_.clear();
+
+  if ( isLabelNumerical ) {
+    vector<num_t> labelData(nSamples);
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      labelData[i] = utils::str2<num_t>(labels[i]);
+    }
+    features_.push_back( Feature(labelData,string("N") + headerDelimiter + "label") );
+  } else {
+    features_.push_back( Feature(labels,string("C") + headerDelimiter + "label") );
+  }
+
+  // Indices start from 1, but 0 is accepted. Features without entries are kept, so that
+  // the names of the features do not depend on which of them happen to be present
+  size_t firstIdx = featureIcs.size() > 0 && featureIcs[0].size() > 0 ? 0 : 1;
+
+  for ( size_t featureIdx = firstIdx; featureIdx < featureIcs.size(); ++featureIdx ) {
+    stringstream ss;
+    ss << "N" << headerDelimiter << featureIdx;
+    features_.push_back( Feature(featureIcs[featureIdx],featureValues[featureIdx],nSamples,ss.str()) );
+    vector<uint32_t>().swap(featureIcs[featureIdx]);
+    vector<num_t>().swap(featureValues[featureIdx]);
+  }
+
+  name2idx_.rehash(4*features_.size());
+
+  for ( size_t featureIdx = 0; featureIdx < features_.size(); ++featureIdx ) {
+    name2idx_[ features_[featureIdx].name() ] = featureIdx;
+  }
+
+}
+
+void SparseTreeData::separateMissingSamples(const size_t featureIdx,
+					    vector<size_t>& sampleIcs,
+					    vector<size_t>& missingIcs) {
+
+  const Feature* feature = this->feature(featureIdx);
+
+  // Most sparse features have no missing samples
+  if ( feature->isSparse() && feature->sparseMissingIcs.size() == 0 ) {
+    missingIcs.clear();
+    return;
+  }
+
+  DenseTreeData::separateMissingSamples(featureIdx,sampleIcs,missingIcs);
+
+}
+
+void SparseTreeData::gatherNonZeros(const Feature* feature,
+				    const vector<size_t>& sampleIcs,
+				    vector<num_t>& values,
+				    vector<size_t>& nonZeroIcs,
+				    vector<size_t>& zeroIcs) {
+
+  values.clear();
+  nonZeroIcs.clear();
+  zeroIcs.clear();
+
+  size_t nSamples = sampleIcs.size();
+  size_t nStored = feature->sparseIcs.size();
+
+  size_t log2Stored = 1;
+  for ( size_t n = nStored; n > 1; n >>= 1 ) {
+    ++log2Stored;
+  }
+
+  // Small nodes look their samples up; large nodes make one pass over the stored entries
+  if ( nSamples * log2Stored < nStored ) {
+
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      size_t pos = feature->sparsePos(sampleIcs[i]);
+      if ( pos != datadefs::MAX_IDX ) {
+	values.push_back(feature->numData[pos]);
+	nonZeroIcs.push_back(sampleIcs[i]);
+      } else {
+	zeroIcs.push_back(sampleIcs[i]);
+      }
+    }
+
+    return;
+
+  }
+
+  // One flag per sample in the data: 1 if the sample is in the node, 2 if it also has a stored entry
+  static thread_local vector<char> flags;
+
+  if ( flags.size() < feature->nSamples() ) {
+    flags.resize(feature->nSamples(),0);
+  }
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    flags[ sampleIcs[i] ] = 1;
+  }
+
+  for ( size_t pos = 0; pos < nStored; ++pos ) {
+    uint32_t sampleIdx = feature->sparseIcs[pos];
+    if ( flags[sampleIdx] == 1 ) {
+      flags[sampleIdx] = 2;
+      values.push_back(feature->numData[pos]);
+      nonZeroIcs.push_back(sampleIdx);
+    }
+  }
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    if ( flags[ sampleIcs[i] ] == 1 ) {
+      zeroIcs.push_back(sampleIcs[i]);
+    }
+    flags[ sampleIcs[i] ] = 0;
+  }
+
+}
+
+num_t SparseTreeData::numericalFeatureSplit(const Feature* target,
+					    const size_t featureIdx,
+					    const size_t minSamples,
+					    const vector<size_t>& sampleWeights,
+					    vector<size_t>& sampleIcs_left,
+					    vector<size_t>& sampleIcs_right,
+					    num_t& splitValue) {
+
+  const Feature* feature = this->feature(featureIdx);
+
+  if ( !feature->isSparse() ) {
+    return( DenseTreeData::numericalFeatureSplit(target,featureIdx,minSamples,sampleWeights,sampleIcs_left,sampleIcs_right,splitValue) );
+  }
+
+  profiler::ScopedTimer scopedTimer("sparseNumericalSplit");
+
+  sampleIcs_left.clear();
+
+  size_t n_tot = sampleIcs_right.size();
+
+  vector<num_t> nzv;
+  vector<size_t> nonZeroIcs;
+  vector<size_t> zeroIcs;
+
+  this->gatherNonZeros(feature,sampleIcs_right,nzv,nonZeroIcs,zeroIcs);
+
+  // Only the non-zero values need sorting
+  vector<size_t> sortIcs = utils::range(nzv.size());
+  {
+    profiler::ScopedTimer sortTimer("sort");
+    utils::sortDataAndMakeRef(true,nzv,sortIcs);
+    utils::sortFromRef(nonZeroIcs,sortIcs);
+  }
+
+  WorkCounters& workCounters = WorkCounters::local();
+  ++workCounters.numCandidates;
+  ++workCounters.sortCalls;
+  workCounters.samplesScanned += n_tot;
+
+  // The zero block sits between the negative and the positive values
+  size_t n_neg = lower_bound(nzv.begin(),nzv.end(),static_cast<num_t>(0.0)) - nzv.begin();
+
+  // Split positions: the non-zero samples, and the zero block summarized as one position per target
+  // value, with the summed multiplicities of its samples. Positions of equal value are never split apart
+  vector<num_t> fv;
+  vector<size_t> wv;
+  size_t w_tot = 0;
+
+  fv.reserve(nzv.size() + 1);
+  wv.reserve(nzv.size() + 1);
+
+  size_t bestSplitIdx = datadefs::MAX_IDX;
+  num_t DI_best = 0.0;
+
+  if ( target->isNumerical() ) {
+
+    vector<num_t> tv;
+    tv.reserve(nzv.size() + 1);
+
+    size_t w_zero = 0;
+    datadefs::acc_t mu_zero = 0.0;
+    for ( size_t i = 0; i < zeroIcs.size(); ++i ) {
+      size_t w = sampleWeights[ zeroIcs[i] ];
+      if ( w > 0 ) {
+	w_zero += w;
+	mu_zero += w * ( target->getNumData(zeroIcs[i]) - mu_zero ) / w_zero;
+      }
+    }
+
+    for ( size_t i = 0; i <= nzv.size(); ++i ) {
+      if ( i == n_neg && w_zero > 0 ) {
+	tv.push_back(mu_zero);
+	fv.push_back(0.0);
+	wv.push_back(w_zero);
+      }
+      if ( i < nzv.size() ) {
+	tv.push_back(target->getNumData(nonZeroIcs[i]));
+	fv.push_back(nzv[i]);
+	wv.push_back(sampleWeights[ nonZeroIcs[i] ]);
+      }
+    }
+
+    for ( size_t i = 0; i < wv.size(); ++i ) {
+      w_tot += wv[i];
+    }
+
+    if ( w_tot < 2 * minSamples ) {
+      return( 0.0 );
+    }
+
+    DI_best = utils::numericalFeatureSplitsNumericalTarget(tv,fv,wv,minSamples,bestSplitIdx);
+
+  } else {
+
+    vector<cat_t> tv;
+    tv.reserve(nzv.size() + 1);
+
+    unordered_map<cat_t,size_t> w_zero;
+    for ( size_t i = 0; i < zeroIcs.size(); ++i ) {
+      size_t w = sampleWeights[ zeroIcs[i] ];
+      if ( w > 0 ) {
+	w_zero[ target->getCatData(zeroIcs[i]) ] += w;
+      }
+    }
+
+    for ( size_t i = 0; i <= nzv.size(); ++i ) {
+      if ( i == n_neg ) {
+	for ( unordered_map<cat_t,size_t>::const_iterator it(w_zero.begin()); it != w_zero.end(); ++it ) {
+	  tv.push_back(it->first);
+	  fv.push_back(0.0);
+	  wv.push_back(it->second);
+	}
+      }
+      if ( i < nzv.size() ) {
+	tv.push_back(target->getCatData(nonZeroIcs[i]));
+	fv.push_back(nzv[i]);
+	wv.push_back(sampleWeights[ nonZeroIcs[i] ]);
+      }
+    }
+
+    for ( size_t i = 0; i < wv.size(); ++i ) {
+      w_tot += wv[i];
+    }
+
+    if ( w_tot < 2 * minSamples ) {
+      return( 0.0 );
+    }
+
+    DI_best = utils::numericalFeatureSplitsCategoricalTarget(tv,fv,wv,minSamples,bestSplitIdx);
+
+  }
+
+  if ( bestSplitIdx == datadefs::MAX_IDX ) {
+    return( 0.0 );
+  }
+
+  splitValue = fv[bestSplitIdx];
+
+  // Samples with values up to the split value go left, in increasing order of value as in DenseTreeData
+  size_t n_leq = upper_bound(nzv.begin(),nzv.end(),splitValue) - nzv.begin();
+
+  sampleIcs_right.clear();
+
+  if ( splitValue >= 0.0 ) {
+    sampleIcs_left.insert(sampleIcs_left.end(),nonZeroIcs.begin(),nonZeroIcs.begin() + n_neg);
+    sampleIcs_left.insert(sampleIcs_left.end(),zeroIcs.begin(),zeroIcs.end());
+    sampleIcs_left.insert(sampleIcs_left.end(),nonZeroIcs.begin() + n_neg,nonZeroIcs.begin() + n_leq);
+    sampleIcs_right.insert(sampleIcs_right.end(),nonZeroIcs.begin() + n_leq,nonZeroIcs.end());
+  } else {
+    sampleIcs_left.insert(sampleIcs_left.end(),nonZeroIcs.begin(),nonZeroIcs.begin() + n_leq);
+    sampleIcs_right.insert(sampleIcs_right.end(),nonZeroIcs.begin() + n_leq,nonZeroIcs.begin() + n_neg);
+    sampleIcs_right.insert(sampleIcs_right.end(),zeroIcs.begin(),zeroIcs.end());
+    sampleIcs_right.insert(sampleIcs_right.end(),nonZeroIcs.begin() + n_neg,nonZeroIcs.end());
+  }
+
+  assert( sampleIcs_left.size() + sampleIcs_right.size() == n_tot );
+
+  return( DI_best );
+
+}
+
+void SparseTreeData::permuteContrasts(distributions::Random* random) {
+
+  size_t nFeatures = this->nFeatures();
+
+  for ( size_t i = nFeatures; i < 2*nFeatures; ++i ) {
+    if ( this->feature(i)->isSparse() ) {
+      this->permuteSparseContrast(i,random);
+    } else {
+      this->permuteContrast(i,random);
+    }
+  }
+
+}
+
+void SparseTreeData::permuteSparseContrast(const size_t featureIdx, distributions::Random* random) {
+
+  Feature& contrast = features_[featureIdx];
+
+  size_t nStored = contrast.sparseIcs.size();
+  size_t nReal = contrast.nRealSamples();
+
+  assert( nStored <= nReal );
+
+  // Floyd's algorithm draws nStored distinct ranks among the real samples without touching the rest
+  unordered_set<size_t> ranks(2*nStored);
+  for ( size_t j = nReal - nStored; j < nReal; ++j ) {
+    size_t rank = random->integer() % ( j + 1 );
+    if ( !ranks.insert(rank).second ) {
+      ranks.insert(j);
+    }
+  }
+
+  vector<uint32_t> newIcs(ranks.begin(),ranks.end());
+  sort(newIcs.begin(),newIcs.end());
+
+  // Ranks become sample indices by skipping over the missing samples, which stay in place
+  const vector<uint32_t>& missingIcs = contrast.sparseMissingIcs;
+  size_t nSkipped = 0;
+  for ( size_t i = 0; i < newIcs.size(); ++i ) {
+    while ( nSkipped < missingIcs.size() && missingIcs[nSkipped] <= newIcs[i] + nSkipped ) {
+      ++nSkipped;
+    }
+    newIcs[i] += nSkipped;
+  }
+
+  // Shuffling the values over the random sample subset permutes the whole feature
+  utils::permute(contrast.numData,random);
+  contrast.sparseIcs = newIcs;
+
+}
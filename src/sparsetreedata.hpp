@@ -0,0 +1,74 @@
+//sparsetreedata.hpp
+//
+//
+
+#ifndef SPARSETREEDATA_HPP
+#define SPARSETREEDATA_HPP
+
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+#include "datadefs.hpp"
+#include "distributions.hpp"
+#include "feature.hpp"
+#include "densetreedata.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+// Data matrix whose numerical features are mostly zeros. Such features are stored sparse, as the
+// sorted sample indices and values of their non-zero entries plus their missing samples (see Feature),
+// and splitting them only sorts the non-zero entries of a node: the zero block is summarized by the
+// multiplicities and target statistics of its samples and enters the split search as one position.
+// Dense features, such as the target, are handled as in DenseTreeData
+class SparseTreeData : public DenseTreeData {
+public:
+
+  // Initializes the object from sparse and dense features
+  SparseTreeData(const vector<Feature>& features, bool useContrasts = false, const vector<string>& sampleHeaders = vector<string>(0));
+
+  // Reads a data file in libsvm format, "<label> <index>:<value> <index>:<value> ...", one sample per line.
+  // Feature <index> is named "N<headerDelimiter><index>", and the label is a dense feature named
+  // "N<headerDelimiter>label", or "C<headerDelimiter>label" if the label is not numerical.
+  // Samples are named by their line number
+  SparseTreeData(const string& fileName, const char headerDelimiter, const bool isLabelNumerical, const bool useContrasts = false);
+
+  ~SparseTreeData();
+
+  // Files with extension .libsvm or .svm are in libsvm format
+  static bool isSparseFile(const string& fileName);
+
+  void separateMissingSamples(const size_t featureIdx,
+			      vector<size_t>& sampleIcs,
+			      vector<size_t>& missingIcs);
+
+  num_t numericalFeatureSplit(const Feature* target,
+			      const size_t featureIdx,
+			      const size_t minSamples,
+			      const vector<size_t>& sampleWeights,
+			      vector<size_t>& sampleIcs_left,
+			      vector<size_t>& sampleIcs_right,
+			      num_t& splitValue);
+
+  void permuteContrasts(distributions::Random* random);
+
+#ifndef TEST__
+private:
+#endif
+
+  void readLibSVM(const string& fileName, const char headerDelimiter, const bool isLabelNumerical);
+
+  // Splits the samples into those with a stored non-zero value, along with the values, and the rest
+  void gatherNonZeros(const Feature* feature,
+		      const vector<size_t>& sampleIcs,
+		      vector<num_t>& values,
+		      vector<size_t>& nonZeroIcs,
+		      vector<size_t>& zeroIcs);
+
+  // Moves the non-zero values of a sparse contrast to random real samples
+  void permuteSparseContrast(const size_t featureIdx, distributions::Random* random);
+
+};
+
+#endif
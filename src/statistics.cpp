@@ -1,8 +1,10 @@
 #include "statistics.hpp"
 #include "utils.hpp"
 #include "math.hpp"
+#include "stochasticforest.hpp"
 
-statistics::RF_statistics::RF_statistics() {
+statistics::RF_statistics::RF_statistics():
+  executionTime_(0.0) {
 
 }
 
@@ -92,3 +94,83 @@ void statistics::RF_statistics::print(ofstream& toFile) {
 
 }
 
+void statistics::RF_statistics::addForest(StochasticForest* forest, const vector<num_t>& importance, const vector<num_t>& contrastImportance) {
+
+  size_t forestIdx = nodeMat_.size();
+  size_t nTrees = forest->nTrees();
+
+  importanceMat_.push_back(importance);
+  contrastImportanceMat_.push_back(contrastImportance);
+  nodeMat_.push_back( vector<size_t>(nTrees) );
+
+  for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
+
+    RootNode::TreeStats treeStats = forest->tree(treeIdx)->getTreeStats();
+
+    TreeRecord treeRecord = { forestIdx, treeIdx, treeStats.depth, treeStats.nNodes, treeStats.nLeaves, 
+			      treeStats.nMissingNodes, treeStats.nOobSamples, treeStats.growTime };
+
+    treeRecords_.push_back(treeRecord);
+    nodeMat_.back()[treeIdx] = treeStats.nNodes;
+
+  }
+
+}
+
+void statistics::RF_statistics::writeTSV(ofstream& toFile) {
+
+  toFile << "forest\ttree\tdepth\tnodes\tleaves\tmissingNodes\toobSamples\tgrowTime" << endl;
+
+  for ( size_t i = 0; i < treeRecords_.size(); ++i ) {
+    const TreeRecord& r = treeRecords_[i];
+    toFile << r.forestIdx << "\t" << r.treeIdx << "\t" << r.depth << "\t" << r.nNodes << "\t" << r.nLeaves << "\t"
+	   << r.nMissingNodes << "\t" << r.nOobSamples << "\t" << r.growTime << endl;
+  }
+
+}
+
+namespace {
+
+  // JSON has no NaN, so undefined values are written as null
+  void writeJSONValue(ofstream& toFile, const num_t value) {
+    if ( datadefs::isNAN(value) ) {
+      toFile << "null";
+    } else {
+      toFile << value;
+    }
+  }
+
+}
+
+void statistics::RF_statistics::writeJSON(ofstream& toFile) {
+
+  toFile << "{\"executionTime\":" << executionTime_ << ",\"forests\":[";
+
+  for ( size_t forestIdx = 0; forestIdx < nodeMat_.size(); ++forestIdx ) {
+
+    size_t nNodes = 0;
+    for ( size_t treeIdx = 0; treeIdx < nodeMat_[forestIdx].size(); ++treeIdx ) {
+      nNodes += nodeMat_[forestIdx][treeIdx];
+    }
+
+    toFile << ( forestIdx > 0 ? "," : "" ) << endl
+	   << "{\"forest\":" << forestIdx << ",\"trees\":" << nodeMat_[forestIdx].size() << ",\"nodes\":" << nNodes << ",\"meanImportance\":";
+    writeJSONValue( toFile, math::mean( utils::removeNANs(importanceMat_[forestIdx]) ) );
+    toFile << ",\"meanContrastImportance\":";
+    writeJSONValue( toFile, math::mean( utils::removeNANs(contrastImportanceMat_[forestIdx]) ) );
+    toFile << "}";
+  }
+
+  toFile << "]," << endl << "\"trees\":[";
+
+  for ( size_t i = 0; i < treeRecords_.size(); ++i ) {
+    const TreeRecord& r = treeRecords_[i];
+    toFile << ( i > 0 ? "," : "" ) << endl
+	   << "{\"forest\":" << r.forestIdx << ",\"tree\":" << r.treeIdx << ",\"depth\":" << r.depth << ",\"nodes\":" << r.nNodes
+	   << ",\"leaves\":" << r.nLeaves << ",\"missingNodes\":" << r.nMissingNodes << ",\"oobSamples\":" << r.nOobSamples
+	   << ",\"growTime\":" << r.growTime << "}";
+  }
+
+  toFile << "]}" << endl;
+
+}
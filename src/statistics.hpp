@@ -13,19 +13,48 @@ using namespace std;
 using datadefs::num_t;
 using datadefs::NUM_NAN;
 
+class StochasticForest;
+
 namespace statistics {
   
   class RF_statistics {
     
   public:
 
+    // One row per tree; forestIdx counts the forests added, such as the permutations of a filter run
+    struct TreeRecord {
+      size_t forestIdx;
+      size_t treeIdx;
+      size_t depth;
+      size_t nNodes;
+      size_t nLeaves;
+      size_t nMissingNodes;
+      size_t nOobSamples;
+      num_t growTime;
+    };
+
     RF_statistics();
     RF_statistics(vector<vector<num_t> > importanceMat, vector<vector<num_t> > contrastImportanceMat, vector<vector<size_t> > nodeMat, num_t executionTime);
 
+    // Appends the trees of the forest, with the importances computed from it; these may be empty
+    void addForest(StochasticForest* forest, const vector<num_t>& importance, const vector<num_t>& contrastImportance);
+
+    void setExecutionTime(const num_t executionTime) { executionTime_ = executionTime; }
+
+    size_t nForests() const { return( nodeMat_.size() ); }
+
+    const vector<TreeRecord>& treeRecords() const { return( treeRecords_ ); }
+
     void printContrastImportance(ofstream& toFile);
     
     void print(ofstream& toFile);
 
+    // Per-tree table with a header line
+    void writeTSV(ofstream& toFile);
+
+    // Per-forest summaries and the per-tree table
+    void writeJSON(ofstream& toFile);
+
   private:
 
     vector<vector<num_t> > importanceMat_;
@@ -35,6 +64,8 @@ namespace statistics {
 
     num_t executionTime_;
 
+    vector<TreeRecord> treeRecords_;
+
   };
 }
 
@@ -4,31 +4,71 @@
 #include <fstream>
 #include <iomanip>
 #include <stack>
+#include <algorithm>
 
 #ifndef NOTHREADS
 #include <thread>
+#include <functional>
+#include <chrono>
 #endif
 
 #include "stochasticforest.hpp"
+#include "densetreedata.hpp"
 #include "datadefs.hpp"
 #include "argparse.hpp"
 #include "utils.hpp"
 #include "math.hpp"
 #include "options.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "workerpool.hpp"
+#include "exceptions.hpp"
 
 StochasticForest::StochasticForest() :
-  forestType_(datadefs::forest_t::UNKNOWN) {
+  forestType_(datadefs::forest_t::UNKNOWN),
+  oobTrainData_(NULL),
+  deadline_(chrono::steady_clock::time_point::max()) {
 }
 
 void StochasticForest::loadForest(const string& fileName) {
 
   ifstream forestStream(fileName.c_str());
-  assert(forestStream.good());
 
-  while ( forestStream.good() ) {
-    rootNodes_.push_back( new RootNode(forestStream) );
+  if ( !forestStream.good() ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "failed to open forest file '" + fileName + "'");
   }
 
+  if ( forestStream.peek() == EOF ) {
+    throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "forest file '" + fileName + "' is empty");
+  }
+
+  Progress progress("-Loading trees:","trees",0);
+
+  vector<RootNode*> rootNodes;
+
+  try {
+
+    while ( forestStream.good() ) {
+
+      rootNodes.push_back( new RootNode(forestStream) );
+
+      if ( rootNodes.back()->getForestType() != rootNodes[0]->getForestType() || 
+	   rootNodes.back()->isTargetNumerical() != rootNodes[0]->isTargetNumerical() ) {
+	throw RFACE_EXCEPTION(ERRNO::INVALID_READ, "trees of forest file '" + fileName + "' differ in forest or target type");
+      }
+
+      progress.add();
+    }
+
+  } catch ( ... ) {
+    for ( size_t treeIdx = 0; treeIdx < rootNodes.size(); ++treeIdx ) {
+      delete rootNodes[treeIdx];
+    }
+    throw;
+  }
+
+  rootNodes_.insert(rootNodes_.end(),rootNodes.begin(),rootNodes.end());
+
 }
 
 StochasticForest::~StochasticForest() {
@@ -54,14 +94,94 @@ void StochasticForest::writeForest(ofstream& toFile) {
 
 }
 
+void StochasticForest::OobBuffer::reset(const size_t nSamples, const size_t nCategories) {
+  numPredictionSum.assign(nSamples,0.0);
+  catVotes.assign(nSamples*nCategories,0);
+  nOobTrees.assign(nSamples,0);
+}
+
+void StochasticForest::OobBuffer::add(const OobBuffer& other) {
+  
+  assert(numPredictionSum.size() == other.numPredictionSum.size());
+  assert(catVotes.size() == other.catVotes.size());
+
+  for ( size_t i = 0; i < numPredictionSum.size(); ++i ) {
+    numPredictionSum[i] += other.numPredictionSum[i];
+    nOobTrees[i] += other.nOobTrees[i];
+  }
+
+  for ( size_t i = 0; i < catVotes.size(); ++i ) {
+    catVotes[i] += other.catVotes[i];
+  }
+}
+
+// Percolates the OOB samples of a freshly grown tree and adds the predictions to the buffer
+void accumulateOobPredictions(TreeData* trainData,
+			      RootNode* rootNode,
+			      const unordered_map<cat_t,size_t>& cat2idx,
+			      StochasticForest::OobBuffer* oobBuffer) {
+
+  vector<size_t> oobIcs = rootNode->getOobIcs();
+  
+  size_t nCategories = cat2idx.size();
+
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(trainData);
+
+  for ( size_t i = 0; i < oobIcs.size(); ++i ) {
+    
+    size_t sampleIdx = oobIcs[i];
+
+    Node* leaf = denseData ? rootNode->percolateData(denseData,sampleIdx) : rootNode->percolateData(trainData,sampleIdx);
+    const Node::Prediction& prediction = leaf->getPrediction();
+
+    if ( nCategories == 0 ) {
+      oobBuffer->numPredictionSum[sampleIdx] += prediction.numTrainPrediction;
+    } else {
+      ++oobBuffer->catVotes[ sampleIdx * nCategories + cat2idx.at(prediction.catTrainPrediction) ];
+    }
+
+    ++oobBuffer->nOobTrees[sampleIdx];
+
+  }
+
+}
+
 void growTreesPerThread(vector<RootNode*>& rootNodes, TreeData* trainData,
     const size_t targetIdx, const ForestOptions* forestOptions,
-    const distributions::PMF* pmf, distributions::Random* random) {
+    const distributions::PMF* pmf, distributions::Random* random,
+    const unordered_map<cat_t,size_t>& cat2idx, StochasticForest::OobBuffer* oobBuffer,
+    const chrono::steady_clock::time_point deadline, const bool growAtLeastOne, size_t* nGrown,
+    Progress* progress, WorkCounters* workCounters, const profiler::Path& profilePath) {
+
+  profiler::ScopedAttach attach(profilePath);
+
+  WorkCounters workCountersBefore = WorkCounters::local();
+
+  chrono::steady_clock::duration elapsed(0);
 
   for (size_t i = 0; i < rootNodes.size(); ++i) {
+
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+    // Cooperative cancellation: a tree is not started if it would likely finish past the deadline
+    if ( !( i == 0 && growAtLeastOne ) ) {
+      chrono::steady_clock::duration expected = i > 0 ? elapsed / static_cast<chrono::steady_clock::rep>(i) : chrono::steady_clock::duration(0);
+      if ( startTime + expected > deadline ) {
+	break;
+      }
+    }
+
+    rootNodes[i] = new RootNode();
     rootNodes[i]->growTree(trainData, targetIdx, pmf, forestOptions, random);
+    accumulateOobPredictions(trainData, rootNodes[i], cat2idx, oobBuffer);
+
+    elapsed += chrono::steady_clock::now() - startTime;
+    ++(*nGrown);
+    progress->add();
   }
 
+  *workCounters = WorkCounters::local() - workCountersBefore;
+
 }
 
 void StochasticForest::learnRF(TreeData* trainData, 
@@ -70,12 +190,40 @@ void StochasticForest::learnRF(TreeData* trainData,
 			       const vector<num_t>& featureWeights,
 			       vector<distributions::Random>& randoms) {
 
+  for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    delete rootNodes_[treeIdx];
+  }
+  rootNodes_.clear();
+
+  oobBuffer_ = OobBuffer();
+  oobCategories_.clear();
+  oobTrainData_ = NULL;
+
+  this->growRF(trainData,targetIdx,forestOptions,featureWeights,randoms);
+
+}
+
+void StochasticForest::growRF(TreeData* trainData, 
+			      const size_t targetIdx,
+			      const ForestOptions* forestOptions, 
+			      const vector<num_t>& featureWeights,
+			      vector<distributions::Random>& randoms) {
+
   assert(forestOptions->forestType != forest_t::GBT );
 
+  if ( rootNodes_.size() > 0 && rootNodes_[0]->getForestType() != forestOptions->forestType ) {
+    cerr << "ERROR: cannot add trees of another forest type to the forest" << endl;
+    exit(1);
+  }
+
   forestType_ = forestOptions->forestType;
   string targetName = trainData->feature(targetIdx)->name();
-  //bool isTargetNumerical = trainData->feature(targetIdx)->isNumerical();
-  //categories_ = trainData->feature(targetIdx)->categories();
+
+  if ( rootNodes_.size() > 0 && rootNodes_[0]->getTargetName() != targetName ) {
+    cerr << "ERROR: cannot add trees for target '" << targetName << "' to a forest predicting '" 
+	 << rootNodes_[0]->getTargetName() << "'" << endl;
+    exit(1);
+  }
 
   assert(trainData->nFeatures() == featureWeights.size());
 
@@ -84,8 +232,6 @@ void StochasticForest::learnRF(TreeData* trainData,
     exit(1);
   }
 
-  rootNodes_.resize(forestOptions->nTrees);
-
   distributions::PMF pmf(featureWeights);
 
   if (forestOptions->isRandomSplit && forestOptions->mTry == 0) {
@@ -93,68 +239,185 @@ void StochasticForest::learnRF(TreeData* trainData,
     exit(1);
   }
 
+  assert(forestOptions->nTrees > 0);
+
+  // OOB predictions keep accumulating over the trees grown on the same data. A loaded
+  // forest carries no OOB information, and the OOB samples of trees grown on other data 
+  // mean nothing here, so then the buffer starts from the new trees
+  if ( trainData != oobTrainData_ || oobBuffer_.nOobTrees.size() != trainData->nSamples() ) {
+    oobTrainData_ = trainData;
+    // Categorical OOB predictions are collected as votes per category
+    oobCategories_.clear();
+    if ( !trainData->feature(targetIdx)->isNumerical() ) {
+      oobCategories_ = trainData->feature(targetIdx)->categories();
+    }
+    oobBuffer_.reset(trainData->nSamples(),oobCategories_.size());
+  }
+
+  unordered_map<cat_t,size_t> cat2idx;
+  for ( size_t i = 0; i < oobCategories_.size(); ++i ) {
+    cat2idx[ oobCategories_[i] ] = i;
+  }
+
+  // One line for all batches; in convergence mode growth may stop short of the total
+  Progress progress("-Growing trees:","trees",forestOptions->nTrees);
+
+  if ( forestOptions->convergenceTolerance <= 0.0 ) {
+    this->addTreesRF(trainData,targetIdx,forestOptions,&pmf,cat2idx,randoms,forestOptions->nTrees,&progress);
+    return;
+  }
+
+  // Convergence mode: nTrees is the maximum number of new trees. Growth stops once the
+  // criterion has changed less than the tolerance over two consecutive batches
+  size_t nNewTrees = 0;
+  size_t nStableBatches = 0;
+  num_t prevOobError = datadefs::NUM_NAN;
+  vector<num_t> prevMDI;
+
+  while ( nNewTrees < forestOptions->nTrees && nStableBatches < 2 ) {
+
+    size_t nBatchTrees = min(forestOptions->treeBatchSize, forestOptions->nTrees - nNewTrees);
+
+    size_t nBatchTreesGrown = this->addTreesRF(trainData,targetIdx,forestOptions,&pmf,cat2idx,randoms,nBatchTrees,&progress);
+
+    nNewTrees += nBatchTreesGrown;
+
+    // The deadline cut the batch short
+    if ( nBatchTreesGrown < nBatchTrees ) {
+      break;
+    }
+
+    num_t change = datadefs::NUM_NAN;
+
+    if ( forestOptions->convergenceCriterion == "mdi" ) {
+
+      vector<num_t> MDI,contrastMDI;
+      this->getMDI(trainData,MDI,contrastMDI);
+
+      // Features not split on yet rank last
+      for ( size_t featureIdx = 0; featureIdx < MDI.size(); ++featureIdx ) {
+	if ( datadefs::isNAN(MDI[featureIdx]) ) {
+	  MDI[featureIdx] = 0.0;
+	}
+      }
+
+      if ( prevMDI.size() > 0 ) {
+	change = 1.0 - math::spearmanCorrelation(prevMDI,MDI);
+      }
+
+      prevMDI = MDI;
+
+    } else {
+
+      num_t oobError = this->getOobError(trainData);
+
+      if ( !datadefs::isNAN(prevOobError) ) {
+	change = fabs(oobError - prevOobError) / max(prevOobError,datadefs::EPS);
+      }
+
+      prevOobError = oobError;
+
+    }
+
+    if ( !datadefs::isNAN(change) && change <= forestOptions->convergenceTolerance ) {
+      ++nStableBatches;
+    } else {
+      nStableBatches = 0;
+    }
+
+  }
+
+}
+
+size_t StochasticForest::addTreesRF(TreeData* trainData, 
+				    const size_t targetIdx,
+				    const ForestOptions* forestOptions, 
+				    const distributions::PMF* pmf,
+				    const unordered_map<cat_t,size_t>& cat2idx,
+				    vector<distributions::Random>& randoms,
+				    const size_t nNewTrees,
+				    Progress* progress) {
+
   size_t nThreads = randoms.size();
 
   assert(nThreads > 0);
-  assert(forestOptions->nTrees > 0);
-  assert(rootNodes_.size() == forestOptions->nTrees);
 
 #ifdef NOTHREADS
   assert( nThreads == 1 );
 #endif
 
-  if (nThreads == 1) {
+  size_t nOldTrees = rootNodes_.size();
 
-    vector<size_t> treeIcs = utils::range(forestOptions->nTrees);
+  // An empty forest is not a valid result, so the first tree ignores the deadline
+  bool growAtLeastOne = nOldTrees == 0;
 
-    for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
-      rootNodes_[treeIdx] = new RootNode(trainData, targetIdx, &pmf, forestOptions, &randoms[0]);
-    }
+  vector<vector<size_t> > treeIcs = utils::splitRange(nNewTrees, nThreads);
 
-  }
-#ifndef NOTHREADS  
-  else {
+  // Thread-local OOB buffers, which are reduced in thread order once the threads have joined
+  vector<OobBuffer> oobBuffers(nThreads);
 
-    vector<vector<size_t> > treeIcs = utils::splitRange(forestOptions->nTrees, nThreads);
+  // Trees per thread need to outlive the threads, as the threads refer to them
+  vector<vector<RootNode*> > rootNodesPerThread(nThreads);
 
-    vector<thread> threads;
+  vector<size_t> nGrown(nThreads,0);
 
-    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+  vector<WorkCounters> workCounters(nThreads);
 
-      vector<size_t>& treeIcsPerThread = treeIcs[threadIdx];
-      vector<RootNode*> rootNodesPerThread(treeIcsPerThread.size());
+  // Trees are allocated by the threads as they are grown, so a budget cut leaves the rest NULL
+  for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+    rootNodesPerThread[threadIdx].resize(treeIcs[threadIdx].size(),NULL);
+  }
 
-      for ( size_t i = 0; i < treeIcsPerThread.size(); ++i ) {
+  // Phases of the worker threads are nested under the phases open here
+  profiler::Path profilePath = profiler::currentPath();
 
-        rootNodes_[treeIcsPerThread[i]] = new RootNode();
+  if (nThreads == 1) {
 
-        rootNodesPerThread[i] = rootNodes_[treeIcsPerThread[i]];
+    growTreesPerThread(rootNodesPerThread[0], trainData, targetIdx, forestOptions, pmf, &randoms[0],
+		       cat2idx, &oobBuffer_, deadline_, growAtLeastOne, &nGrown[0], progress, &workCounters[0], profilePath);
 
-      }
+  }
+#ifndef NOTHREADS  
+  else {
+
+    vector<thread> threads;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+
+      oobBuffers[threadIdx].reset(trainData->nSamples(),oobCategories_.size());
 
       threads.push_back(thread(growTreesPerThread, 
-			       rootNodesPerThread, 
+			       ref(rootNodesPerThread[threadIdx]), 
 			       trainData, 
 			       targetIdx, 
 			       forestOptions, 
-			       &pmf, 
-			       &randoms[threadIdx])); 
+			       pmf, 
+			       &randoms[threadIdx],
+			       cref(cat2idx),
+			       &oobBuffers[threadIdx],
+			       deadline_,
+			       growAtLeastOne && threadIdx == 0,
+			       &nGrown[threadIdx],
+			       progress,
+			       &workCounters[threadIdx],
+			       cref(profilePath))); 
     }
 
     for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
       threads[threadIdx].join();
+      oobBuffer_.add(oobBuffers[threadIdx]);
     }
   }
 #endif
 
-  // Get features in the forest for fast look-up
-  for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
-    set <size_t> featuresInTree = rootNodes_[treeIdx]->getFeaturesInTree();
-    for ( set<size_t>::const_iterator it(featuresInTree.begin()); it != featuresInTree.end(); ++it ) {
-      //featuresInForest_.insert(*it);
-    }
+  // New trees are appended after the existing ones in thread order
+  for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+    rootNodes_.insert(rootNodes_.end(),rootNodesPerThread[threadIdx].begin(),rootNodesPerThread[threadIdx].begin() + nGrown[threadIdx]);
+    workCounters_ += workCounters[threadIdx];
   }
 
+  return( rootNodes_.size() - nOldTrees );
+
 }
 
 void StochasticForest::learnGBT(TreeData* trainData, const size_t targetIdx,
@@ -163,26 +426,27 @@ void StochasticForest::learnGBT(TreeData* trainData, const size_t targetIdx,
 
   assert( forestOptions->forestType == forest_t::GBT );
 
-  cerr << "ERROR: learning GBT is temporarily disabled!" << endl;
-  exit(1);
-
   forestType_ = forestOptions->forestType;
 
   GBTShrinkage_ = forestOptions->shrinkage;
   
-  string targetName = trainData->feature(targetIdx)->name();
-
   bool isTargetNumerical = trainData->feature(targetIdx)->isNumerical();
 
   assert(trainData->nFeatures() == featureWeights.size());
   assert(fabs(featureWeights[targetIdx]) < datadefs::EPS);
-  assert(randoms.size() == 1);
+  assert(randoms.size() > 0);
 
   distributions::PMF pmf(featureWeights);
 
+  // Trees are grown one after another, so the threads are put to use in the split search within the nodes
+  ForestOptions gbtOptions(*forestOptions);
+  gbtOptions.nSplitThreads = randoms.size();
+
+  GBTCategories_.clear();
+
   if (!isTargetNumerical) {
-    vector<cat_t> categories = trainData->feature(targetIdx)->categories();
-    size_t nCategories = categories.size();
+    GBTCategories_ = trainData->feature(targetIdx)->categories();
+    size_t nCategories = GBTCategories_.size();
     size_t nTrees = forestOptions->nTrees * nCategories;
     rootNodes_.resize(nTrees);
     GBTConstants_.resize(nCategories);
@@ -197,9 +461,9 @@ void StochasticForest::learnGBT(TreeData* trainData, const size_t targetIdx,
   }
 
   if (isTargetNumerical) {
-    this->growNumericalGBT(trainData, targetIdx, forestOptions, &pmf, randoms);
+    this->growNumericalGBT(trainData, targetIdx, &gbtOptions, &pmf, randoms);
   } else {
-    this->growCategoricalGBT(trainData, targetIdx, forestOptions, &pmf, randoms);
+    this->growCategoricalGBT(trainData, targetIdx, &gbtOptions, &pmf, randoms);
   }
 
 }
@@ -211,56 +475,107 @@ void StochasticForest::growNumericalGBT(TreeData* trainData,
 					const distributions::PMF* pmf, 
 					vector<distributions::Random>& randoms) {
 
-  assert(randoms.size() == 1);
-
   size_t nSamples = trainData->nSamples();
-  // save a copy of the target column because it will be overwritten
-  vector<num_t> trueTargetData = trainData->feature(targetIdx)->getNumData();
 
-  // Target for GBT is different for each tree
-  // reference to the target column, will overwrite it
-  vector<num_t> curTargetData = trueTargetData;
+  const Feature* trueTarget = trainData->feature(targetIdx);
 
   vector<size_t> sampleIcs = utils::range(nSamples);
   vector<size_t> missingIcs;
   trainData->separateMissingSamples(targetIdx,sampleIcs,missingIcs);
   assert(GBTConstants_.size() == 1);
-  GBTConstants_[0] = math::mean(trainData->feature(targetIdx)->getNumData(sampleIcs));
+  GBTConstants_[0] = math::mean(trueTarget->getNumData(sampleIcs));
 
   // Set the initial prediction to be the mean
   vector<num_t> prediction(nSamples, GBTConstants_[0]);
 
-  for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
-    // current target is the negative gradient of the loss function
-    // for 1/2*square loss, it is ( target - prediction )
-    for (size_t i = 0; i < nSamples; i++) {
-      curTargetData[i] = trueTargetData[i] - prediction[i];
-    }
+  // Target for GBT is different for each tree: the trees are fit against this residual 
+  // feature, while the target in trainData is left untouched
+  Feature residual(trueTarget->getNumData(), trueTarget->name());
 
-    cout << "REPLACE FEATURE DATA" << endl;
+  vector<num_t> curPrediction(nSamples);
 
-    //trainData->replaceFeatureData(targetIdx, curTargetData);
+  // The trees are grown in this thread, and their split search runs on workers that serve all trees
+  WorkCounters workCountersBefore = WorkCounters::local();
+  WorkerPool* splitPool = forestOptions->nSplitThreads > 1 ? new WorkerPool(forestOptions->nSplitThreads) : NULL;
 
-    // Grow a tree to predict the current target
-    rootNodes_[treeIdx]->growTree(trainData, targetIdx, pmf, forestOptions, &randoms[0]);
+  Progress progress("-Growing trees:","trees",rootNodes_.size());
 
-    // What kind of a prediction does the new tree produce?
-    vector<num_t> curPrediction(nSamples); // = rootNodes_[treeIdx]->getTrainPrediction(); 
-    for (size_t i = 0; i < nSamples; ++i) {
-      curPrediction[i] = rootNodes_[treeIdx]->getPrediction(trainData, i).numTrainPrediction;
+  for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
+    // current target is the negative gradient of the loss function
+    // for 1/2*square loss, it is ( target - prediction ); missing values stay missing
+    for (size_t i = 0; i < sampleIcs.size(); ++i) {
+      residual.numData[sampleIcs[i]] = trueTarget->getNumData(sampleIcs[i]) - prediction[sampleIcs[i]];
     }
 
+    // Grow a tree to predict the current target, and get what it predicts for the training samples
+    rootNodes_[treeIdx]->growTree(trainData, targetIdx, pmf, forestOptions, &randoms[0], &residual, &curPrediction, splitPool);
+
     // Calculate the current total prediction adding the newly generated tree
     for (size_t i = 0; i < nSamples; i++) {
       prediction[i] += GBTShrinkage_ * curPrediction[i];
     }
 
+    progress.add();
+
   }
 
-  // GBT-forest is now done!
-  // restore true target
-  cout << "REPLACE FEATURE DATA" << endl;
-  //trainData->replaceFeatureData(targetIdx, trueTargetData);
+  delete splitPool;
+
+  workCounters_ += WorkCounters::local() - workCountersBefore;
+
+}
+
+// Multiclass logistic transform of the current predictions of a block of samples
+void transformLogisticPerThread(const vector<size_t>& sampleIcs, 
+				vector<vector<num_t> >& prediction, 
+				vector<vector<num_t> >& probability) {
+
+  for (size_t i = 0; i < sampleIcs.size(); ++i) {
+    math::transformLogistic(prediction[sampleIcs[i]].size(), prediction[sampleIcs[i]], probability[sampleIcs[i]]);
+  }
+
+}
+
+// Grows the trees of one boosting iteration for the classes in classIcs. Each class has a residual 
+// feature and a random stream of its own, so the classes can be grown in any order or concurrently
+void growClassTreesPerThread(const vector<size_t>& classIcs, 
+			     TreeData* trainData,
+			     const size_t targetIdx,
+			     const ForestOptions* forestOptions,
+			     const distributions::PMF* pmf,
+			     const vector<cat_t>& categories,
+			     const vector<size_t>& sampleIcs,
+			     const vector<vector<num_t> >& probability,
+			     vector<RootNode*>& rootNodes,
+			     vector<Feature>& residuals,
+			     vector<distributions::Random>& classRandoms,
+			     vector<vector<num_t> >& curPrediction,
+			     WorkerPool* splitPool,
+			     WorkCounters* workCounters,
+			     const profiler::Path& profilePath) {
+
+  profiler::ScopedAttach attach(profilePath);
+
+  WorkCounters workCountersBefore = WorkCounters::local();
+
+  const Feature* trueTarget = trainData->feature(targetIdx);
+
+  for (size_t c = 0; c < classIcs.size(); ++c) {
+    
+    size_t k = classIcs[c];
+
+    // target for class k is the difference between true target and current prediction
+    for (size_t i = 0; i < sampleIcs.size(); ++i) {
+      size_t sampleIdx = sampleIcs[i];
+      residuals[k].numData[sampleIdx] = (categories[k] == trueTarget->getCatData(sampleIdx)) - probability[sampleIdx][k];
+    }
+
+    // Grow a tree to predict the current target, and get what it predicts for the training samples
+    rootNodes[k]->growTree(trainData, targetIdx, pmf, forestOptions, &classRandoms[k], &residuals[k], &curPrediction[k], splitPool);
+
+  }
+
+  *workCounters += WorkCounters::local() - workCountersBefore;
 
 }
 
@@ -273,7 +588,9 @@ void StochasticForest::growCategoricalGBT(TreeData* trainData,
 
   size_t nTrees = rootNodes_.size();
 
-  vector<cat_t> categories = trainData->feature(targetIdx)->categories();
+  const Feature* trueTarget = trainData->feature(targetIdx);
+
+  const vector<cat_t>& categories = GBTCategories_;
 
   size_t nCategories = categories.size();
 
@@ -281,25 +598,57 @@ void StochasticForest::growCategoricalGBT(TreeData* trainData,
   // each of those predicting the probability residual for each class.
   size_t numIterations = nTrees / nCategories;
 
-  // Save a copy of the target column because it will be overwritten later.
-  // We also know that it must be categorical.
   size_t nSamples = trainData->nSamples();
-  vector<cat_t> trueTargetData = trainData->feature(targetIdx)->getCatData();
-  //vector<string> trueRawTargetData = trainData->getRawFeatureData(targetIdx);
 
-  // Target for GBT is different for each tree.
-  // We use the original target column to save each temporary target.
-  // Reference to the target column, will overwrite it:
-  vector<cat_t> curTargetData = trueTargetData;
+  size_t nThreads = randoms.size();
+
+#ifdef NOTHREADS
+  assert( nThreads == 1 );
+#endif
+
+  vector<size_t> sampleIcs = utils::range(nSamples);
+  vector<size_t> missingIcs;
+  trainData->separateMissingSamples(targetIdx,sampleIcs,missingIcs);
 
   for (size_t categoryIdx = 0; categoryIdx < nCategories; ++categoryIdx) {
     GBTConstants_[categoryIdx] = 0.0;
-    for (size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx) {
-      if (trueTargetData[sampleIdx] == categories[categoryIdx]) {
+    for (size_t i = 0; i < sampleIcs.size(); ++i) {
+      if (trueTarget->getCatData(sampleIcs[i]) == categories[categoryIdx]) {
         ++GBTConstants_[categoryIdx];
       }
     }
-    GBTConstants_[categoryIdx] /= nSamples;
+    GBTConstants_[categoryIdx] /= sampleIcs.size();
+  }
+
+  // Target for GBT is different for each tree: each class fits a numerical residual feature 
+  // of its own instead of the categorical target, which stays untouched in trainData
+  vector<Feature> residuals(nCategories, Feature(vector<num_t>(nSamples,datadefs::NUM_NAN), trueTarget->name()));
+
+  // The class trees draw from random streams of their own, so that they do not depend on the order they are grown in
+  vector<distributions::Random> classRandoms;
+  for (size_t k = 0; k < nCategories; ++k) {
+    classRandoms.push_back( distributions::Random(randoms[0].integer()) );
+  }
+
+  // Threads are spent on the classes first, and whatever is left over goes to the split search within the trees
+  size_t nClassThreads = min(nThreads, nCategories);
+  ForestOptions classOptions(*forestOptions);
+  classOptions.nSplitThreads = max(static_cast<size_t>(1), nThreads / nClassThreads);
+
+  vector<vector<size_t> > classIcs = utils::splitRange(nCategories, nClassThreads);
+
+  // Work of the class threads over all iterations
+  vector<WorkCounters> workCounters(nClassThreads);
+
+  // Phases of the worker threads are nested under the phases open here
+  profiler::Path profilePath = profiler::currentPath();
+  vector<vector<size_t> > sampleBlocks = utils::splitRange(nSamples, nThreads);
+
+  // The threads of the iterations, and the split search workers of each class thread, serve all iterations
+  WorkerPool* iterationPool = nThreads > 1 ? new WorkerPool(nThreads) : NULL;
+  vector<WorkerPool*> splitPools(nClassThreads,NULL);
+  for (size_t threadIdx = 0; threadIdx < nClassThreads && classOptions.nSplitThreads > 1; ++threadIdx) {
+    splitPools[threadIdx] = new WorkerPool(classOptions.nSplitThreads);
   }
 
   // Initialize class probability estimates and the predictions.
@@ -308,114 +657,277 @@ void StochasticForest::growCategoricalGBT(TreeData* trainData,
   vector<vector<num_t> > curPrediction(nCategories, vector<num_t>(nSamples, 0.0));
   vector<vector<num_t> > curProbability(nSamples, vector<num_t>(nCategories));
 
+  Progress progress("-Growing trees:","trees",numIterations * nCategories);
+
   for (size_t m = 0; m < numIterations; ++m) {
-    // Multiclass logistic transform of class probabilities from current probability estimates.
-    for (size_t i = 0; i < nSamples; ++i) {
-      math::transformLogistic(nCategories, prediction[i], curProbability[i]);
-      // each prediction[i] is a vector<num_t>(numClasses_)
-    }
-
-    // construct a tree for each class
-    for (size_t k = 0; k < nCategories; ++k) {
-      // target for class k is ...
-      for (size_t i = 0; i < nSamples; ++i) {
-        // ... the difference between true target and current prediction
-        curTargetData[i] = (categories[k] == trueTargetData[i]) - curProbability[i][k];
-      }
 
-      // utils::write(cout,curTargetData.begin(),curTargetData.end());
-      // cout << endl;
+    // Trees of this iteration, one per class
+    vector<RootNode*> iterRootNodes(rootNodes_.begin() + m * nCategories, rootNodes_.begin() + (m + 1) * nCategories);
 
-      // For each tree the target data becomes the recently computed residuals
-      cout << "REPLACE FEATURE DATA" << endl;
-      //trainData->replaceFeatureData(targetIdx, curTargetData);
+    if ( nThreads == 1 ) {
 
-      // Grow a tree to predict the current target
-      size_t treeIdx = m * nCategories + k; // tree index
-      //cout << " " << treeIdx;
-      rootNodes_[treeIdx]->growTree(trainData, targetIdx, pmf, forestOptions, &randoms[0]);
+      // Multiclass logistic transform of class probabilities from current probability estimates.
+      transformLogisticPerThread(sampleBlocks[0], prediction, curProbability);
 
-      //cout << "Tree " << treeIdx << " ready, predicting OOB samples..." << endl;
+      // construct a tree for each class
+      growClassTreesPerThread(classIcs[0], trainData, targetIdx, &classOptions, pmf, categories, sampleIcs, curProbability, 
+			      iterRootNodes, residuals, classRandoms, curPrediction, splitPools[0], &workCounters[0], profilePath);
 
-      // What kind of a prediction does the new tree produce
-      // out of the whole training data set?
-      curPrediction[k] = vector<num_t> (nSamples); //rootNodes_[treeIdx]->getTrainPrediction();
-      for (size_t i = 0; i < nSamples; ++i) {
-        curPrediction[k][i] = rootNodes_[treeIdx]->getPrediction(trainData, i).numTrainPrediction;
+    }
+#ifndef NOTHREADS
+    else {
+
+      vector<function<void()> > tasks;
+
+      for (size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx) {
+	tasks.push_back(bind(transformLogisticPerThread, 
+			     cref(sampleBlocks[threadIdx]), 
+			     ref(prediction), 
+			     ref(curProbability)));
       }
+      
+      iterationPool->run(tasks);
+
+      tasks.clear();
+
+      for (size_t threadIdx = 0; threadIdx < nClassThreads; ++threadIdx) {
+	tasks.push_back(bind(growClassTreesPerThread,
+			     cref(classIcs[threadIdx]),
+			     trainData,
+			     targetIdx,
+			     &classOptions,
+			     pmf,
+			     cref(categories),
+			     cref(sampleIcs),
+			     cref(curProbability),
+			     ref(iterRootNodes),
+			     ref(residuals),
+			     ref(classRandoms),
+			     ref(curPrediction),
+			     splitPools[threadIdx],
+			     &workCounters[threadIdx],
+			     cref(profilePath)));
+      }
+
+      iterationPool->run(tasks);
+    }
+#endif
 
-      // Calculate the current total prediction adding the newly generated tree
-      for (size_t i = 0; i < nSamples; i++) {
+    // Calculate the current total prediction adding the newly generated trees
+    for (size_t i = 0; i < nSamples; i++) {
+      for (size_t k = 0; k < nCategories; ++k) {
         prediction[i][k] += GBTShrinkage_ * curPrediction[k][i];
       }
     }
+
+    progress.add(nCategories);
+  }
+
+  delete iterationPool;
+  for (size_t threadIdx = 0; threadIdx < nClassThreads; ++threadIdx) {
+    delete splitPools[threadIdx];
   }
 
-  // GBT-forest is now done!
-  // restore the true target
-  cout << "REPLACE FEATURE DATA" << endl;
-  //trainData->replaceFeatureData(targetIdx, trueTargetData);
+  for (size_t threadIdx = 0; threadIdx < nClassThreads; ++threadIdx) {
+    workCounters_ += workCounters[threadIdx];
+  }
+
+}
+
+// Loss of a single prediction: squared error for numerical, misclassification for categorical targets
+inline num_t predictionLoss(TreeData* trainData, const size_t targetIdx, const bool isTargetNumerical, const size_t sampleIdx, const Node::Prediction& prediction) {
+  if ( isTargetNumerical ) {
+    num_t d = prediction.numTrainPrediction - trainData->feature(targetIdx)->getNumData(sampleIdx);
+    return( d * d );
+  } else {
+    return( prediction.catTrainPrediction == trainData->feature(targetIdx)->getCatData(sampleIdx) ? 0.0 : 1.0 );
+  }
 }
 
-/*
- void StochasticForest::getImportanceValues(vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues) {
+void permutationImportancePerThread(TreeData* trainData,
+				    vector<RootNode*>& rootNodes,
+				    distributions::Random* random,
+				    vector<num_t>* importanceSum,
+				    vector<size_t>* featureCounts,
+				    size_t* nTreesWithOob,
+				    const profiler::Path& profilePath) {
 
- this->getMeanMinimalDepthValues(importanceValues,contrastImportanceValues);
- return;
+  profiler::ScopedAttach attach(profilePath);
 
- if ( featuresInForest_.size() == 0 ) {
- cout << "NOTE: forest is empty!" << endl;
- }
+  // The data class is resolved once, and the trees are descended with direct calls if it is DenseTreeData
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(trainData);
 
- vector<num_t> oobPredictions = this->getOobPredictions();
+  for ( size_t treeIdx = 0; treeIdx < rootNodes.size(); ++treeIdx ) {
 
- size_t nRealFeatures = trainData_->nFeatures();
- size_t nAllFeatures = 2*nRealFeatures;
+    RootNode* rootNode = rootNodes[treeIdx];
 
- size_t targetIdx = trainData_->getFeatureIdx(params_->targetStr);
+    trace::ScopedEvent event("permutationImportance", "nNodes", rootNode->nNodes());
 
- vector<num_t> trueData = trainData_->getFeatureData(targetIdx);
+    size_t targetIdx = trainData->getFeatureIdx(rootNode->getTargetName());
+    bool isTargetNumerical = trainData->feature(targetIdx)->isNumerical();
 
- importanceValues.clear();
- importanceValues.resize(nAllFeatures,0.0);
+    vector<size_t> oobIcs = rootNode->getOobIcs();
+    size_t nOob = oobIcs.size();
 
- num_t oobError = this->error(oobPredictions,trueData);
+    if ( nOob == 0 ) {
+      continue;
+    }
 
- for ( set<size_t>::const_iterator it(featuresInForest_.begin()); it != featuresInForest_.end(); ++it ) {
+    ++(*nTreesWithOob);
+
+    // Original loss per OOB sample, and for each feature the OOB samples whose path splits on it;
+    // only those can change when the feature is permuted
+    vector<num_t> loss(nOob);
+    num_t lossSum = 0.0;
+    unordered_map<size_t,vector<size_t> > samplesByFeature;
+    vector<size_t> pathFeatureIcs;
+
+    for ( size_t i = 0; i < nOob; ++i ) {
+      Node* leaf = denseData ? 
+	rootNode->percolateData(denseData,oobIcs[i],datadefs::MAX_IDX,datadefs::MAX_IDX,&pathFeatureIcs) : 
+	rootNode->percolateData(trainData,oobIcs[i],datadefs::MAX_IDX,datadefs::MAX_IDX,&pathFeatureIcs);
+      loss[i] = predictionLoss(trainData,targetIdx,isTargetNumerical,oobIcs[i],leaf->getPrediction());
+      lossSum += loss[i];
+      for ( size_t j = 0; j < pathFeatureIcs.size(); ++j ) {
+	vector<size_t>& positions = samplesByFeature[ pathFeatureIcs[j] ];
+	if ( positions.empty() || positions.back() != i ) {
+	  positions.push_back(i);
+	}
+      }
+    }
 
- size_t featureIdx = *it;
+    vector<size_t> donorIcs = oobIcs;
 
- vector<num_t> permutedOobPredictions = this->getPermutedOobPredictions(featureIdx);
+    // Visit features in a fixed order so that the random stream, and hence the result, is reproducible
+    vector<size_t> featureIcs;
+    featureIcs.reserve(samplesByFeature.size());
+    for ( unordered_map<size_t,vector<size_t> >::const_iterator it(samplesByFeature.begin()); it != samplesByFeature.end(); ++it ) {
+      featureIcs.push_back(it->first);
+    }
+    sort(featureIcs.begin(),featureIcs.end());
 
- num_t permutedOobError = this->error(permutedOobPredictions,trueData);
+    for ( size_t f = 0; f < featureIcs.size(); ++f ) {
 
- importanceValues[featureIdx] = permutedOobError - oobError;
+      size_t featureIdx = featureIcs[f];
 
- if ( params_->normalizeImportanceValues ) {
- if ( oobError < datadefs::EPS ) {
- importanceValues[featureIdx] /= datadefs::EPS;
- } else {
- importanceValues[featureIdx] /= oobError;
- }
- }
+      // Permutation of the OOB samples: sample oobIcs[i] borrows the feature value of donorIcs[i]
+      for ( size_t i = nOob; i > 1; --i ) {
+	swap(donorIcs[i-1],donorIcs[random->integer() % i]);
+      }
 
- }
+      const vector<size_t>& positions = samplesByFeature[featureIdx];
+      num_t lossDiff = 0.0;
 
- assert( !datadefs::containsNAN(importanceValues) );
+      for ( size_t j = 0; j < positions.size(); ++j ) {
+	size_t i = positions[j];
+	Node* leaf = denseData ? 
+	  rootNode->percolateData(denseData,oobIcs[i],featureIdx,donorIcs[i]) : 
+	  rootNode->percolateData(trainData,oobIcs[i],featureIdx,donorIcs[i]);
+	lossDiff += predictionLoss(trainData,targetIdx,isTargetNumerical,oobIcs[i],leaf->getPrediction()) - loss[i];
+      }
 
+      (*importanceSum)[featureIdx] += lossDiff / nOob;
+      ++(*featureCounts)[featureIdx];
 
- contrastImportanceValues.resize(nRealFeatures);
+    }
 
- copy(importanceValues.begin() + nRealFeatures,
- importanceValues.end(),
- contrastImportanceValues.begin());
+  }
 
- importanceValues.resize(nRealFeatures);
+}
 
- }
- */
+void StochasticForest::getPermutationImportance(TreeData* trainData,
+						vector<num_t>& importance,
+						vector<num_t>& contrastImportance,
+						vector<distributions::Random>& randoms) {
 
-void predictCatPerThread(TreeData* testData, 
+  size_t nRealFeatures = trainData->nFeatures();
+  size_t nAllFeatures = 2 * nRealFeatures;
+
+  size_t nThreads = randoms.size();
+
+  assert( nThreads > 0 );
+
+#ifdef NOTHREADS
+  assert( nThreads == 1 );
+#endif
+
+  // Thread-local accumulators, reduced in thread order so that the result does not depend on scheduling
+  vector<vector<num_t> > importanceSums(nThreads,vector<num_t>(nAllFeatures,0.0));
+  vector<vector<size_t> > featureCounts(nThreads,vector<size_t>(nAllFeatures,0));
+  vector<size_t> nTreesWithOob(nThreads,0);
+
+  vector<vector<size_t> > treeIcs = utils::splitRange(this->nTrees(), nThreads);
+  vector<vector<RootNode*> > rootNodesPerThread(nThreads);
+
+  for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+    for ( size_t i = 0; i < treeIcs[threadIdx].size(); ++i ) {
+      rootNodesPerThread[threadIdx].push_back(rootNodes_[ treeIcs[threadIdx][i] ]);
+    }
+  }
+
+  profiler::ScopedTimer scopedTimer("permutationImportance");
+
+  profiler::Path profilePath = profiler::currentPath();
+
+  if ( nThreads == 1 ) {
+    permutationImportancePerThread(trainData,rootNodesPerThread[0],&randoms[0],&importanceSums[0],&featureCounts[0],&nTreesWithOob[0],profilePath);
+  }
+#ifndef NOTHREADS
+  else {
+
+    vector<thread> threads;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      threads.push_back(thread(permutationImportancePerThread,
+			       trainData,
+			       ref(rootNodesPerThread[threadIdx]),
+			       &randoms[threadIdx],
+			       &importanceSums[threadIdx],
+			       &featureCounts[threadIdx],
+			       &nTreesWithOob[threadIdx],
+			       cref(profilePath)));
+    }
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      threads[threadIdx].join();
+    }
+
+  }
+#endif
+
+  importance.clear();
+  importance.resize(nAllFeatures,0.0);
+
+  size_t nTreesTotal = 0;
+  vector<size_t> featureCountsTotal(nAllFeatures,0);
+
+  for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+    nTreesTotal += nTreesWithOob[threadIdx];
+    for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+      importance[featureIdx] += importanceSums[threadIdx][featureIdx];
+      featureCountsTotal[featureIdx] += featureCounts[threadIdx][featureIdx];
+    }
+  }
+
+  // Trees not splitting on a feature contribute zero, so the sum is averaged over all trees
+  for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+    if ( featureCountsTotal[featureIdx] == 0 ) {
+      importance[featureIdx] = datadefs::NUM_NAN;
+    } else {
+      importance[featureIdx] /= nTreesTotal;
+    }
+  }
+
+  contrastImportance.resize(nRealFeatures);
+
+  copy(importance.begin() + nRealFeatures, importance.end(), contrastImportance.begin());
+
+  importance.resize(nRealFeatures);
+
+}
+
+template<typename DataT>
+void predictCatSamples(DataT* testData, 
 			 vector<RootNode*>& rootNodes,
 			 forest_t forestType,
 			 vector<size_t>& sampleIcs, 
@@ -423,7 +935,8 @@ void predictCatPerThread(TreeData* testData,
 			 vector<num_t>* confidence, 
 			 vector<cat_t>& categories,
 			 vector<num_t>& GBTConstants, 
-			 num_t& GBTShrinkage) {
+			 num_t& GBTShrinkage,
+			 Progress* progress) {
 
   size_t nTrees = rootNodes.size();
   for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
@@ -432,60 +945,60 @@ void predictCatPerThread(TreeData* testData,
 
     if ( forestType == forest_t::GBT ) {
 
-      cerr << "Prediction with GBT is turned OFF" << endl;
-      exit(1);
-
       size_t nCategories = categories.size();
-      num_t maxProb = 0;
-      size_t maxProbCat = 0;
-
-      for ( size_t categoryIdx = 0; categoryIdx < nCategories; ++categoryIdx ) {
-
-        num_t cumProb = GBTConstants[categoryIdx];
+      vector<num_t> cumPrediction(GBTConstants);
+      vector<num_t> probability(nCategories);
 
-        for ( size_t iterIdx = 0; iterIdx < nTrees / nCategories; ++iterIdx ) {
+      // Trees are summed in the order they were grown, so the result does not depend on the thread
+      for ( size_t iterIdx = 0; iterIdx < nTrees / nCategories; ++iterIdx ) {
+	for ( size_t categoryIdx = 0; categoryIdx < nCategories; ++categoryIdx ) {
           size_t treeIdx = iterIdx * nCategories + categoryIdx;
-          cumProb += GBTShrinkage * rootNodes[treeIdx]->getPrediction(testData, sampleIdx).numTrainPrediction;
-        }
-
-        if (cumProb > maxProb) {
-          maxProb = cumProb;
-          maxProbCat = categoryIdx;
-        }
+          cumPrediction[categoryIdx] += GBTShrinkage * rootNodes[treeIdx]->percolateData(testData, sampleIdx)->getPrediction().numTrainPrediction;
+	}
       }
 
+      math::transformLogistic(nCategories, cumPrediction, probability);
+
+      size_t maxProbCat = max_element(probability.begin(),probability.end()) - probability.begin();
+
       (*predictions)[sampleIdx] = categories[maxProbCat];
-      (*confidence)[sampleIdx] = 0.0;
+      (*confidence)[sampleIdx] = 1.0 - probability[maxProbCat];
 
-      // MISSING: confidence
     } else {
 
       vector<string> predictionVec(nTrees);
       for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
-        predictionVec[treeIdx] = rootNodes[treeIdx]->getPrediction(testData, sampleIdx).catTrainPrediction;
+        predictionVec[treeIdx] = rootNodes[treeIdx]->percolateData(testData, sampleIdx)->getPrediction().catTrainPrediction;
       }
 
       (*predictions)[sampleIdx] = math::mode(predictionVec);
       (*confidence)[sampleIdx] = 1.0 * math::nMismatches(predictionVec, (*predictions)[sampleIdx]) / nTrees;
     }
+
+    // Samples are reported in batches, so that the threads rarely touch the shared counter
+    if ( ( i + 1 ) % 256 == 0 || i + 1 == sampleIcs.size() ) {
+      progress->add( i % 256 + 1 );
+    }
   }
 }
 
-void predictNumPerThread(TreeData* testData, 
+template<typename DataT>
+void predictNumSamples(DataT* testData, 
 			 vector<RootNode*>& rootNodes,
 			 forest_t forestType, 
 			 vector<size_t>& sampleIcs,
 			 vector<num_t>* predictions, 
 			 vector<num_t>* confidence,
 			 vector<num_t>& GBTConstants, 
-			 num_t& GBTShrinkage) {
+			 num_t& GBTShrinkage,
+			 Progress* progress) {
 
   size_t nTrees = rootNodes.size();
   for (size_t i = 0; i < sampleIcs.size(); ++i) {
     size_t sampleIdx = sampleIcs[i];
     vector<num_t> predictionVec(nTrees);
     for (size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx) {
-      predictionVec[treeIdx] = rootNodes[treeIdx]->getPrediction(testData,sampleIdx).numTrainPrediction;
+      predictionVec[treeIdx] = rootNodes[treeIdx]->percolateData(testData,sampleIdx)->getPrediction().numTrainPrediction;
     }
     if (forestType == forest_t::GBT) {
       (*predictions)[sampleIdx] = GBTConstants[0];
@@ -498,36 +1011,81 @@ void predictNumPerThread(TreeData* testData,
       (*predictions)[sampleIdx] = math::mean(predictionVec);
     }
     (*confidence)[sampleIdx]  = sqrt(math::var(predictionVec));
+
+    // Samples are reported in batches, so that the threads rarely touch the shared counter
+    if ( ( i + 1 ) % 256 == 0 || i + 1 == sampleIcs.size() ) {
+      progress->add( i % 256 + 1 );
+    }
+  }
+}
+
+// The data class is resolved once per thread, and the trees are descended with direct calls if it is DenseTreeData
+void predictCatPerThread(TreeData* testData, 
+			 vector<RootNode*>& rootNodes,
+			 forest_t forestType,
+			 vector<size_t>& sampleIcs, 
+			 vector<cat_t>* predictions,
+			 vector<num_t>* confidence, 
+			 vector<cat_t>& categories,
+			 vector<num_t>& GBTConstants, 
+			 num_t& GBTShrinkage,
+			 Progress* progress) {
+
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(testData);
+
+  if ( denseData ) {
+    predictCatSamples(denseData, rootNodes, forestType, sampleIcs, predictions, confidence, categories, GBTConstants, GBTShrinkage, progress);
+  } else {
+    predictCatSamples(testData, rootNodes, forestType, sampleIcs, predictions, confidence, categories, GBTConstants, GBTShrinkage, progress);
   }
+
+}
+
+void predictNumPerThread(TreeData* testData, 
+			 vector<RootNode*>& rootNodes,
+			 forest_t forestType, 
+			 vector<size_t>& sampleIcs,
+			 vector<num_t>* predictions, 
+			 vector<num_t>* confidence,
+			 vector<num_t>& GBTConstants, 
+			 num_t& GBTShrinkage,
+			 Progress* progress) {
+
+  DenseTreeData* denseData = dynamic_cast<DenseTreeData*>(testData);
+
+  if ( denseData ) {
+    predictNumSamples(denseData, rootNodes, forestType, sampleIcs, predictions, confidence, GBTConstants, GBTShrinkage, progress);
+  } else {
+    predictNumSamples(testData, rootNodes, forestType, sampleIcs, predictions, confidence, GBTConstants, GBTShrinkage, progress);
+  }
+
 }
 
 void StochasticForest::predict(TreeData* testData, vector<cat_t>& predictions,vector<num_t>& confidence, size_t nThreads) {
 
   assert( nThreads > 0 );
 
-  if ( forestType_ == forest_t::GBT && nThreads != 1 ) {
-    cout << "NOTE: GBT does not support multithreading. Turning threads OFF... " << flush;
-    nThreads = 1;
-  }
-  
   assert( ! rootNodes_[0]->isTargetNumerical() );
 
 #ifdef NOTHREADS
   assert( nThreads == 1 );
 #endif
 
-  vector<cat_t> categories = {};
+  // Categorical GBT has one tree per category in each iteration
+  vector<cat_t>& categories = GBTCategories_;
 
   size_t nSamples = testData->nSamples();
 
   predictions.resize(nSamples);
   confidence.resize(nSamples);
 
+  Progress progress("-Predicting:","samples",nSamples);
+
   if (nThreads == 1) {
 
     vector<size_t> sampleIcs = utils::range(nSamples);
 
-    predictCatPerThread(testData, rootNodes_, forestType_, sampleIcs, &predictions, &confidence, categories, GBTConstants_, GBTShrinkage_);
+    predictCatPerThread(testData, rootNodes_, forestType_, sampleIcs, &predictions, &confidence, categories, GBTConstants_, GBTShrinkage_, &progress);
 
   }
 #ifndef NOTHREADS
@@ -539,8 +1097,8 @@ void StochasticForest::predict(TreeData* testData, vector<cat_t>& predictions,ve
 
     for (size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx) {
       // We only launch a thread if there are any samples allocated for prediction
-      if (sampleIcs.size() > 0) {
-        threads.push_back( thread(predictCatPerThread, testData, rootNodes_, forestType_, sampleIcs[threadIdx], &predictions, &confidence, categories, GBTConstants_, GBTShrinkage_) );
+      if (sampleIcs[threadIdx].size() > 0) {
+        threads.push_back( thread(predictCatPerThread, testData, ref(rootNodes_), forestType_, ref(sampleIcs[threadIdx]), &predictions, &confidence, ref(categories), ref(GBTConstants_), ref(GBTShrinkage_), &progress) );
       }
     }
 
@@ -556,11 +1114,6 @@ void StochasticForest::predict(TreeData* testData, vector<num_t>& predictions,ve
 
   assert( nThreads > 0 );
 
-  if ( forestType_ == forest_t::GBT && nThreads != 1 ) {
-    cout << "NOTE: GBT does not support multithreading. Turning threads OFF... " << flush;
-    nThreads = 1;
-  }
-
   assert( rootNodes_[0]->isTargetNumerical() );
 
 #ifdef NOTHREADS
@@ -572,11 +1125,13 @@ void StochasticForest::predict(TreeData* testData, vector<num_t>& predictions,ve
   predictions.resize(nSamples);
   confidence.resize(nSamples);
 
+  Progress progress("-Predicting:","samples",nSamples);
+
   if (nThreads == 1) {
 
     vector<size_t> sampleIcs = utils::range(nSamples);
     //cout << "1 thread!" << endl;
-    predictNumPerThread(testData, rootNodes_, forestType_, sampleIcs, &predictions, &confidence, GBTConstants_, GBTShrinkage_);
+    predictNumPerThread(testData, rootNodes_, forestType_, sampleIcs, &predictions, &confidence, GBTConstants_, GBTShrinkage_, &progress);
 
   }
 #ifndef NOTHREADS
@@ -588,7 +1143,9 @@ void StochasticForest::predict(TreeData* testData, vector<num_t>& predictions,ve
 
     for (size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx) {
       // We only launch a thread if there are any samples allocated for prediction
-      threads.push_back( thread(predictNumPerThread, testData, rootNodes_, forestType_, sampleIcs[threadIdx], &predictions, &confidence, GBTConstants_, GBTShrinkage_));
+      if (sampleIcs[threadIdx].size() > 0) {
+	threads.push_back( thread(predictNumPerThread, testData, ref(rootNodes_), forestType_, ref(sampleIcs[threadIdx]), &predictions, &confidence, ref(GBTConstants_), ref(GBTShrinkage_), &progress) );
+      }
     }
 
     // Join all launched threads
@@ -608,6 +1165,8 @@ void StochasticForest::getNumDistributions(TreeData* testData,
   size_t nSamples = testData->nSamples();
 
   distributions.resize(nSamples,vector<num_t>(nTrees*nSamplesPerTree));
+
+  Progress progress("-Predicting:","samples",nSamples);
   
   for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
     for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
@@ -617,6 +1176,7 @@ void StochasticForest::getNumDistributions(TreeData* testData,
 	distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = treeData[ random->integer() % nSamplesInTreeData ];
       }
     }
+    progress.add();
   }
   
 }
@@ -631,6 +1191,8 @@ void StochasticForest::getCatDistributions(TreeData* testData,
 
   distributions.resize(nSamples,vector<cat_t>(nTrees*nSamplesPerTree));
 
+  Progress progress("-Predicting:","samples",nSamples);
+
   for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
     for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
       vector<cat_t> treeData = rootNodes_[treeIdx]->getChildLeafCatTrainData(testData,sampleIdx);
@@ -639,10 +1201,85 @@ void StochasticForest::getCatDistributions(TreeData* testData,
         distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = treeData[ random->integer() % nSamplesInTreeData ];
       }
     }
+    progress.add();
+  }
+
+}
+
+
+void StochasticForest::getOobPredictions(vector<num_t>& predictions) {
+
+  assert( oobCategories_.size() == 0 );
+
+  size_t nSamples = oobBuffer_.nOobTrees.size();
+
+  predictions.assign(nSamples,datadefs::NUM_NAN);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    if ( oobBuffer_.nOobTrees[i] > 0 ) {
+      predictions[i] = oobBuffer_.numPredictionSum[i] / oobBuffer_.nOobTrees[i];
+    }
+  }
+  
+}
+
+void StochasticForest::getOobPredictions(vector<cat_t>& predictions) {
+
+  size_t nCategories = oobCategories_.size();
+  size_t nSamples = oobBuffer_.nOobTrees.size();
+
+  assert( nCategories > 0 );
+
+  predictions.assign(nSamples,datadefs::STR_NAN);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    if ( oobBuffer_.nOobTrees[i] == 0 ) {
+      continue;
+    }
+    vector<size_t>::const_iterator votes( oobBuffer_.catVotes.begin() + i * nCategories );
+    size_t maxIdx = distance(votes, max_element(votes, votes + nCategories));
+    predictions[i] = oobCategories_[maxIdx];
   }
 
 }
 
+num_t StochasticForest::getOobError(TreeData* trainData) {
+
+  size_t targetIdx = trainData->getFeatureIdx(this->getTargetName());
+
+  assert( targetIdx != trainData->end() );
+
+  // Only the samples that have an OOB prediction contribute to the error
+  vector<size_t> sampleIcs;
+  for ( size_t i = 0; i < oobBuffer_.nOobTrees.size(); ++i ) {
+    if ( oobBuffer_.nOobTrees[i] > 0 ) {
+      sampleIcs.push_back(i);
+    }
+  }
+
+  if ( oobCategories_.size() == 0 ) {
+    vector<num_t> predictions;
+    this->getOobPredictions(predictions);
+    vector<num_t> oobPredictions(sampleIcs.size());
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      oobPredictions[i] = predictions[ sampleIcs[i] ];
+    }
+    return( math::numericalError(oobPredictions,trainData->feature(targetIdx)->getNumData(sampleIcs)) );
+  } else {
+    vector<cat_t> predictions;
+    this->getOobPredictions(predictions);
+    vector<cat_t> oobPredictions(sampleIcs.size());
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      oobPredictions[i] = predictions[ sampleIcs[i] ];
+    }
+    return( math::categoricalError(oobPredictions,trainData->feature(targetIdx)->getCatData(sampleIcs)) );
+  }
+
+}
+
+size_t StochasticForest::nOobSamples() const {
+  return( oobBuffer_.nOobTrees.size() - count(oobBuffer_.nOobTrees.begin(),oobBuffer_.nOobTrees.end(),0) );
+}
 
 /**
  Returns the number of trees in the forest
@@ -656,6 +1293,8 @@ void StochasticForest::getMDI(TreeData* trainData,
 			      vector<num_t>& MDI, 
 			      vector<num_t>& contrastMDI) {
 
+  profiler::ScopedTimer scopedTimer("MDI");
+
   size_t nRealFeatures = trainData->nFeatures();
   size_t nAllFeatures = 2 * nRealFeatures;
 
@@ -698,3 +1337,14 @@ void StochasticForest::getMDI(TreeData* trainData,
   MDI.resize(nRealFeatures);
 
 }
+
+void StochasticForest::memoryUsage(memreport::Breakdown& breakdown) const {
+
+  for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    rootNodes_[treeIdx]->memoryUsage(breakdown);
+  }
+
+  memreport::add(breakdown, "OOB predictions", memreport::heapBytes(oobBuffer_.numPredictionSum) + 
+		 memreport::heapBytes(oobBuffer_.catVotes) + memreport::heapBytes(oobBuffer_.nOobTrees));
+
+}
@@ -3,26 +3,56 @@
 
 #include <cstdlib>
 #include <fstream>
+#include <chrono>
 #include "rootnode.hpp"
 #include "treedata.hpp"
 #include "options.hpp"
 #include "distributions.hpp"
+#include "workcounters.hpp"
+#include "progress.hpp"
 
 using namespace std;
 
 class StochasticForest {
 public:
   
+  // Per-sample accumulators for out-of-bag predictions. During training every thread fills 
+  // its own buffer, and the buffers are summed into the forest's buffer once the threads join
+  struct OobBuffer {
+
+    // Sum of numerical OOB predictions per sample
+    vector<num_t> numPredictionSum;
+
+    // OOB votes per sample and category, stored as sampleIdx * nCategories + categoryIdx
+    vector<size_t> catVotes;
+
+    // Number of trees for which the sample was OOB
+    vector<size_t> nOobTrees;
+
+    void reset(const size_t nSamples, const size_t nCategories);
+    void add(const OobBuffer& other);
+
+  };
+
   StochasticForest();
   
   ~StochasticForest();
 
   void learnRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms);
+
+  // Adds trees to the forest, which may be empty, loaded from file or trained earlier. 
+  // If forestOptions->convergenceTolerance > 0, grows batches until convergence
+  void growRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms);
+
+  // Trees that would likely finish past the deadline are not grown; the forest keeps at least one tree
+  void setDeadline(const chrono::steady_clock::time_point& deadline) { deadline_ = deadline; }
+
   void learnGBT(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms);
 
+  // Appends the trees of a forest file. A file that cannot be read, is empty, is malformed, or mixes
+  // forest or target types throws RFACE_EXCEPTION with ERRNO::INVALID_READ, and adds no trees
   void loadForest(const string& fileName);
 
-
   void trainForestAndPredictQuantiles(TreeData* trainData,
 				      const size_t targetIdx,
 				      TreeData* testData,
@@ -32,9 +62,16 @@ public:
 				      vector<vector<num_t> >& predictions); 
 
   //num_t getError() { return(0.0); }
-  //num_t getOobError();
 
-  //void getImportanceValues(TreeData* trainData, vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues);
+  // RMSE (numerical target) or misclassification rate (categorical target) of the OOB predictions,
+  // computed over the training samples that were OOB for at least one tree
+  num_t getOobError(TreeData* trainData);
+
+  // Number of training samples that were OOB for at least one tree
+  size_t nOobSamples() const;
+
+  // Mean increase in OOB error when a feature is permuted among the OOB samples of each tree
+  void getPermutationImportance(TreeData* trainData, vector<num_t>& importance, vector<num_t>& contrastImportance, vector<distributions::Random>& randoms);
   void getMDI(TreeData* trainData, vector<num_t>& impurityValues, vector<num_t>& contrastImpurityValues);
 
   void predict(TreeData* testData, vector<string>& predictions, vector<num_t>& confidence, size_t nThreads = 1);
@@ -45,8 +82,10 @@ public:
   void getNumDistributions(TreeData* testData, vector<vector<num_t> >& distributions, distributions::Random* random, const size_t nSamplesPerTree);
   void getCatDistributions(TreeData* testData, vector<vector<cat_t> >& distributions, distributions::Random* random, const size_t nSamplesPerTree);
 
-  //vector<num_t> getOobPredictions();
-  //vector<num_t> getPermutedOobPredictions(const size_t featureIdx);
+  // OOB predictions for the training samples; samples that were never OOB are assigned NAN
+  void getOobPredictions(vector<num_t>& predictions);
+  void getOobPredictions(vector<cat_t>& predictions);
+
 
   //Counts the number of nodes in the forest
   //size_t nNodes();
@@ -54,7 +93,7 @@ public:
 
   size_t nTrees();
 
-  //RootNode* tree(const size_t treeIdx) { return( rootNodes_[treeIdx] ); }
+  const RootNode* tree(const size_t treeIdx) const { return( rootNodes_[treeIdx] ); }
 
   //inline set<size_t> getFeaturesInForest() const { return( featuresInForest_ ); }
   inline string getTargetName() const { assert(rootNodes_.size() > 0); return( rootNodes_[0]->getTargetName() ); }
@@ -62,11 +101,20 @@ public:
 
   void writeForest(ofstream& toFile);
 
+  // Work done growing the trees of this forest, summed over the threads
+  const WorkCounters& getWorkCounters() const { return( workCounters_ ); }
+
+  // Bytes held by the trees and the OOB bookkeeping of the forest
+  void memoryUsage(memreport::Breakdown& breakdown) const;
+
 #ifndef TEST__
 private:
 #endif
 
   void readForestHeader(ifstream& forestStream);
+
+  // Returns the number of trees actually grown, which is less than nNewTrees if the deadline was hit
+  size_t addTreesRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const distributions::PMF* pmf, const unordered_map<cat_t,size_t>& cat2idx, vector<distributions::Random>& randoms, const size_t nNewTrees, Progress* progress);
   
   void growNumericalGBT(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const distributions::PMF* pmf, vector<distributions::Random>& randoms);
   void growCategoricalGBT(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const distributions::PMF* pmf, vector<distributions::Random>& randoms);
@@ -78,10 +126,22 @@ private:
 
   vector<num_t> GBTConstants_;
   num_t GBTShrinkage_;
+  vector<cat_t> GBTCategories_;
 
   // Root nodes for every tree
   vector<RootNode*> rootNodes_;
 
+  // OOB predictions accumulated over the trees grown so far
+  OobBuffer oobBuffer_;
+  vector<cat_t> oobCategories_;
+
+  // Data the OOB predictions were accumulated over
+  const TreeData* oobTrainData_;
+
+  chrono::steady_clock::time_point deadline_;
+
+  WorkCounters workCounters_;
+
   // Container for all features in the forest for fast look-up
   //set<size_t> featuresInForest_;
   
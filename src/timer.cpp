@@ -0,0 +1,449 @@
+#include "timer.hpp"
+
+#include <cstring>
+#include <cassert>
+#include <iomanip>
+
+#ifndef NOTHREADS
+#include <mutex>
+#endif
+
+void Timer::tic(const string& objName) {
+  name2idx_.insert( pair<string,size_t>(objName,timedObjects_.size()) );
+  timedObjects_.push_back( TimedObject(objName) );
+}
+
+void Timer::toc(const string& objName) {
+
+  map<string,size_t>::const_iterator it( name2idx_.find(objName) );
+
+  if ( it == name2idx_.end() ) {
+    cerr << "Cannot stop timing '" << objName << "', since it was never started!" << endl;
+    exit(1);
+  }
+
+  TimedObject& timedObject = timedObjects_[it->second];
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - timedObject.startTime;
+  timedObject.wallTime = elapsed.count();
+  timedObject.cpuTime = 1.0 * ( clock() - timedObject.startClocks ) / CLOCKS_PER_SEC;
+  timedObject.isRunning = false;
+}
+
+void Timer::print() {
+  cout << "Execution time breakdown:" << endl;
+  for ( size_t i = 0; i < timedObjects_.size(); ++i ) {
+    timedObjects_[i].print();
+  }
+  cout << endl;
+}
+
+void Timer::TimedObject::print() {
+  if ( !isRunning ) {
+    cout << name << "  " << fixed << setprecision(3) << wallTime << " seconds (CPU " << cpuTime << " seconds)" << endl;
+    cout.unsetf(ios_base::floatfield);
+    cout << setprecision(6);
+  } else {
+    cout << name << " is still running!" << endl;
+  }
+}
+
+bool profiler::isEnabled = false;
+
+namespace {
+
+  struct PhaseNode {
+    const char* name;
+    size_t parentIdx;
+    size_t nCalls;
+    uint64_t totalNs;
+    vector<size_t> childIcs;
+    perfcounters::Counts counts;
+  };
+
+  // Phase tree of one thread; node 0 is the unnamed root
+  struct ThreadProfile {
+    vector<PhaseNode> nodes;
+    vector<chrono::steady_clock::time_point> startTimes;
+    vector<perfcounters::Counts> startCounts;
+    size_t currentIdx;
+  };
+
+  // Profiles of the running threads. When a thread finishes, its profile is folded into the
+  // merged phases of the finished threads and freed, so that spawning threads over and over,
+  // as done once per tree or permutation, does not keep a profile per thread ever started
+  vector<ThreadProfile*> profiles;
+  profiler::Phase finishedPhases;
+  size_t generation = 0;
+  chrono::steady_clock::time_point enableTime;
+
+#ifndef NOTHREADS
+  mutex profilesMutex;
+#endif
+
+  void mergePhase(const ThreadProfile* profile, const size_t nodeIdx, profiler::Phase& phase);
+
+  // A profile left over from before a reset() has been freed already, and is replaced by a fresh one
+  struct ThreadSlot {
+    ThreadProfile* profile;
+    size_t profileGeneration;
+    ThreadSlot(): profile(NULL),profileGeneration(0) {}
+    ~ThreadSlot();
+  };
+
+  thread_local ThreadSlot threadSlot;
+
+  ThreadSlot::~ThreadSlot() {
+
+    if ( !profile ) {
+      return;
+    }
+
+#ifndef NOTHREADS
+    lock_guard<mutex> lock(profilesMutex);
+#endif
+
+    if ( profileGeneration != generation ) {
+      return;
+    }
+
+    mergePhase(profile, 0, finishedPhases);
+
+    for ( size_t i = 0; i < profiles.size(); ++i ) {
+      if ( profiles[i] == profile ) {
+	profiles.erase( profiles.begin() + i );
+	break;
+      }
+    }
+
+    delete profile;
+    profile = NULL;
+
+  }
+
+  ThreadProfile* getThreadProfile() {
+
+    if ( threadSlot.profile && threadSlot.profileGeneration == generation ) {
+      return( threadSlot.profile );
+    }
+
+    ThreadProfile* profile = new ThreadProfile;
+    PhaseNode root = { "", 0, 0, 0, vector<size_t>(), perfcounters::Counts() };
+    profile->nodes.push_back(root);
+    profile->currentIdx = 0;
+
+#ifndef NOTHREADS
+    lock_guard<mutex> lock(profilesMutex);
+#endif
+    profiles.push_back(profile);
+    threadSlot.profile = profile;
+    threadSlot.profileGeneration = generation;
+
+    return( profile );
+
+  }
+
+  size_t findOrAddChild(ThreadProfile* profile, const size_t parentIdx, const char* name) {
+
+    const vector<size_t>& childIcs = profile->nodes[parentIdx].childIcs;
+
+    for ( size_t i = 0; i < childIcs.size(); ++i ) {
+      const char* childName = profile->nodes[ childIcs[i] ].name;
+      if ( childName == name || strcmp(childName,name) == 0 ) {
+	return( childIcs[i] );
+      }
+    }
+
+    PhaseNode node = { name, parentIdx, 0, 0, vector<size_t>(), perfcounters::Counts() };
+    profile->nodes.push_back(node);
+    profile->nodes[parentIdx].childIcs.push_back( profile->nodes.size() - 1 );
+
+    return( profile->nodes.size() - 1 );
+
+  }
+
+  void mergePhase(const ThreadProfile* profile, const size_t nodeIdx, profiler::Phase& phase) {
+
+    const PhaseNode& node = profile->nodes[nodeIdx];
+
+    phase.nCalls += node.nCalls;
+    phase.totalNs += node.totalNs;
+    phase.nThreads += node.nCalls > 0 ? 1 : 0;
+    for ( size_t i = 0; i < perfcounters::N_EVENTS; ++i ) {
+      phase.counts.values[i] += node.counts.values[i];
+    }
+
+    for ( size_t i = 0; i < node.childIcs.size(); ++i ) {
+
+      const char* childName = profile->nodes[ node.childIcs[i] ].name;
+
+      size_t childIdx = 0;
+      while ( childIdx < phase.children.size() && phase.children[childIdx].name != childName ) {
+	++childIdx;
+      }
+
+      if ( childIdx == phase.children.size() ) {
+	phase.children.push_back( profiler::Phase() );
+	phase.children.back().name = childName;
+      }
+
+      mergePhase(profile, node.childIcs[i], phase.children[childIdx]);
+    }
+
+  }
+
+  // Cycles, instructions per cycle, and misses per thousand instructions; "-" for events that are not counted
+  void printCounts(const perfcounters::Counts& counts, ostream& os) {
+
+    uint64_t nCycles = counts.values[perfcounters::CYCLES];
+    uint64_t nInstructions = counts.values[perfcounters::INSTRUCTIONS];
+
+    os << setw(12) << setprecision(1) << nCycles / 1e6;
+
+    if ( perfcounters::isCounted(perfcounters::INSTRUCTIONS) && nCycles > 0 ) {
+      os << setw(7) << setprecision(2) << 1.0 * nInstructions / nCycles;
+    } else {
+      os << setw(7) << "-";
+    }
+
+    for ( size_t i = perfcounters::LLC_MISSES; i <= perfcounters::BRANCH_MISSES; ++i ) {
+      if ( perfcounters::isCounted( static_cast<perfcounters::Event>(i) ) && nInstructions > 0 ) {
+	os << setw(14) << setprecision(3) << 1e3 * counts.values[i] / nInstructions;
+      } else {
+	os << setw(14) << "-";
+      }
+    }
+
+  }
+
+  void printPhase(const profiler::Phase& phase, const size_t depth, const double wallNs, ostream& os) {
+
+    string name = string(2 * depth,' ') + phase.name;
+
+    os << "  " << left << setw(36) << name << right
+       << setw(10) << phase.nCalls
+       << setw(13) << fixed << setprecision(3) << phase.totalNs / 1e6
+       << setw(8) << setprecision(1) << ( wallNs > 0 ? 100.0 * phase.totalNs / wallNs : 0.0 )
+       << setw(13) << setprecision(3) << ( phase.nCalls > 0 ? phase.totalNs / 1e3 / phase.nCalls : 0.0 )
+       << setw(9) << phase.nThreads;
+
+    if ( perfcounters::isEnabled ) {
+      printCounts(phase.counts, os);
+    }
+
+    os << endl;
+
+    for ( size_t i = 0; i < phase.children.size(); ++i ) {
+      printPhase(phase.children[i], depth + 1, wallNs, os);
+    }
+
+  }
+
+  void writePhaseJSON(const profiler::Phase& phase, ostream& os) {
+
+    os << "{\"name\":\"" << phase.name << "\",\"calls\":" << phase.nCalls << ",\"totalNs\":" << phase.totalNs
+       << ",\"threads\":" << phase.nThreads;
+
+    for ( size_t i = 0; i < perfcounters::N_EVENTS; ++i ) {
+      if ( perfcounters::isCounted( static_cast<perfcounters::Event>(i) ) ) {
+	os << ",\"" << perfcounters::eventNames[i] << "\":" << phase.counts.values[i];
+      }
+    }
+
+    os << ",\"children\":[";
+
+    for ( size_t i = 0; i < phase.children.size(); ++i ) {
+      os << ( i > 0 ? "," : "" );
+      writePhaseJSON(phase.children[i], os);
+    }
+
+    os << "]}";
+
+  }
+
+}
+
+void profiler::enable() {
+  isEnabled = true;
+  enableTime = chrono::steady_clock::now();
+}
+
+void profiler::push(const char* phase) {
+
+  ThreadProfile* profile = getThreadProfile();
+
+  profile->currentIdx = findOrAddChild(profile, profile->currentIdx, phase);
+  profile->startTimes.push_back( chrono::steady_clock::now() );
+
+  if ( perfcounters::isEnabled ) {
+    profile->startCounts.push_back( perfcounters::Counts() );
+    perfcounters::read( profile->startCounts.back() );
+  }
+
+}
+
+void profiler::pop() {
+
+  perfcounters::Counts counts;
+  perfcounters::read(counts);
+
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  ThreadProfile* profile = getThreadProfile();
+
+  assert( profile->startTimes.size() > 0 );
+
+  PhaseNode& node = profile->nodes[ profile->currentIdx ];
+  node.totalNs += chrono::duration_cast<chrono::nanoseconds>( now - profile->startTimes.back() ).count();
+  ++node.nCalls;
+
+  if ( perfcounters::isEnabled ) {
+    assert( profile->startCounts.size() > 0 );
+    for ( size_t i = 0; i < perfcounters::N_EVENTS; ++i ) {
+      node.counts.values[i] += counts.values[i] - profile->startCounts.back().values[i];
+    }
+    profile->startCounts.pop_back();
+  }
+
+  profile->startTimes.pop_back();
+  profile->currentIdx = node.parentIdx;
+
+}
+
+profiler::Path profiler::currentPath() {
+
+  Path path;
+
+  if ( !isEnabled ) {
+    return( path );
+  }
+
+  ThreadProfile* profile = getThreadProfile();
+
+  for ( size_t nodeIdx = profile->currentIdx; nodeIdx != 0; nodeIdx = profile->nodes[nodeIdx].parentIdx ) {
+    path.insert( path.begin(), profile->nodes[nodeIdx].name );
+  }
+
+  return( path );
+
+}
+
+profiler::ScopedAttach::ScopedAttach(const Path& path):
+  isAttached_(false) {
+
+  if ( !isEnabled || path.empty() ) {
+    return;
+  }
+
+  ThreadProfile* profile = getThreadProfile();
+
+  if ( profile->currentIdx != 0 ) {
+    return;
+  }
+
+  for ( size_t i = 0; i < path.size(); ++i ) {
+    profile->currentIdx = findOrAddChild(profile, profile->currentIdx, path[i]);
+  }
+
+  isAttached_ = true;
+
+}
+
+profiler::ScopedAttach::~ScopedAttach() {
+
+  if ( isAttached_ ) {
+    ThreadProfile* profile = getThreadProfile();
+    assert( profile->startTimes.empty() );
+    profile->currentIdx = 0;
+  }
+
+}
+
+size_t profiler::nThreadProfiles() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(profilesMutex);
+#endif
+
+  return( profiles.size() );
+
+}
+
+profiler::Phase profiler::collect() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(profilesMutex);
+#endif
+
+  Phase root = finishedPhases;
+
+  for ( size_t i = 0; i < profiles.size(); ++i ) {
+    mergePhase(profiles[i], 0, root);
+  }
+
+  return( root );
+
+}
+
+void profiler::print(ostream& os) {
+
+  Phase root = collect();
+
+  double wallNs = chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - enableTime ).count();
+
+  streamsize precision = os.precision();
+
+  os << endl << "Profile of phases, " << fixed << setprecision(3) << wallNs / 1e9
+     << " seconds since profiling started (times of phases in several threads are summed):" << endl
+     << "  " << left << setw(36) << "phase" << right << setw(10) << "calls" << setw(13) << "total(ms)"
+     << setw(8) << "%" << setw(13) << "mean(us)" << setw(9) << "threads";
+
+  if ( perfcounters::isEnabled ) {
+    os << setw(12) << "Mcycles" << setw(7) << "IPC" << setw(14) << "LLCmiss/kinst" << setw(14) << "brmiss/kinst";
+  }
+
+  os << endl;
+
+  for ( size_t i = 0; i < root.children.size(); ++i ) {
+    printPhase(root.children[i], 0, wallNs, os);
+  }
+
+  os << endl;
+  os.unsetf(ios_base::floatfield);
+  os.precision(precision);
+
+}
+
+void profiler::writeJSON(ostream& os) {
+
+  Phase root = collect();
+
+  uint64_t wallNs = chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - enableTime ).count();
+
+  os << "{\"wallNs\":" << wallNs << ",\"phases\":[";
+
+  for ( size_t i = 0; i < root.children.size(); ++i ) {
+    os << ( i > 0 ? "," : "" );
+    writePhaseJSON(root.children[i], os);
+  }
+
+  os << "]}" << endl;
+
+}
+
+void profiler::reset() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(profilesMutex);
+#endif
+
+  for ( size_t i = 0; i < profiles.size(); ++i ) {
+    assert( profiles[i]->startTimes.empty() );
+    delete profiles[i];
+  }
+
+  profiles.clear();
+  finishedPhases = Phase();
+  ++generation;
+  threadSlot.profile = NULL;
+
+}
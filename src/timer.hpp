@@ -2,17 +2,20 @@
 #define TIMER_HPP
 
 #include <cstdlib>
+#include <iostream>
 #include <vector>
 #include <string>
-#include <cassert>
-#include <ctime>
-#include <cmath>
 #include <map>
+#include <chrono>
+#include <ctime>
+#include <stdint.h>
 
 #include "datadefs.hpp"
+#include "perfcounters.hpp"
 
 using namespace std;
 
+// Wall-clock timer of named objects, with the CPU time spent meanwhile by all threads
 class Timer {
 
 public:
@@ -20,62 +23,93 @@ public:
   Timer() {}
   ~Timer() {}
 
-  void tic(const string& objName) { 
-    name2idx_.insert( pair<string,size_t>(objName,timedObjects_.size()) );
-    timedObjects_.push_back( TimedObject(objName) );
-  }
-
-  void toc(const string& objName) {
-
-    map<string,size_t>::const_iterator it( name2idx_.find(objName) );
-
-    if ( it == name2idx_.end() ) {
-      cerr << "Cannot stop timing '" << objName << "', since it was never started!" << endl;
-      exit(1);
-    }
-
-    size_t idx = name2idx_[objName];
-    timedObjects_[idx].timeDiff = time(0) - timedObjects_[idx].startTime;
-    timedObjects_[idx].clockDiff = clock() - timedObjects_[idx].startClocks;
-    if ( timedObjects_[idx].timeDiff > 0 ) {
-      timedObjects_[idx].boost = static_cast<clock_t>(round(1.0 * timedObjects_[idx].clockDiff / ( CLOCKS_PER_SEC * timedObjects_[idx].timeDiff )));
-    }
-    timedObjects_[idx].isRunning = false;
-  }
-
-  void print() {
-    cout << "Execution time breakdown:" << endl;
-    for ( size_t i = 0; i < timedObjects_.size(); ++i ) {
-      timedObjects_[i].print();
-    }
-    cout << endl;
-  }
+  void tic(const string& objName);
+  void toc(const string& objName);
+
+  void print();
 
 private:
 
   struct TimedObject {
     string  name;
-    clock_t startTime;
-    clock_t timeDiff;
+    chrono::steady_clock::time_point startTime;
+    double  wallTime;
     clock_t startClocks;
-    clock_t clockDiff;
-    clock_t boost;
+    double  cpuTime;
     bool    isRunning;
-    TimedObject(const string& newName): name(newName),startTime(time(0)),startClocks(clock()),boost(1),isRunning(true) {}
-    void print() {
-      if ( !isRunning ) {
-	cout << name << "  " << timeDiff << " seconds (" << boost << "x)" << endl;
-      } else {
-	cout << name << " is still running!" << endl;
-      }
-    }
+    TimedObject(const string& newName): name(newName),startTime(chrono::steady_clock::now()),wallTime(0.0),startClocks(clock()),cpuTime(0.0),isRunning(true) {}
+    void print();
   };
-  
+
   map<string,size_t> name2idx_;
 
   vector<TimedObject> timedObjects_;
 
 };
 
+// Hierarchical phase profiler. A ScopedTimer adds the time spent in its scope to the named phase,
+// nested under the phases open in the same thread. Every thread keeps a phase tree of its own,
+// and the trees are merged by phase path when reported; the tree of a finished thread is merged right
+// away and freed. While disabled, a ScopedTimer costs one branch.
+// With perfcounters enabled, the hardware counts of the thread are attributed to the phases as well
+namespace profiler {
+
+  // Phase names are expected to be string literals, as they are stored by pointer
+  typedef vector<const char*> Path;
+
+  // Set by enable(), before any threads are spawned
+  extern bool isEnabled;
+
+  void enable();
+
+  void push(const char* phase);
+  void pop();
+
+  // The phases open in the calling thread, outermost first
+  Path currentPath();
+
+  class ScopedTimer {
+  public:
+    explicit ScopedTimer(const char* phase): isActive_(isEnabled) { if ( isActive_ ) push(phase); }
+    ~ScopedTimer() { if ( isActive_ ) pop(); }
+  private:
+    bool isActive_;
+  };
+
+  // Nests the phases of a worker thread under the phases of the thread that spawned it.
+  // In a thread that already has open phases, such as when the work runs inline, it does nothing
+  class ScopedAttach {
+  public:
+    explicit ScopedAttach(const Path& path);
+    ~ScopedAttach();
+  private:
+    bool isAttached_;
+  };
+
+  struct Phase {
+    string name;
+    size_t nCalls;
+    uint64_t totalNs;
+    size_t nThreads;
+    perfcounters::Counts counts;
+    vector<Phase> children;
+    Phase(): name(""),nCalls(0),totalNs(0),nThreads(0) {}
+  };
+
+  // Number of phase trees held for threads that have not finished yet
+  size_t nThreadProfiles();
+
+  // Merges the phase trees of all threads seen so far; the root is unnamed
+  Phase collect();
+
+  // Breakdown table, with times relative to the time since enable()
+  void print(ostream& os);
+
+  void writeJSON(ostream& os);
+
+  // Drops the recorded phases. No phases may be open in any thread
+  void reset();
+
+}
 
 #endif
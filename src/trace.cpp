@@ -0,0 +1,237 @@
+#include "trace.hpp"
+
+#include <cassert>
+#include <iomanip>
+#include <algorithm>
+
+#ifndef NOTHREADS
+#include <mutex>
+#endif
+
+bool trace::isEnabled = false;
+size_t trace::minNodeSize = 0;
+
+namespace {
+
+  struct Event {
+    const char* name;
+    const char* argName;
+    size_t arg;
+    uint64_t startNs;
+    uint64_t durationNs;
+  };
+
+  // Ring buffer of one thread at a time; events[nRecorded % capacity] is the next slot to write.
+  // The events are allocated as they come, up to the capacity
+  struct ThreadBuffer {
+    size_t threadId;
+    vector<Event> events;
+    size_t nRecorded;
+  };
+
+  // Buffers outlive their threads, so that they can be written once the threads have joined.
+  // The buffer of a finished thread is handed to the next new thread, which appends to it, so
+  // that spawning threads over and over keeps only as many buffers as threads ran at once
+  vector<ThreadBuffer*> buffers;
+  vector<ThreadBuffer*> freeBuffers;
+  size_t generation = 0;
+  size_t capacity = 0;
+  chrono::steady_clock::time_point enableTime;
+
+#ifndef NOTHREADS
+  mutex buffersMutex;
+#endif
+
+  // A buffer left over from before a reset() has been freed already, and is replaced by another one
+  struct ThreadSlot {
+    ThreadBuffer* buffer;
+    size_t bufferGeneration;
+    ThreadSlot(): buffer(NULL),bufferGeneration(0) {}
+    ~ThreadSlot();
+  };
+
+  thread_local ThreadSlot threadSlot;
+
+  ThreadSlot::~ThreadSlot() {
+
+    if ( !buffer ) {
+      return;
+    }
+
+#ifndef NOTHREADS
+    lock_guard<mutex> lock(buffersMutex);
+#endif
+
+    if ( bufferGeneration == generation ) {
+      freeBuffers.push_back(buffer);
+    }
+
+    buffer = NULL;
+
+  }
+
+  ThreadBuffer* getThreadBuffer() {
+
+    if ( threadSlot.buffer && threadSlot.bufferGeneration == generation ) {
+      return( threadSlot.buffer );
+    }
+
+#ifndef NOTHREADS
+    lock_guard<mutex> lock(buffersMutex);
+#endif
+
+    ThreadBuffer* buffer = NULL;
+
+    if ( freeBuffers.size() > 0 ) {
+      buffer = freeBuffers.back();
+      freeBuffers.pop_back();
+    } else {
+      buffer = new ThreadBuffer;
+      buffer->nRecorded = 0;
+      buffer->threadId = buffers.size() + 1;
+      buffers.push_back(buffer);
+    }
+
+    threadSlot.buffer = buffer;
+    threadSlot.bufferGeneration = generation;
+
+    return( buffer );
+
+  }
+
+  void writeEvent(const Event& event, const size_t threadId, ostream& os) {
+    os << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+       << ",\"ts\":" << event.startNs / 1e3 << ",\"dur\":" << event.durationNs / 1e3;
+    if ( event.argName ) {
+      os << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+    }
+    os << "}";
+  }
+
+}
+
+void trace::enable(const size_t nodeSize, const size_t eventsPerThread) {
+  assert( eventsPerThread > 0 );
+  minNodeSize = nodeSize;
+  capacity = eventsPerThread;
+  enableTime = chrono::steady_clock::now();
+  isEnabled = true;
+}
+
+uint64_t trace::now() {
+  return( chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - enableTime ).count() );
+}
+
+void trace::record(const char* name, const char* argName, const size_t arg, const uint64_t startNs, const uint64_t endNs) {
+
+  ThreadBuffer* buffer = getThreadBuffer();
+
+  if ( buffer->events.size() < capacity ) {
+    buffer->events.push_back( Event() );
+  }
+
+  Event& event = buffer->events[ buffer->nRecorded % capacity ];
+  event.name = name;
+  event.argName = argName;
+  event.arg = arg;
+  event.startNs = startNs;
+  event.durationNs = endNs - startNs;
+
+  ++buffer->nRecorded;
+
+}
+
+size_t trace::nEvents() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(buffersMutex);
+#endif
+
+  size_t n = 0;
+  for ( size_t i = 0; i < buffers.size(); ++i ) {
+    n += buffers[i]->nRecorded;
+  }
+
+  return( n );
+
+}
+
+size_t trace::nBuffers() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(buffersMutex);
+#endif
+
+  return( buffers.size() );
+
+}
+
+size_t trace::nDropped() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(buffersMutex);
+#endif
+
+  size_t n = 0;
+  for ( size_t i = 0; i < buffers.size(); ++i ) {
+    n += buffers[i]->nRecorded > capacity ? buffers[i]->nRecorded - capacity : 0;
+  }
+
+  return( n );
+
+}
+
+void trace::writeJSON(ostream& os) {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(buffersMutex);
+#endif
+
+  streamsize precision = os.precision();
+
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+  os << fixed << setprecision(3);
+
+  bool isFirst = true;
+
+  for ( size_t i = 0; i < buffers.size(); ++i ) {
+
+    const ThreadBuffer* buffer = buffers[i];
+
+    os << ( isFirst ? "" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+       << ",\"args\":{\"name\":\"thread " << buffer->threadId << "\"}}";
+    isFirst = false;
+
+    // Oldest first; a full buffer starts from the slot that is to be overwritten next
+    size_t nKept = min(buffer->nRecorded, capacity);
+    size_t firstIdx = buffer->nRecorded - nKept;
+
+    for ( size_t j = 0; j < nKept; ++j ) {
+      os << ",\n";
+      writeEvent(buffer->events[ (firstIdx + j) % capacity ], buffer->threadId, os);
+    }
+  }
+
+  os << endl << "]}" << endl;
+
+  os.unsetf(ios_base::floatfield);
+  os.precision(precision);
+
+}
+
+void trace::reset() {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(buffersMutex);
+#endif
+
+  for ( size_t i = 0; i < buffers.size(); ++i ) {
+    delete buffers[i];
+  }
+
+  buffers.clear();
+  freeBuffers.clear();
+  ++generation;
+  threadSlot.buffer = NULL;
+
+}
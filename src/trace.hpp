@@ -0,0 +1,62 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <stdint.h>
+
+#include "datadefs.hpp"
+
+using namespace std;
+
+// Timeline tracing in the Chrome trace-event format, which chrome://tracing and Perfetto open.
+// A ScopedEvent records one complete event, with its start and duration, into a bounded ring
+// buffer of the calling thread. Only the owning thread writes into a buffer, so recording takes no
+// locks; once full, a buffer overwrites its oldest events. Threads that start after others have
+// finished reuse their buffers, and appear in the timeline under the same thread id. While disabled, a ScopedEvent costs one branch
+namespace trace {
+
+  // Set by enable(), before any threads are spawned
+  extern bool isEnabled;
+
+  // Tree nodes with fewer samples than this are not traced
+  extern size_t minNodeSize;
+
+  void enable(const size_t nodeSize, const size_t eventsPerThread = 65536);
+
+  uint64_t now();
+
+  void record(const char* name, const char* argName, const size_t arg, const uint64_t startNs, const uint64_t endNs);
+
+  class ScopedEvent {
+  public:
+    // A NULL name disables the event, so that the caller can decide on the spot whether to trace
+    explicit ScopedEvent(const char* name, const char* argName = NULL, const size_t arg = 0):
+      isActive_(isEnabled && name),name_(name),argName_(argName),arg_(arg),startNs_(isActive_ ? now() : 0) {}
+    ~ScopedEvent() { if ( isActive_ ) record(name_,argName_,arg_,startNs_,now()); }
+  private:
+    bool isActive_;
+    const char* name_;
+    const char* argName_;
+    size_t arg_;
+    uint64_t startNs_;
+  };
+
+  // Number of events recorded and number overwritten in full buffers
+  size_t nEvents();
+  size_t nDropped();
+
+  // Number of buffers, which is the largest number of threads that have traced at once
+  size_t nBuffers();
+
+  // Writes the events of all threads seen so far. No events may be recorded meanwhile
+  void writeJSON(ostream& os);
+
+  void reset();
+
+}
+
+#endif
@@ -20,6 +20,9 @@ using datadefs::num_t;
 class TreeData {
 public:
 
+  // Data is deleted through base pointers, which hold derived classes that release files and mappings
+  virtual ~TreeData() { }
+
   // Reveals the Feature class interface to the user
   virtual const Feature* feature(const size_t featureIdx) const = 0;
   
@@ -44,37 +47,45 @@ public:
 				      vector<size_t>& sampleIcs,
 				      vector<size_t>& missingIcs) = 0;
   
-  virtual num_t numericalFeatureSplit(const size_t targetIdx,
+  virtual num_t numericalFeatureSplit(const Feature* target,
 				      const size_t featureIdx,
 				      const size_t minSamples,
+				      const vector<size_t>& sampleWeights,
 				      vector<size_t>& sampleIcs_left,
 				      vector<size_t>& sampleIcs_right,
 				      num_t& splitValue) = 0;
 
-  virtual num_t categoricalFeatureSplit(const size_t targetIdx,
+  virtual num_t categoricalFeatureSplit(const Feature* target,
 					const size_t featureIdx,
 					const vector<cat_t>& catOrder,
 					const size_t minSamples,
+					const vector<size_t>& sampleWeights,
 					vector<size_t>& sampleIcs_left,
 					vector<size_t>& sampleIcs_right,
 					unordered_set<cat_t>& splitValues_left) = 0;
   
-  virtual num_t textualFeatureSplit(const size_t targetIdx,
+  virtual num_t textualFeatureSplit(const Feature* target,
 				    const size_t featureIdx,
 				    const uint32_t hashIdx,
 				    const size_t minSamples,
+				    const vector<size_t>& sampleWeights,
 				    vector<size_t>& sampleIcs_left,
 				    vector<size_t>& sampleIcs_right) = 0;
     
-  // Generates a bootstrap sample from the real samples of featureIdx. Samples not in the bootstrap sample will be stored in oob_ics,
-  // and the number of oob samples is stored in noob.
+  // Generates a bootstrap sample from the real samples of featureIdx. The sample is represented as per-sample
+  // multiplicities in sampleWeights (one entry per sample in the data, 0 if not drawn). The distinct drawn 
+  // samples are stored in ics, and the real samples that were not drawn (weight 0) are stored in oobIcs.
   virtual void bootstrapFromRealSamples(distributions::Random* random,
 					const bool withReplacement, 
 					const num_t sampleSize, 
 					const size_t featureIdx, 
 					vector<size_t>& ics, 
+					vector<size_t>& sampleWeights,
 					vector<size_t>& oobIcs) = 0;
 
+  // Hints that the features are about to be read, so that data kept on disk can be read ahead
+  virtual void prefetchFeatures(const vector<size_t>& /* featureIcs */) { }
+
   virtual void createContrasts() = 0;
   virtual void permuteContrasts(distributions::Random* random) = 0;
   
@@ -384,39 +384,63 @@ num_t utils::numericalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
 						   const size_t minSamples,
 						   size_t& splitIdx) {
 
-  size_t n_tot = tv.size();
+  return( utils::numericalFeatureSplitsNumericalTarget(tv,fv,vector<size_t>(tv.size(),1),minSamples,splitIdx) );
+
+}
+
+num_t utils::numericalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
+						   const vector<num_t>& fv,
+						   const vector<size_t>& wv,
+						   const size_t minSamples,
+						   size_t& splitIdx) {
+
+  assert( tv.size() == wv.size() );
+
+  size_t n = tv.size();
+
+  // Sample counts are sums of multiplicities
+  size_t n_tot = 0;
+  for ( size_t i = 0; i < n; ++i ) {
+    n_tot += wv[i];
+  }
+
   size_t n_left = 0;
   size_t n_right = n_tot;
 
-  // We start with all samples on the left branch
-  num_t mu_tot = math::mean(tv);
-  num_t mu_left = 0.0;
-  num_t mu_right = mu_tot;
+  // We start with all samples on the left branch. Running means are accumulated in acc_t
+  datadefs::acc_t mu_tot = math::accMean(tv,wv);
+  datadefs::acc_t mu_left = 0.0;
+  datadefs::acc_t mu_right = mu_tot;
 
   // Make sure the squared error didn't become corrupted by NANs
-  assert( !datadefs::isNAN(mu_tot) );
+  assert( n == 0 || !datadefs::isNAN(mu_tot) );
 
-  num_t DI_best = 0.0;
+  datadefs::acc_t DI_best = 0.0;
 
   // Add samples one by one from left to right until we hit the
   // minimum allowed size of the branch
-  for( size_t i = 0; i < n_tot - minSamples; ++i ) {
+  for( size_t i = 0; i + 1 < n; ++i ) {
+
+    n_left  += wv[i];
+    n_right -= wv[i];
+
+    if ( n_right < minSamples || n_right == 0 ) {
+      break;
+    }
 
-    // Add n'th sample tv[i] from left to right and update
-    // mean and squared error
-    ++n_left;
-    --n_right;
-    mu_left  += ( tv[i] - mu_left  ) / n_left;
-    mu_right -= ( tv[i] - mu_right ) / n_right;
+    // Add n'th sample tv[i] (with multiplicity wv[i]) from left to right 
+    // and update mean and squared error
+    mu_left  += wv[i] * ( tv[i] - mu_left  ) / n_left;
+    mu_right -= wv[i] * ( tv[i] - mu_right ) / n_right;
 
     // If the sample is repeated and we can continue, continue
-    if ( n_left < minSamples || (n_left < n_tot - minSamples && fv[ i + 1 ] == fv[ i ]) ) {
+    if ( n_left < minSamples || fv[ i + 1 ] == fv[ i ] ) {
       continue;
     }
 
     // If the current split point yields a better split than the best,
     // update DI_best and bestSplitIdx
-    num_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
+    datadefs::acc_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
     //cout << "(" << n_left << "," << tv[i] << "," << DI << ")";
     if (  DI > DI_best ) {
 
@@ -434,45 +458,64 @@ num_t utils::numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 						     const vector<num_t>& fv,
 						     const size_t minSamples,
 						     size_t& splitIdx) {
+
+  return( utils::numericalFeatureSplitsCategoricalTarget(tv,fv,vector<size_t>(tv.size(),1),minSamples,splitIdx) );
+
+}
+
+num_t utils::numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
+						     const vector<num_t>& fv,
+						     const vector<size_t>& wv,
+						     const size_t minSamples,
+						     size_t& splitIdx) {
  
-  size_t n_tot = tv.size();
-  size_t n_left = 0;
-  size_t n_right = n_tot;
+  assert( tv.size() == wv.size() );
+
+  size_t n = tv.size();
+  size_t n_tot = 0;
  
-  unordered_map<cat_t,size_t> freq_right(n_tot);
+  unordered_map<cat_t,size_t> freq_right(n);
   size_t sf_right = 0;
   
-  for ( size_t i = 0; i < n_tot; ++i ) {
-    math::incrementSquaredFrequency(tv[i],freq_right,sf_right);
+  for ( size_t i = 0; i < n; ++i ) {
+    math::incrementSquaredFrequency(tv[i],wv[i],freq_right,sf_right);
+    n_tot += wv[i];
   }
   
   size_t sf_tot = sf_right;
+
+  size_t n_left = 0;
+  size_t n_right = n_tot;
   
-  unordered_map<cat_t,size_t> freq_left(n_tot);
+  unordered_map<cat_t,size_t> freq_left(n);
   size_t sf_left = 0;
 
-  num_t DI_best = 0.0;
+  datadefs::acc_t DI_best = 0.0;
   
   // Add samples one by one from right to left until we hit the
   // minimum allowed size of the branch
-  for( size_t i = 0; i < n_tot - minSamples; ++i ) {
+  for( size_t i = 0; i + 1 < n; ++i ) {
     
-    // Add n'th sample tv[i] from right to left and update
-    // mean and squared frequency
-    math::incrementSquaredFrequency(tv[i],freq_left,sf_left);
-    ++n_left;
+    if ( n_right - wv[i] < minSamples || n_right == wv[i] ) {
+      break;
+    }
+
+    // Add n'th sample tv[i] (with multiplicity wv[i]) from right to left 
+    // and update mean and squared frequency
+    math::incrementSquaredFrequency(tv[i],wv[i],freq_left,sf_left);
+    n_left += wv[i];
     
-    math::decrementSquaredFrequency(tv[i],freq_right,sf_right);
-    --n_right;
+    math::decrementSquaredFrequency(tv[i],wv[i],freq_right,sf_right);
+    n_right -= wv[i];
     
     // If we have repeated samples and can continue, continue
-    if ( n_left < minSamples || (n_left < n_tot - minSamples && fv[ i + 1 ] == fv[ i ]) ) {
+    if ( n_left < minSamples || fv[ i + 1 ] == fv[ i ] ) {
       continue;
     }
     
     // If the split point "i-1" yields a better split than the previous one,
     // update se_best and bestSplitIdx
-    num_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
+    datadefs::acc_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
     
     if ( DI > DI_best ) {
       splitIdx = i;
@@ -491,24 +534,49 @@ num_t utils::categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
 						     const vector<cat_t>& catOrder,
 						     unordered_map<cat_t,vector<size_t> >& fmap_left,
 						     unordered_map<cat_t,vector<size_t> >& fmap_right) {
+
+  return( utils::categoricalFeatureSplitsNumericalTarget(tv,fv,vector<size_t>(tv.size(),1),minSamples,catOrder,fmap_left,fmap_right) );
+
+}
+
+num_t utils::categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
+						     const vector<cat_t>& fv,
+						     const vector<size_t>& wv,
+						     const size_t minSamples,
+						     const vector<cat_t>& catOrder,
+						     unordered_map<cat_t,vector<size_t> >& fmap_left,
+						     unordered_map<cat_t,vector<size_t> >& fmap_right) {
   
+  assert( tv.size() == wv.size() );
+
   fmap_left.clear();
   fmap_left.rehash(2*catOrder.size());
   fmap_right.clear();
   fmap_right.rehash(2*catOrder.size());
 
-  size_t n_tot = 0;
+  size_t n_real = 0;
   
-  datadefs::map_data(fv,fmap_right,n_tot);
+  datadefs::map_data(fv,fmap_right,n_real);
+
+  // Weighted size of each category
+  unordered_map<cat_t,size_t> catWeights(2*fmap_right.size());
+  size_t n_tot = 0;
+  for ( unordered_map<cat_t,vector<size_t> >::const_iterator it(fmap_right.begin()); it != fmap_right.end(); ++it ) {
+    size_t& w = catWeights[it->first];
+    for ( size_t j = 0; j < it->second.size(); ++j ) {
+      w += wv[ it->second[j] ];
+    }
+    n_tot += w;
+  }
 
   size_t n_right = n_tot;
   size_t n_left = 0;
   
-  num_t mu_tot = math::mean(tv);
-  num_t mu_right = mu_tot;
-  num_t mu_left = 0.0;
+  datadefs::acc_t mu_tot = math::accMean(tv,wv);
+  datadefs::acc_t mu_right = mu_tot;
+  datadefs::acc_t mu_left = 0.0;
   
-  num_t DI_best = 0.0;
+  datadefs::acc_t DI_best = 0.0;
   
   for ( size_t i = 0; i < catOrder.size(); ++i ) {
     
@@ -516,20 +584,26 @@ num_t utils::categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
 
     assert( it != fmap_right.end() );
 
-    if ( n_right - it->second.size() < minSamples ) {
+    size_t w_cat = catWeights[it->first];
+
+    if ( n_right - w_cat < minSamples || n_right == w_cat ) {
       continue;
     }
     
     for ( size_t j = 0; j < it->second.size(); ++j ) {
       
-      ++n_left;
-      --n_right;
-      mu_left  += ( tv[ it->second[j] ] - mu_left  ) / n_left;
-      mu_right -= ( tv[ it->second[j] ] - mu_right ) / n_right;
+      size_t w = wv[ it->second[j] ];
+      if ( w == 0 ) {
+	continue;
+      }
+      n_left  += w;
+      n_right -= w;
+      mu_left  += w * ( tv[ it->second[j] ] - mu_left  ) / n_left;
+      mu_right -= w * ( tv[ it->second[j] ] - mu_right ) / n_right;
       
     }
     
-    num_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
+    datadefs::acc_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
     
     if ( DI > DI_best ) { 
 
@@ -542,10 +616,14 @@ num_t utils::categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
       
       for ( size_t j = 0; j < it->second.size(); ++j ) {
 	
-	--n_left;
-	++n_right;
-	mu_left  -= ( tv[ it->second[j] ] - mu_left  ) / n_left;
-	mu_right += ( tv[ it->second[j] ] - mu_right ) / n_right;
+	size_t w = wv[ it->second[j] ];
+	if ( w == 0 ) {
+	  continue;
+	}
+	n_left  -= w;
+	n_right += w;
+	mu_right += w * ( tv[ it->second[j] ] - mu_right ) / n_right;
+	mu_left   = n_left > 0 ? mu_left - w * ( tv[ it->second[j] ] - mu_left ) / n_left : 0.0;
 	
       }    
     }
@@ -562,17 +640,28 @@ num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 						       unordered_map<cat_t,vector<size_t> >& fmap_left,
 						       unordered_map<cat_t,vector<size_t> >& fmap_right) {
 
+  return( utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,vector<size_t>(tv.size(),1),minSamples,catOrder,fmap_left,fmap_right) );
+
+}
+
+num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
+						       const vector<cat_t>& fv,
+						       const vector<size_t>& wv,
+						       const size_t minSamples,
+						       const vector<cat_t>& catOrder,
+						       unordered_map<cat_t,vector<size_t> >& fmap_left,
+						       unordered_map<cat_t,vector<size_t> >& fmap_right) {
+
+  assert( tv.size() == wv.size() );
+
   fmap_left.clear();
   fmap_left.rehash(2*catOrder.size());
   fmap_right.clear();
   fmap_right.rehash(2*catOrder.size());
 
-  size_t n_tot = 0;
-
-  datadefs::map_data(fv,fmap_right,n_tot);
+  size_t n_real = 0;
 
-  size_t n_right = n_tot;
-  size_t n_left = 0;
+  datadefs::map_data(fv,fmap_right,n_real);
 
   size_t sf_right = 0;
   size_t sf_left = 0;
@@ -580,13 +669,25 @@ num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
   unordered_map<cat_t,size_t> freq_left(catOrder.size());
   unordered_map<cat_t,size_t> freq_right(catOrder.size());
 
-  for( size_t i = 0; i < n_tot; ++i ) {
-    math::incrementSquaredFrequency(tv[i], freq_right, sf_right);
+  // Weighted size of each category
+  unordered_map<cat_t,size_t> catWeights(2*fmap_right.size());
+  size_t n_tot = 0;
+  for ( unordered_map<cat_t,vector<size_t> >::const_iterator it(fmap_right.begin()); it != fmap_right.end(); ++it ) {
+    size_t& w = catWeights[it->first];
+    for ( size_t j = 0; j < it->second.size(); ++j ) {
+      size_t k = it->second[j];
+      math::incrementSquaredFrequency(tv[k], wv[k], freq_right, sf_right);
+      w += wv[k];
+    }
+    n_tot += w;
   }
 
+  size_t n_right = n_tot;
+  size_t n_left = 0;
+
   size_t sf_tot = sf_right;
  
-  num_t DI_best = 0.0;
+  datadefs::acc_t DI_best = 0.0;
 
   for ( size_t i = 0; i < catOrder.size(); ++i ) {
 
@@ -594,26 +695,31 @@ num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 
     assert( it != fmap_right.end() );
 
-    if ( n_right - it->second.size() < minSamples ) {
+    size_t w_cat = catWeights[it->first];
+
+    if ( n_right - w_cat < minSamples || n_right == w_cat ) {
       continue;
     }
 
     //cout << "Sending category " << catOrder[i] << " from right to left: [" << flush;
     for ( size_t j = 0; j < it->second.size(); ++j ) {
 
-      //cout << " " << tv[it->second[j]] << flush;
+      size_t k = it->second[j];
+      if ( wv[k] == 0 ) {
+	continue;
+      }
 
-      ++n_left;
-      math::incrementSquaredFrequency(tv[ it->second[j] ],freq_left,sf_left);
+      n_left += wv[k];
+      math::incrementSquaredFrequency(tv[k],wv[k],freq_left,sf_left);
       
-      --n_right;
-      math::decrementSquaredFrequency(tv[ it->second[j] ],freq_right,sf_right);
+      n_right -= wv[k];
+      math::decrementSquaredFrequency(tv[k],wv[k],freq_right,sf_right);
       
     }
     
     //cout << "]" << flush;
 
-    num_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
+    datadefs::acc_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
 
     if ( DI > DI_best ) {
 
@@ -630,13 +736,16 @@ num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 
       for ( size_t j = 0; j < it->second.size(); ++j ) {
 
-	//cout << " " << tv[ it->second[j] ] << flush;
+	size_t k = it->second[j];
+	if ( wv[k] == 0 ) {
+	  continue;
+	}
 
-        --n_left;
-	math::decrementSquaredFrequency(tv[ it->second[j] ],freq_left,sf_left);
+        n_left -= wv[k];
+	math::decrementSquaredFrequency(tv[k],wv[k],freq_left,sf_left);
 
-        ++n_right;
-	math::incrementSquaredFrequency(tv[ it->second[j] ],freq_right,sf_right);
+        n_right += wv[k];
+	math::incrementSquaredFrequency(tv[k],wv[k],freq_right,sf_right);
 
       }
       //cout << "] " << flush;
@@ -647,4 +756,3 @@ num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
   return(DI_best);
 
 }
-
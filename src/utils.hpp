@@ -119,18 +119,27 @@ namespace utils {
     }
   }
     
+  // Converts the string into value, and returns false if the string is not formatted as a T
   template <typename T>
-  T str2(const string& str) {
+  bool convert(const string& str, T& value) {
 
     if( datadefs::isNAN_STR(str) ) {
-      return( static_cast<T>(datadefs::NUM_NAN) );
+      value = static_cast<T>(datadefs::NUM_NAN);
+      return( true );
     }
     
     stringstream ss( chomp(str) );
+    ss >> value;
+    
+    return( !ss.fail() && !ss.bad() && ss.eof() );
+  }
+
+  template <typename T>
+  T str2(const string& str) {
+
     T ret;
-    ss >> ret;
     
-    if ( ss.fail() || ss.bad() || !ss.eof() ) {
+    if ( !convert(str,ret) ) {
       cerr << "utils::convert::str2<T>() -- input '" << str
 	   << "' incorrectly formatted for conversion to type T" << endl;
       exit(1);
@@ -180,11 +189,25 @@ namespace utils {
 					      const vector<num_t>& fv,
 					      const size_t minSamples,
 					      size_t& splitIdx);
+
+  // Weighted counterpart; wv[i] is the multiplicity of sample i (e.g. in the bootstrap), 
+  // and minSamples refers to the sum of multiplicities in each branch
+  num_t numericalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
+					      const vector<num_t>& fv,
+					      const vector<size_t>& wv,
+					      const size_t minSamples,
+					      size_t& splitIdx);
   
   num_t numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 						const vector<num_t>& fv,
 						const size_t minSamples,
 						size_t& splitIdx);
+
+  num_t numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
+						const vector<num_t>& fv,
+						const vector<size_t>& wv,
+						const size_t minSamples,
+						size_t& splitIdx);
   
   num_t categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
 						const vector<cat_t>& fv,
@@ -192,6 +215,14 @@ namespace utils {
 						const vector<cat_t>& catOrder,
 						unordered_map<cat_t,vector<size_t> >& fmap_left,
 						unordered_map<cat_t,vector<size_t> >& fmap_right);
+
+  num_t categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
+						const vector<cat_t>& fv,
+						const vector<size_t>& wv,
+						const size_t minSamples,
+						const vector<cat_t>& catOrder,
+						unordered_map<cat_t,vector<size_t> >& fmap_left,
+						unordered_map<cat_t,vector<size_t> >& fmap_right);
   
   num_t categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
 						  const vector<cat_t>& fv,
@@ -199,6 +230,14 @@ namespace utils {
 						  const vector<cat_t>& catOrder,
 						  unordered_map<cat_t,vector<size_t> >& fmap_left,
 						  unordered_map<cat_t,vector<size_t> >& fmap_right);
+
+  num_t categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
+						  const vector<cat_t>& fv,
+						  const vector<size_t>& wv,
+						  const size_t minSamples,
+						  const vector<cat_t>& catOrder,
+						  unordered_map<cat_t,vector<size_t> >& fmap_left,
+						  unordered_map<cat_t,vector<size_t> >& fmap_right);
   
   
 }
@@ -0,0 +1,83 @@
+#include "workcounters.hpp"
+
+#include <iomanip>
+
+WorkCounters::WorkCounters():
+  numCandidates(0),
+  catCandidates(0),
+  txtCandidates(0),
+  samplesScanned(0),
+  sortCalls(0),
+  nodesCreated(0),
+  leaves(0),
+  missingNodes(0),
+  rejectedSplits(0) {
+}
+
+WorkCounters& WorkCounters::operator+=(const WorkCounters& other) {
+  numCandidates  += other.numCandidates;
+  catCandidates  += other.catCandidates;
+  txtCandidates  += other.txtCandidates;
+  samplesScanned += other.samplesScanned;
+  sortCalls      += other.sortCalls;
+  nodesCreated   += other.nodesCreated;
+  leaves         += other.leaves;
+  missingNodes   += other.missingNodes;
+  rejectedSplits += other.rejectedSplits;
+  return( *this );
+}
+
+WorkCounters WorkCounters::operator-(const WorkCounters& other) const {
+  WorkCounters diff;
+  diff.numCandidates  = numCandidates  - other.numCandidates;
+  diff.catCandidates  = catCandidates  - other.catCandidates;
+  diff.txtCandidates  = txtCandidates  - other.txtCandidates;
+  diff.samplesScanned = samplesScanned - other.samplesScanned;
+  diff.sortCalls      = sortCalls      - other.sortCalls;
+  diff.nodesCreated   = nodesCreated   - other.nodesCreated;
+  diff.leaves         = leaves         - other.leaves;
+  diff.missingNodes   = missingNodes   - other.missingNodes;
+  diff.rejectedSplits = rejectedSplits - other.rejectedSplits;
+  return( diff );
+}
+
+namespace {
+  void printCounter(ostream& os, const string& name, const size_t count, const double seconds) {
+    os << "  " << left << setw(28) << name << right << setw(14) << count;
+    if ( seconds > 0.0 ) {
+      os << setw(16) << fixed << setprecision(0) << count / seconds << " /s";
+    }
+    os << endl;
+  }
+}
+
+void WorkCounters::print(ostream& os, const double seconds) const {
+
+  streamsize precision = os.precision();
+
+  os << "Work counters:" << endl;
+  printCounter(os, "candidates evaluated", this->candidates(), seconds);
+  printCounter(os, "  numerical", numCandidates, seconds);
+  printCounter(os, "  categorical", catCandidates, seconds);
+  printCounter(os, "  textual", txtCandidates, seconds);
+  printCounter(os, "samples scanned", samplesScanned, seconds);
+  printCounter(os, "sort calls", sortCalls, seconds);
+  printCounter(os, "nodes created", nodesCreated, seconds);
+  printCounter(os, "leaves", leaves, seconds);
+  printCounter(os, "missing-branch nodes", missingNodes, seconds);
+  printCounter(os, "rejected splits", rejectedSplits, seconds);
+  if ( this->candidates() > 0 ) {
+    os << "  " << left << setw(28) << "samples per candidate" << right << setw(14) << fixed << setprecision(1)
+       << 1.0 * samplesScanned / this->candidates() << endl;
+  }
+  os << endl;
+
+  os.unsetf(ios_base::floatfield);
+  os.precision(precision);
+
+}
+
+WorkCounters& WorkCounters::local() {
+  static thread_local WorkCounters counters;
+  return( counters );
+}
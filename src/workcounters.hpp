@@ -0,0 +1,46 @@
+#ifndef WORKCOUNTERS_HPP
+#define WORKCOUNTERS_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Counts of the work done while growing trees. Every thread counts into WorkCounters::local(),
+// and the per-thread counts of a forest are reduced once its threads have joined
+struct WorkCounters {
+
+  // Candidate splitters evaluated, by feature type
+  size_t numCandidates;
+  size_t catCandidates;
+  size_t txtCandidates;
+
+  // Samples passed over by the candidate evaluations
+  size_t samplesScanned;
+
+  size_t sortCalls;
+
+  size_t nodesCreated;
+  size_t leaves;
+  size_t missingNodes;
+
+  // Nodes that were searched for a split but had no candidate that worked
+  size_t rejectedSplits;
+
+  WorkCounters();
+
+  WorkCounters& operator+=(const WorkCounters& other);
+  WorkCounters operator-(const WorkCounters& other) const;
+
+  size_t candidates() const { return( numCandidates + catCandidates + txtCandidates ); }
+
+  // Totals, and rates over the given wall-clock time
+  void print(ostream& os, const double seconds) const;
+
+  // Counters of the calling thread
+  static WorkCounters& local();
+
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <cassert>
+
+#include "workerpool.hpp"
+
+#ifdef NOTHREADS
+
+WorkerPool::WorkerPool(const size_t nWorkers):
+  nWorkers_(nWorkers) {
+  assert( nWorkers > 0 );
+}
+
+WorkerPool::~WorkerPool() { /* EMPTY DESTRUCTOR */ }
+
+void WorkerPool::run(const vector<function<void()> >& tasks) {
+
+  assert( tasks.size() <= nWorkers_ );
+
+  for ( size_t i = 0; i < tasks.size(); ++i ) {
+    tasks[i]();
+  }
+
+}
+
+#else
+
+WorkerPool::WorkerPool(const size_t nWorkers):
+  nWorkers_(nWorkers),
+  nBatches_(0),
+  nPending_(0),
+  isStopping_(false) {
+
+  assert( nWorkers > 0 );
+
+  for ( size_t workerIdx = 0; workerIdx < nWorkers_; ++workerIdx ) {
+    threads_.push_back( thread(&WorkerPool::work, this, workerIdx) );
+  }
+
+}
+
+WorkerPool::~WorkerPool() {
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    isStopping_ = true;
+  }
+
+  batchReady_.notify_all();
+
+  for ( size_t workerIdx = 0; workerIdx < threads_.size(); ++workerIdx ) {
+    threads_[workerIdx].join();
+  }
+
+}
+
+void WorkerPool::run(const vector<function<void()> >& tasks) {
+
+  assert( tasks.size() <= nWorkers_ );
+
+  unique_lock<mutex> lock(mutex_);
+
+  tasks_ = tasks;
+  nPending_ = nWorkers_;
+  ++nBatches_;
+
+  batchReady_.notify_all();
+
+  while ( nPending_ > 0 ) {
+    batchDone_.wait(lock);
+  }
+
+  tasks_.clear();
+
+}
+
+void WorkerPool::work(const size_t workerIdx) {
+
+  size_t nBatchesSeen = 0;
+
+  unique_lock<mutex> lock(mutex_);
+
+  while ( true ) {
+
+    while ( !isStopping_ && nBatches_ == nBatchesSeen ) {
+      batchReady_.wait(lock);
+    }
+
+    if ( isStopping_ ) {
+      return;
+    }
+
+    nBatchesSeen = nBatches_;
+
+    if ( workerIdx < tasks_.size() ) {
+      function<void()> task = tasks_[workerIdx];
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+
+    if ( --nPending_ == 0 ) {
+      batchDone_.notify_one();
+    }
+
+  }
+
+}
+
+#endif
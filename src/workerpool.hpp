@@ -0,0 +1,56 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <cstdlib>
+#include <vector>
+#include <functional>
+#ifndef NOTHREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+using namespace std;
+
+// Fixed set of worker threads that run batches of tasks. The threads live as long as the pool, so
+// work that comes in many small batches, such as the split search of every node of a tree, does
+// not start and join threads for each batch. Without threads the tasks run in the calling thread
+class WorkerPool {
+public:
+
+  explicit WorkerPool(const size_t nWorkers);
+  ~WorkerPool();
+
+  size_t nWorkers() const { return( nWorkers_ ); }
+
+  // Runs task i on worker i and returns once all tasks are done; there may be at most nWorkers tasks
+  void run(const vector<function<void()> >& tasks);
+
+private:
+
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+
+  size_t nWorkers_;
+
+#ifndef NOTHREADS
+
+  void work(const size_t workerIdx);
+
+  vector<thread> threads_;
+
+  mutex mutex_;
+  condition_variable batchReady_;
+  condition_variable batchDone_;
+
+  // Tasks of the current batch, which every worker acknowledges before the next one is posted
+  vector<function<void()> > tasks_;
+  size_t nBatches_;
+  size_t nPending_;
+  bool isStopping_;
+
+#endif
+
+};
+
+#endif
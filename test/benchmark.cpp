@@ -0,0 +1,263 @@
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "benchmark.hpp"
+#include "argparse.hpp"
+#include "densetreedata.hpp"
+#include "rootnode.hpp"
+#include "options.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+// Everything the micro-benchmarks operate on. The inputs are prepared once;
+// the scratch space is overwritten by every repetition
+struct BenchData {
+
+  DenseTreeData* treeData;
+  size_t numTargetIdx;
+  size_t catTargetIdx;
+  size_t numFeatureIdx;
+  size_t catFeatureIdx;
+  size_t txtFeatureIdx;
+
+  vector<size_t> sampleWeights;
+  vector<size_t> numRealIcs;
+  vector<size_t> catRealIcs;
+  vector<size_t> txtRealIcs;
+
+  // Numerical target sorted by the numerical feature, as the split kernel expects
+  vector<num_t> tv;
+  vector<num_t> fv;
+  vector<size_t> wv;
+
+  vector<cat_t> catOrder;
+  uint32_t hashIdx;
+
+  ForestOptions* forestOptions;
+  distributions::PMF* pmf;
+  distributions::Random random;
+  RootNode* tree;
+
+  vector<size_t> sampleIcs_left;
+  vector<size_t> sampleIcs_right;
+  num_t splitValue;
+  unordered_set<cat_t> splitValues_left;
+  vector<size_t> bootstrapIcs;
+  vector<size_t> bootstrapWeights;
+  vector<size_t> oobIcs;
+  num_t sink;
+
+};
+
+void bench_numericalSplitKernel(BenchData& d) {
+  size_t splitIdx;
+  d.sink += utils::numericalFeatureSplitsNumericalTarget(d.tv,d.fv,d.wv,d.forestOptions->nodeSize,splitIdx);
+}
+
+void bench_numericalSplitNumTarget(BenchData& d) {
+  d.sampleIcs_right = d.numRealIcs;
+  d.sink += d.treeData->numericalFeatureSplit(d.treeData->feature(d.numTargetIdx),d.numFeatureIdx,d.forestOptions->nodeSize,d.sampleWeights,
+					      d.sampleIcs_left,d.sampleIcs_right,d.splitValue);
+}
+
+void bench_numericalSplitCatTarget(BenchData& d) {
+  d.sampleIcs_right = d.numRealIcs;
+  d.sink += d.treeData->numericalFeatureSplit(d.treeData->feature(d.catTargetIdx),d.numFeatureIdx,d.forestOptions->nodeSize,d.sampleWeights,
+					      d.sampleIcs_left,d.sampleIcs_right,d.splitValue);
+}
+
+void bench_categoricalSplitNumTarget(BenchData& d) {
+  d.sampleIcs_right = d.catRealIcs;
+  d.sink += d.treeData->categoricalFeatureSplit(d.treeData->feature(d.numTargetIdx),d.catFeatureIdx,d.catOrder,d.forestOptions->nodeSize,d.sampleWeights,
+						d.sampleIcs_left,d.sampleIcs_right,d.splitValues_left);
+}
+
+void bench_categoricalSplitCatTarget(BenchData& d) {
+  d.sampleIcs_right = d.catRealIcs;
+  d.sink += d.treeData->categoricalFeatureSplit(d.treeData->feature(d.catTargetIdx),d.catFeatureIdx,d.catOrder,d.forestOptions->nodeSize,d.sampleWeights,
+						d.sampleIcs_left,d.sampleIcs_right,d.splitValues_left);
+}
+
+void bench_textualSplitNumTarget(BenchData& d) {
+  d.sampleIcs_right = d.txtRealIcs;
+  d.sink += d.treeData->textualFeatureSplit(d.treeData->feature(d.numTargetIdx),d.txtFeatureIdx,d.hashIdx,d.forestOptions->nodeSize,d.sampleWeights,
+					    d.sampleIcs_left,d.sampleIcs_right);
+}
+
+void bench_bootstrap(BenchData& d) {
+  d.treeData->bootstrapFromRealSamples(&d.random,d.forestOptions->sampleWithReplacement,d.forestOptions->inBoxFraction,d.numTargetIdx,
+				       d.bootstrapIcs,d.bootstrapWeights,d.oobIcs);
+}
+
+// A RootNode is grown only once, so every repetition grows (and frees) a tree of its own
+void bench_growTree(BenchData& d) {
+  RootNode tree;
+  tree.growTree(d.treeData,d.numTargetIdx,d.pmf,d.forestOptions,&d.random);
+  d.sink += tree.nNodes();
+}
+
+void bench_percolate(BenchData& d) {
+  size_t nSamples = d.treeData->nSamples();
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    d.sink += d.tree->percolate(d.treeData,i)->getPrediction().numTrainPrediction;
+  }
+}
+
+void printHelp(const benchmark::DataSpec& spec, const size_t nReps) {
+  cout << endl
+       << "Micro-benchmarks of the split kernels, bootstrapping, tree growth and traversal on synthetic data" << endl << endl
+       << " -n / --nSamples     Number of samples (default " << spec.nSamples << ")" << endl
+       << " -f / --nFeatures    Number of numerical and of categorical features (default " << spec.nNumFeatures << ")" << endl
+       << " -t / --nTxtFeatures Number of textual features (default " << spec.nTxtFeatures << ")" << endl
+       << " -c / --cardinality  Number of categories in the categorical features (default " << spec.cardinality << ")" << endl
+       << " -a / --naFraction   Fraction of missing values in the features (default " << spec.naFraction << ")" << endl
+       << " -s / --seed         Seed of the data generator and the trees (default " << spec.seed << ")" << endl
+       << " -r / --nReps        Number of timed repetitions (default " << nReps << ")" << endl
+       << " -b / --only         Run only the benchmarks whose name contains this string" << endl
+       << " -o / --output       Write the results as tab-separated values into this file" << endl
+       << endl;
+}
+
+int main(const int argc, char* const argv[]) {
+
+  benchmark::DataSpec spec;
+  size_t nReps = 10;
+  string only = "";
+  string outputFile = "";
+  bool printHelpAndExit = false;
+
+  try {
+    ArgParse parser(argc,argv);
+    parser.getFlag("h","help",printHelpAndExit);
+    parser.getArgument<size_t>("n","nSamples",spec.nSamples);
+    parser.getArgument<size_t>("f","nFeatures",spec.nNumFeatures);
+    parser.getArgument<size_t>("t","nTxtFeatures",spec.nTxtFeatures);
+    parser.getArgument<size_t>("c","cardinality",spec.cardinality);
+    parser.getArgument<num_t>("a","naFraction",spec.naFraction);
+    parser.getArgument<size_t>("s","seed",spec.seed);
+    parser.getArgument<size_t>("r","nReps",nReps);
+    parser.getArgument<string>("b","only",only);
+    parser.getArgument<string>("o","output",outputFile);
+  } catch(...) {
+    cerr << "Could not parse command-line arguments" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  spec.nCatFeatures = spec.nNumFeatures;
+
+  if ( printHelpAndExit ) {
+    printHelp(spec,nReps);
+    return(EXIT_SUCCESS);
+  }
+
+  if ( spec.nSamples < 10 || spec.nNumFeatures == 0 || spec.nTxtFeatures == 0 || nReps == 0 ) {
+    cerr << "ERROR: need at least 10 samples, one feature of each type and one repetition" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  DenseTreeData treeData(benchmark::makeFeatures(spec),false,benchmark::makeSampleNames(spec));
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = treeData.nFeatures() / 3;
+
+  BenchData d;
+  d.treeData = &treeData;
+  d.numTargetIdx = treeData.getFeatureIdx("N:target");
+  d.catTargetIdx = treeData.getFeatureIdx("C:target");
+  d.numFeatureIdx = treeData.getFeatureIdx("N:x0");
+  d.catFeatureIdx = treeData.getFeatureIdx("C:x0");
+  d.txtFeatureIdx = treeData.getFeatureIdx("T:x0");
+  d.sampleWeights.assign(spec.nSamples,1);
+  d.forestOptions = &forestOptions;
+  d.random.seed(spec.seed);
+  d.sink = 0.0;
+
+  vector<size_t> missingIcs;
+  d.numRealIcs = utils::range(spec.nSamples);
+  treeData.separateMissingSamples(d.numFeatureIdx,d.numRealIcs,missingIcs);
+  d.catRealIcs = utils::range(spec.nSamples);
+  treeData.separateMissingSamples(d.catFeatureIdx,d.catRealIcs,missingIcs);
+  d.txtRealIcs = utils::range(spec.nSamples);
+  treeData.separateMissingSamples(d.txtFeatureIdx,d.txtRealIcs,missingIcs);
+
+  d.fv = treeData.feature(d.numFeatureIdx)->getNumData(d.numRealIcs);
+  vector<size_t> sortIcs = utils::range(d.fv.size());
+  utils::sortDataAndMakeRef(true,d.fv,sortIcs);
+  vector<size_t> sortedIcs = d.numRealIcs;
+  utils::sortFromRef(sortedIcs,sortIcs);
+  d.tv = treeData.feature(d.numTargetIdx)->getNumData(sortedIcs);
+  d.wv.assign(d.tv.size(),1);
+
+  d.catOrder = treeData.feature(d.catFeatureIdx)->categories();
+  d.hashIdx = treeData.feature(d.txtFeatureIdx)->getHash(d.txtRealIcs[0],0);
+
+  // Neither target is a candidate splitter
+  vector<num_t> featureWeights = treeData.getFeatureWeights();
+  featureWeights[d.numTargetIdx] = 0;
+  featureWeights[d.catTargetIdx] = 0;
+  distributions::PMF pmf(featureWeights);
+  d.pmf = &pmf;
+
+  RootNode tree;
+  d.tree = &tree;
+  tree.growTree(&treeData,d.numTargetIdx,&pmf,&forestOptions,&d.random);
+
+  stringstream config;
+  config << "n=" << spec.nSamples << ",f=" << spec.nNumFeatures << ",t=" << spec.nTxtFeatures
+	 << ",c=" << spec.cardinality << ",a=" << spec.naFraction << ",mTry=" << forestOptions.mTry;
+
+  cout << endl << "Benchmarking with " << config.str() << " over " << nReps << " repetitions" << endl << endl;
+
+  vector<benchmark::Result> results;
+
+  struct Entry {
+    const char* name;
+    void (*func)(BenchData&);
+    size_t nSamples;
+  };
+
+  const Entry entries[] = {
+    { "utils::numericalFeatureSplitsNumericalTarget", &bench_numericalSplitKernel, d.tv.size() },
+    { "numericalFeatureSplit/numTarget", &bench_numericalSplitNumTarget, d.numRealIcs.size() },
+    { "numericalFeatureSplit/catTarget", &bench_numericalSplitCatTarget, d.numRealIcs.size() },
+    { "categoricalFeatureSplit/numTarget", &bench_categoricalSplitNumTarget, d.catRealIcs.size() },
+    { "categoricalFeatureSplit/catTarget", &bench_categoricalSplitCatTarget, d.catRealIcs.size() },
+    { "textualFeatureSplit/numTarget", &bench_textualSplitNumTarget, d.txtRealIcs.size() },
+    { "bootstrapFromRealSamples", &bench_bootstrap, spec.nSamples },
+    { "RootNode::growTree", &bench_growTree, spec.nSamples },
+    { "Node::percolate", &bench_percolate, spec.nSamples }
+  };
+
+  for ( size_t i = 0; i < sizeof(entries) / sizeof(Entry); ++i ) {
+    if ( only != "" && string(entries[i].name).find(only) == string::npos ) {
+      continue;
+    }
+    results.push_back( benchmark::run<BenchData>(entries[i].name,config.str(),entries[i].func,d,entries[i].nSamples,nReps) );
+    benchmark::printResult(results.back(),cout);
+  }
+
+  // The sink keeps the compiler from optimizing the benchmarked calls away
+  cout << endl << "(checksum " << d.sink << ")" << endl;
+
+  if ( outputFile != "" ) {
+    ofstream toFile(outputFile.c_str());
+    benchmark::writeHeader(toFile);
+    for ( size_t i = 0; i < results.size(); ++i ) {
+      benchmark::writeResult(results[i],toFile);
+    }
+    toFile.close();
+    cout << "Results written to '" << outputFile << "'" << endl;
+  }
+
+  cout << endl;
+
+  return(EXIT_SUCCESS);
+
+}
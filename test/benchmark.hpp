@@ -0,0 +1,296 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+
+#include "datadefs.hpp"
+#include "feature.hpp"
+#include "distributions.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+namespace benchmark {
+
+  // Layout of a synthetic data set. The targets N:target and C:target come first,
+  // followed by N:x<i>, C:x<i> and T:x<i> for the numerical, categorical and textual features
+  struct DataSpec {
+
+    size_t nSamples;
+    size_t nNumFeatures;
+    size_t nCatFeatures;
+    size_t nTxtFeatures;
+    size_t cardinality;
+    num_t naFraction;
+    bool mixedNARates;
+    size_t seed;
+
+    DataSpec():
+      nSamples(10000),
+      nNumFeatures(10),
+      nCatFeatures(10),
+      nTxtFeatures(2),
+      cardinality(10),
+      naFraction(0.1),
+      mixedNARates(false),
+      seed(1) {}
+
+  };
+
+  // Generates the features of a synthetic data set. The numerical target depends on the first numerical
+  // and categorical features, and the categorical target on its terciles, so that the trees have something to find.
+  // Textual features are stored hashed, so their raw text is handed out in rawTxtData if requested
+  inline vector<Feature> makeFeatures(const DataSpec& spec, vector<vector<string> >* rawTxtData = NULL) {
+
+    distributions::Random random(spec.seed);
+
+    size_t n = spec.nSamples;
+    size_t cardinality = spec.cardinality > 0 ? spec.cardinality : 1;
+
+    vector<vector<num_t> > numData(spec.nNumFeatures, vector<num_t>(n));
+    vector<vector<cat_t> > catData(spec.nCatFeatures, vector<cat_t>(n));
+    vector<vector<string> > txtData(spec.nTxtFeatures, vector<string>(n));
+    vector<num_t> numTarget(n);
+
+    for ( size_t i = 0; i < n; ++i ) {
+
+      for ( size_t f = 0; f < spec.nNumFeatures; ++f ) {
+	numData[f][i] = random.uniform();
+      }
+
+      vector<size_t> catIcs(spec.nCatFeatures);
+      for ( size_t f = 0; f < spec.nCatFeatures; ++f ) {
+	catIcs[f] = random.integer() % cardinality;
+	catData[f][i] = "c" + utils::num2str(catIcs[f]);
+      }
+
+      for ( size_t f = 0; f < spec.nTxtFeatures; ++f ) {
+	size_t nWords = 1 + random.integer() % 5;
+	string text = "";
+	for ( size_t w = 0; w < nWords; ++w ) {
+	  text += ( w > 0 ? " w" : "w" ) + utils::num2str(random.integer() % (10 * cardinality));
+	}
+	txtData[f][i] = text;
+      }
+
+      numTarget[i] = 0.1 * random.uniform();
+      if ( spec.nNumFeatures > 0 ) {
+	numTarget[i] += numData[0][i];
+      }
+      if ( spec.nCatFeatures > 0 ) {
+	numTarget[i] += 0.5 * ( catIcs[0] % 3 );
+      }
+    }
+
+    // Classes from the terciles of the numerical target, before any values go missing
+    vector<num_t> sortedTarget(numTarget);
+    sort(sortedTarget.begin(),sortedTarget.end());
+    num_t lo = sortedTarget[n / 3];
+    num_t hi = sortedTarget[2 * n / 3];
+
+    vector<cat_t> catTarget(n);
+    for ( size_t i = 0; i < n; ++i ) {
+      catTarget[i] = numTarget[i] < lo ? "low" : ( numTarget[i] < hi ? "mid" : "high" );
+    }
+
+    // Missing values are sprinkled over the input features only. With mixed rates, the rate of 
+    // each feature is drawn from [0,2*naFraction], so that naFraction is still the average
+    size_t nInputs = spec.nNumFeatures + spec.nCatFeatures + spec.nTxtFeatures;
+    vector<num_t> naRates(nInputs,spec.naFraction);
+    if ( spec.mixedNARates ) {
+      for ( size_t f = 0; f < nInputs; ++f ) {
+	naRates[f] = 2 * spec.naFraction * random.uniform();
+      }
+    }
+
+    for ( size_t i = 0; i < n; ++i ) {
+      for ( size_t f = 0; f < spec.nNumFeatures; ++f ) {
+	if ( random.uniform() < naRates[f] ) numData[f][i] = datadefs::NUM_NAN;
+      }
+      for ( size_t f = 0; f < spec.nCatFeatures; ++f ) {
+	if ( random.uniform() < naRates[spec.nNumFeatures + f] ) catData[f][i] = datadefs::STR_NAN;
+      }
+      for ( size_t f = 0; f < spec.nTxtFeatures; ++f ) {
+	if ( random.uniform() < naRates[spec.nNumFeatures + spec.nCatFeatures + f] ) txtData[f][i] = datadefs::STR_NAN;
+      }
+    }
+
+    if ( rawTxtData ) {
+      *rawTxtData = txtData;
+    }
+
+    vector<Feature> features;
+    features.push_back( Feature(numTarget,"N:target") );
+    features.push_back( Feature(catTarget,"C:target") );
+
+    for ( size_t f = 0; f < spec.nNumFeatures; ++f ) {
+      features.push_back( Feature(numData[f],"N:x" + utils::num2str(f)) );
+    }
+    for ( size_t f = 0; f < spec.nCatFeatures; ++f ) {
+      features.push_back( Feature(catData[f],"C:x" + utils::num2str(f)) );
+    }
+    for ( size_t f = 0; f < spec.nTxtFeatures; ++f ) {
+      features.push_back( Feature(txtData[f],"T:x" + utils::num2str(f),true) );
+    }
+
+    return( features );
+
+  }
+
+  // DenseTreeData needs sample names to know the number of samples
+  inline vector<string> makeSampleNames(const DataSpec& spec) {
+    vector<string> sampleNames(spec.nSamples);
+    for ( size_t i = 0; i < spec.nSamples; ++i ) {
+      sampleNames[i] = "sample_" + utils::num2str(i);
+    }
+    return( sampleNames );
+  }
+
+  // Writes the data in AFM format, features as rows, so that it can be fed to rf-ace
+  inline void writeAFM(const vector<Feature>& features, const vector<string>& sampleNames, const vector<vector<string> >& rawTxtData, const string& fileName) {
+
+    ofstream toFile(fileName.c_str());
+
+    for ( size_t i = 0; i < sampleNames.size(); ++i ) {
+      toFile << "\t" << sampleNames[i];
+    }
+    toFile << endl;
+
+    size_t txtIdx = 0;
+
+    for ( size_t f = 0; f < features.size(); ++f ) {
+      toFile << features[f].name();
+      for ( size_t i = 0; i < sampleNames.size(); ++i ) {
+	if ( features[f].isNumerical() ) {
+	  toFile << "\t" << utils::num2str(features[f].getNumData(i));
+	} else if ( features[f].isCategorical() ) {
+	  toFile << "\t" << features[f].getCatData(i);
+	} else {
+	  toFile << "\t" << rawTxtData[txtIdx][i];
+	}
+      }
+      toFile << endl;
+      txtIdx += features[f].isTextual() ? 1 : 0;
+    }
+
+    toFile.close();
+
+  }
+
+  struct Summary {
+    double mean;
+    double sd;
+    double min;
+    double max;
+  };
+
+  inline Summary summarize(const vector<double>& x) {
+
+    Summary s = {0.0, 0.0, datadefs::NUM_INF, -datadefs::NUM_INF};
+
+    for ( size_t i = 0; i < x.size(); ++i ) {
+      s.mean += x[i] / x.size();
+      s.min = x[i] < s.min ? x[i] : s.min;
+      s.max = x[i] > s.max ? x[i] : s.max;
+    }
+
+    for ( size_t i = 0; i < x.size(); ++i ) {
+      s.sd += pow(x[i] - s.mean,2);
+    }
+
+    s.sd = x.size() > 1 ? sqrt( s.sd / (x.size() - 1) ) : 0.0;
+
+    return( s );
+
+  }
+
+  // Nearest-rank percentile, p in [0,1], of data sorted in ascending order
+  inline double percentile(const vector<double>& sortedX, const double p) {
+    assert( sortedX.size() > 0 );
+    size_t rank = static_cast<size_t>( ceil( p * sortedX.size() ) );
+    return( sortedX[ rank > 0 ? rank - 1 : 0 ] );
+  }
+
+  // Parses a comma-separated list of values, as used by the sweeps
+  template<typename T>
+  vector<T> parseList(const string& str) {
+    vector<string> items = utils::split(str,',');
+    vector<T> list(items.size());
+    for ( size_t i = 0; i < items.size(); ++i ) {
+      list[i] = utils::str2<T>(items[i]);
+    }
+    return( list );
+  }
+
+  // Timing of one benchmark: per-repetition times, normalized by the number of samples processed per repetition
+  struct Result {
+    string name;
+    string config;
+    size_t nSamples;
+    size_t nReps;
+    Summary nsPerSample;
+    double samplesPerSec;
+  };
+
+  // Runs func once to warm up, then nReps times under the clock
+  template<typename T>
+  Result run(const string& name, const string& config, void (*func)(T&), T& context, const size_t nSamples, const size_t nReps) {
+
+    func(context);
+
+    vector<double> nsPerSample(nReps);
+
+    for ( size_t r = 0; r < nReps; ++r ) {
+      chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+      func(context);
+      chrono::duration<double,nano> elapsed = chrono::steady_clock::now() - startTime;
+      nsPerSample[r] = elapsed.count() / nSamples;
+    }
+
+    Result result;
+    result.name = name;
+    result.config = config;
+    result.nSamples = nSamples;
+    result.nReps = nReps;
+    result.nsPerSample = summarize(nsPerSample);
+    result.samplesPerSec = 1e9 / result.nsPerSample.mean;
+
+    return( result );
+
+  }
+
+  inline void printResult(const Result& result, ostream& os) {
+    streamsize precision = os.precision();
+    os << "  " << left << setw(46) << result.name << right
+       << setw(12) << fixed << setprecision(1) << result.nsPerSample.mean << " ns/sample"
+       << "  +/- " << setw(8) << result.nsPerSample.sd
+       << setw(14) << setprecision(0) << result.samplesPerSec << " samples/s" << endl;
+    os.unsetf(ios_base::floatfield);
+    os.precision(precision);
+  }
+
+  // One tab-separated line per result, meant to be diffed between builds
+  inline void writeHeader(ostream& os) {
+    os << "BENCHMARK\tCONFIG\tNSAMPLES\tNREPS\tNS_PER_SAMPLE\tNS_PER_SAMPLE_SD\tNS_PER_SAMPLE_MIN\tNS_PER_SAMPLE_MAX\tSAMPLES_PER_SEC" << endl;
+  }
+
+  inline void writeResult(const Result& result, ostream& os) {
+    os << result.name << "\t" << result.config << "\t" << result.nSamples << "\t" << result.nReps << "\t"
+       << result.nsPerSample.mean << "\t" << result.nsPerSample.sd << "\t"
+       << result.nsPerSample.min << "\t" << result.nsPerSample.max << "\t" << result.samplesPerSec << endl;
+  }
+
+}
+
+#endif
@@ -0,0 +1,408 @@
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "benchmark.hpp"
+#include "argparse.hpp"
+#include "densetreedata.hpp"
+#include "rf_ace.hpp"
+#include "options.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+// What a scoring call needs, plus the outputs it writes into
+struct Scorer {
+  RFACE* rface;
+  ForestOptions* forestOptions;
+  bool isTargetNumerical;
+  vector<num_t> numPredictions;
+  vector<cat_t> catPredictions;
+  vector<num_t> confidence;
+  num_t sink;
+};
+
+void score_predict(Scorer& s, TreeData* batch) {
+  if ( s.isTargetNumerical ) {
+    s.rface->forestRef()->predict(batch,s.numPredictions,s.confidence);
+  } else {
+    s.rface->forestRef()->predict(batch,s.catPredictions,s.confidence);
+  }
+  s.sink += s.confidence[0];
+}
+
+void score_predictQRF(Scorer& s, TreeData* batch) {
+  RFACE::QRFPredictionOutput qPredOut = s.rface->predictQRF(batch,*s.forestOptions);
+  s.sink += qPredOut.isTargetNumerical ? qPredOut.numPredictions[0][0] : qPredOut.catPredictions[0][0];
+}
+
+// Reads the number of trees and the forest type off the tree headers of a forest file
+size_t readForestFile(const string& fileName, string& forestType) {
+
+  ifstream forestStream(fileName.c_str());
+  if ( !forestStream.good() ) {
+    cerr << "ERROR: could not open forest file '" << fileName << "'" << endl;
+    exit(1);
+  }
+
+  size_t nTrees = 0;
+  string newLine;
+  while ( getline(forestStream,newLine) ) {
+    if ( newLine.compare(0,5,"TREE=") == 0 ) {
+      if ( nTrees == 0 ) {
+	map<string,string> treeSetup = utils::parse(utils::chomp(newLine),',','=','"');
+	forestType = treeSetup["FOREST"];
+      }
+      ++nTrees;
+    }
+  }
+
+  return( nTrees );
+
+}
+
+// Copies the first nTrees trees of a forest file, so that forests of different sizes can be loaded
+void writeFirstTrees(const string& fileName, const size_t nTrees, const string& toFileName) {
+
+  ifstream forestStream(fileName.c_str());
+  ofstream toFile(toFileName.c_str());
+
+  size_t treeIdx = 0;
+  string newLine;
+  while ( getline(forestStream,newLine) ) {
+    if ( newLine.compare(0,5,"TREE=") == 0 && ++treeIdx > nTrees ) {
+      break;
+    }
+    toFile << newLine << endl;
+  }
+
+  toFile.close();
+
+}
+
+// Copies the given samples of the data into a data set of their own
+DenseTreeData* makeBatch(TreeData* data, const vector<size_t>& sampleIcs) {
+
+  size_t nSamples = sampleIcs.size();
+
+  vector<Feature> features;
+  for ( size_t featureIdx = 0; featureIdx < data->nFeatures(); ++featureIdx ) {
+    const Feature* feature = data->feature(featureIdx);
+    if ( feature->isNumerical() ) {
+      features.push_back( Feature(feature->getNumData(sampleIcs),feature->name()) );
+    } else if ( feature->isCategorical() ) {
+      features.push_back( Feature(feature->getCatData(sampleIcs),feature->name()) );
+    } else {
+      Feature txtFeature(Feature::Type::TXT,feature->name(),nSamples);
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	txtFeature.txtData[i] = feature->txtData[ sampleIcs[i] ];
+      }
+      features.push_back( txtFeature );
+    }
+  }
+
+  vector<string> sampleNames(nSamples);
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    sampleNames[i] = data->getSampleName(sampleIcs[i]);
+  }
+
+  return( new DenseTreeData(features,false,sampleNames) );
+
+}
+
+// Writes over a buffer larger than the last-level cache, so that the forest and the batch have to be fetched from memory
+void evictCaches(vector<char>& buffer, num_t& sink) {
+  for ( size_t i = 0; i < buffer.size(); i += 64 ) {
+    buffer[i] += 1;
+  }
+  sink += buffer[ buffer.size() / 2 ];
+}
+
+// Latencies of nIters calls in seconds. A warm cache scores the same batch over and over after one
+// untimed call; a cold cache cycles through the batches and evicts the caches before every call
+vector<double> measureLatencies(Scorer& s, void (*func)(Scorer&,TreeData*), const vector<DenseTreeData*>& batches,
+				const bool isCold, const size_t nIters, vector<char>& evictBuffer) {
+
+  vector<double> latencies(nIters);
+
+  if ( !isCold ) {
+    func(s,batches[0]);
+  }
+
+  for ( size_t it = 0; it < nIters; ++it ) {
+    TreeData* batch = batches[0];
+    if ( isCold ) {
+      batch = batches[ it % batches.size() ];
+      evictCaches(evictBuffer,s.sink);
+    }
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    func(s,batch);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    latencies[it] = elapsed.count();
+  }
+
+  return( latencies );
+
+}
+
+void printHelp() {
+  cout << endl
+       << "Latency benchmark of scoring single rows and small batches with a trained forest, through" << endl
+       << "StochasticForest::predict and RFACE::predictQRF, which traverse the trees with Node::percolate" << endl << endl
+       << " -L / --forest       Forest file to load; if not given, a QRF forest is trained on synthetic data" << endl
+       << " -I / --input        Data to score the rows from (default: synthetic data with the layout of the training data)" << endl
+       << " -t / --nTrees       Comma-separated list of tree counts; the first trees of the forest are used (default 10,50,100)" << endl
+       << " -b / --batchSizes   Comma-separated list of rows per call (default 1,10,100)" << endl
+       << " -i / --nIters       Number of timed calls per configuration (default 1000)" << endl
+       << " -C / --cacheMB      Size of the buffer that is written over to evict the caches (default 16)" << endl
+       << " -n / --nSamples     Number of samples in the synthetic data (default 1000)" << endl
+       << " -f / --nFeatures    Number of numerical and of categorical features in the synthetic data (default 10)" << endl
+       << " -s / --seed         Seed of the data generator, the trees and the batches (default 1)" << endl
+       << " -o / --output       Write the results as tab-separated values into this file" << endl
+       << endl;
+}
+
+int main(const int argc, char* const argv[]) {
+
+  string forestFile = "";
+  string inputFile = "";
+  string nTreesStr = "10,50,100";
+  string batchSizesStr = "1,10,100";
+  size_t nIters = 1000;
+  size_t cacheMB = 16;
+  string outputFile = "";
+  bool printHelpAndExit = false;
+
+  benchmark::DataSpec spec;
+  spec.nSamples = 1000;
+
+  try {
+    ArgParse parser(argc,argv);
+    parser.getFlag("h","help",printHelpAndExit);
+    parser.getArgument<string>("L","forest",forestFile);
+    parser.getArgument<string>("I","input",inputFile);
+    parser.getArgument<string>("t","nTrees",nTreesStr);
+    parser.getArgument<string>("b","batchSizes",batchSizesStr);
+    parser.getArgument<size_t>("i","nIters",nIters);
+    parser.getArgument<size_t>("C","cacheMB",cacheMB);
+    parser.getArgument<size_t>("n","nSamples",spec.nSamples);
+    parser.getArgument<size_t>("f","nFeatures",spec.nNumFeatures);
+    parser.getArgument<size_t>("s","seed",spec.seed);
+    parser.getArgument<string>("o","output",outputFile);
+  } catch(...) {
+    cerr << "Could not parse command-line arguments" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  spec.nCatFeatures = spec.nNumFeatures;
+
+  if ( printHelpAndExit ) {
+    printHelp();
+    return(EXIT_SUCCESS);
+  }
+
+  vector<size_t> nTreesList = benchmark::parseList<size_t>(nTreesStr);
+  vector<size_t> batchSizes = benchmark::parseList<size_t>(batchSizesStr);
+
+  if ( nTreesList.empty() || batchSizes.empty() || nIters == 0 || cacheMB == 0 || spec.nSamples < 10 ) {
+    cerr << "ERROR: need at least one tree count and batch size, one iteration, a cache buffer and 10 samples" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  char tmpForestFile[] = "/tmp/rface_latency_XXXXXX";
+  int fd = mkstemp(tmpForestFile);
+  if ( fd < 0 ) {
+    cerr << "ERROR: could not create a temporary file" << endl;
+    return(EXIT_FAILURE);
+  }
+  close(fd);
+
+  // Without a forest file, a QRF forest of the largest size asked for is trained, so that both scoring paths apply
+  char trainedForestFile[] = "/tmp/rface_latency_forest_XXXXXX";
+  if ( forestFile == "" ) {
+
+    fd = mkstemp(trainedForestFile);
+    if ( fd < 0 ) {
+      cerr << "ERROR: could not create a temporary file" << endl;
+      return(EXIT_FAILURE);
+    }
+    close(fd);
+    forestFile = trainedForestFile;
+
+    DenseTreeData trainData(benchmark::makeFeatures(spec),false,benchmark::makeSampleNames(spec));
+
+    size_t targetIdx = trainData.getFeatureIdx("N:target");
+    vector<num_t> weights = trainData.getFeatureWeights();
+    weights[targetIdx] = 0;
+    weights[trainData.getFeatureIdx("C:target")] = 0;
+
+    ForestOptions forestOptions(forest_t::QRF);
+    forestOptions.nTrees = *max_element(nTreesList.begin(),nTreesList.end());
+    forestOptions.mTry = max(static_cast<size_t>(1), trainData.nFeatures() / 3);
+
+    cout << "Training a QRF forest of " << forestOptions.nTrees << " trees on " << spec.nSamples << " synthetic samples" << endl;
+
+    RFACE trainer(1,spec.seed);
+    trainer.train(&trainData,targetIdx,weights,&forestOptions);
+    trainer.save(forestFile);
+
+  }
+
+  string forestType = "";
+  size_t nTreesInFile = readForestFile(forestFile,forestType);
+
+  if ( nTreesInFile == 0 ) {
+    cerr << "ERROR: no trees in forest file '" << forestFile << "'" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  // The rows to score come from data the forest was not trained on
+  TreeData* data = NULL;
+  if ( inputFile != "" ) {
+    data = new DenseTreeData(inputFile,datadefs::GENERAL_DEFAULT_DATA_DELIMITER,datadefs::GENERAL_DEFAULT_HEADER_DELIMITER);
+  } else {
+    benchmark::DataSpec testSpec = spec;
+    testSpec.seed = spec.seed + 1;
+    data = new DenseTreeData(benchmark::makeFeatures(testSpec),false,benchmark::makeSampleNames(testSpec));
+  }
+
+  // Cold calls cycle through this many different batches, so that none of them is left in the cache by the previous call
+  const size_t nBatchesPerSize = 16;
+
+  distributions::Random random(spec.seed);
+
+  vector<vector<DenseTreeData*> > batches(batchSizes.size());
+  for ( size_t bi = 0; bi < batchSizes.size(); ++bi ) {
+    for ( size_t i = 0; i < nBatchesPerSize; ++i ) {
+      vector<size_t> sampleIcs(batchSizes[bi]);
+      for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
+	sampleIcs[j] = random.integer() % data->nSamples();
+      }
+      batches[bi].push_back( makeBatch(data,sampleIcs) );
+    }
+  }
+
+  vector<char> evictBuffer(cacheMB * 1024 * 1024,0);
+
+  struct Method {
+    const char* name;
+    void (*func)(Scorer&,TreeData*);
+  };
+
+  // Quantile predictions need the training data that only QRF stores in the leaves
+  vector<Method> methods;
+  Method predictMethod = { "predict", &score_predict };
+  methods.push_back(predictMethod);
+  if ( forestType == "QRF" ) {
+    Method predictQRFMethod = { "predictQRF", &score_predictQRF };
+    methods.push_back(predictQRFMethod);
+  } else {
+    cout << "The forest is of type " << forestType << ", so predictQRF is skipped" << endl;
+  }
+
+  ofstream toFile;
+  if ( outputFile != "" ) {
+    toFile.open(outputFile.c_str());
+    toFile << "METHOD\tNTREES\tBATCH\tCACHE\tNITERS\tP50_US\tP90_US\tP99_US\tP99_9_US\tMAX_US\tMEAN_US\tROWS_PER_SEC" << endl;
+  }
+
+  cout << endl << "Latencies over " << nIters << " calls, in microseconds per call" << endl << endl
+       << setw(11) << "method" << setw(7) << "trees" << setw(7) << "batch" << setw(7) << "cache"
+       << setw(11) << "p50" << setw(11) << "p90" << setw(11) << "p99" << setw(11) << "p99.9"
+       << setw(11) << "max" << setw(13) << "rows/s" << endl;
+
+  num_t sink = 0.0;
+
+  for ( size_t ti = 0; ti < nTreesList.size(); ++ti ) {
+
+    size_t nTrees = nTreesList[ti];
+
+    if ( nTrees == 0 || nTrees > nTreesInFile ) {
+      cerr << "WARNING: skipping " << nTrees << " trees, as the forest has " << nTreesInFile << endl;
+      continue;
+    }
+
+    writeFirstTrees(forestFile,nTrees,tmpForestFile);
+
+    RFACE rface(1,spec.seed);
+    rface.load(tmpForestFile);
+
+    ForestOptions forestOptions(forest_t::QRF);
+
+    Scorer s;
+    s.rface = &rface;
+    s.forestOptions = &forestOptions;
+    s.isTargetNumerical = rface.forestRef()->isTargetNumerical();
+    s.sink = 0.0;
+
+    for ( size_t mi = 0; mi < methods.size(); ++mi ) {
+      for ( size_t bi = 0; bi < batchSizes.size(); ++bi ) {
+	for ( size_t ci = 0; ci < 2; ++ci ) {
+
+	  bool isCold = ci == 1;
+
+	  vector<double> latencies = measureLatencies(s,methods[mi].func,batches[bi],isCold,nIters,evictBuffer);
+	  sort(latencies.begin(),latencies.end());
+
+	  double p50 = 1e6 * benchmark::percentile(latencies,0.5);
+	  double p90 = 1e6 * benchmark::percentile(latencies,0.9);
+	  double p99 = 1e6 * benchmark::percentile(latencies,0.99);
+	  double p999 = 1e6 * benchmark::percentile(latencies,0.999);
+	  double maxLatency = 1e6 * latencies.back();
+	  double mean = 1e6 * benchmark::summarize(latencies).mean;
+	  double rowsPerSec = 1e6 * batchSizes[bi] / mean;
+
+	  cout << setw(11) << methods[mi].name << setw(7) << nTrees << setw(7) << batchSizes[bi] << setw(7) << ( isCold ? "cold" : "warm" )
+	       << fixed << setprecision(1) << setw(11) << p50 << setw(11) << p90 << setw(11) << p99 << setw(11) << p999
+	       << setw(11) << maxLatency << setprecision(0) << setw(13) << rowsPerSec << endl;
+	  cout.unsetf(ios_base::floatfield);
+	  cout << setprecision(6);
+
+	  if ( toFile.is_open() ) {
+	    toFile << methods[mi].name << "\t" << nTrees << "\t" << batchSizes[bi] << "\t" << ( isCold ? "cold" : "warm" ) << "\t" << nIters << "\t"
+		   << p50 << "\t" << p90 << "\t" << p99 << "\t" << p999 << "\t" << maxLatency << "\t" << mean << "\t" << rowsPerSec << endl;
+	  }
+
+	}
+      }
+    }
+
+    sink += s.sink;
+
+  }
+
+  // The sink keeps the compiler from optimizing the scoring calls away
+  cout << endl << "(checksum " << sink << ")" << endl;
+
+  if ( toFile.is_open() ) {
+    toFile.close();
+    cout << "Results written to '" << outputFile << "'" << endl;
+  }
+
+  cout << endl;
+
+  for ( size_t bi = 0; bi < batches.size(); ++bi ) {
+    for ( size_t i = 0; i < batches[bi].size(); ++i ) {
+      delete batches[bi][i];
+    }
+  }
+  delete data;
+
+  remove(tmpForestFile);
+  if ( forestFile == trainedForestFile ) {
+    remove(trainedForestFile);
+  }
+
+  return(EXIT_SUCCESS);
+
+}
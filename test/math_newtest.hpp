@@ -11,6 +11,7 @@ using namespace std;
 void math_newtest_erf();
 void math_newtest_var();
 void math_newtest_pearsonCorrelation();
+void math_newtest_spearmanCorrelation();
 void math_newtest_ttest();
 void math_newtest_mean();
 void math_newtest_mode();
@@ -23,6 +24,7 @@ void math_newtest() {
   newtest( "erf(x)", &math_newtest_erf );
   newtest( "var(x)", &math_newtest_var );
   newtest( "corr(x)", &math_newtest_pearsonCorrelation );
+  newtest( "spearmanCorrelation(x)", &math_newtest_spearmanCorrelation );
   newtest( "ttest(x,y)", &math_newtest_ttest );
   newtest( "mean(x)", &math_newtest_mean );
   newtest( "mode(x)", &math_newtest_mode );
@@ -295,6 +297,30 @@ void math_newtest_pearsonCorrelation() {
   newassert( datadefs::isNAN(corr) );
 }
 
+void math_newtest_spearmanCorrelation() {
+
+  vector<datadefs::num_t> x = {3.0,1.0,4.0,1.0,5.0};
+  vector<datadefs::num_t> r = math::ranks(x);
+
+  newassert( fabs( r[0] - 3.0 ) < 1e-6 );
+  newassert( fabs( r[1] - 1.5 ) < 1e-6 );
+  newassert( fabs( r[2] - 4.0 ) < 1e-6 );
+  newassert( fabs( r[3] - 1.5 ) < 1e-6 );
+  newassert( fabs( r[4] - 5.0 ) < 1e-6 );
+
+  // Monotone transformations do not change the rank correlation
+  vector<datadefs::num_t> y(x.size());
+  vector<datadefs::num_t> y2(x.size());
+  for ( size_t i = 0; i < x.size(); ++i ) {
+    y[i] = exp(x[i]);
+    y2[i] = -x[i]*x[i]*x[i];
+  }
+
+  newassert( fabs( math::spearmanCorrelation(x,y) - 1.0 ) < 1e-6 );
+  newassert( fabs( math::spearmanCorrelation(x,y2) + 1.0 ) < 1e-6 );
+
+}
+
 void math_newtest_incrementDecrementSquaredFrequency() {
 
   unordered_map<cat_t,size_t> freq;
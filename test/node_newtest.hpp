@@ -19,6 +19,7 @@ void node_newtest_recursiveNodeSplit();
 void node_newtest_cleanPairVectorFromNANs();
 void node_newtest_recursiveNDescendantNodes();
 void node_newtest_regularSplitterSeek();
+void node_newtest_nodeStats();
 
 void node_newtest() {
 
@@ -31,6 +32,7 @@ void node_newtest() {
   newtest( "cleanPairVectorFromNANs(x)", &node_newtest_cleanPairVectorFromNANs );
   newtest( "recursiveNDescendantNodes(x)", &node_newtest_recursiveNDescendantNodes );
   newtest( "regularSplitterSeek(x)", &node_newtest_regularSplitterSeek );
+  newtest( "NodeStats(x)", &node_newtest_nodeStats );
 
 
 }
@@ -146,6 +148,17 @@ void node_newtest_percolateData() {
   newassert( node.percolate(&treeData,18,1) == &rightChild );
   newassert( node.percolate(&treeData,19,1) == &rightChild );
 
+  // With a donor sample, the split feature is read from the donor
+  newassert( node.percolate(&treeData,0,1,5) == &leftChild );
+  newassert( node.percolate(&treeData,5,1,0) == &rightChild );
+  newassert( node.percolate(&treeData,5,0,0) == &leftChild );
+
+  vector<size_t> pathFeatureIcs;
+  newassert( node.percolate(&treeData,5,pathFeatureIcs) == &leftChild );
+  newassert( pathFeatureIcs.size() == 1 );
+  newassert( pathFeatureIcs[0] == 1 );
+  newassert( leftChild.percolate(&treeData,5,pathFeatureIcs) == &leftChild );
+  newassert( pathFeatureIcs.size() == 0 );
 
 }
 
@@ -153,6 +166,99 @@ void node_newtest_regularSplitterSeek() {
 
 }
 
+void node_newtest_nodeStats() {
+
+  DenseTreeData treeData("test_103by300_mixed_nan_matrix.afm",'\t',':');
+
+  size_t numIdx = treeData.getFeatureIdx("N:output");
+  size_t catIdx = treeData.getFeatureIdx("C:class");
+
+  vector<size_t> sampleWeights(treeData.nSamples(),0);
+  vector<size_t> parentIcs,childIcs,siblingIcs;
+
+  // Pick samples with a real target and give them varying multiplicities
+  for ( size_t i = 0; i < treeData.nSamples(); ++i ) {
+    if ( datadefs::isNAN(treeData.feature(numIdx)->getNumData(i)) || 
+	 datadefs::isNAN(treeData.feature(catIdx)->getCatData(i)) ) {
+      continue;
+    }
+    sampleWeights[i] = 1 + i % 3;
+    parentIcs.push_back(i);
+    ( i % 2 == 0 ? childIcs : siblingIcs ).push_back(i);
+  }
+
+  Node::NodeStats parent,child,sibling;
+  parent.add(treeData.feature(numIdx),parentIcs,sampleWeights);
+  child.add(treeData.feature(numIdx),childIcs,sampleWeights);
+  sibling.add(treeData.feature(numIdx),siblingIcs,sampleWeights);
+
+  Node::NodeStats derived = parent;
+  derived.subtract(child);
+
+  vector<size_t> w(siblingIcs.size());
+  for ( size_t i = 0; i < siblingIcs.size(); ++i ) {
+    w[i] = sampleWeights[ siblingIcs[i] ];
+  }
+
+  newassert( derived.n == sibling.n );
+  newassert( fabs( derived.sum - sibling.sum ) < 1e-6 * fabs(sibling.sum) );
+  newassert( fabs( derived.sum / derived.n - math::mean(treeData.feature(numIdx)->getNumData(siblingIcs),w) ) < 1e-4 );
+  newassert( !derived.isPure() );
+
+  parent = Node::NodeStats();
+  child = Node::NodeStats();
+  sibling = Node::NodeStats();
+  parent.add(treeData.feature(catIdx),parentIcs,sampleWeights);
+  child.add(treeData.feature(catIdx),childIcs,sampleWeights);
+  sibling.add(treeData.feature(catIdx),siblingIcs,sampleWeights);
+
+  derived = parent;
+  derived.subtract(child);
+
+  newassert( derived.n == sibling.n );
+  newassert( derived.catFreq == sibling.catFreq );
+  newassert( math::mode(derived.catFreq) == math::mode(treeData.feature(catIdx)->getCatData(siblingIcs),w) );
+
+  // A single sample, whatever its multiplicity, is a pure node
+  Node::NodeStats single;
+  single.add(treeData.feature(catIdx),vector<size_t>(1,parentIcs[0]),sampleWeights);
+  newassert( single.isPure() );
+  single = Node::NodeStats();
+  single.add(treeData.feature(numIdx),vector<size_t>(1,parentIcs[1]),sampleWeights);
+  newassert( single.isPure() );
+
+  // Purity does not depend on the offset of the target, as long as the shift is a value of the data
+  num_t x[] = { 2000, 2000, 2001, 2001, 2000, 2001 };
+  Feature offsetTarget(vector<num_t>(x,x+6),"N:offset");
+  vector<size_t> offsetIcs = utils::range(6);
+  vector<size_t> unitWeights(6,1);
+
+  Node::NodeStats offsetStats(2000);
+  offsetStats.add(&offsetTarget,offsetIcs,unitWeights);
+  newassert( !offsetStats.isPure() );
+
+  Node::NodeStats lowStats(2000);
+  lowStats.add(&offsetTarget,vector<size_t>({0,1,4}),unitWeights);
+  newassert( lowStats.isPure() );
+
+  Node::NodeStats highStats = offsetStats;
+  highStats.subtract(lowStats);
+  newassert( highStats.isPure() );
+
+  // ... nor on the distance of the node from the shift
+  num_t z[] = { 0, 0, 10000, 10000, 10001, 10001 };
+  Feature farTarget(vector<num_t>(z,z+6),"N:far");
+
+  Node::NodeStats farStats(0);
+  farStats.add(&farTarget,vector<size_t>({2,3,4,5}),unitWeights);
+  newassert( !farStats.isPure() );
+
+  farStats = Node::NodeStats(0);
+  farStats.add(&farTarget,vector<size_t>({4,5}),unitWeights);
+  newassert( farStats.isPure() );
+
+}
+
 void node_newtest_getLeafTrainPrediction() {
 }
 
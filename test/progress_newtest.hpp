@@ -0,0 +1,89 @@
+#ifndef PROGRESS_NEWTEST_HPP
+#define PROGRESS_NEWTEST_HPP
+
+#include <vector>
+
+#ifndef NOTHREADS
+#include <thread>
+#endif
+
+#include "progress.hpp"
+#include "newtest.hpp"
+
+using namespace std;
+
+void progress_newtest_concurrentAdd();
+void progress_newtest_nested();
+
+void progress_newtest() {
+
+  newtest( "Progress counts units added by several threads", &progress_newtest_concurrentAdd );
+  newtest( "Progress nested in another is not reported", &progress_newtest_nested );
+
+}
+
+void progress_newtest_addUnits(Progress* progress, const size_t nUnits) {
+  for ( size_t i = 0; i < nUnits; ++i ) {
+    progress->add();
+  }
+}
+
+void progress_newtest_concurrentAdd() {
+
+  Progress::isEnabled = true;
+
+  {
+    Progress progress("progress test:","units",4000);
+
+#ifndef NOTHREADS
+    vector<thread> threads;
+    for ( size_t threadIdx = 0; threadIdx < 4; ++threadIdx ) {
+      threads.push_back( thread(progress_newtest_addUnits, &progress, 1000) );
+    }
+    for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
+      threads[threadIdx].join();
+    }
+#else
+    progress_newtest_addUnits(&progress, 4000);
+#endif
+
+    newassert( progress.nDone() == 4000 );
+  }
+
+  Progress::isEnabled = false;
+
+}
+
+void progress_newtest_nested() {
+
+  Progress::isEnabled = true;
+
+  {
+    Progress outer("outer:","units",10);
+    Progress inner("inner:","units",10);
+
+    outer.add(2);
+    inner.add(3);
+
+    newassert( outer.nDone() == 2 );
+    newassert( inner.nDone() == 0 );
+  }
+
+  // With the outer one gone, a new progress is reported again
+  {
+    Progress progress("progress test:","units",0);
+    progress.add(5);
+    newassert( progress.nDone() == 5 );
+  }
+
+  Progress::isEnabled = false;
+
+  {
+    Progress progress("progress test:","units",0);
+    progress.add(5);
+    newassert( progress.nDone() == 0 );
+  }
+
+}
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef RFACE_C_NEWTEST_HPP
+#define RFACE_C_NEWTEST_HPP
+
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+
+#include "rf_ace_c.h"
+#include "distributions.hpp"
+#include "newtest.hpp"
+
+using namespace std;
+
+// Builds without threads train and predict on one thread
+#ifdef NOTHREADS
+const size_t rface_c_newtest_nThreads = 1;
+#else
+const size_t rface_c_newtest_nThreads = 2;
+#endif
+
+void rface_c_newtest_zeroCopy();
+void rface_c_newtest_regression();
+void rface_c_newtest_classification();
+void rface_c_newtest_errors();
+
+void rface_c_newtest() {
+
+  newtest( "numerical columns are read in place", &rface_c_newtest_zeroCopy );
+  newtest( "train, predict, save and load through the C interface", &rface_c_newtest_regression );
+  newtest( "categorical columns and targets through the C interface", &rface_c_newtest_classification );
+  newtest( "failures of the C interface are reported", &rface_c_newtest_errors );
+
+}
+
+// y = 2*x1 + 1 plus noise, with x2 pure noise, and cls the sign of x1 - 0.5 as category codes
+void rface_c_newtest_makeColumns(const size_t nSamples, vector<float>& x1, vector<float>& x2, vector<float>& y, vector<int32_t>& cls) {
+
+  distributions::Random random(1);
+
+  x1.resize(nSamples);
+  x2.resize(nSamples);
+  y.resize(nSamples);
+  cls.resize(nSamples);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    x1[i] = random.uniform();
+    x2[i] = random.uniform();
+    y[i] = 2*x1[i] + 1 + 0.05*random.uniform();
+    cls[i] = x1[i] > 0.5 ? 1 : 0;
+  }
+
+}
+
+// A file in the temporary directory, out of the working tree
+string rface_c_newtest_tempFile(const string& name) {
+  const char* tmpDir = getenv("TMPDIR");
+  return( string(tmpDir ? tmpDir : "/tmp") + "/rface_c_newtest_" + name + ".sf" );
+}
+
+float rface_c_newtest_RMSE(const vector<float>& x, const vector<float>& y) {
+  float SSE = 0;
+  for ( size_t i = 0; i < x.size(); ++i ) {
+    SSE += ( x[i] - y[i] ) * ( x[i] - y[i] );
+  }
+  return( sqrt( SSE / x.size() ) );
+}
+
+void rface_c_newtest_zeroCopy() {
+
+  size_t nSamples = 100;
+
+  vector<float> x1,x2,y;
+  vector<int32_t> cls;
+  rface_c_newtest_makeColumns(nSamples,x1,x2,y,cls);
+
+  rface_data* data = rface_data_create(nSamples);
+  rface_data_add_numerical(data,"N:x1",&x1[0],NULL);
+  rface_data_add_numerical(data,"N:y",&y[0],NULL);
+
+  rface_train_options options;
+  rface_train_options_init(&options,RFACE_RF);
+  options.n_trees = 20;
+  options.seed = 1;
+
+  rface_model* model = rface_train(data,"N:y",&options);
+
+  // Changes to a column read in place show in the predictions, but not to a masked, copied column
+  vector<uint8_t> mask(nSamples,0);
+
+  rface_data* viewData = rface_data_create(nSamples);
+  rface_data* copyData = rface_data_create(nSamples);
+  newassert( rface_data_add_numerical(viewData,"N:x1",&x1[0],NULL) == 0 );
+  newassert( rface_data_add_numerical(copyData,"N:x1",&x1[0],&mask[0]) == 0 );
+  newassert( rface_data_n_samples(viewData) == nSamples );
+
+  vector<float> viewBefore(nSamples),viewAfter(nSamples),copyBefore(nSamples),copyAfter(nSamples);
+
+  rface_predict_numerical(model,viewData,&viewBefore[0],NULL);
+  rface_predict_numerical(model,copyData,&copyBefore[0],NULL);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    x1[i] = 1 - x1[i];
+  }
+
+  rface_predict_numerical(model,viewData,&viewAfter[0],NULL);
+  rface_predict_numerical(model,copyData,&copyAfter[0],NULL);
+
+  size_t nViewChanged = 0;
+  size_t nCopyChanged = 0;
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    nViewChanged += viewAfter[i] != viewBefore[i];
+    nCopyChanged += copyAfter[i] != copyBefore[i];
+  }
+
+#ifndef NUM_T_DOUBLE
+  newassert( nViewChanged > nSamples / 2 );
+#else
+  // Builds with NUM_T_DOUBLE copy every column
+  newassert( nViewChanged == 0 );
+#endif
+  newassert( nCopyChanged == 0 );
+
+  // Masked samples are missing
+  mask.assign(nSamples,1);
+  rface_data* maskedData = rface_data_create(nSamples);
+  rface_data_add_numerical(maskedData,"N:x1",&x1[0],&mask[0]);
+  rface_predict_numerical(model,maskedData,&copyAfter[0],NULL);
+
+  bool isConstant = true;
+  for ( size_t i = 1; i < nSamples; ++i ) {
+    isConstant = isConstant && copyAfter[i] == copyAfter[0];
+  }
+  newassert( isConstant );
+
+  rface_model_free(model);
+  rface_data_free(maskedData);
+  rface_data_free(copyData);
+  rface_data_free(viewData);
+  rface_data_free(data);
+
+}
+
+void rface_c_newtest_regression() {
+
+  size_t nSamples = 300;
+
+  vector<float> x1,x2,y;
+  vector<int32_t> cls;
+  rface_c_newtest_makeColumns(nSamples,x1,x2,y,cls);
+
+  rface_data* data = rface_data_create(nSamples);
+  rface_data_add_numerical(data,"N:x1",&x1[0],NULL);
+  rface_data_add_numerical(data,"N:x2",&x2[0],NULL);
+  rface_data_add_numerical(data,"N:y",&y[0],NULL);
+
+  rface_train_options options;
+  rface_train_options_init(&options,RFACE_RF);
+  options.n_trees = 50;
+  options.seed = 1;
+
+  rface_model* model = rface_train(data,"N:y",&options);
+
+  newassert( model != NULL );
+  newassert( rface_model_is_numerical(model) == 1 );
+
+  vector<float> predictions(nSamples),confidence(nSamples);
+
+  newassert( rface_predict_numerical(model,data,&predictions[0],&confidence[0]) == 0 );
+
+  newassert( rface_c_newtest_RMSE(predictions,y) < 0.1 );
+
+  // The loaded model predicts a data set without the target; the forest file is text, so the
+  // predictions are as accurate but not identical
+  rface_data* testData = rface_data_create(nSamples);
+  rface_data_add_numerical(testData,"N:x2",&x2[0],NULL);
+  rface_data_add_numerical(testData,"N:x1",&x1[0],NULL);
+
+  string forestFile = rface_c_newtest_tempFile("regression");
+
+  newassert( rface_model_save(model,forestFile.c_str()) == 0 );
+
+  rface_model* loadedModel = rface_model_load(forestFile.c_str(),rface_c_newtest_nThreads);
+  newassert( loadedModel != NULL );
+
+  // A loaded model is saved as it was read
+  ifstream savedStream(forestFile.c_str());
+  string savedForest( (istreambuf_iterator<char>(savedStream)), istreambuf_iterator<char>() );
+  savedStream.close();
+
+  newassert( rface_model_save(loadedModel,forestFile.c_str()) == 0 );
+
+  ifstream resavedStream(forestFile.c_str());
+  string resavedForest( (istreambuf_iterator<char>(resavedStream)), istreambuf_iterator<char>() );
+  resavedStream.close();
+
+  newassert( resavedForest == savedForest );
+  remove(forestFile.c_str());
+
+  vector<float> loadedPredictions(nSamples);
+  newassert( rface_predict_numerical(loadedModel,testData,&loadedPredictions[0],NULL) == 0 );
+
+  newassert( rface_c_newtest_RMSE(loadedPredictions,y) < 0.1 );
+  newassert( rface_c_newtest_RMSE(loadedPredictions,predictions) < 0.05 );
+
+  rface_model_free(loadedModel);
+  rface_model_free(model);
+  rface_data_free(testData);
+  rface_data_free(data);
+
+}
+
+void rface_c_newtest_classification() {
+
+  size_t nSamples = 300;
+
+  vector<float> x1,x2,y;
+  vector<int32_t> cls;
+  rface_c_newtest_makeColumns(nSamples,x1,x2,y,cls);
+
+  const char* categories[] = { "low", "high" };
+
+  rface_data* data = rface_data_create(nSamples);
+  rface_data_add_numerical(data,"N:x1",&x1[0],NULL);
+  rface_data_add_numerical(data,"N:x2",&x2[0],NULL);
+
+  cls[7] = -1;
+  newassert( rface_data_add_categorical(data,"C:cls",&cls[0],NULL,categories,2) == 0 );
+
+  rface_train_options options;
+  rface_train_options_init(&options,RFACE_RF);
+  options.n_trees = 50;
+  options.n_threads = rface_c_newtest_nThreads;
+  options.seed = 1;
+
+  rface_model* model = rface_train(data,"C:cls",&options);
+
+  newassert( model != NULL );
+  newassert( rface_model_is_numerical(model) == 0 );
+
+  vector<int32_t> predictions(nSamples);
+  newassert( rface_predict_categorical(model,data,categories,2,&predictions[0],NULL) == 0 );
+
+  size_t nErrors = 0;
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    nErrors += i != 7 && predictions[i] != cls[i];
+  }
+  newassert( nErrors < 15 );
+
+  // The codes follow the list given at prediction, and unlisted categories are -1
+  const char* otherCategories[] = { "high" };
+  newassert( rface_predict_categorical(model,data,otherCategories,1,&predictions[0],NULL) == 0 );
+  newassert( predictions[0] == ( x1[0] > 0.5 ? 0 : -1 ) );
+
+  rface_model_free(model);
+  rface_data_free(data);
+
+}
+
+void rface_c_newtest_errors() {
+
+  vector<float> x1,x2,y;
+  vector<int32_t> cls;
+  rface_c_newtest_makeColumns(20,x1,x2,y,cls);
+
+  const char* categories[] = { "low", "high" };
+
+  rface_data* data = rface_data_create(20);
+
+  newassert( rface_data_add_numerical(data,"N:x1",&x1[0],NULL) == 0 );
+  newassert( rface_data_add_numerical(data,"N:x1",&x2[0],NULL) == -1 );
+  newassert( string(rface_last_error()).find("N:x1") != string::npos );
+
+  cls[5] = 2;
+  newassert( rface_data_add_categorical(data,"C:cls",&cls[0],NULL,categories,2) == -1 );
+
+  rface_data_add_numerical(data,"N:y",&y[0],NULL);
+
+  rface_train_options options;
+  rface_train_options_init(&options,RFACE_QRF);
+
+  newassert( rface_train(data,"N:missing",&options) == NULL );
+  newassert( string(rface_last_error()).find("N:missing") != string::npos );
+
+  options.forest_type = RFACE_GBT;
+  options.shrinkage = 0.0;
+  newassert( rface_train(data,"N:y",&options) == NULL );
+  newassert( string(rface_last_error()).find("shrinkage") != string::npos );
+
+  options.shrinkage = 0.1;
+  vector<float> missing(20,NAN);
+  rface_data_add_numerical(data,"N:missing",&missing[0],NULL);
+  newassert( rface_train(data,"N:missing",&options) == NULL );
+  newassert( string(rface_last_error()).find("no values") != string::npos );
+
+  newassert( rface_model_load("no_such_forest.sf",1) == NULL );
+
+  // Malformed forest files are reported instead of ending the process
+  const char* forests[] = { "",
+                            "TREE=,FOREST=RF,NNODES=3,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n",
+                            "TREE=,FOREST=XX,NNODES=3,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n",
+                            "TREE=,FOREST=RF,NNODES=3,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n"
+                            "NODE=*,PRED=1,DATA=\"1\",SPLITTER=\"N:x1\",SPLITTERTYPE=NUMERICAL,LVALUES=\"0.5\",DI=1\n"
+                            "NODE=*L,PRED=x,DATA=\"1\"\n"
+                            "NODE=*R,PRED=1,DATA=\"1\"\n",
+                            "TREE=,FOREST=RF,NNODES=1,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n"
+                            "NODE=*,PRED=1,DATA=\"1\",SPLITTER=\"N:x1\",SPLITTERTYPE=NUMERICAL,LVALUES=\"0.5\",DI=1\n",
+                            "TREE=,FOREST=RF,NNODES=1,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n"
+                            "NODE=*,PRED=1,DATA=\"1\"\n"
+                            "TREE=,FOREST=GBT,NNODES=1,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n"
+                            "NODE=*,PRED=1,DATA=\"1\"\n" };
+
+  string forestFile = rface_c_newtest_tempFile("errors");
+
+  for ( size_t i = 0; i < sizeof(forests) / sizeof(forests[0]); ++i ) {
+    ofstream(forestFile.c_str()) << forests[i];
+    newassert( rface_model_load(forestFile.c_str(),1) == NULL );
+    newassert( string(rface_last_error()).size() > 0 );
+  }
+
+  // A tree of a single leaf is valid
+  ofstream(forestFile.c_str()) << "TREE=,FOREST=RF,NNODES=1,TARGET=\"N:y\",ISTARGETNUMERICAL=1\n"
+                                  "NODE=*,PRED=1,DATA=\"1\"\n";
+  rface_model* leafModel = rface_model_load(forestFile.c_str(),1);
+  newassert( leafModel != NULL );
+  newassert( rface_model_is_numerical(leafModel) == 1 );
+  rface_model_free(leafModel);
+
+  remove(forestFile.c_str());
+
+#ifdef NOTHREADS
+  newassert( rface_model_load("no_such_forest.sf",2) == NULL );
+  newassert( string(rface_last_error()).find("one thread") != string::npos );
+#endif
+  newassert( rface_data_create(0) == NULL );
+
+  newassert( rface_abi_version() == RFACE_ABI_VERSION );
+
+  rface_data_free(data);
+
+}
+
+#endif
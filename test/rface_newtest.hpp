@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
 #include "options.hpp"
 #include "densetreedata.hpp"
 #include "rf_ace.hpp"
@@ -11,6 +12,15 @@
 using namespace std;
 using datadefs::num_t;
 
+// Thread counts the tests run with; builds without threads run everything on one thread
+#ifdef NOTHREADS
+const size_t rface_newtest_maxThreads = 1;
+const size_t rface_newtest_maxPredictThreads = 1;
+#else
+const size_t rface_newtest_maxThreads = 2;
+const size_t rface_newtest_maxPredictThreads = 4;
+#endif
+
 void rface_newtest_RF_train_test_classification();
 void rface_newtest_RF_train_test_regression();
 void rface_newtest_QRF_train_test_regression();
@@ -21,19 +31,45 @@ void rface_newtest_RF_save_load_regression();
 void rface_newtest_QRF_save_load_regression();
 void rface_newtest_GBT_save_load_classification();
 void rface_newtest_GBT_save_load_regression();
+void rface_newtest_RF_oob_classification();
+void rface_newtest_RF_oob_regression();
+void rface_newtest_RF_permutation_importance();
+void rface_newtest_RF_warm_start();
+void rface_newtest_RF_convergence();
+void rface_newtest_RF_time_budget();
+void rface_newtest_filter_time_budget();
+void rface_newtest_GBT_split_threads();
+void rface_newtest_GBT_class_threads();
+void rface_newtest_GBT_predict_threads();
+void rface_newtest_work_counters();
+void rface_newtest_RF_statistics();
+void rface_newtest_RF_target_offset();
 
 void rface_newtest() {
   
   newtest( "RF for classification", &rface_newtest_RF_train_test_classification );
   newtest( "RF for regression", &rface_newtest_RF_train_test_regression );
   newtest( "QRF for regression", &rface_newtest_QRF_train_test_regression );
-  //newtest( "Testing GBT for classification", &rface_newtest_GBT_train_test_classification );
-  //newtest( "Testing GBT for regression", &rface_newtest_GBT_train_test_regression );
+  newtest( "GBT for classification", &rface_newtest_GBT_train_test_classification );
+  newtest( "GBT for regression", &rface_newtest_GBT_train_test_regression );
   newtest( "save/load RF for classification", &rface_newtest_RF_save_load_classification );
   newtest( "save/load RF for regression", &rface_newtest_RF_save_load_regression );
   newtest( "save/load QRF for regression", &rface_newtest_QRF_save_load_regression );
   //newtest( "Testing save/load GBT for classification", &rface_newtest_GBT_save_load_classification );
   //newtest( "Testing save/load GBT for regression", &rface_newtest_GBT_save_load_regression );
+  newtest( "OOB error of RF for classification", &rface_newtest_RF_oob_classification );
+  newtest( "OOB error of RF for regression", &rface_newtest_RF_oob_regression );
+  newtest( "OOB permutation importance of RF", &rface_newtest_RF_permutation_importance );
+  newtest( "warm start of RF", &rface_newtest_RF_warm_start );
+  newtest( "RF grown until convergence", &rface_newtest_RF_convergence );
+  newtest( "RF grown within a time budget", &rface_newtest_RF_time_budget );
+  newtest( "filter run within a time budget", &rface_newtest_filter_time_budget );
+  newtest( "GBT with multi-threaded split search", &rface_newtest_GBT_split_threads );
+  newtest( "categorical GBT with class trees grown in parallel", &rface_newtest_GBT_class_threads );
+  newtest( "multi-threaded GBT prediction", &rface_newtest_GBT_predict_threads );
+  newtest( "work counters of RF and GBT", &rface_newtest_work_counters );
+  newtest( "per-tree statistics of RF and filter", &rface_newtest_RF_statistics );
+  newtest( "RF on a target with a large offset", &rface_newtest_RF_target_offset );
 
 }
 
@@ -195,9 +231,70 @@ void rface_newtest_QRF_train_test_regression() {
   
 }
 
+void rface_newtest_RF_oob_classification() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("C:class");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+
+  // OOB predictions are accumulated in per-thread buffers, so try with more than one thread too
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface(nThreads);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    vector<cat_t> oobPredictions;
+    rface.forestRef()->getOobPredictions(oobPredictions);
+
+    num_t oobError = rface.forestRef()->getOobError(&trainData);
+    num_t trainError = classification_error( rface.test(&trainData) );
+
+    newassert( oobPredictions.size() == trainData.nSamples() );
+    newassert( rface.forestRef()->nOobSamples() == trainData.feature(targetIdx)->nRealSamples() );
+    newassert( oobError > trainError );
+    newassert( oobError < 0.7 );
+
+  }
+
+}
+
+void rface_newtest_RF_oob_regression() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface(nThreads);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    // The OOB error is an estimate of the generalization error, and hence larger than the error on the train data
+    num_t oobError = rface.forestRef()->getOobError(&trainData);
+    num_t trainError = regression_error( rface.test(&trainData) );
+
+    newassert( rface.forestRef()->nOobSamples() == trainData.feature(targetIdx)->nRealSamples() );
+    newassert( oobError > trainError );
+    newassert( oobError < 2.0 );
+
+  }
+
+}
+
 void rface_newtest_GBT_train_test_classification() {
 
   ForestOptions forestOptions(forest_t::GBT);
+  forestOptions.setGBTDefaults();
 
   num_t pError = classification_error( make_predictions(forestOptions,"C:class") );
 
@@ -208,6 +305,7 @@ void rface_newtest_GBT_train_test_classification() {
 void rface_newtest_GBT_train_test_regression() { 
 
   ForestOptions forestOptions(forest_t::GBT);
+  forestOptions.setGBTDefaults();
 
   num_t RMSE = regression_error( make_predictions(forestOptions,"N:output") );
 
@@ -276,4 +374,530 @@ void rface_newtest_GBT_save_load_regression() {
 
 }
 
+void rface_newtest_RF_permutation_importance() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  size_t inputIdx = trainData.getFeatureIdx("N:input");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface(nThreads);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    vector<num_t> importance,contrastImportance;
+    vector<distributions::Random> randoms(nThreads);
+    rface.forestRef()->getPermutationImportance(&trainData,importance,contrastImportance,randoms);
+
+    newassert( importance.size() == trainData.nFeatures() );
+    newassert( contrastImportance.size() == trainData.nFeatures() );
+    newassert( importance[inputIdx] > 0.0 );
+
+    // The informative feature should stand out from all the noise features
+    for ( size_t featureIdx = 0; featureIdx < importance.size(); ++featureIdx ) {
+      if ( featureIdx != inputIdx && !datadefs::isNAN(importance[featureIdx]) ) {
+	newassert( importance[inputIdx] > importance[featureIdx] );
+      }
+    }
+
+  }
+
+}
+
+void rface_newtest_RF_warm_start() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface(nThreads);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    num_t oobError = rface.forestRef()->getOobError(&trainData);
+
+    newassert( rface.forestRef()->nTrees() == 10 );
+
+    forestOptions.warmStart = true;
+    forestOptions.nTrees = 40;
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    // OOB estimate keeps accumulating over the old and the new trees
+    newassert( rface.forestRef()->nTrees() == 50 );
+    newassert( rface.forestRef()->nOobSamples() == trainData.feature(targetIdx)->nRealSamples() );
+    newassert( rface.forestRef()->getOobError(&trainData) < oobError );
+
+    // Warm start also applies to a forest loaded from file
+    rface.save("foo.sf");
+
+    RFACE rface2(nThreads);
+    rface2.load("foo.sf");
+    forestOptions.nTrees = 5;
+    rface2.train(&trainData,targetIdx,weights,&forestOptions);
+
+    newassert( rface2.forestRef()->nTrees() == 55 );
+    newassert( rface2.forestRef()->nOobSamples() > 0 );
+
+    // ... and the grown forest can be saved and loaded again
+    rface2.save("foo.sf");
+
+    RFACE rface3(nThreads);
+    rface3.load("foo.sf");
+
+    newassert( rface3.forestRef()->nTrees() == 55 );
+    for ( size_t treeIdx = 0; treeIdx < 55; ++treeIdx ) {
+      newassert( rface3.forestRef()->tree(treeIdx)->nLeaves() == rface2.forestRef()->tree(treeIdx)->nLeaves() );
+    }
+
+    // OOB predictions made on other data are not carried over, even if the sample count matches
+    DenseTreeData otherData(fileName,'\t',':',false);
+    forestOptions.nTrees = 1;
+    rface.train(&otherData,targetIdx,weights,&forestOptions);
+
+    newassert( rface.forestRef()->nTrees() == 51 );
+    newassert( rface.forestRef()->nOobSamples() < trainData.feature(targetIdx)->nRealSamples() );
+
+    forestOptions.warmStart = false;
+    forestOptions.nTrees = 10;
+
+  }
+
+}
+
+void rface_newtest_RF_convergence() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 500;
+  forestOptions.treeBatchSize = 10;
+  forestOptions.convergenceTolerance = 0.05;
+
+  vector<string> criteria = {"oob","mdi"};
+
+  for ( size_t i = 0; i < criteria.size(); ++i ) {
+
+    forestOptions.convergenceCriterion = criteria[i];
+
+    RFACE rface;
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    // At least three batches are needed to see two stable changes
+    size_t nTrees = rface.forestRef()->nTrees();
+    newassert( nTrees >= 30 );
+    newassert( nTrees < 500 );
+    newassert( nTrees % 10 == 0 );
+
+  }
+
+  // A tiny tolerance is never met, so growth stops at the maximum
+  forestOptions.nTrees = 35;
+  forestOptions.convergenceTolerance = 1e-12;
+  forestOptions.convergenceCriterion = "oob";
+
+  RFACE rface;
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+  newassert( rface.forestRef()->nTrees() == 35 );
+
+}
+
+void rface_newtest_RF_time_budget() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 1000000;
+  forestOptions.timeBudget = 0.2;
+
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface(nThreads);
+
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+    num_t seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+    size_t nTrees = rface.forestRef()->nTrees();
+
+    newassert( nTrees > 1 );
+    newassert( nTrees < forestOptions.nTrees );
+    newassert( seconds < 1.0 );
+    newassert( rface.forestRef()->nOobSamples() > 0 );
+    newassert( rface.test(&trainData).numPredictions.size() == trainData.nSamples() );
+
+  }
+
+  // A budget too small for any tree still yields a valid forest of one tree
+  forestOptions.timeBudget = 1e-9;
+
+  RFACE rface(rface_newtest_maxThreads);
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+  newassert( rface.forestRef()->nTrees() == 1 );
+
+}
+
+void rface_newtest_filter_time_budget() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData(fileName,'\t',':',true);
+  size_t targetIdx = filterData.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 20;
+  forestOptions.timeBudget = 1e-9;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 1000;
+
+  RFACE rface;
+
+  // The null distribution always gets its minimum of 5 permutations
+  RFACE::FilterOutput filterOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions);
+
+  newassert( filterOutput.nPerms == 5 );
+  newassert( filterOutput.nSignificantFeatures == filterOutput.pValues.size() );
+  newassert( rface.getStatistics().nForests() == 5 );
+
+  forestOptions.timeBudget = 0.5;
+  filterOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions);
+
+  newassert( filterOutput.nPerms >= 5 );
+  newassert( filterOutput.nPerms < 1000 );
+
+}
+
+void rface_newtest_GBT_split_threads() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::GBT);
+  forestOptions.setGBTDefaults();
+
+  // Training error is compared against the constant predictor that boosting starts from
+  vector<num_t> trueData = trainData.feature(targetIdx)->getNumData();
+  vector<size_t> sampleIcs = utils::range(trainData.nSamples());
+  vector<size_t> missingIcs;
+  trainData.separateMissingSamples(targetIdx,sampleIcs,missingIcs);
+  num_t mean = math::mean(trainData.feature(targetIdx)->getNumData(sampleIcs));
+  num_t constantError = 0.0;
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    constantError += powf(trueData[sampleIcs[i]] - mean,2);
+  }
+
+  for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+    RFACE rface1(nThreads,1234), rface2(nThreads,1234);
+    rface1.train(&trainData,targetIdx,weights,&forestOptions);
+    rface2.train(&trainData,targetIdx,weights,&forestOptions);
+
+    RFACE::TestOutput predictions1 = rface1.test(&trainData);
+    RFACE::TestOutput predictions2 = rface2.test(&trainData);
+
+    // Training leaves the target in the data intact
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      newassert( trainData.feature(targetIdx)->getNumData(sampleIcs[i]) == trueData[sampleIcs[i]] );
+    }
+
+    newassert( rface1.forestRef()->nTrees() == forestOptions.nTrees );
+    num_t trainError = 0.0;
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      trainError += powf(trueData[sampleIcs[i]] - predictions1.numPredictions[sampleIcs[i]],2);
+    }
+    newassert( trainError < 0.5 * constantError );
+
+    // The split search is spread over the threads deterministically
+    newassert( predictions1.numPredictions == predictions2.numPredictions );
+
+  }
+
+}
+
+void rface_newtest_GBT_class_threads() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("C:class");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  vector<cat_t> trueData = trainData.feature(targetIdx)->getCatData();
+  size_t nCategories = trainData.feature(targetIdx)->categories().size();
+
+  ForestOptions forestOptions(forest_t::GBT);
+  forestOptions.setGBTDefaults();
+  forestOptions.nTrees = 20;
+
+  // With no more threads than classes, each class tree is grown by one thread from its own random stream,
+  // so the forest is the same whether the classes are grown one after another or concurrently
+  RFACE rface1(1,1234), rface2(rface_newtest_maxThreads,1234);
+  rface1.train(&trainData,targetIdx,weights,&forestOptions);
+  rface2.train(&trainData,targetIdx,weights,&forestOptions);
+
+  newassert( trainData.feature(targetIdx)->getCatData() == trueData );
+
+  StochasticForest* forest1 = rface1.forestRef();
+  StochasticForest* forest2 = rface2.forestRef();
+
+  newassert( forest1->nTrees() == forestOptions.nTrees * nCategories );
+  newassert( forest2->nTrees() == forest1->nTrees() );
+
+  for ( size_t treeIdx = 0; treeIdx < forest1->nTrees(); ++treeIdx ) {
+    newassert( forest1->rootNodes_[treeIdx]->nNodes() == forest2->rootNodes_[treeIdx]->nNodes() );
+    for ( size_t i = 0; i < trainData.nSamples(); i += 10 ) {
+      newassert( forest1->rootNodes_[treeIdx]->getPrediction(&trainData,i).numTrainPrediction ==
+		 forest2->rootNodes_[treeIdx]->getPrediction(&trainData,i).numTrainPrediction );
+    }
+  }
+
+}
+
+void rface_newtest_GBT_predict_threads() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::GBT);
+  forestOptions.setGBTDefaults();
+  forestOptions.nTrees = 20;
+
+  vector<string> targets = {"N:output","C:class"};
+
+  for ( size_t t = 0; t < targets.size(); ++t ) {
+
+    size_t targetIdx = trainData.getFeatureIdx(targets[t]);
+    vector<num_t> weights = trainData.getFeatureWeights();
+    weights[targetIdx] = 0;
+
+    RFACE rface(1,1234);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+    StochasticForest* forest = rface.forestRef();
+
+    // Each sample is predicted by one thread summing the trees in order, so the number of threads makes no difference
+    if ( trainData.feature(targetIdx)->isNumerical() ) {
+      vector<num_t> predictions1,predictions4,confidence1,confidence4;
+      forest->predict(&trainData,predictions1,confidence1,1);
+      forest->predict(&trainData,predictions4,confidence4,rface_newtest_maxPredictThreads);
+      newassert( predictions1 == predictions4 );
+      newassert( confidence1 == confidence4 );
+    } else {
+      vector<cat_t> predictions1,predictions4;
+      vector<num_t> confidence1,confidence4;
+      forest->predict(&trainData,predictions1,confidence1,1);
+      forest->predict(&trainData,predictions4,confidence4,rface_newtest_maxPredictThreads);
+      newassert( predictions1 == predictions4 );
+      newassert( confidence1 == confidence4 );
+      for ( size_t i = 0; i < confidence1.size(); ++i ) {
+	newassert( confidence1[i] >= 0.0 && confidence1[i] < 1.0 );
+      }
+    }
+
+  }
+
+}
+
+void rface_newtest_work_counters() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  vector<string> targets = {"N:output","C:class"};
+
+  for ( size_t t = 0; t < targets.size(); ++t ) {
+
+    size_t targetIdx = trainData.getFeatureIdx(targets[t]);
+    vector<num_t> weights = trainData.getFeatureWeights();
+    weights[targetIdx] = 0;
+
+    for ( size_t nThreads = 1; nThreads <= rface_newtest_maxThreads; ++nThreads ) {
+
+      forestOptions.setRFDefaults();
+      forestOptions.mTry = 30;
+      forestOptions.nTrees = 10;
+
+      for ( size_t f = 0; f < 2; ++f ) {
+
+	RFACE rface(nThreads,1234);
+	rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+	StochasticForest* forest = rface.forestRef();
+	const WorkCounters& workCounters = forest->getWorkCounters();
+
+	// Every node of every tree is counted once, no matter which thread grew it
+	size_t nNodes = 0;
+	for ( size_t treeIdx = 0; treeIdx < forest->nTrees(); ++treeIdx ) {
+	  nNodes += forest->rootNodes_[treeIdx]->nNodes();
+	}
+
+	newassert( workCounters.nodesCreated == nNodes );
+	newassert( workCounters.leaves > 0 );
+	newassert( workCounters.leaves < workCounters.nodesCreated );
+	newassert( workCounters.candidates() > 0 );
+	newassert( workCounters.samplesScanned >= workCounters.candidates() );
+	newassert( workCounters.sortCalls == workCounters.numCandidates );
+
+	forestOptions.setGBTDefaults();
+	forestOptions.nTrees = 10;
+
+      }
+    }
+  }
+
+}
+
+void rface_newtest_RF_statistics() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  RFACE rface;
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+  statistics::RF_statistics& statistics = rface.getStatistics();
+  const vector<statistics::RF_statistics::TreeRecord>& treeRecords = statistics.treeRecords();
+
+  newassert( statistics.nForests() == 1 );
+  newassert( treeRecords.size() == 10 );
+
+  for ( size_t treeIdx = 0; treeIdx < treeRecords.size(); ++treeIdx ) {
+
+    const statistics::RF_statistics::TreeRecord& treeRecord = treeRecords[treeIdx];
+    const RootNode* tree = rface.forestRef()->tree(treeIdx);
+
+    newassert( treeRecord.treeIdx == treeIdx );
+    newassert( treeRecord.nNodes == tree->nNodes() );
+    newassert( treeRecord.nOobSamples == tree->oobIcs_.size() );
+    newassert( treeRecord.growTime > 0.0 );
+    newassert( treeRecord.depth > 0 && treeRecord.depth < treeRecord.nNodes );
+
+    // Every split adds two children and possibly a missing-branch child, and turns a leaf into an internal node
+    newassert( 2 * treeRecord.nLeaves == treeRecord.nNodes + 1 + treeRecord.nMissingNodes );
+  }
+
+  rface.save("foo.sf");
+
+  ofstream toFile("foo.tsv");
+  statistics.writeTSV(toFile);
+  toFile.close();
+
+  ifstream fromFile("foo.tsv");
+  size_t nLines = 0;
+  string line;
+  while ( getline(fromFile,line) ) {
+    ++nLines;
+  }
+
+  newassert( nLines == 11 );
+
+  // Trees loaded from file keep their shape, but have no growth time
+  RFACE rface2;
+  rface2.load("foo.sf");
+
+  RootNode::TreeStats treeStats = rface2.forestRef()->tree(0)->getTreeStats();
+  newassert( treeStats.nNodes == treeRecords[0].nNodes );
+  newassert( treeStats.nLeaves == treeRecords[0].nLeaves );
+  newassert( treeStats.depth == treeRecords[0].depth );
+  newassert( treeStats.growTime == 0.0 );
+
+}
+
+void rface_newtest_RF_target_offset() {
+
+  // A unit step on top of an offset of 2000 is learned as well as the step alone
+  size_t nSamples = 200;
+  distributions::Random random(1);
+  vector<num_t> x(nSamples),y(nSamples);
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    x[i] = random.uniform();
+    y[i] = 2000 + ( x[i] > 0.5 );
+  }
+
+  vector<Feature> features;
+  features.push_back( Feature(x,"N:x") );
+  features.push_back( Feature(y,"N:y") );
+  DenseTreeData trainData(features);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = 1;
+  forestOptions.nTrees = 20;
+
+  vector<num_t> weights = {1,0};
+
+  RFACE rface(1,1234);
+  rface.train(&trainData,1,weights,&forestOptions);
+
+  StochasticForest* forest = rface.forestRef();
+
+  for ( size_t treeIdx = 0; treeIdx < forest->nTrees(); ++treeIdx ) {
+    newassert( forest->rootNodes_[treeIdx]->nNodes() > 1 );
+  }
+
+  newassert( forest->getOobError(&trainData) < 0.1 );
+
+  // A unit step in a small cluster far from the shift of the tree is split as well. With the samples
+  // in increasing order of x, every tree takes its shift from the cluster at 0
+  sort(x.begin(),x.end());
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    y[i] = x[i] < 0.8 ? 0 : 10000 + ( x[i] > 0.9 );
+  }
+
+  features[0] = Feature(x,"N:x");
+  features[1] = Feature(y,"N:y");
+  DenseTreeData farData(features);
+
+  RFACE farRface(1,1234);
+  farRface.train(&farData,1,weights,&forestOptions);
+
+  RFACE::TestOutput testOutput = farRface.test(&farData);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    if ( fabs(x[i] - 0.9) > 0.02 && x[i] > 0.8 ) {
+      newassert( fabs(testOutput.numPredictions[i] - y[i]) < 0.5 );
+    }
+  }
+
+}
+
 #endif
@@ -5,11 +5,16 @@
 #include "reader_newtest.hpp"
 #include "treedata_newtest.hpp"
 #include "rface_newtest.hpp"
+#include "rface_c_newtest.hpp"
 #include "distributions_newtest.hpp"
 #include "utils_newtest.hpp"
 #include "datadefs_newtest.hpp"
 #include "node_newtest.hpp"
 #include "math_newtest.hpp"
+#include "timer_newtest.hpp"
+#include "trace_newtest.hpp"
+#include "progress_newtest.hpp"
+#include "workerpool_newtest.hpp"
 
 using namespace std;
 
@@ -26,6 +31,9 @@ int main() {
   cout << endl << "Testing RFACE class:" << endl;
   rface_newtest();
 
+  cout << endl << "Testing C interface:" << endl;
+  rface_c_newtest();
+
   cout << endl << "Testing Distributions namespace:" << endl;
   distributions_newtest();
   
@@ -41,6 +49,18 @@ int main() {
   cout << endl << "Testing math namespace:" << endl;
   math_newtest();
 
+  cout << endl << "Testing profiler namespace:" << endl;
+  timer_newtest();
+
+  cout << endl << "Testing trace namespace:" << endl;
+  trace_newtest();
+
+  cout << endl << "Testing Progress class:" << endl;
+  progress_newtest();
+
+  cout << endl << "Testing WorkerPool class:" << endl;
+  workerpool_newtest();
+
   newtestdone();
 
   return( EXIT_SUCCESS );
@@ -0,0 +1,305 @@
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "benchmark.hpp"
+#include "argparse.hpp"
+#include "densetreedata.hpp"
+#include "rf_ace.hpp"
+#include "options.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+// One point of the sweep
+struct Config {
+  string mode;
+  size_t nThreads;
+  size_t nSamples;
+  size_t nFeatures;
+  size_t mTry;
+  size_t nMaxLeaves;
+};
+
+struct Measurement {
+  double wallTime;
+  double peakRSSMB;
+  bool ok;
+};
+
+// Splits the features of a configuration into numerical, categorical and textual ones
+benchmark::DataSpec makeSpec(const Config& config, const benchmark::DataSpec& base) {
+  benchmark::DataSpec spec(base);
+  spec.nSamples = config.nSamples;
+  spec.nTxtFeatures = config.nFeatures / 10;
+  spec.nCatFeatures = ( config.nFeatures - spec.nTxtFeatures ) / 2;
+  spec.nNumFeatures = config.nFeatures - spec.nTxtFeatures - spec.nCatFeatures;
+  return( spec );
+}
+
+// Generates the data and runs the configuration; returns the wall time of training or filtering alone
+double runConfig(const Config& config, const benchmark::DataSpec& base, const size_t nTrees, const size_t nPerms) {
+
+  benchmark::DataSpec spec = makeSpec(config,base);
+
+  bool isFilter = config.mode == "filter";
+
+  DenseTreeData treeData(benchmark::makeFeatures(spec),isFilter,benchmark::makeSampleNames(spec));
+
+  size_t targetIdx = treeData.getFeatureIdx("N:target");
+
+  // The categorical target is derived from the numerical one, so it is left out of the model
+  vector<num_t> weights = treeData.getFeatureWeights();
+  weights[targetIdx] = 0;
+  weights[treeData.getFeatureIdx("C:target")] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  if ( config.mode == "QRF" ) {
+    forestOptions.setQRFDefaults();
+  } else {
+    forestOptions.setRFDefaults();
+  }
+  forestOptions.nTrees = nTrees;
+  forestOptions.mTry = config.mTry > 0 ? config.mTry : max(static_cast<size_t>(1), treeData.nFeatures() / 3);
+  if ( config.nMaxLeaves > 0 ) {
+    forestOptions.nMaxLeaves = config.nMaxLeaves;
+  }
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = nPerms;
+
+  RFACE rface(config.nThreads,spec.seed);
+
+  chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+  if ( isFilter ) {
+    rface.filter(&treeData,targetIdx,weights,&forestOptions,&filterOptions);
+  } else {
+    rface.train(&treeData,targetIdx,weights,&forestOptions);
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+
+  return( elapsed.count() );
+
+}
+
+// Every configuration runs in a child process of its own, so that its peak RSS is not shadowed by the earlier ones
+Measurement measure(const Config& config, const benchmark::DataSpec& base, const size_t nTrees, const size_t nPerms) {
+
+  Measurement m = {0.0, 0.0, false};
+
+  int fd[2];
+  if ( pipe(fd) != 0 ) {
+    cerr << "ERROR: could not create a pipe" << endl;
+    exit(1);
+  }
+
+  pid_t pid = fork();
+
+  if ( pid < 0 ) {
+    cerr << "ERROR: could not fork" << endl;
+    exit(1);
+  }
+
+  if ( pid == 0 ) {
+    close(fd[0]);
+    // Progress and summaries printed by RFACE would garble the report
+    if ( !freopen("/dev/null","w",stdout) ) {
+      _exit(1);
+    }
+    double wallTime = runConfig(config,base,nTrees,nPerms);
+    ssize_t nWritten = write(fd[1],&wallTime,sizeof(wallTime));
+    close(fd[1]);
+    _exit( nWritten == sizeof(wallTime) ? 0 : 1 );
+  }
+
+  close(fd[1]);
+  ssize_t nRead = read(fd[0],&m.wallTime,sizeof(m.wallTime));
+  close(fd[0]);
+
+  int status = 0;
+  struct rusage usage;
+  wait4(pid,&status,0,&usage);
+
+  m.ok = nRead == sizeof(m.wallTime) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+#ifdef __APPLE__
+  m.peakRSSMB = usage.ru_maxrss / 1048576.0;
+#else
+  m.peakRSSMB = usage.ru_maxrss / 1024.0;
+#endif
+
+  return( m );
+
+}
+
+void printHelp() {
+  cout << endl
+       << "Scaling benchmark of rf-ace over threads, samples, features, mTry and nMaxLeaves on synthetic data" << endl << endl
+       << " -M / --modes        Comma-separated list of RF, QRF and filter (default RF,QRF,filter)" << endl
+       << " -e / --nThreads     Comma-separated list of thread counts (default 1,2,4)" << endl
+       << " -n / --nSamples     Comma-separated list of sample counts (default 1000,10000)" << endl
+       << " -f / --nFeatures    Comma-separated list of feature counts (default 20,100)" << endl
+       << " -m / --mTry         Comma-separated list of mTry values, 0 = nFeatures/3 (default 0)" << endl
+       << " -a / --nMaxLeaves   Comma-separated list of leaf limits, 0 = forest default (default 0)" << endl
+       << " -t / --nTrees       Number of trees per forest (default 50)" << endl
+       << " -p / --nPerms       Number of permutations in filter mode (default 5)" << endl
+       << " -c / --cardinality  Number of categories in the categorical features (default 10)" << endl
+       << " -A / --naFraction   Average fraction of missing values; rates vary between features (default 0.1)" << endl
+       << " -s / --seed         Seed of the data generator and the forests (default 1)" << endl
+       << " -o / --output       Write the results as tab-separated values into this file" << endl
+       << " -W / --writeData    Write a data set of the first sample and feature count as AFM into this file, and exit" << endl
+       << endl;
+}
+
+int main(const int argc, char* const argv[]) {
+
+  string modesStr = "RF,QRF,filter";
+  string nThreadsStr = "1,2,4";
+  string nSamplesStr = "1000,10000";
+  string nFeaturesStr = "20,100";
+  string mTryStr = "0";
+  string nMaxLeavesStr = "0";
+  size_t nTrees = 50;
+  size_t nPerms = 5;
+  string outputFile = "";
+  string dataFile = "";
+  bool printHelpAndExit = false;
+
+  benchmark::DataSpec base;
+  base.mixedNARates = true;
+
+  try {
+    ArgParse parser(argc,argv);
+    parser.getFlag("h","help",printHelpAndExit);
+    parser.getArgument<string>("M","modes",modesStr);
+    parser.getArgument<string>("e","nThreads",nThreadsStr);
+    parser.getArgument<string>("n","nSamples",nSamplesStr);
+    parser.getArgument<string>("f","nFeatures",nFeaturesStr);
+    parser.getArgument<string>("m","mTry",mTryStr);
+    parser.getArgument<string>("a","nMaxLeaves",nMaxLeavesStr);
+    parser.getArgument<size_t>("t","nTrees",nTrees);
+    parser.getArgument<size_t>("p","nPerms",nPerms);
+    parser.getArgument<size_t>("c","cardinality",base.cardinality);
+    parser.getArgument<num_t>("A","naFraction",base.naFraction);
+    parser.getArgument<size_t>("s","seed",base.seed);
+    parser.getArgument<string>("o","output",outputFile);
+    parser.getArgument<string>("W","writeData",dataFile);
+  } catch(...) {
+    cerr << "Could not parse command-line arguments" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if ( printHelpAndExit ) {
+    printHelp();
+    return(EXIT_SUCCESS);
+  }
+
+  vector<string> modes = utils::split(modesStr,',');
+  vector<size_t> nThreadsList = benchmark::parseList<size_t>(nThreadsStr);
+  vector<size_t> nSamplesList = benchmark::parseList<size_t>(nSamplesStr);
+  vector<size_t> nFeaturesList = benchmark::parseList<size_t>(nFeaturesStr);
+  vector<size_t> mTryList = benchmark::parseList<size_t>(mTryStr);
+  vector<size_t> nMaxLeavesList = benchmark::parseList<size_t>(nMaxLeavesStr);
+
+  if ( nThreadsList.empty() || nSamplesList.empty() || nFeaturesList.empty() || mTryList.empty() || nMaxLeavesList.empty() ) {
+    cerr << "ERROR: every swept parameter needs at least one value" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  for ( size_t i = 0; i < modes.size(); ++i ) {
+    if ( modes[i] != "RF" && modes[i] != "QRF" && modes[i] != "filter" ) {
+      cerr << "ERROR: unknown mode '" << modes[i] << "'" << endl;
+      return(EXIT_FAILURE);
+    }
+  }
+
+  if ( dataFile != "" ) {
+    Config config = {"RF", 1, nSamplesList[0], nFeaturesList[0], 0, 0};
+    benchmark::DataSpec spec = makeSpec(config,base);
+    vector<vector<string> > rawTxtData;
+    vector<Feature> features = benchmark::makeFeatures(spec,&rawTxtData);
+    benchmark::writeAFM(features,benchmark::makeSampleNames(spec),rawTxtData,dataFile);
+    cout << "Data with " << spec.nSamples << " samples and " << features.size() << " features written to '" << dataFile << "'" << endl;
+    return(EXIT_SUCCESS);
+  }
+
+  ofstream toFile;
+  if ( outputFile != "" ) {
+    toFile.open(outputFile.c_str());
+    toFile << "MODE\tNTHREADS\tNSAMPLES\tNFEATURES\tMTRY\tNMAXLEAVES\tNTREES\tWALL_S\tSPEEDUP\tEFFICIENCY\tPEAK_RSS_MB" << endl;
+  }
+
+  cout << endl << setw(8) << "mode" << setw(9) << "threads" << setw(10) << "samples" << setw(10) << "features"
+       << setw(6) << "mTry" << setw(8) << "leaves" << setw(11) << "wall(s)" << setw(9) << "speedup"
+       << setw(11) << "efficiency" << setw(13) << "peakRSS(MB)" << endl;
+
+  for ( size_t mi = 0; mi < modes.size(); ++mi ) {
+    for ( size_t ni = 0; ni < nSamplesList.size(); ++ni ) {
+      for ( size_t fi = 0; fi < nFeaturesList.size(); ++fi ) {
+	for ( size_t ti = 0; ti < mTryList.size(); ++ti ) {
+	  for ( size_t li = 0; li < nMaxLeavesList.size(); ++li ) {
+
+	    // Speedup is relative to the first thread count of the sweep, normally 1
+	    double baseTime = 0.0;
+	    size_t baseThreads = nThreadsList[0];
+
+	    for ( size_t ei = 0; ei < nThreadsList.size(); ++ei ) {
+
+	      Config config = {modes[mi], nThreadsList[ei], nSamplesList[ni], nFeaturesList[fi], mTryList[ti], nMaxLeavesList[li]};
+
+	      Measurement m = measure(config,base,nTrees,nPerms);
+
+	      if ( !m.ok ) {
+		cerr << "WARNING: configuration " << config.mode << " with " << config.nThreads << " threads, "
+		     << config.nSamples << " samples and " << config.nFeatures << " features failed" << endl;
+		continue;
+	      }
+
+	      if ( ei == 0 ) {
+		baseTime = m.wallTime;
+	      }
+
+	      double speedup = baseTime > 0.0 ? baseTime / m.wallTime : datadefs::NUM_NAN;
+	      double efficiency = speedup * baseThreads / config.nThreads;
+
+	      cout << setw(8) << config.mode << setw(9) << config.nThreads << setw(10) << config.nSamples << setw(10) << config.nFeatures
+		   << setw(6) << config.mTry << setw(8) << config.nMaxLeaves << fixed << setprecision(3) << setw(11) << m.wallTime
+		   << setprecision(2) << setw(9) << speedup << setw(11) << efficiency << setprecision(1) << setw(13) << m.peakRSSMB << endl;
+	      cout.unsetf(ios_base::floatfield);
+
+	      if ( outputFile != "" ) {
+		toFile << config.mode << "\t" << config.nThreads << "\t" << config.nSamples << "\t" << config.nFeatures << "\t"
+		       << config.mTry << "\t" << config.nMaxLeaves << "\t" << nTrees << "\t" << m.wallTime << "\t"
+		       << speedup << "\t" << efficiency << "\t" << m.peakRSSMB << endl;
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  if ( outputFile != "" ) {
+    toFile.close();
+    cout << endl << "Results written to '" << outputFile << "'" << endl;
+  }
+
+  cout << endl;
+
+  return(EXIT_SUCCESS);
+
+}
@@ -0,0 +1,213 @@
+#ifndef TIMER_NEWTEST_HPP
+#define TIMER_NEWTEST_HPP
+
+#include <vector>
+
+#ifndef NOTHREADS
+#include <thread>
+#include <functional>
+#endif
+
+#include "timer.hpp"
+#include "newtest.hpp"
+
+using namespace std;
+
+void timer_newtest_profilerNesting();
+void timer_newtest_profilerDisabled();
+void timer_newtest_profilerAttach();
+void timer_newtest_profilerFinishedThreads();
+void timer_newtest_perfCounters();
+
+void timer_newtest() {
+
+  newtest( "Profiler nests phases and counts calls", &timer_newtest_profilerNesting );
+  newtest( "Disabled profiler records nothing", &timer_newtest_profilerDisabled );
+  newtest( "Profiler nests worker threads under their spawner", &timer_newtest_profilerAttach );
+  newtest( "Profiler frees the phase trees of finished threads", &timer_newtest_profilerFinishedThreads );
+  newtest( "Profiler attributes hardware counters to phases, or degrades without them", &timer_newtest_perfCounters );
+
+}
+
+void timer_newtest_profilerNesting() {
+
+  profiler::reset();
+  profiler::enable();
+
+  {
+    profiler::ScopedTimer outer("outer");
+    for ( size_t i = 0; i < 3; ++i ) {
+      profiler::ScopedTimer inner("inner");
+      newassert( profiler::currentPath().size() == 2 );
+    }
+  }
+
+  profiler::isEnabled = false;
+
+  profiler::Phase root = profiler::collect();
+
+  newassert( root.children.size() == 1 );
+  newassert( root.children[0].name == "outer" );
+  newassert( root.children[0].nCalls == 1 );
+  newassert( root.children[0].nThreads == 1 );
+  newassert( root.children[0].children.size() == 1 );
+  newassert( root.children[0].children[0].name == "inner" );
+  newassert( root.children[0].children[0].nCalls == 3 );
+  newassert( root.children[0].totalNs >= root.children[0].children[0].totalNs );
+
+  profiler::reset();
+
+}
+
+void timer_newtest_profilerDisabled() {
+
+  profiler::reset();
+
+  {
+    profiler::ScopedTimer outer("outer");
+    newassert( profiler::currentPath().empty() );
+  }
+
+  newassert( profiler::collect().children.empty() );
+
+}
+
+void timer_newtest_profilerAttachedWork(const profiler::Path& profilePath) {
+  profiler::ScopedAttach attach(profilePath);
+  profiler::ScopedTimer scopedTimer("work");
+}
+
+void timer_newtest_profilerAttach() {
+
+  profiler::reset();
+  profiler::enable();
+
+  {
+    profiler::ScopedTimer outer("outer");
+    profiler::Path profilePath = profiler::currentPath();
+
+    // Inline, the work nests under the open phase anyway
+    timer_newtest_profilerAttachedWork(profilePath);
+
+#ifndef NOTHREADS
+    vector<thread> threads;
+    for ( size_t threadIdx = 0; threadIdx < 2; ++threadIdx ) {
+      threads.push_back( thread(timer_newtest_profilerAttachedWork, cref(profilePath)) );
+    }
+    for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
+      threads[threadIdx].join();
+    }
+#endif
+  }
+
+  profiler::isEnabled = false;
+
+  profiler::Phase root = profiler::collect();
+
+  newassert( root.children.size() == 1 );
+  newassert( root.children[0].name == "outer" );
+  newassert( root.children[0].nCalls == 1 );
+  newassert( root.children[0].children.size() == 1 );
+  newassert( root.children[0].children[0].name == "work" );
+
+#ifndef NOTHREADS
+  newassert( root.children[0].nThreads == 1 );
+  newassert( root.children[0].children[0].nCalls == 3 );
+  newassert( root.children[0].children[0].nThreads == 3 );
+#else
+  newassert( root.children[0].children[0].nCalls == 1 );
+#endif
+
+  profiler::reset();
+
+}
+
+void timer_newtest_profilerFinishedThreads() {
+
+  profiler::reset();
+  profiler::enable();
+
+  {
+    profiler::ScopedTimer outer("outer");
+    profiler::Path profilePath = profiler::currentPath();
+
+#ifndef NOTHREADS
+    // One thread at a time, as when threads are started anew for every tree
+    for ( size_t threadIdx = 0; threadIdx < 50; ++threadIdx ) {
+      thread worker(timer_newtest_profilerAttachedWork, cref(profilePath));
+      worker.join();
+    }
+#else
+    timer_newtest_profilerAttachedWork(profilePath);
+#endif
+  }
+
+  profiler::isEnabled = false;
+
+  // Only the tree of this thread is left
+  newassert( profiler::nThreadProfiles() == 1 );
+
+  profiler::Phase root = profiler::collect();
+
+  newassert( root.children.size() == 1 );
+  newassert( root.children[0].children.size() == 1 );
+
+#ifndef NOTHREADS
+  newassert( root.children[0].children[0].nCalls == 50 );
+  newassert( root.children[0].children[0].nThreads == 50 );
+#else
+  newassert( root.children[0].children[0].nCalls == 1 );
+#endif
+
+  profiler::reset();
+
+  newassert( profiler::nThreadProfiles() == 0 );
+
+}
+
+void timer_newtest_perfCounters() {
+
+  profiler::reset();
+  profiler::enable();
+
+  string errorMessage;
+  bool isAvailable = perfcounters::enable(errorMessage);
+
+  newassert( isAvailable == perfcounters::isEnabled );
+  newassert( isAvailable || errorMessage != "" );
+
+  {
+    profiler::ScopedTimer outer("outer");
+    volatile num_t sum = 0.0;
+    for ( size_t i = 0; i < 100000; ++i ) {
+      sum += i;
+    }
+    profiler::ScopedTimer inner("inner");
+  }
+
+  profiler::isEnabled = false;
+  perfcounters::isEnabled = false;
+
+  profiler::Phase root = profiler::collect();
+
+  newassert( root.children.size() == 1 );
+  newassert( root.children[0].nCalls == 1 );
+
+  const perfcounters::Counts& outerCounts = root.children[0].counts;
+  const perfcounters::Counts& innerCounts = root.children[0].children[0].counts;
+
+  // Counts of a phase include those of the phases nested in it
+  if ( isAvailable ) {
+    newassert( outerCounts.values[perfcounters::CYCLES] > 0 );
+    newassert( outerCounts.values[perfcounters::CYCLES] >= innerCounts.values[perfcounters::CYCLES] );
+  } else {
+    for ( size_t i = 0; i < perfcounters::N_EVENTS; ++i ) {
+      newassert( outerCounts.values[i] == 0 );
+    }
+  }
+
+  profiler::reset();
+
+}
+
+#endif
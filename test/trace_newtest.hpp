@@ -0,0 +1,133 @@
+#ifndef TRACE_NEWTEST_HPP
+#define TRACE_NEWTEST_HPP
+
+#include <sstream>
+#include <string>
+
+#ifndef NOTHREADS
+#include <thread>
+#endif
+
+#include "trace.hpp"
+#include "newtest.hpp"
+
+using namespace std;
+
+void trace_newtest_scopedEvent();
+void trace_newtest_ringBuffer();
+void trace_newtest_finishedThreads();
+
+void trace_newtest() {
+
+  newtest( "Traced events are written as trace-event JSON", &trace_newtest_scopedEvent );
+  newtest( "Full trace buffer keeps the newest events", &trace_newtest_ringBuffer );
+  newtest( "New threads reuse the trace buffers of finished threads", &trace_newtest_finishedThreads );
+
+}
+
+void trace_newtest_scopedEvent() {
+
+  trace::reset();
+
+  {
+    trace::ScopedEvent event("disabled");
+  }
+
+  newassert( trace::nEvents() == 0 );
+
+  trace::enable(10,100);
+
+  {
+    trace::ScopedEvent outer("outer", "nSamples", 42);
+    trace::ScopedEvent skipped(NULL);
+  }
+
+  trace::isEnabled = false;
+
+  newassert( trace::nEvents() == 1 );
+  newassert( trace::nDropped() == 0 );
+
+  stringstream ss;
+  trace::writeJSON(ss);
+  string json = ss.str();
+
+  newassert( json.find("\"traceEvents\":[") != string::npos );
+  newassert( json.find("\"name\":\"outer\",\"ph\":\"X\"") != string::npos );
+  newassert( json.find("\"args\":{\"nSamples\":42}") != string::npos );
+  newassert( json.find("disabled") == string::npos );
+
+  trace::reset();
+
+}
+
+void trace_newtest_ringBuffer() {
+
+  trace::reset();
+  trace::enable(0,4);
+
+  const char* names[] = { "e0", "e1", "e2", "e3", "e4", "e5" };
+
+  for ( size_t i = 0; i < 6; ++i ) {
+    trace::ScopedEvent event(names[i]);
+  }
+
+  trace::isEnabled = false;
+
+  newassert( trace::nEvents() == 6 );
+  newassert( trace::nDropped() == 2 );
+
+  stringstream ss;
+  trace::writeJSON(ss);
+  string json = ss.str();
+
+  newassert( json.find("\"e1\"") == string::npos );
+  newassert( json.find("\"e2\"") != string::npos );
+  newassert( json.find("\"e2\"") < json.find("\"e5\"") );
+
+  trace::reset();
+
+}
+
+void trace_newtest_tracedWork() {
+  trace::ScopedEvent event("work");
+}
+
+void trace_newtest_finishedThreads() {
+
+  trace::reset();
+  trace::enable(0,100);
+
+#ifndef NOTHREADS
+  // One thread at a time, as when threads are started anew for every tree
+  for ( size_t threadIdx = 0; threadIdx < 50; ++threadIdx ) {
+    thread worker(trace_newtest_tracedWork);
+    worker.join();
+  }
+
+  // Two threads at once need two buffers
+  thread worker1(trace_newtest_tracedWork);
+  thread worker2(trace_newtest_tracedWork);
+  worker1.join();
+  worker2.join();
+
+  trace::isEnabled = false;
+
+  newassert( trace::nEvents() == 52 );
+  newassert( trace::nDropped() == 0 );
+  newassert( trace::nBuffers() <= 2 );
+#else
+  trace_newtest_tracedWork();
+
+  trace::isEnabled = false;
+
+  newassert( trace::nEvents() == 1 );
+  newassert( trace::nBuffers() == 1 );
+#endif
+
+  trace::reset();
+
+  newassert( trace::nBuffers() == 0 );
+
+}
+
+#endif
@@ -2,11 +2,16 @@
 #define TREEDATA_NEWTEST_HPP
 
 #include <cstdlib>
+#include <set>
+#include <fstream>
+#include <sstream>
 
 #include "newtest.hpp"
 #include "murmurhash3.hpp"
 #include "distributions.hpp"
 #include "densetreedata.hpp"
+#include "sparsetreedata.hpp"
+#include "mappedtreedata.hpp"
 
 using namespace std;
 
@@ -22,6 +27,13 @@ void treedata_newtest_end();
 void treedata_newtest_hashFeature();
 void treedata_newtest_bootstrapRealSamples();
 void treedata_newtest_separateMissingSamples();
+void treedata_newtest_memoryUsage();
+void treedata_newtest_readLibSVM();
+void treedata_newtest_sparseFeatureSplits();
+void treedata_newtest_permuteSparseContrasts();
+void treedata_newtest_mappedData();
+void treedata_newtest_featureReaders();
+void treedata_newtest_quantizeFeatures();
 
 void treedata_newtest() {
 
@@ -37,6 +49,13 @@ void treedata_newtest() {
   newtest( "hashFeature(x)", &treedata_newtest_hashFeature );
   newtest( "bootstrapRealSamples(x)", &treedata_newtest_bootstrapRealSamples );
   newtest( "separateMissingSamples(x)", &treedata_newtest_separateMissingSamples );
+  newtest( "memoryUsage(x)", &treedata_newtest_memoryUsage );
+  newtest( "readLibSVM(x)", &treedata_newtest_readLibSVM );
+  newtest( "sparse numericalFeatureSplit(x) agrees with dense", &treedata_newtest_sparseFeatureSplits );
+  newtest( "permuteContrasts(x) of sparse features", &treedata_newtest_permuteSparseContrasts );
+  newtest( "writeBinary(x) and memory-mapped reading", &treedata_newtest_mappedData );
+  newtest( "visitData(x) readers agree with getNumData(x)", &treedata_newtest_featureReaders );
+  newtest( "quantizeFeatures(x)", &treedata_newtest_quantizeFeatures );
 
 }
 
@@ -274,9 +293,10 @@ void treedata_newtest_numericalFeatureSplitsNumericalTarget() {
   size_t targetIdx = 0; // numerical
   size_t featureIdx = 2; // numerical
 
-  deltaImpurity = treeData.numericalFeatureSplit(targetIdx,
+  deltaImpurity = treeData.numericalFeatureSplit(treeData.feature(targetIdx),
 						 featureIdx,
 						 minSamples,
+						 vector<size_t>(treeData.nSamples(),1),
 						 sampleIcs_left,
 						 sampleIcs_right,
 						 splitValue);
@@ -324,9 +344,10 @@ void treedata_newtest_numericalFeatureSplitsCategoricalTarget() {
 
   size_t minSamples = 1;
 
-  deltaImpurity = treeData.numericalFeatureSplit(targetIdx,
+  deltaImpurity = treeData.numericalFeatureSplit(treeData.feature(targetIdx),
 						  featureIdx,
 						  minSamples,
+						  vector<size_t>(treeData.nSamples(),1),
 						  sampleIcs_left,
 						  sampleIcs_right,
 						  splitValue);
@@ -369,10 +390,11 @@ void treedata_newtest_categoricalFeatureSplitsNumericalTarget() {
   size_t targetIdx = 0;
   size_t minSamples = 1;
   
-  datadefs::num_t deltaImpurity = treeData.categoricalFeatureSplit(targetIdx,
+  datadefs::num_t deltaImpurity = treeData.categoricalFeatureSplit(treeData.feature(targetIdx),
 								   featureIdx,
 								   {"1","2"},
 								   minSamples,
+								   vector<size_t>(treeData.nSamples(),1),
 								   sampleIcs_left,
 								   sampleIcs_right,
 								   splitValues_left);
@@ -433,17 +455,29 @@ void treedata_newtest_bootstrapRealSamples() {
   bool withReplacement = true;
   num_t sampleSize = 1.0;
   size_t featureIdx = 0;
-  vector<size_t> ics,oobIcs;
+  vector<size_t> ics,sampleWeights,oobIcs;
 
   num_t oobFraction = 0.0;
 
   for ( size_t i = 0; i < 1000; ++i ) {
 
-    treeData.bootstrapFromRealSamples(&random,withReplacement,sampleSize,featureIdx,ics,oobIcs);
+    treeData.bootstrapFromRealSamples(&random,withReplacement,sampleSize,featureIdx,ics,sampleWeights,oobIcs);
 
     oobFraction += 1.0 * oobIcs.size();
 
-    newassert( ics.size() == treeData.feature(featureIdx)->nRealSamples() );
+    size_t nDrawn = 0;
+    size_t nOobDrawn = 0;
+    for ( size_t j = 0; j < ics.size(); ++j ) {
+      nDrawn += sampleWeights[ics[j]];
+    }
+    for ( size_t j = 0; j < oobIcs.size(); ++j ) {
+      nOobDrawn += sampleWeights[oobIcs[j]];
+    }
+
+    newassert( sampleWeights.size() == treeData.nSamples() );
+    newassert( nDrawn == treeData.feature(featureIdx)->nRealSamples() );
+    newassert( nOobDrawn == 0 );
+    newassert( ics.size() + oobIcs.size() == treeData.feature(featureIdx)->nRealSamples() );
     newassert( !datadefs::containsNAN(treeData.feature(featureIdx)->getNumData(ics)) );
     newassert( !datadefs::containsNAN(treeData.feature(featureIdx)->getNumData(oobIcs)) );
 
@@ -453,6 +487,16 @@ void treedata_newtest_bootstrapRealSamples() {
 
   newassert( fabs( oobFraction - 0.36 ) < 0.05 );
 
+  // Without replacement every drawn sample has multiplicity one
+  withReplacement = false;
+  sampleSize = 0.5;
+
+  treeData.bootstrapFromRealSamples(&random,withReplacement,sampleSize,featureIdx,ics,sampleWeights,oobIcs);
+
+  newassert( ics.size() == static_cast<size_t>( floor( sampleSize * treeData.feature(featureIdx)->nRealSamples() ) ) );
+  newassert( ics.size() + oobIcs.size() == treeData.feature(featureIdx)->nRealSamples() );
+  newassert( *max_element(sampleWeights.begin(),sampleWeights.end()) == 1 );
+
 }
 
 
@@ -575,4 +619,565 @@ void treedata_newtest_separateMissingSamples() {
 }
 
 
+void treedata_newtest_memoryUsage() {
+
+  string fileName = "test/data/3by8_mixed_NA_matrix.afm";
+
+  DenseTreeData treeData(fileName,'\t',':',false);
+  DenseTreeData treeDataC(fileName,'\t',':',true);
+
+  memreport::Breakdown breakdown,breakdownC;
+  treeData.memoryUsage(breakdown);
+  treeDataC.memoryUsage(breakdownC);
+
+  size_t numBytes = 0;
+  size_t contrastBytes = 0;
+  for ( size_t i = 0; i < breakdownC.size(); ++i ) {
+    if ( breakdownC[i].first == "numerical features" ) {
+      numBytes = breakdownC[i].second;
+    } else if ( breakdownC[i].first == "contrast features" ) {
+      contrastBytes = breakdownC[i].second;
+    }
+  }
+
+  // Every numerical feature holds at least its object and one value per sample
+  size_t nNumerical = 0;
+  for ( size_t featureIdx = 0; featureIdx < treeData.nFeatures(); ++featureIdx ) {
+    nNumerical += treeData.feature(featureIdx)->isNumerical() ? 1 : 0;
+  }
+
+  newassert( nNumerical > 0 );
+  newassert( numBytes >= nNumerical * ( sizeof(Feature) + treeData.nSamples() * sizeof(num_t) ) );
+
+  // Contrasts are copies of the features, with longer names
+  size_t featureBytes = memreport::total(breakdown) - breakdown.back().second;
+  newassert( breakdown.back().first == "sample names and indices" );
+  newassert( contrastBytes >= featureBytes );
+
+  // Items are merged by name
+  size_t nItems = breakdown.size();
+  size_t totalBytes = memreport::total(breakdown);
+  memreport::add(breakdown, "numerical features", 10);
+  newassert( breakdown.size() == nItems );
+  newassert( memreport::total(breakdown) == totalBytes + 10 );
+
+#ifdef __linux__
+  newassert( memreport::currentRSS() > 0 );
+  newassert( memreport::peakRSS() >= memreport::currentRSS() );
+#endif
+
+  // A checkpoint restarts the peak from the current size where the kernel allows it, and
+  // otherwise the report shows the current size only
+  ofstream clearRefs("/proc/self/clear_refs");
+  bool isResettable = clearRefs.good();
+  clearRefs.close();
+
+  {
+    vector<char> buffer(64 * 1048576, 1);
+    newassert( buffer.back() == 1 );
+  }
+
+  size_t peakBefore = memreport::peakRSS();
+
+  memreport::enable();
+  memreport::checkpoint("buffer");
+  memreport::isEnabled = false;
+
+  stringstream ss;
+  memreport::printCheckpoints(ss);
+
+  if ( isResettable ) {
+    newassert( memreport::peakRSS() + 32 * 1048576 < peakBefore );
+    newassert( ss.str().find("peak during the phase") != string::npos );
+  } else {
+    newassert( ss.str().find("current RSS") != string::npos );
+  }
+
+  memreport::reset();
+
+}
+
+void treedata_newtest_readLibSVM() {
+
+  SparseTreeData treeData("test/data/4by4_sparse_matrix.libsvm",':',true);
+  SparseTreeData treeDataC("test/data/4by4_sparse_matrix.libsvm",':',false,true);
+
+  newassert( treeData.nSamples() == 4 );
+  newassert( treeData.nFeatures() == 5 );
+  newassert( treeDataC.nFeatures() == 5 );
+  newassert( treeDataC.features_.size() == 10 );
+
+  // Samples are named by line, skipping the empty line
+  newassert( treeData.getSampleName(0) == "1" );
+  newassert( treeData.getSampleName(1) == "2" );
+  newassert( treeData.getSampleName(2) == "4" );
+  newassert( treeData.getSampleName(3) == "5" );
+
+  newassert( treeData.getFeatureIdx("N:label") == 0 );
+  newassert( treeData.getFeatureIdx("C:label") == treeData.end() );
+  newassert( treeDataC.getFeatureIdx("C:label") == 0 );
+  newassert( treeDataC.getFeatureIdx("N:4_CONTRAST") == 9 );
+
+  const Feature* label = treeData.feature(0);
+  newassert( !label->isSparse() );
+  newassert( fabs( label->getNumData(1) + 0.5 ) < 1e-5 );
+  newassert( treeDataC.feature(0)->getCatData(3) == "0.25" );
+
+  for ( size_t featureIdx = 1; featureIdx < 5; ++featureIdx ) {
+    newassert( treeData.feature(featureIdx)->isSparse() );
+    newassert( treeData.feature(featureIdx)->nSamples() == 4 );
+  }
+
+  const Feature* f1 = treeData.feature( treeData.getFeatureIdx("N:1") );
+  newassert( f1->sparseIcs.size() == 1 );
+  newassert( fabs( f1->getNumData(0) - 2.0 ) < 1e-5 );
+  newassert( f1->getNumData(1) == 0.0 );
+  newassert( f1->isMissing(2) );
+  newassert( datadefs::isNAN( f1->getNumData(2) ) );
+  newassert( f1->nRealSamples() == 3 );
+
+  // Explicit zeros are not stored
+  const Feature* f3 = treeData.feature( treeData.getFeatureIdx("N:3") );
+  newassert( f3->sparseIcs.size() == 1 );
+  newassert( fabs( f3->getNumData(0) + 1.0 ) < 1e-5 );
+  newassert( f3->getNumData(2) == 0.0 );
+  newassert( !f3->isMissing(2) );
+
+  vector<num_t> f4 = treeData.feature( treeData.getFeatureIdx("N:4") )->getNumData();
+  newassert( f4.size() == 4 );
+  newassert( f4[0] == 0.0 && f4[1] == 0.0 );
+  newassert( fabs( f4[2] - 7.0 ) < 1e-5 && fabs( f4[3] - 1.0 ) < 1e-5 );
+
+  vector<size_t> sampleIcs = utils::range(4);
+  vector<size_t> missingIcs;
+  treeData.separateMissingSamples( treeData.getFeatureIdx("N:1"), sampleIcs, missingIcs );
+  newassert( sampleIcs.size() == 3 );
+  newassert( missingIcs.size() == 1 && missingIcs[0] == 2 );
+
+  newassert( SparseTreeData::isSparseFile("data.libsvm") );
+  newassert( SparseTreeData::isSparseFile("data.svm") );
+  newassert( !SparseTreeData::isSparseFile("data.afm") );
+  newassert( !SparseTreeData::isSparseFile("libsvm") );
+
+}
+
+// Splits of the sparse storage must match those of the same data stored dense
+void treedata_newtest_sparseFeatureSplits() {
+
+  distributions::Random random(1234);
+
+  size_t nSamples = 200;
+  size_t nFeatures = 6;
+
+  vector<vector<num_t> > data(nFeatures,vector<num_t>(nSamples,0.0));
+  vector<num_t> numTarget(nSamples,0.0);
+  vector<cat_t> catTarget(nSamples);
+
+  for ( size_t i = 0; i < nSamples; ++i ) {
+    for ( size_t f = 0; f < nFeatures; ++f ) {
+      num_t u = random.uniform();
+      if ( f >= 3 && u < 0.05 ) {
+	data[f][i] = datadefs::NUM_NAN;
+      } else if ( u < 0.35 ) {
+	data[f][i] = 2 * random.uniform() - 1;
+      }
+    }
+    numTarget[i] = data[0][i] - 2 * ( data[1][i] > 0.2 ) + 0.1 * random.uniform();
+    catTarget[i] = data[0][i] > 0 ? "a" : ( data[1][i] < 0 ? "b" : "c" );
+  }
+
+  for ( size_t t = 0; t < 2; ++t ) {
+
+    vector<Feature> denseFeatures;
+    vector<Feature> sparseFeatures;
+
+    if ( t == 0 ) {
+      denseFeatures.push_back( Feature(numTarget,"N:target") );
+    } else {
+      denseFeatures.push_back( Feature(catTarget,"C:target") );
+    }
+    sparseFeatures.push_back( denseFeatures[0] );
+
+    for ( size_t f = 0; f < nFeatures; ++f ) {
+      vector<uint32_t> ics;
+      vector<num_t> values;
+      for ( size_t i = 0; i < nSamples; ++i ) {
+	if ( data[f][i] != 0.0 ) {
+	  ics.push_back(i);
+	  values.push_back(data[f][i]);
+	}
+      }
+      denseFeatures.push_back( Feature(data[f],"N:x" + utils::num2str(f)) );
+      sparseFeatures.push_back( Feature(ics,values,nSamples,"N:x" + utils::num2str(f)) );
+    }
+
+    vector<string> sampleHeaders(nSamples,"s");
+    DenseTreeData denseData(denseFeatures,false,sampleHeaders);
+    SparseTreeData sparseData(sparseFeatures,false,sampleHeaders);
+
+    vector<size_t> ics,sampleWeights,oobIcs;
+    denseData.bootstrapFromRealSamples(&random,true,1.0,0,ics,sampleWeights,oobIcs);
+
+    // A large node is scanned, a small one looked up sample by sample
+    vector<size_t> smallIcs(ics.begin(),ics.begin() + 6);
+
+    for ( size_t n = 0; n < 2; ++n ) {
+
+      const vector<size_t>& nodeIcs = n == 0 ? ics : smallIcs;
+      size_t minSamples = n == 0 ? 5 : 1;
+
+      for ( size_t featureIdx = 1; featureIdx <= nFeatures; ++featureIdx ) {
+
+	vector<size_t> denseLeft,denseRight(nodeIcs),denseMissing;
+	vector<size_t> sparseLeft,sparseRight(nodeIcs),sparseMissing;
+	num_t denseSplitValue = 0.0;
+	num_t sparseSplitValue = 0.0;
+
+	denseData.separateMissingSamples(featureIdx,denseRight,denseMissing);
+	sparseData.separateMissingSamples(featureIdx,sparseRight,sparseMissing);
+
+	newassert( denseMissing == sparseMissing );
+
+	num_t denseDI = denseData.numericalFeatureSplit(denseData.feature(0),featureIdx,minSamples,sampleWeights,denseLeft,denseRight,denseSplitValue);
+	num_t sparseDI = sparseData.numericalFeatureSplit(sparseData.feature(0),featureIdx,minSamples,sampleWeights,sparseLeft,sparseRight,sparseSplitValue);
+
+	newassert( fabs( denseDI - sparseDI ) <= 1e-4 * ( 1 + fabs(denseDI) ) );
+
+	if ( denseDI > 0.0 ) {
+	  newassert( denseSplitValue == sparseSplitValue );
+	  newassert( set<size_t>(denseLeft.begin(),denseLeft.end()) == set<size_t>(sparseLeft.begin(),sparseLeft.end()) );
+	  newassert( set<size_t>(denseRight.begin(),denseRight.end()) == set<size_t>(sparseRight.begin(),sparseRight.end()) );
+	}
+
+      }
+
+    }
+
+  }
+
+}
+
+void treedata_newtest_permuteSparseContrasts() {
+
+  distributions::Random random(42);
+
+  size_t nSamples = 50;
+
+  vector<uint32_t> ics;
+  vector<num_t> values;
+  for ( size_t i = 0; i < nSamples; i += 3 ) {
+    ics.push_back(i);
+    values.push_back( i % 2 == 0 ? 1.0 + i : datadefs::NUM_NAN );
+  }
+
+  vector<Feature> features;
+  features.push_back( Feature(vector<num_t>(nSamples,1.0),"N:target") );
+  features.push_back( Feature(ics,values,nSamples,"N:x") );
+
+  SparseTreeData treeData(features,true,vector<string>(nSamples,"s"));
+
+  const Feature* feature = treeData.feature(1);
+  const Feature* contrast = treeData.feature(3);
+
+  newassert( contrast->isSparse() );
+
+  multiset<num_t> originalValues(feature->numData.begin(),feature->numData.end());
+
+  for ( size_t iter = 0; iter < 20; ++iter ) {
+
+    treeData.permuteContrasts(&random);
+
+    // The same values on distinct real samples, and the missing samples stay in place
+    newassert( contrast->sparseIcs.size() == feature->sparseIcs.size() );
+    newassert( multiset<num_t>(contrast->numData.begin(),contrast->numData.end()) == originalValues );
+    newassert( contrast->sparseMissingIcs == feature->sparseMissingIcs );
+
+    for ( size_t i = 0; i < contrast->sparseIcs.size(); ++i ) {
+      newassert( contrast->sparseIcs[i] < nSamples );
+      newassert( !contrast->isMissing(contrast->sparseIcs[i]) );
+      if ( i > 0 ) {
+	newassert( contrast->sparseIcs[i-1] < contrast->sparseIcs[i] );
+      }
+    }
+
+  }
+
+}
+
+void treedata_newtest_mappedData() {
+
+  DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':');
+
+  MappedTreeData::writeBinary(&treeData,"foo.rfb");
+
+  {
+    MappedTreeData mappedData("foo.rfb",true);
+
+    newassert( mappedData.nFeatures() == treeData.nFeatures() );
+    newassert( mappedData.nSamples() == treeData.nSamples() );
+    newassert( mappedData.mappedBytes() >= treeData.nFeatures() * treeData.nSamples() * sizeof(num_t) );
+
+    size_t nMapped = 0;
+
+    for ( size_t featureIdx = 0; featureIdx < treeData.nFeatures(); ++featureIdx ) {
+
+      const Feature* feature = treeData.feature(featureIdx);
+      const Feature* mapped = mappedData.feature(featureIdx);
+
+      newassert( mapped->name() == feature->name() );
+      newassert( mappedData.getFeatureIdx(feature->name()) == featureIdx );
+      newassert( mapped->isNumerical() == feature->isNumerical() );
+      newassert( mapped->nRealSamples() == feature->nRealSamples() );
+
+      if ( feature->isNumerical() ) {
+	newassert( mapped->isMapped() );
+	++nMapped;
+	vector<num_t> data = feature->getNumData();
+	vector<num_t> mappedValues = mapped->getNumData();
+	bool isEqual = true;
+	for ( size_t i = 0; i < data.size(); ++i ) {
+	  isEqual = isEqual && ( data[i] == mappedValues[i] || ( datadefs::isNAN(data[i]) && datadefs::isNAN(mappedValues[i]) ) );
+	}
+	newassert( isEqual );
+      } else {
+	newassert( mapped->getCatData() == feature->getCatData() );
+      }
+    }
+
+    newassert( nMapped > 0 );
+
+    for ( size_t i = 0; i < treeData.nSamples(); ++i ) {
+      newassert( mappedData.getSampleName(i) == treeData.getSampleName(i) );
+    }
+
+    // Splits read the mapped columns as they would the dense ones
+    mappedData.prefetchFeatures( utils::range(mappedData.nFeatures()) );
+
+    vector<size_t> left,right = utils::range(treeData.nSamples()),missing;
+    vector<size_t> mappedLeft,mappedRight = right,mappedMissing;
+    num_t splitValue,mappedSplitValue;
+    vector<size_t> sampleWeights(treeData.nSamples(),1);
+
+    treeData.separateMissingSamples(2,right,missing);
+    mappedData.separateMissingSamples(2,mappedRight,mappedMissing);
+
+    num_t DI = treeData.numericalFeatureSplit(treeData.feature(0),2,1,sampleWeights,left,right,splitValue);
+    num_t mappedDI = mappedData.numericalFeatureSplit(mappedData.feature(0),2,1,sampleWeights,mappedLeft,mappedRight,mappedSplitValue);
+
+    newassert( DI == mappedDI );
+    newassert( splitValue == mappedSplitValue );
+    newassert( left == mappedLeft );
+
+    // Mapped contrasts are the values of their feature in a shared random order
+    distributions::Random random(7);
+    mappedData.permuteContrasts(&random);
+
+    size_t contrastIdx = mappedData.getFeatureIdx( treeData.feature(2)->name() + "_CONTRAST" );
+    newassert( mappedData.feature(contrastIdx)->isMapped() );
+
+    vector<num_t> values = mappedData.feature(2)->getNumData();
+    vector<num_t> contrastValues = mappedData.feature(contrastIdx)->getNumData();
+
+    bool isPermutation = true;
+    for ( size_t i = 0; i < values.size(); ++i ) {
+      num_t x = values[ mappedData.contrastOrder_[i] ];
+      isPermutation = isPermutation && ( contrastValues[i] == x || ( datadefs::isNAN(x) && datadefs::isNAN(contrastValues[i]) ) );
+    }
+    newassert( isPermutation );
+    newassert( contrastValues != values );
+  }
+
+  remove("foo.rfb");
+
+}
+
+// Reads all samples of a feature through the reader it is visited with
+struct ReaderCopy {
+
+  size_t nSamples;
+  vector<num_t> values;
+  vector<bool> isMissing;
+
+  explicit ReaderCopy(const size_t n): nSamples(n) {}
+
+  template<typename Reader> void operator()(const Reader& reader) {
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      values.push_back(reader[i]);
+      isMissing.push_back(reader.isMissing(i));
+    }
+  }
+
+  void operator()(const Feature::CatReader& reader) {
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      values.push_back(reader[i].size());
+      isMissing.push_back(reader.isMissing(i));
+    }
+  }
+
+  void operator()(const Feature::TxtReader& reader) {
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      values.push_back(reader[i].size());
+      isMissing.push_back(reader.isMissing(i));
+    }
+  }
+
+};
+
+void treedata_newtest_featureReaders() {
+
+  size_t nSamples = 6;
+  num_t NaN = datadefs::NUM_NAN;
+
+  num_t x[] = { 1.5, 0.0, NaN, -2.0, 0.0, 3.0 };
+  vector<num_t> dense(x,x+nSamples);
+
+  uint32_t ics[] = { 5, 0, 2, 3 };
+  num_t values[] = { 3.0, 1.5, NaN, -2.0 };
+
+  uint32_t order[] = { 5, 4, 3, 2, 1, 0 };
+
+  Feature denseFeature(dense,"N:dense");
+  Feature sparseFeature(vector<uint32_t>(ics,ics+4),vector<num_t>(values,values+4),nSamples,"N:sparse");
+  Feature mappedFeature(&dense[0],nSamples,"N:mapped");
+  Feature permutedFeature(&dense[0],nSamples,"N:permuted");
+  permutedFeature.setMappedOrder(order);
+  Feature quantizedFeature(dense,"N:quantized");
+  quantizedFeature.quantize();
+
+  const Feature* features[] = { &denseFeature, &sparseFeature, &mappedFeature, &permutedFeature, &quantizedFeature };
+
+  for ( size_t f = 0; f < 5; ++f ) {
+    ReaderCopy copy(nSamples);
+    features[f]->visitData(copy);
+    bool isEqual = true;
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      num_t value = features[f]->getNumData(i);
+      isEqual = isEqual && copy.isMissing[i] == features[f]->isMissing(i) && copy.isMissing[i] == datadefs::isNAN(value);
+      isEqual = isEqual && ( copy.isMissing[i] || copy.values[i] == value );
+    }
+    newassert( isEqual );
+  }
+
+  newassert( permutedFeature.getNumData(0) == 3.0 );
+
+  cat_t c[] = { "a", "NA", "bb", "" };
+  Feature catFeature(vector<cat_t>(c,c+4),"C:cat");
+  ReaderCopy catCopy(4);
+  catFeature.visitData(catCopy);
+
+  newassert( catCopy.values[2] == 2 );
+  newassert( catCopy.isMissing[0] == false );
+  newassert( catCopy.isMissing[1] == catFeature.isMissing(1) );
+  newassert( catCopy.isMissing[3] == catFeature.isMissing(3) );
+
+}
+
+void treedata_newtest_quantizeFeatures() {
+
+  num_t NaN = datadefs::NUM_NAN;
+
+  num_t x[] = { 0.25, -1.0, NaN, 7.5, 3.0, 3.0 };
+  vector<num_t> data(x,x+6);
+
+  Feature feature(data,"N:x");
+  size_t denseBytes = feature.memoryBytes();
+
+  feature.quantize();
+
+  newassert( feature.isQuantized() );
+  newassert( feature.nSamples() == 6 );
+  newassert( feature.numData.size() == 0 );
+  newassert( feature.memoryBytes() < denseBytes );
+
+  // The extremes are kept exactly, and the rest within half a grid step
+  num_t step = 8.5 / 65534;
+  newassert( feature.getNumData(1) == -1.0 );
+  newassert( fabs( feature.getNumData(3) - 7.5 ) < 1e-5 );
+  newassert( fabs( feature.getNumData(0) - 0.25 ) <= step );
+  newassert( feature.getNumData(4) == feature.getNumData(5) );
+  newassert( feature.isMissing(2) );
+  newassert( datadefs::isNAN(feature.getNumData(2)) );
+  newassert( feature.nRealSamples() == 5 );
+
+  // Values set later are clamped to the range of the grid
+  feature.setNumSampleValue(2,100.0);
+  newassert( !feature.isMissing(2) );
+  newassert( fabs( feature.getNumData(2) - 7.5 ) < 1e-5 );
+  feature.setNumSampleValue(2,NaN);
+  newassert( feature.isMissing(2) );
+
+  Feature constant(vector<num_t>(4,2.0),"N:constant");
+  constant.quantize();
+  newassert( constant.getNumData(3) == 2.0 );
+
+  // Infinite values do not stretch the grid, and are stored at its ends
+  num_t inf = datadefs::NUM_INF;
+  num_t y[] = { inf, 0.0, 1.0, -inf };
+  Feature infinite(vector<num_t>(y,y+4),"N:infinite");
+  infinite.quantize();
+  newassert( infinite.getNumData(1) == 0.0 );
+  newassert( fabs( infinite.getNumData(2) - 1.0 ) < 1e-5 );
+  newassert( fabs( infinite.getNumData(0) - 1.0 ) < 1e-5 );
+  newassert( infinite.getNumData(3) == 0.0 );
+
+  // A split at a grid value lies at the upper edge of its cell
+  newassert( feature.splitEdge( feature.getNumData(0) ) > feature.getNumData(0) );
+  newassert( fabs( feature.splitEdge( feature.getNumData(0) ) - feature.getNumData(0) - step / 2 ) < 1e-6 );
+  newassert( constant.splitEdge(2.0) == 2.0 );
+
+  // The target stays at full precision, and splits of the quantized features stay where they were
+  DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':',true);
+  DenseTreeData quantData("test_103by300_mixed_matrix.afm",'\t',':',true);
+
+  size_t targetIdx = 0;
+  quantData.quantizeFeatures(targetIdx);
+
+  newassert( !quantData.feature(targetIdx)->isQuantized() );
+  newassert( quantData.feature(2)->isQuantized() );
+  newassert( quantData.feature(2 + quantData.nFeatures())->isQuantized() );
+
+  vector<size_t> sampleIcs_left, quantIcs_left;
+  vector<size_t> sampleIcs_right = utils::range(300);
+  vector<size_t> quantIcs_right = utils::range(300);
+  num_t splitValue, quantSplitValue;
+
+  num_t DI = treeData.numericalFeatureSplit(treeData.feature(targetIdx),2,1,vector<size_t>(300,1),
+					     sampleIcs_left,sampleIcs_right,splitValue);
+  num_t quantDI = quantData.numericalFeatureSplit(quantData.feature(targetIdx),2,1,vector<size_t>(300,1),
+						  quantIcs_left,quantIcs_right,quantSplitValue);
+
+  newassert( fabs( DI - quantDI ) < 1e-5 );
+  newassert( fabs( splitValue - quantSplitValue ) < 1e-3 );
+  newassert( sampleIcs_left.size() == quantIcs_left.size() );
+
+  // The original values, as test data would have them, are split the way their codes were
+  set<size_t> quantLeft(quantIcs_left.begin(),quantIcs_left.end());
+  bool isSameSide = true;
+  for ( size_t i = 0; i < 300; ++i ) {
+    num_t value = treeData.feature(2)->getNumData(i);
+    if ( !datadefs::isNAN(value) && !quantData.feature(2)->isMissing(i) ) {
+      isSameSide = isSameSide && ( value <= quantSplitValue ) == ( quantLeft.find(i) != quantLeft.end() );
+    }
+  }
+  newassert( isSameSide );
+
+  // With a grid step of 1, the value 1.4 is stored as 1, and must still go left at a split between 1 and 2
+  num_t z[] = { 0.0, 1.4, 2.4, 65534.0 };
+  num_t t[] = { 0.0, 0.0, 1.0, 1.0 };
+  vector<Feature> gridFeatures;
+  gridFeatures.push_back( Feature(vector<num_t>(t,t+4),"N:t") );
+  gridFeatures.push_back( Feature(vector<num_t>(z,z+4),"N:z") );
+  DenseTreeData gridData(gridFeatures);
+  gridData.quantizeFeatures(0);
+
+  vector<size_t> gridIcs_left;
+  vector<size_t> gridIcs_right = utils::range(4);
+  num_t gridSplitValue;
+  gridData.numericalFeatureSplit(gridData.feature(0),1,1,vector<size_t>(4,1),gridIcs_left,gridIcs_right,gridSplitValue);
+
+  newassert( gridIcs_left.size() == 2 );
+  newassert( 1.4 <= gridSplitValue && gridSplitValue < 2.4 );
+
+}
+
 #endif
@@ -16,6 +16,7 @@ using namespace std;
 using datadefs::num_t;
 
 
+void utils_newtest_numericalFeatureSplitsNumericalTargetOffset();
 void utils_newtest_categoricalFeatureSplitsNumericalTarget();
 void utils_newtest_categoricalFeatureSplitsCategoricalTarget();
 void utils_newtest_parse();
@@ -34,6 +35,7 @@ void utils_newtest_text2tokens();
 
 void utils_newtest() {
 
+  newtest( "numericalFeatureSplitsNumericalTarget(x) with a large offset", &utils_newtest_numericalFeatureSplitsNumericalTargetOffset);
   newtest( "categoricalFeatureSplitsNumericalTarget(x)", &utils_newtest_categoricalFeatureSplitsNumericalTarget);
   newtest( "categoricalFeatureSplitsCategoricalTarget(x)", &utils_newtest_categoricalFeatureSplitsCategoricalTarget);
   newtest( "parse(x)", &utils_newtest_parse );
@@ -52,6 +54,23 @@ void utils_newtest() {
 
 }
 
+void utils_newtest_numericalFeatureSplitsNumericalTargetOffset() {
+
+  // The squared means are around 1e8, where a float has a spacing of 8, but the impurity decrease is 0.25
+  vector<num_t> tv = {10000,10000,10000,10001,10001,10001};
+  vector<num_t> fv = {1,2,3,4,5,6};
+
+  size_t splitIdx;
+
+  num_t DI = utils::numericalFeatureSplitsNumericalTarget(tv,fv,1,splitIdx);
+
+  newassert( splitIdx == 2 );
+  newassert( fabs( DI - 0.25 ) < 1e-5 );
+
+  newassert( fabs( math::accMean(tv,vector<size_t>(6,1)) - 10000.5 ) < 1e-9 );
+
+}
+
 void utils_newtest_categoricalFeatureSplitsNumericalTarget() {
 
   vector<cat_t> fv = {"1","1","1","2","2","2","3","3","3","4","4","4"};
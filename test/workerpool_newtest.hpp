@@ -0,0 +1,82 @@
+#ifndef WORKERPOOL_NEWTEST_HPP
+#define WORKERPOOL_NEWTEST_HPP
+
+#include <vector>
+#include <functional>
+
+#ifndef NOTHREADS
+#include <thread>
+#endif
+
+#include "workerpool.hpp"
+#include "newtest.hpp"
+
+using namespace std;
+
+void workerpool_newtest_batches();
+
+void workerpool_newtest() {
+
+  newtest( "WorkerPool runs many batches on the same workers", &workerpool_newtest_batches );
+
+}
+
+void workerpool_newtest_square(const size_t x, size_t* result) {
+  *result = x * x;
+}
+
+#ifndef NOTHREADS
+void workerpool_newtest_threadId(thread::id* id) {
+  *id = this_thread::get_id();
+}
+#endif
+
+void workerpool_newtest_batches() {
+
+  WorkerPool pool(3);
+
+  newassert( pool.nWorkers() == 3 );
+
+  // Every batch finishes before run() returns, including batches smaller than the pool
+  for ( size_t batchIdx = 0; batchIdx < 200; ++batchIdx ) {
+
+    size_t nTasks = 1 + batchIdx % 3;
+    vector<size_t> results(nTasks,0);
+    vector<function<void()> > tasks;
+
+    for ( size_t i = 0; i < nTasks; ++i ) {
+      tasks.push_back( bind(workerpool_newtest_square, batchIdx + i, &results[i]) );
+    }
+
+    pool.run(tasks);
+
+    for ( size_t i = 0; i < nTasks; ++i ) {
+      newassert( results[i] == ( batchIdx + i ) * ( batchIdx + i ) );
+    }
+
+  }
+
+#ifndef NOTHREADS
+  // Task i always runs on the same worker thread
+  vector<thread::id> firstIds(3),ids(3);
+  vector<function<void()> > tasks;
+  for ( size_t i = 0; i < 3; ++i ) {
+    tasks.push_back( bind(workerpool_newtest_threadId, &firstIds[i]) );
+  }
+  pool.run(tasks);
+
+  tasks.clear();
+  for ( size_t i = 0; i < 3; ++i ) {
+    tasks.push_back( bind(workerpool_newtest_threadId, &ids[i]) );
+  }
+  pool.run(tasks);
+
+  for ( size_t i = 0; i < 3; ++i ) {
+    newassert( ids[i] == firstIds[i] );
+    newassert( ids[i] != this_thread::get_id() );
+  }
+#endif
+
+}
+
+#endif